@@ -181,6 +181,38 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_SET
     },
 
+
+
+
+
+    /* Operating mode options. */
+    {
+      "streamrows",
+      UI_KEY_STREAMROWS,
+      "INT",
+      0,
+      "Rows to read/write at once (0: read all).",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->streamrows,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "stackmemory",
+      UI_KEY_STACKMEMORY,
+      "INT",
+      0,
+      "Memory (MB) for input rows of stacks (0: all).",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->stackmemory,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+
     {0}
   };
 
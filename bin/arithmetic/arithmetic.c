@@ -44,6 +44,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include "main.h"
 
+#include "fused.h"
 #include "operands.h"
 #include "arithmetic.h"
 
@@ -639,8 +640,10 @@ arithmetic_erode_dilate(struct arithmeticparams *p, char *token, int op)
   /* Do the operation. */
   switch(op)
     {
-    case ARITHMETIC_OP_ERODE:  gal_binary_erode(in,  1, conn_int, 1); break;
-    case ARITHMETIC_OP_DILATE: gal_binary_dilate(in, 1, conn_int, 1); break;
+    case ARITHMETIC_OP_ERODE:
+      gal_binary_erode(in,  1, conn_int, 1, p->cp.numthreads); break;
+    case ARITHMETIC_OP_DILATE:
+      gal_binary_dilate(in, 1, conn_int, 1, p->cp.numthreads); break;
     default:
       error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
             "problem. The operator code %d not recognized", __func__,
@@ -690,7 +693,7 @@ arithmetic_connected_components(struct arithmeticparams *p, char *token)
   conn_int=arithmetic_binary_sanity_checks(in, conn, token);
 
   /* Do the connected components labeling. */
-  gal_binary_connected_components(in, &out, conn_int);
+  gal_binary_connected_components(in, &out, conn_int, p->cp.numthreads);
 
   /* Push the result onto the stack. */
   operands_add(p, NULL, out);
@@ -845,7 +848,8 @@ arithmetic_interpolate_region(struct arithmeticparams *p,
   /* Build a binary image with the blank regions masked and label them,
      then free the flagged array. */
   flag=gal_blank_flag(in);
-  numlabs=gal_binary_connected_components(flag, &lab, con[0]);
+  numlabs=gal_binary_connected_components(flag, &lab, con[0],
+                                          p->cp.numthreads);
   gal_data_free(flag);
 
   /* Allocate array to keep maximum values for each region. Just note that
@@ -1445,6 +1449,214 @@ arithmetic_repeat(struct arithmeticparams *p, char *token, int operator)
 
 
 
+/***************************************************************/
+/*************     Stacking in blocks of rows      *************/
+/***************************************************************/
+/* Multi-operand operators where each output pixel only depends on the
+   same pixel in all the operands (so any block of rows can be stacked
+   independently). The "filled" clipping operators also use the
+   neighbors of each pixel, so they need the full images. */
+static int
+arithmetic_stack_by_rows(int operator)
+{
+  switch(operator)
+    {
+    case GAL_ARITHMETIC_OP_MIN:
+    case GAL_ARITHMETIC_OP_MAX:
+    case GAL_ARITHMETIC_OP_SUM:
+    case GAL_ARITHMETIC_OP_STD:
+    case GAL_ARITHMETIC_OP_MAD:
+    case GAL_ARITHMETIC_OP_MEAN:
+    case GAL_ARITHMETIC_OP_NUMBER:
+    case GAL_ARITHMETIC_OP_MEDIAN:
+    case GAL_ARITHMETIC_OP_QUANTILE:
+    case GAL_ARITHMETIC_OP_MADCLIP_STD:
+    case GAL_ARITHMETIC_OP_SIGCLIP_STD:
+    case GAL_ARITHMETIC_OP_MADCLIP_MAD:
+    case GAL_ARITHMETIC_OP_SIGCLIP_MAD:
+    case GAL_ARITHMETIC_OP_MADCLIP_MEAN:
+    case GAL_ARITHMETIC_OP_SIGCLIP_MEAN:
+    case GAL_ARITHMETIC_OP_MADCLIP_MEDIAN:
+    case GAL_ARITHMETIC_OP_SIGCLIP_MEDIAN:
+    case GAL_ARITHMETIC_OP_MADCLIP_NUMBER:
+    case GAL_ARITHMETIC_OP_SIGCLIP_NUMBER:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+
+
+
+
+/* Each operand of a stack that is done in blocks of rows. */
+struct arithmetic_stack_operand
+{
+  gal_data_t         *data;  /* Full dataset ('array==NULL' if in file). */
+  gal_data_t         *rows;  /* Rows of the current block.               */
+  char           *filename;  /* Name of file (if not read into memory).  */
+  char                *hdu;  /* HDU in file (if not read into memory).   */
+  fitsfile           *fptr;  /* Opened file (if not read into memory).   */
+};
+
+
+
+
+
+/* Stack the 'numop' operands on the top of the stack with the
+   multi-operand 'operator' in blocks of rows: the images in files are
+   never completely read into memory, only the rows of the current block
+   (of all the inputs) are read, such that they fit within the memory that
+   is given to '--stackmemory'. Since each output pixel only depends on
+   the same pixel in the inputs, the output is identical to stacking the
+   full images in one step. */
+static void
+arithmetic_stack_rows(struct arithmeticparams *p, int operator,
+                      char *operator_string, size_t numop,
+                      gal_data_t *params, int flags)
+{
+  int status=0;
+  struct arithmetic_stack_operand *in;
+  gal_data_t *list, *tmp, *out=NULL, *ref;
+  size_t i, d, num, ndim, first, nrows, rowsize, blockrows, rowbytes=0;
+
+  /* The library shouldn't free the rows or use them for the output: the
+     rows of the operands that are in memory belong to the full array. */
+  flags &= ~(GAL_ARITHMETIC_FLAG_FREE | GAL_ARITHMETIC_FLAG_INPLACE);
+
+  /* Allocate space for the operands. */
+  errno=0;
+  in=calloc(numop, sizeof *in);
+  if(in==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'in'",
+          __func__, numop*sizeof *in);
+
+  /* Pop the operands: images in files are only opened here (their pixels
+     are read in blocks of rows below), others are used from memory. */
+  for(i=0;i<numop;++i)
+    {
+      in[i].data=operands_pop_lazy(p, &in[i].filename, &in[i].hdu);
+      if(in[i].data)
+        {
+          in[i].fptr=gal_fits_hdu_open_format(in[i].filename, in[i].hdu,
+                                              0, "--hdu");
+          rowbytes += in[i].data->size * gal_type_sizeof(in[i].data->type);
+          if(!p->cp.quiet)
+            printf(" - Read: %s (hdu %s, in blocks of rows).\n",
+                   in[i].filename, in[i].hdu);
+        }
+      else
+        in[i].data=operands_pop(p, operator_string);
+
+      /* The blocks of rows are only comparable when all the operands
+         have the same size. */
+      if( gal_dimension_is_different(in[0].data, in[i].data) )
+        error(EXIT_FAILURE, 0, "the sizes of all operands to the '%s' "
+              "operator must be same", operator_string);
+    }
+
+  /* Find the number of rows in each block (at least one). Note that in
+     the default mode, each popped operand is added to the top of the
+     list, so the last popped operand is the reference of the output. */
+  ref=in[numop-1].data;
+  ndim=ref->ndim;
+  nrows=ref->dsize[0];
+  rowsize=ref->size/nrows;
+  rowbytes/=nrows;
+  blockrows = rowbytes ? p->stackmemory*1000000/rowbytes : nrows;
+  if(blockrows==0)    blockrows=1;
+  if(blockrows>nrows) blockrows=nrows;
+
+  /* Stack each block of rows. */
+  for(first=0; first<nrows; first+=num)
+    {
+      /* Number of rows in this block. */
+      num = first+blockrows > nrows ? nrows-first : blockrows;
+
+      /* Prepare the rows of all operands (in the same order as the
+         default mode). */
+      list=NULL;
+      for(i=0;i<numop;++i)
+        {
+          /* Read the rows from the file. The image in the file may have
+             extra (length-one) dimensions, so its dimensions are set
+             from the full dataset (they are contiguous in memory). */
+          if(in[i].fptr)
+            {
+              in[i].rows=gal_fits_img_read_rows(in[i].fptr, first, num,
+                                                p->cp.minmapsize,
+                                                p->cp.quietmmap);
+              in[i].rows->ndim=ndim;
+              for(d=0;d<ndim;++d)
+                in[i].rows->dsize[d] = d ? ref->dsize[d] : num;
+            }
+
+          /* The operand is already in memory: only point to its rows. */
+          else
+            {
+              in[i].rows=gal_data_alloc(
+                  gal_pointer_increment(in[i].data->array, first*rowsize,
+                                        in[i].data->type),
+                  in[i].data->type, ndim, in[i].data->dsize, NULL, 0,
+                  p->cp.minmapsize, p->cp.quietmmap, NULL, NULL, NULL);
+              in[i].rows->dsize[0]=num;
+              in[i].rows->size=num*rowsize;
+            }
+          gal_list_data_add(&list, in[i].rows);
+        }
+
+      /* Stack the rows and copy them into the output (which is allocated
+         after the first block: when its type is known). */
+      tmp=gal_arithmetic(operator, p->cp.numthreads, flags, list, params);
+      if(out==NULL)
+        out=gal_data_alloc(NULL, tmp->type, ndim, ref->dsize, ref->wcs,
+                           0, p->cp.minmapsize, p->cp.quietmmap, NULL,
+                           NULL, NULL);
+      memcpy(gal_pointer_increment(out->array, first*rowsize, out->type),
+             tmp->array, tmp->size*gal_type_sizeof(tmp->type));
+      gal_data_free(tmp);
+
+      /* Clean up the rows of this block. */
+      for(i=0;i<numop;++i)
+        {
+          if(in[i].fptr==NULL) in[i].rows->array=NULL;
+          gal_data_free(in[i].rows);
+        }
+    }
+
+  /* Clean up and put the output on the stack. */
+  for(i=0;i<numop;++i)
+    {
+      if(in[i].fptr && fits_close_file(in[i].fptr, &status))
+        gal_fits_io_error(status, NULL);
+      if(in[i].hdu) free(in[i].hdu);
+      gal_data_free(in[i].data);
+    }
+  if(params) gal_list_data_free(params);
+  operands_add(p, NULL, out);
+  free(in);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /***************************************************************/
 /*************      Reverse Polish algorithm       *************/
 /***************************************************************/
@@ -1606,6 +1818,11 @@ arithmetic_operator_run(struct arithmeticparams *p, int operator,
   if(p->cp.quiet) flags |= GAL_ARITHMETIC_FLAG_QUIET;
   if(p->envseed)  flags |= GAL_ARITHMETIC_FLAG_ENVSEED;
 
+  /* Element-wise operators that can be fused with their neighbors are
+     not evaluated here (see 'fused.c'). */
+  if(inlib && fused_operator(p, operator, operator_string, flags))
+    return;
+
   /* If this operator is in the library, we should pop everything here.  */
   if(inlib)
     {
@@ -1657,6 +1874,15 @@ arithmetic_operator_run(struct arithmeticparams *p, int operator,
              linked list of any number of operands within the single 'd1'
              pointer. */
           numop=pop_number_of_operands(p, operator, operator_string, &d2);
+
+          /* With '--stackmemory', the pixel-wise stacking operators read
+             the images in blocks of rows. */
+          if( p->stackmemory && arithmetic_stack_by_rows(operator) )
+            {
+              arithmetic_stack_rows(p, operator, operator_string, numop,
+                                    d2, flags);
+              return;
+            }
           for(i=0;i<numop;++i)
             gal_list_data_add(&d1, operands_pop(p, operator_string));
           break;
@@ -2001,6 +2227,21 @@ reversepolish(struct arithmeticparams *p)
     error(EXIT_FAILURE, 0, "too many operands");
 
 
+  /* In the streaming mode (with '--streamrows'), a final fused expression
+     is evaluated and written into the output in blocks of rows (without
+     reading the full inputs into memory, see 'fused.c'). */
+  if( p->streamrows && p->operands->next==NULL && p->operands->fused
+      && fused_stream(p, p->operands->fused) )
+    {
+      gal_wcs_free(p->refdata.wcs);
+      free(p->refdata.dsize);
+      gal_list_data_free(p->setprm.named);
+      gal_list_str_free(p->tokens, 0);
+      free(p->operands);
+      return;
+    }
+
+
   /* If the final operand has a filename, but its 'data' element is NULL,
      then the file hasn't actually be read yet. In this case, we need to
      read the contents of the file and put the resulting dataset into the
@@ -2008,7 +2249,12 @@ reversepolish(struct arithmeticparams *p)
      are called and there is only one filename as an argument (which can
      happen in scripts).*/
   for(otmp=p->operands; otmp!=NULL; otmp=otmp->next)
-    if(otmp->data==NULL && otmp->filename)
+    if(otmp->fused)
+      {
+        otmp->data=fused_evaluate(p, otmp->fused);
+        otmp->fused=NULL;
+      }
+    else if(otmp->data==NULL && otmp->filename)
       arithmetic_final_read_file(p, otmp);
 
 
@@ -2059,9 +2305,10 @@ reversepolish(struct arithmeticparams *p)
     }
 
 
-  /* Clean up, note that above, we copied the pointer to 'refdata->wcs'
-     into 'data', so it is freed when freeing 'data'. */
+  /* Clean up, note that above, each output got its own copy of
+     'refdata->wcs', so it should also be freed here. */
   gal_data_free(data);
+  gal_wcs_free(p->refdata.wcs);
   free(p->refdata.dsize);
   gal_list_data_free(p->setprm.named);
 
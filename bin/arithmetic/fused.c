@@ -0,0 +1,963 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/wcs.h>
+#include <gnuastro/type.h>
+#include <gnuastro/array.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
+#include <gnuastro/pointer.h>
+#include <gnuastro/dimension.h>
+#include <gnuastro/arithmetic.h>
+
+#include <gnuastro-internal/checkset.h>
+
+#include "main.h"
+
+#include "fused.h"
+#include "operands.h"
+
+
+
+/* Fused evaluation of element-wise operators
+   ==========================================
+
+   When a long chain of element-wise operators is called on large
+   datasets, running each operator separately (as is done in the library)
+   is limited by the memory bandwidth: each operator has to read its full
+   inputs and write a full output. Therefore, in the Arithmetic program,
+   the element-wise floating point operators are not run immediately,
+   instead they are put in the stack as a "fused node" (a node in an
+   expression tree). When the result is needed (because a non-fusible
+   operator pops it, or for the final output), the tree is compiled into a
+   list of instructions and evaluated in small chunks (that fit in the
+   CPU's cache) over many threads. In this way, every input is read once
+   and the output is written once.
+
+   To guarantee that the result is identical to running the operators one
+   by one, only operators (and operand types) that are done in floating
+   point are fused. All values are kept in double precision registers, but
+   each operation is done in the type that the library would use (since
+   every 32-bit float is exactly representable in 64-bit, the values don't
+   change). In any other situation, the operator is given to the library as
+   before.
+
+   With '--streamrows', the images of the input files are also not read
+   when they are popped by a fused operator. If the final output is a
+   fused expression, it is then evaluated in blocks of rows: the rows of
+   every input are read, the expression is evaluated on them and the
+   result is written into the output file before going to the next block.
+   Therefore the memory that is necessary is independent of the size of
+   the images (which can be much larger than the available RAM). If the
+   expression is needed as a whole (for example when a non-fusible
+   operator pops it), the input images are read completely like before. */
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************            Tree construction          ***************/
+/**********************************************************************/
+static int
+fused_operator_is_fusible(int operator)
+{
+  switch(operator)
+    {
+    case GAL_ARITHMETIC_OP_PLUS:
+    case GAL_ARITHMETIC_OP_MINUS:
+    case GAL_ARITHMETIC_OP_MULTIPLY:
+    case GAL_ARITHMETIC_OP_DIVIDE:
+    case GAL_ARITHMETIC_OP_POW:
+    case GAL_ARITHMETIC_OP_SQRT:
+    case GAL_ARITHMETIC_OP_LOG:
+    case GAL_ARITHMETIC_OP_LOG10:
+      return 1;
+    }
+  return 0;
+}
+
+
+
+
+
+static int
+fused_type_is_float(uint8_t type)
+{
+  return type==GAL_TYPE_FLOAT32 || type==GAL_TYPE_FLOAT64;
+}
+
+
+
+
+
+static struct fused_node *
+fused_node_alloc(void)
+{
+  struct fused_node *node;
+
+  errno=0;
+  node=calloc(1, sizeof *node);
+  if(node==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'node'",
+          __func__, sizeof *node);
+  return node;
+}
+
+
+
+
+
+/* Pop the top operand of the stack as a node of the expression tree: if
+   it is already a fused node, it is returned without evaluation,
+   otherwise a leaf will be built from its dataset. */
+static struct fused_node *
+fused_pop(struct arithmeticparams *p, char *operator_string)
+{
+  gal_data_t *data;
+  struct fused_node *node;
+  char *filename=NULL, *hdu=NULL;
+
+  if(p->operands && p->operands->fused)
+    node=operands_pop_fused(p);
+  else
+    {
+      /* In the streaming mode, images aren't read here (only their
+         metadata). */
+      data = p->streamrows ? operands_pop_lazy(p, &filename, &hdu) : NULL;
+      if(data==NULL) data=operands_pop(p, operator_string);
+
+      /* Build the leaf. */
+      node=fused_node_alloc();
+      node->hdu=hdu;
+      node->data=data;
+      node->filename=filename;
+      node->type=node->data->type;
+      node->size=node->data->size;
+    }
+  return node;
+}
+
+
+
+
+
+/* Return a leaf with more than one element in the tree (to be used for
+   checking the dimensions and allocating the output). */
+static gal_data_t *
+fused_node_shape(struct fused_node *node)
+{
+  gal_data_t *out;
+
+  if(node->data) return node->size>1 ? node->data : NULL;
+  out=fused_node_shape(node->left);
+  if(out==NULL && node->right) out=fused_node_shape(node->right);
+  return out;
+}
+
+
+
+
+
+/* A non-floating point operand can only be used if it is a single
+   (non-blank) number: for example the '2' in 'a.fits 2 /'. */
+static int
+fused_node_is_good_number(struct fused_node *node)
+{
+  return ( node->data
+           && node->size==1
+           && gal_blank_present(node->data, 1)==0 );
+}
+
+
+
+
+
+/* See if the given operator can be fused with the given operands. If so,
+   the type of the output will be put in 'otype' and 1 will be
+   returned. Otherwise, 0 will be returned. */
+static int
+fused_node_check(int operator, struct fused_node *l, struct fused_node *r,
+                 uint8_t *otype)
+{
+  gal_data_t *ls, *rs;
+  uint8_t ltype, rtype;
+
+  /* Unary operators: the input should be a floating point dataset with
+     more than one element. */
+  if(r==NULL)
+    {
+      *otype=l->type;
+      return fused_type_is_float(l->type) && l->size>1;
+    }
+
+  /* We need at least one full-sized dataset (when both are single
+     numbers, there is no benefit in fusion). Empty datasets need special
+     attention and are also left to the library. */
+  if( l->size==0 || r->size==0 || (l->size==1 && r->size==1) )
+    return 0;
+
+  /* When both have more than one element, they should have the same
+     dimensions (otherwise, the library should complain). */
+  if( l->size>1 && r->size>1 )
+    {
+      ls=fused_node_shape(l);
+      rs=fused_node_shape(r);
+      if( ls==NULL || rs==NULL || gal_dimension_is_different(ls, rs) )
+        return 0;
+    }
+
+  /* Check the types: a non-floating point operand is only acceptable when
+     it is a single number. */
+  if( !fused_type_is_float(l->type) && !fused_node_is_good_number(l) )
+    return 0;
+  if( !fused_type_is_float(r->type) && !fused_node_is_good_number(r) )
+    return 0;
+
+  /* Set the output type. For the binary function operators (like 'pow')
+     the library converts the integer inputs to 64-bit floating point
+     before the operation. */
+  ltype=l->type;
+  rtype=r->type;
+  if(operator==GAL_ARITHMETIC_OP_POW)
+    {
+      if( !fused_type_is_float(ltype) ) ltype=GAL_TYPE_FLOAT64;
+      if( !fused_type_is_float(rtype) ) rtype=GAL_TYPE_FLOAT64;
+    }
+  else if( !fused_type_is_float(ltype) && !fused_type_is_float(rtype) )
+    return 0;
+  *otype=gal_type_out(ltype, rtype);
+  return 1;
+}
+
+
+
+
+
+/* Free the tree (and the datasets of its leaves, except 'keep'). */
+static void
+fused_node_free(struct fused_node *node, gal_data_t *keep)
+{
+  if(node==NULL) return;
+  fused_node_free(node->left, keep);
+  fused_node_free(node->right, keep);
+  if(node->data && node->data!=keep) gal_data_free(node->data);
+  if(node->hdu) free(node->hdu);
+  free(node);
+}
+
+
+
+
+
+/* Read the full images of the leaves that haven't been read yet (in the
+   streaming mode). */
+static void
+fused_node_read(struct arithmeticparams *p, struct fused_node *node)
+{
+  gal_data_t *data;
+
+  /* An internal node: read the leaves of its children. */
+  if(node->data==NULL)
+    {
+      fused_node_read(p, node->left);
+      if(node->right) fused_node_read(p, node->right);
+      return;
+    }
+
+  /* A leaf that has already been read (or wasn't in a file). */
+  if(node->filename==NULL || node->data->array) return;
+
+  /* Read the image and remove possibly extra dimensions. Similar to
+     'operands_pop', the metadata of the input shouldn't be used. */
+  data=gal_array_read_one_ch(node->filename, node->hdu, NULL,
+                             p->cp.minmapsize, p->cp.quietmmap, "--hdu");
+  data->ndim=gal_dimension_remove_extra(data->ndim, data->dsize, NULL);
+  if(data->name)    { free(data->name);    data->name=NULL;    }
+  if(data->unit)    { free(data->unit);    data->unit=NULL;    }
+  if(data->comment) { free(data->comment); data->comment=NULL; }
+  if(!p->cp.quiet)
+    printf(" - Read: %s (hdu %s).\n", node->filename, node->hdu);
+
+  /* Replace the metadata with the read dataset. */
+  gal_data_free(node->data);
+  node->data=data;
+}
+
+
+
+
+
+/* Return the dataset that corresponds to the node (evaluating it if it is
+   not a leaf). */
+static gal_data_t *
+fused_node_to_data(struct arithmeticparams *p, struct fused_node *node)
+{
+  gal_data_t *out;
+  if(node->data)
+    {
+      fused_node_read(p, node);
+      out=node->data;
+      if(node->hdu) free(node->hdu);
+      free(node);
+      return out;
+    }
+  return fused_evaluate(p, node);
+}
+
+
+
+
+
+/* If the operator can be fused, do it (put a fused node on the stack) and
+   return 1. If the operator is fusible, but its operands aren't (for
+   example when they are integers), the operands are evaluated and the
+   operator is run by the library (and 1 is returned). Otherwise, 0 is
+   returned and nothing will be popped. */
+int
+fused_operator(struct arithmeticparams *p, int operator,
+               char *operator_string, int flags)
+{
+  uint8_t otype;
+  gal_data_t *d1, *d2=NULL;
+  struct fused_node *l, *r=NULL, *node;
+
+  /* If the operator can't be fused, return. */
+  if( fused_operator_is_fusible(operator)==0 ) return 0;
+
+  /* Pop the operands. Note that the operands are popped from a linked
+     list (which is last-in-first-out), so for the binary operators, the
+     first popped operand is the right one. */
+  switch(operator)
+    {
+    case GAL_ARITHMETIC_OP_SQRT:
+    case GAL_ARITHMETIC_OP_LOG:
+    case GAL_ARITHMETIC_OP_LOG10:
+      l=fused_pop(p, operator_string);
+      break;
+    default:
+      r=fused_pop(p, operator_string);
+      l=fused_pop(p, operator_string);
+    }
+
+  /* If the operands can be fused, build a new node and put it on the
+     stack. */
+  if( fused_node_check(operator, l, r, &otype) )
+    {
+      node=fused_node_alloc();
+      node->left=l;
+      node->right=r;
+      node->type=otype;
+      node->operator=operator;
+      node->size = r && r->size>l->size ? r->size : l->size;
+      operands_add_fused(p, node);
+    }
+
+  /* The operands can't be fused, so evaluate them (if they are already
+     fused nodes) and run the operator through the library. */
+  else
+    {
+      d1=fused_node_to_data(p, l);
+      if(r) d2=fused_node_to_data(p, r);
+      operands_add(p, NULL, gal_arithmetic(operator, p->cp.numthreads,
+                                           flags, d1, d2));
+    }
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************              Compilation              ***************/
+/**********************************************************************/
+/* Convert the value of a single-element dataset to the type that an
+   operation is done in (following C's implicit conversion for the
+   library's operators). Since all 32-bit floats can be exactly written in
+   64-bit floats, it is then kept as a 'double'. */
+static double
+fused_scalar_value(gal_data_t *data, uint8_t type)
+{
+  double out;
+  gal_data_t *conv=gal_data_copy_to_new_type(data, type);
+  out = ( type==GAL_TYPE_FLOAT32
+          ? ((float *)(conv->array))[0]
+          : ((double *)(conv->array))[0] );
+  gal_data_free(conv);
+  return out;
+}
+
+
+
+
+
+/* Compile the given node into instructions (in post-order, so the
+   operands of every instruction are evaluated before it). 'reg' is the
+   lowest register that can be used for this node's result. 'offset' is
+   the first element of the full-sized datasets that corresponds to the
+   first element of the output (only non-zero in the streaming mode: the
+   leaves that are streamed only contain the current rows). */
+static struct fused_operand
+fused_compile(struct fused_program *prog, struct fused_node *node,
+              size_t reg, size_t offset)
+{
+  struct fused_instruction *inst;
+  struct fused_operand op={0}, a, b={0};
+
+  /* A leaf: the data are read directly from the dataset. */
+  if(node->data)
+    {
+      op.type=node->type;
+      op.kind = node->size==1 ? FUSED_OPERAND_SCALAR : FUSED_OPERAND_ARRAY;
+      op.array = ( op.kind==FUSED_OPERAND_ARRAY && node->fptr==NULL
+                   ? gal_pointer_increment(node->data->array, offset,
+                                           node->type)
+                   : node->data->array );
+      return op;
+    }
+
+  /* Compile the operands. If the first operand uses a register, the
+     second should use the next one. */
+  a=fused_compile(prog, node->left, reg, offset);
+  if(node->right)
+    b=fused_compile(prog, node->right,
+                    a.kind==FUSED_OPERAND_REGISTER ? reg+1 : reg, offset);
+
+  /* Add this instruction (the output can overwrite the input registers,
+     since every element only depends on the same element of the
+     inputs). */
+  inst=&prog->inst[prog->numinst++];
+  inst->a=a;
+  inst->b=b;
+  inst->out=reg;
+  inst->type=node->type;
+  inst->operator=node->operator;
+  if(a.kind==FUSED_OPERAND_SCALAR)
+    inst->a.value=fused_scalar_value(node->left->data, inst->type);
+  if(b.kind==FUSED_OPERAND_SCALAR)
+    inst->b.value=fused_scalar_value(node->right->data, inst->type);
+  if(reg+1 > prog->numreg) prog->numreg=reg+1;
+
+  /* Return the register of this node's output. */
+  op.reg=reg;
+  op.type=node->type;
+  op.kind=FUSED_OPERAND_REGISTER;
+  return op;
+}
+
+
+
+
+
+static size_t
+fused_count_operators(struct fused_node *node)
+{
+  if(node->data) return 0;
+  return ( 1 + fused_count_operators(node->left)
+           + (node->right ? fused_count_operators(node->right) : 0) );
+}
+
+
+
+
+
+/* Find a leaf that can be used for the output (to avoid allocating a new
+   array). */
+static gal_data_t *
+fused_inplace_leaf(struct fused_node *node, uint8_t type, size_t size)
+{
+  gal_data_t *out;
+
+  if(node->data)
+    return ( node->data->type==type && node->data->size==size
+             && size>1 ) ? node->data : NULL;
+  out=fused_inplace_leaf(node->left, type, size);
+  if(out==NULL && node->right)
+    out=fused_inplace_leaf(node->right, type, size);
+  return out;
+}
+
+
+
+
+
+/* The smallest 'minmapsize' and the 'quietmmap' of all the leaves. */
+static void
+fused_mmap_params(struct fused_node *node, size_t *minmapsize,
+                  int *quietmmap)
+{
+  if(node->data)
+    {
+      if(node->data->minmapsize < *minmapsize)
+        *minmapsize=node->data->minmapsize;
+      *quietmmap = *quietmmap && node->data->quietmmap;
+      return;
+    }
+  fused_mmap_params(node->left, minmapsize, quietmmap);
+  if(node->right) fused_mmap_params(node->right, minmapsize, quietmmap);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************               Evaluation              ***************/
+/**********************************************************************/
+/* Return a pointer to the values of an operand within the current chunk
+   (starting from element 'start' and with 'n' elements). The stride is
+   zero for single values. */
+static double *
+fused_fetch(struct fused_operand *op, double *regs, double *scratch,
+            size_t start, size_t n, int *stride)
+{
+  size_t i;
+  float *f;
+
+  *stride=1;
+  switch(op->kind)
+    {
+    case FUSED_OPERAND_REGISTER:
+      return regs + op->reg*FUSED_CHUNK_SIZE;
+
+    case FUSED_OPERAND_SCALAR:
+      *stride=0;
+      return &op->value;
+
+    case FUSED_OPERAND_ARRAY:
+      if(op->type==GAL_TYPE_FLOAT64)
+        return (double *)(op->array) + start;
+      f=(float *)(op->array) + start;
+      for(i=0;i<n;++i) scratch[i]=f[i];
+      return scratch;
+
+    case FUSED_OPERAND_INVALID:
+      return NULL;
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+            "the problem. The operand kind %d is not recognized",
+            __func__, PACKAGE_BUGREPORT, op->kind);
+    }
+  return NULL;
+}
+
+
+
+
+
+/* The operation is done in type 'T': the values are read into 'x' and
+   'y' (of type 'T'), and the result is converted to 'T' before being
+   written into the (double precision) output. */
+#define FUSED_BINARY(T, EXPR) {                                         \
+    T x, y;                                                             \
+    if(sa && sb)                                                        \
+      for(i=0;i<n;++i) { x=a[i]; y=b[i]; o[i]=(T)(EXPR); }              \
+    else if(sa)                                                         \
+      { y=b[0]; for(i=0;i<n;++i) { x=a[i]; o[i]=(T)(EXPR); } }          \
+    else                                                                \
+      { x=a[0]; for(i=0;i<n;++i) { y=b[i]; o[i]=(T)(EXPR); } }          \
+  }
+
+#define FUSED_UNARY(T, EXPR) {                                          \
+    T x;                                                                \
+    for(i=0;i<n;++i) { x=a[i]; o[i]=(T)(EXPR); }                        \
+  }
+
+#define FUSED_OPERATOR(T)                                               \
+  switch(inst->operator)                                                \
+    {                                                                   \
+    case GAL_ARITHMETIC_OP_PLUS:     FUSED_BINARY(T, x+y);      break;  \
+    case GAL_ARITHMETIC_OP_MINUS:    FUSED_BINARY(T, x-y);      break;  \
+    case GAL_ARITHMETIC_OP_MULTIPLY: FUSED_BINARY(T, x*y);      break;  \
+    case GAL_ARITHMETIC_OP_DIVIDE:   FUSED_BINARY(T, x/y);      break;  \
+    case GAL_ARITHMETIC_OP_POW:      FUSED_BINARY(T, pow(x,y)); break;  \
+    case GAL_ARITHMETIC_OP_SQRT:     FUSED_UNARY(T, sqrt(x));   break;  \
+    case GAL_ARITHMETIC_OP_LOG:      FUSED_UNARY(T, log(x));    break;  \
+    case GAL_ARITHMETIC_OP_LOG10:    FUSED_UNARY(T, log10(x));  break;  \
+    default:                                                            \
+      error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to "   \
+            "fix the problem. Operator code %d is not recognized",      \
+            "FUSED_OPERATOR", PACKAGE_BUGREPORT, inst->operator);       \
+    }
+
+static void
+fused_instruction_run(struct fused_instruction *inst, double *regs,
+                      double *scratch, double *o, size_t start, size_t n)
+{
+  size_t i;
+  int sa, sb;
+  double *a=fused_fetch(&inst->a, regs, scratch, start, n, &sa);
+  double *b=fused_fetch(&inst->b, regs, scratch+FUSED_CHUNK_SIZE, start,
+                        n, &sb);
+
+  if(inst->type==GAL_TYPE_FLOAT32) { FUSED_OPERATOR(float);  }
+  else                             { FUSED_OPERATOR(double); }
+}
+
+
+
+
+
+static void *
+fused_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct fused_program *prog=(struct fused_program *)tprm->params;
+
+  float *f;
+  double *o, *regs, *scratch;
+  size_t i, j, n, start, last=prog->numinst-1;
+  gal_data_t *out=prog->out;
+
+  /* Allocate the registers (and two scratch registers for the conversion
+     of 32-bit floating point inputs) of this thread. */
+  regs=gal_pointer_allocate(GAL_TYPE_FLOAT64,
+                            (prog->numreg+2)*FUSED_CHUNK_SIZE, 0,
+                            __func__, "regs");
+  scratch=regs+prog->numreg*FUSED_CHUNK_SIZE;
+
+  /* Go over all the chunks of this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the range of this chunk. */
+      start=tprm->indexs[i]*FUSED_CHUNK_SIZE;
+      n = ( start+FUSED_CHUNK_SIZE > prog->size
+            ? prog->size-start : FUSED_CHUNK_SIZE );
+
+      /* Run the instructions. When the output is a 64-bit float, the last
+         instruction can directly write into it. */
+      for(j=0;j<prog->numinst;++j)
+        {
+          o = ( j==last && out->type==GAL_TYPE_FLOAT64
+                ? (double *)(out->array)+start
+                : regs + prog->inst[j].out*FUSED_CHUNK_SIZE );
+          fused_instruction_run(&prog->inst[j], regs, scratch, o,
+                                start, n);
+        }
+
+      /* Write the final result into a 32-bit output. */
+      if(out->type==GAL_TYPE_FLOAT32)
+        {
+          f=(float *)(out->array)+start;
+          o=regs+prog->inst[last].out*FUSED_CHUNK_SIZE;
+          for(j=0;j<n;++j) f[j]=o[j];
+        }
+    }
+
+  /* Clean up, wait for all threads to finish and return. */
+  free(regs);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Evaluate the expression tree into the already allocated 'out' (see
+   'fused_compile' for 'offset'). */
+static void
+fused_run(struct arithmeticparams *p, struct fused_node *root,
+          gal_data_t *out, size_t offset)
+{
+  struct fused_program prog={0};
+
+  /* Compile the expression tree. */
+  errno=0;
+  prog.out=out;
+  prog.size=out->size;
+  prog.inst=malloc(fused_count_operators(root) * sizeof *prog.inst);
+  if(prog.inst==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'prog.inst'",
+          __func__, fused_count_operators(root) * sizeof *prog.inst);
+  fused_compile(&prog, root, 0, offset);
+
+  /* Evaluate the expression over all the chunks. */
+  prog.numchunks = prog.size/FUSED_CHUNK_SIZE
+                   + (prog.size%FUSED_CHUNK_SIZE ? 1 : 0);
+  gal_threads_spin_off(fused_on_thread, &prog, prog.numchunks,
+                       p->cp.numthreads, p->cp.minmapsize,
+                       p->cp.quietmmap);
+
+  /* Clean up. */
+  free(prog.inst);
+}
+
+
+
+
+
+/* Evaluate the expression tree of the given node, free all its internal
+   datasets and return the output dataset. */
+gal_data_t *
+fused_evaluate(struct arithmeticparams *p, struct fused_node *root)
+{
+  int quietmmap=1;
+  gal_data_t *out, *shape;
+  size_t minmapsize=-1;
+
+  /* Read any leaf that hasn't been read yet. */
+  fused_node_read(p, root);
+  shape=fused_node_shape(root);
+
+  /* Small sanity check. */
+  if(shape==NULL)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+          "the problem. The expression has no dataset with more than "
+          "one element", __func__, PACKAGE_BUGREPORT);
+
+  /* Prepare the output: if one of the inputs has the same type and size
+     as the output, use it (like the in-place operations of the library),
+     otherwise, allocate a new dataset. */
+  out=fused_inplace_leaf(root, root->type, root->size);
+  if(out==NULL)
+    {
+      fused_mmap_params(root, &minmapsize, &quietmmap);
+      out=gal_data_alloc(NULL, root->type, shape->ndim, shape->dsize,
+                         shape->wcs, 0, minmapsize, quietmmap,
+                         NULL, NULL, NULL);
+    }
+
+  /* Evaluate the expression, clean up and return. */
+  fused_run(p, root, out, 0);
+  fused_node_free(root, out);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**********************************************************************/
+/****************               Streaming               ***************/
+/**********************************************************************/
+/* Open the files of the leaves that haven't been read yet and return the
+   number of such leaves. */
+static size_t
+fused_stream_open(struct arithmeticparams *p, struct fused_node *node)
+{
+  if(node->data==NULL)
+    return ( fused_stream_open(p, node->left)
+             + (node->right ? fused_stream_open(p, node->right) : 0) );
+
+  if(node->filename==NULL || node->data->array) return 0;
+  node->fptr=gal_fits_hdu_open_format(node->filename, node->hdu, 0,
+                                      "--hdu");
+  if(!p->cp.quiet)
+    printf(" - Stream: %s (hdu %s).\n", node->filename, node->hdu);
+  return 1;
+}
+
+
+
+
+
+/* Read the given rows of the streamed leaves (replacing their previous
+   rows). */
+static void
+fused_stream_read(struct arithmeticparams *p, struct fused_node *node,
+                  size_t first, size_t num)
+{
+  if(node->data==NULL)
+    {
+      fused_stream_read(p, node->left, first, num);
+      if(node->right) fused_stream_read(p, node->right, first, num);
+      return;
+    }
+
+  if(node->fptr)
+    {
+      gal_data_free(node->data);
+      node->data=gal_fits_img_read_rows(node->fptr, first, num,
+                                        p->cp.minmapsize,
+                                        p->cp.quietmmap);
+    }
+}
+
+
+
+
+
+static void
+fused_stream_close(struct fused_node *node)
+{
+  int status=0;
+
+  if(node->data==NULL)
+    {
+      fused_stream_close(node->left);
+      if(node->right) fused_stream_close(node->right);
+      return;
+    }
+
+  if(node->fptr)
+    {
+      if( fits_close_file(node->fptr, &status) )
+        gal_fits_io_error(status, NULL);
+      node->fptr=NULL;
+    }
+}
+
+
+
+
+
+/* Evaluate the final expression in blocks of '--streamrows' rows and write
+   each block into the output file before going onto the next. In this
+   way, only one block of every input (and the output) is in memory at
+   any time. If the expression can't be streamed (for example it doesn't
+   have any un-read image), nothing is done and 0 is returned (so the
+   output is written as before). Otherwise, the expression is freed and 1
+   is returned. */
+int
+fused_stream(struct arithmeticparams *p, struct fused_node *root)
+{
+  int status=0;
+  fitsfile *ofptr;
+  gal_data_t *meta, *out, *shape=fused_node_shape(root);
+  size_t i, num, first, nrows, rowsize, numblocks=0;
+
+  /* Only images can be streamed (1D outputs are tables by default) and
+     at least one input should not be read yet. */
+  if( shape==NULL || (shape->ndim==1 && p->onedasimage==0)
+      || fused_stream_open(p, root)==0 )
+    return 0;
+
+  /* The blocks of rows are written into a FITS image, so the output must
+     be a FITS file (check it before anything is read or written). */
+  if( gal_fits_name_is_fits(p->cp.output)==0 )
+    error(EXIT_FAILURE, 0, "%s: the output of '--streamrows' should be a "
+          "FITS file. The given name doesn't have a FITS suffix (see "
+          "'--output')", p->cp.output);
+
+  /* Keep the full size (the leaves will only contain the current rows
+     after reading the first block). */
+  nrows=shape->dsize[0];
+  rowsize=shape->size/nrows;
+  meta=gal_data_alloc_empty(shape->ndim, p->cp.minmapsize,
+                            p->cp.quietmmap);
+  for(i=0;i<shape->ndim;++i) meta->dsize[i]=shape->dsize[i];
+  meta->size=shape->size;
+  meta->type=root->type;
+
+  /* Set the metadata of the output and prepare the output HDU (similar to
+     the non-streaming output, the 0-th HDU has the common keywords). */
+  meta->wcs=gal_wcs_copy(p->refdata.wcs);
+  if(p->metaname)    gal_checkset_allocate_copy(p->metaname, &meta->name);
+  if(p->metaunit)    gal_checkset_allocate_copy(p->metaunit, &meta->unit);
+  if(p->metacomment) gal_checkset_allocate_copy(p->metacomment,
+                                                &meta->comment);
+  gal_fits_key_write(p->cp.ckeys, p->cp.output, "0", "NONE", 1, 1);
+  ofptr=gal_fits_img_write_rows_init(meta, p->cp.output, NULL, 0);
+
+  /* Allocate the output of one block. */
+  meta->dsize[0] = p->streamrows < nrows ? p->streamrows : nrows;
+  out=gal_data_alloc(NULL, root->type, meta->ndim, meta->dsize, NULL, 0,
+                     p->cp.minmapsize, p->cp.quietmmap, NULL, NULL, NULL);
+  meta->dsize[0]=nrows;
+
+  /* Go over the blocks: read the rows of all the streamed inputs,
+     evaluate the expression on them and write the result. */
+  for(first=0; first<nrows; first+=num)
+    {
+      num = first+p->streamrows > nrows ? nrows-first : p->streamrows;
+      fused_stream_read(p, root, first, num);
+      out->dsize[0]=num;
+      out->size=num*rowsize;
+      fused_run(p, root, out, first*rowsize);
+      gal_fits_img_write_rows(ofptr, out, first);
+      ++numblocks;
+    }
+
+  /* Close the files and clean up. */
+  if( fits_close_file(ofptr, &status) ) gal_fits_io_error(status, NULL);
+  fused_stream_close(root);
+  fused_node_free(root, NULL);
+  gal_data_free(meta);
+  gal_data_free(out);
+
+  /* Let the user know that the job is done. */
+  if(!p->cp.quiet)
+    printf(" - Write (final, %zu blocks): %s\n", numblocks, p->cp.output);
+  return 1;
+}
@@ -0,0 +1,124 @@
+/*********************************************************************
+Arithmetic - Do arithmetic operations on images.
+Arithmetic is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef FUSED_H
+#define FUSED_H
+
+/* Number of elements that are evaluated together in one chunk. Every
+   intermediate result of a fused expression is kept in a buffer of this
+   many 64-bit elements, so with a few levels in the expression tree, all
+   the buffers of one thread comfortably fit within the CPU's cache. */
+#define FUSED_CHUNK_SIZE 2048
+
+/* Kinds of operands that an instruction may read. */
+enum fused_operand_kinds
+{
+  FUSED_OPERAND_INVALID,            /* ==0 by C standard. */
+
+  FUSED_OPERAND_ARRAY,              /* Full-sized input array.         */
+  FUSED_OPERAND_SCALAR,             /* Single value (number).          */
+  FUSED_OPERAND_REGISTER,           /* Result of a previous instruction. */
+};
+
+
+
+
+
+/* A node in the (not yet evaluated) expression tree. For leaves, only
+   'data' is used. For the internal nodes (operators), 'data' is NULL and
+   the children are in 'left' and 'right' ('right' is NULL for unary
+   operators). In the streaming mode, the pixels of a leaf may not be read
+   yet: in this case, 'filename' is not NULL and 'data->array' is NULL
+   (until the leaf is read). */
+struct fused_node
+{
+  int                operator;  /* Operator code (INVALID for leaves).  */
+  uint8_t                type;  /* Type of the node's output.           */
+  size_t                 size;  /* Number of elements in the output.    */
+  gal_data_t            *data;  /* Dataset (only for leaves).           */
+  char              *filename;  /* File of a not-yet-read leaf.         */
+  char                   *hdu;  /* HDU of a not-yet-read leaf.          */
+  fitsfile              *fptr;  /* Opened file (while streaming).       */
+  struct fused_node     *left;  /* First (left) operand.                */
+  struct fused_node    *right;  /* Second (right) operand.              */
+};
+
+
+
+
+
+/* One operand of a compiled instruction. */
+struct fused_operand
+{
+  uint8_t                kind;  /* Kind of operand (see enum above).    */
+  uint8_t                type;  /* Type of array (when kind is array).  */
+  size_t                  reg;  /* Register index (for registers).      */
+  void                 *array;  /* Pointer to start of array.           */
+  double                value;  /* Value of the scalar operands.        */
+};
+
+
+
+
+
+/* A single compiled instruction: all the values are kept as 'double' in
+   the registers, but the operation is done in 'type' (so the result is
+   identical to running each operator separately). */
+struct fused_instruction
+{
+  int                operator;  /* Operator code.                       */
+  uint8_t                type;  /* Type to do the operation in.         */
+  size_t                  out;  /* Output register.                     */
+  struct fused_operand      a;  /* First (left) operand.                */
+  struct fused_operand      b;  /* Second (right) operand.              */
+};
+
+
+
+
+
+/* The full compiled expression. */
+struct fused_program
+{
+  size_t              numinst;  /* Number of instructions.              */
+  size_t               numreg;  /* Number of registers.                 */
+  struct fused_instruction *inst; /* Array of instructions.             */
+  size_t                 size;  /* Number of elements in output.        */
+  size_t            numchunks;  /* Number of chunks to evaluate.        */
+  gal_data_t             *out;  /* Output dataset.                      */
+};
+
+
+
+
+
+int
+fused_operator(struct arithmeticparams *p, int operator,
+               char *operator_string, int flags);
+
+gal_data_t *
+fused_evaluate(struct arithmeticparams *p, struct fused_node *root);
+
+int
+fused_stream(struct arithmeticparams *p, struct fused_node *root);
+
+#endif
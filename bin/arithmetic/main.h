@@ -50,14 +50,15 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
-/* In every node of the operand linked list, only one of the 'filename' or
-   'data' should be non-NULL. Otherwise it will be a bug and will cause
-   problems. All the operands operate on this premise. */
+/* In every node of the operand linked list, only one of the 'filename',
+   'data' or 'fused' should be non-NULL. Otherwise it will be a bug and
+   will cause problems. All the operands operate on this premise. */
 struct operand
 {
   char       *filename;    /* !=NULL if the operand is a filename. */
   char            *hdu;    /* !=NULL if the operand is a filename. */
   gal_data_t     *data;    /* !=NULL if the operand is a dataset.  */
+  struct fused_node *fused; /* !=NULL if not yet evaluated.        */
   struct operand *next;    /* Pointer to next operand.             */
 };
 
@@ -90,6 +91,8 @@ struct arithmeticparams
 
   /* Operating mode: */
   int        wcs_collapsed;  /* If the internal WCS is already collapsed.*/
+  size_t        streamrows;  /* Number of rows in each streamed block.  */
+  size_t       stackmemory;  /* Memory (MB) for stacking inputs' rows.  */
 
   /* Internal: */
   uint8_t          envseed;  /* To setup the random number generator.   */
@@ -33,11 +33,13 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 #include <gnuastro/tiff.h>
 #include <gnuastro/array.h>
+#include <gnuastro/dimension.h>
 #include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/arithmetic-set.h>
 
 #include "main.h"
 
+#include "fused.h"
 #include "operands.h"
 
 
@@ -108,6 +110,7 @@ operands_add_list(struct arithmeticparams *p, gal_data_t *data)
       /* Set the basic parameters. */
       newnode->data=tmp;
       newnode->hdu=NULL;
+      newnode->fused=NULL;
       newnode->filename=NULL;
       newnode->data->next=NULL;
 
@@ -147,6 +150,7 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
       if(newnode==NULL)
         error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'newnode'",
               __func__, sizeof *newnode);
+      newnode->fused=NULL;
 
       /* If the 'filename' is the name of a dataset, then use a copy of it.
          otherwise, do the basic analysis. */
@@ -220,10 +224,40 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data)
 
 
 
+/* When the reference data structure's dimensionality is non-zero, it
+   means that this is not the first image read. So, write its basic
+   information into the reference data structure for future checks. */
+static void
+operands_set_refdata(struct arithmeticparams *p, gal_data_t *data)
+{
+  size_t i;
+
+  /* Only for the first image. */
+  if(p->refdata.ndim) return;
+
+  /* Set the dimensionality. */
+  p->refdata.ndim=data->ndim;
+
+  /* Allocate the dsize array. */
+  errno=0;
+  p->refdata.dsize=malloc(p->refdata.ndim * sizeof *p->refdata.dsize);
+  if(p->refdata.dsize==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+          "p->refdata.dsize", __func__,
+          p->refdata.ndim * sizeof *p->refdata.dsize);
+
+  /* Write the values into it. */
+  for(i=0;i<p->refdata.ndim;++i)
+    p->refdata.dsize[i]=data->dsize[i];
+}
+
+
+
+
+
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator)
 {
-  size_t i;
   gal_data_t *data;
   char *filename, *hdu;
   struct operand *operands=p->operands;
@@ -234,9 +268,12 @@ operands_pop(struct arithmeticparams *p, char *operator)
     error(EXIT_FAILURE, 0, "not enough operands for the '%s' operator",
           operator);
 
-  /* Set the dataset. If filename is present then read the file
-     and fill in the array, if not then just set the array. */
-  if(operands->filename)
+  /* Set the dataset. If filename is present then read the file and fill
+     in the array, if the operand is a (not yet evaluated) fused
+     expression, evaluate it, otherwise just set the array. */
+  if(operands->fused)
+    data=fused_evaluate(p, operands->fused);
+  else if(operands->filename)
     {
       /* Set the HDU and filename */
       hdu=operands->hdu;
@@ -247,28 +284,8 @@ operands_pop(struct arithmeticparams *p, char *operator)
                                  p->cp.quietmmap, "--hdu");
       data->ndim=gal_dimension_remove_extra(data->ndim, data->dsize, NULL);
 
-      /* When the reference data structure's dimensionality is non-zero, it
-         means that this is not the first image read. So, write its basic
-         information into the reference data structure for future
-         checks. */
-      if(p->refdata.ndim==0)
-        {
-          /* Set the dimensionality. */
-          p->refdata.ndim=(data)->ndim;
-
-          /* Allocate the dsize array. */
-          errno=0;
-          p->refdata.dsize=malloc(p->refdata.ndim
-                                  * sizeof *p->refdata.dsize);
-          if(p->refdata.dsize==NULL)
-            error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
-                  "p->refdata.dsize", __func__,
-                  p->refdata.ndim * sizeof *p->refdata.dsize);
-
-          /* Write the values into it. */
-          for(i=0;i<p->refdata.ndim;++i)
-            p->refdata.dsize[i]=data->dsize[i];
-        }
+      /* Keep the basic information of the first image. */
+      operands_set_refdata(p, data);
 
       /* Report the read image if desired: */
       if(!p->cp.quiet) printf(" - Read: %s (hdu %s).\n", filename, hdu);
@@ -299,6 +316,117 @@ operands_pop(struct arithmeticparams *p, char *operator)
 
 
 
+/* Add a fused expression (that hasn't been evaluated yet) to the top of
+   the stack. */
+void
+operands_add_fused(struct arithmeticparams *p, struct fused_node *node)
+{
+  struct operand *newnode;
+
+  /* Allocate space for the new operand. */
+  errno=0;
+  newnode=malloc(sizeof *newnode);
+  if(newnode==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for 'newnode'",
+          __func__, sizeof *newnode);
+
+  /* Set the basic parameters and add it to the top of the stack. */
+  newnode->hdu=NULL;
+  newnode->data=NULL;
+  newnode->fused=node;
+  newnode->filename=NULL;
+  newnode->next=p->operands;
+  p->operands=newnode;
+}
+
+
+
+
+
+/* Pop the top operand of the stack when it is a fused expression (without
+   evaluating it). */
+struct fused_node *
+operands_pop_fused(struct arithmeticparams *p)
+{
+  struct fused_node *node;
+  struct operand *operands=p->operands;
+
+  /* Small sanity check. */
+  if(operands==NULL || operands->fused==NULL)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+          "the problem. The top operand is not a fused expression",
+          __func__, PACKAGE_BUGREPORT);
+
+  /* Remove this node from the stack and return the expression. */
+  node=operands->fused;
+  p->operands=operands->next;
+  free(operands);
+  return node;
+}
+
+
+
+
+
+/* When the images are only read in blocks of rows (with '--streamrows' or
+   '--stackmemory'), if the top operand is an image in a FITS file that
+   hasn't been read yet, it is popped without reading its pixels: the
+   returned dataset only has the type and size of the image (its 'array'
+   is NULL) and its file name and HDU are put in 'filename' and 'hdu'
+   (which should be freed by the caller). If the top operand isn't such an
+   image (or only has one pixel), NULL is returned and nothing is
+   popped. */
+gal_data_t *
+operands_pop_lazy(struct arithmeticparams *p, char **filename, char **hdu)
+{
+  fitsfile *fptr;
+  gal_data_t *out;
+  int type, status=0;
+  size_t i, ndim, *dsize;
+  struct operand *operands=p->operands;
+
+  /* Check if the top operand is a not-yet-read FITS image. */
+  if( operands==NULL
+      || operands->hdu==NULL
+      || operands->filename==NULL
+      || gal_fits_file_recognized(operands->filename)==0
+      || gal_fits_hdu_format(operands->filename, operands->hdu,
+                             "--hdu")!=IMAGE_HDU )
+    return NULL;
+
+  /* Read the basic information of the image and remove possibly extra
+     dimensions. */
+  fptr=gal_fits_hdu_open_format(operands->filename, operands->hdu, 0,
+                                "--hdu");
+  gal_fits_img_info(fptr, &type, &ndim, &dsize, NULL, NULL);
+  if( fits_close_file(fptr, &status) ) gal_fits_io_error(status, NULL);
+  ndim = ndim ? gal_dimension_remove_extra(ndim, dsize, NULL) : 0;
+
+  /* Images with a single pixel are read normally. */
+  if( ndim==0 || gal_dimension_total_size(ndim, dsize)<2 )
+    { free(dsize); return NULL; }
+
+  /* Build the dataset (without any array). */
+  out=gal_data_alloc_empty(ndim, p->cp.minmapsize, p->cp.quietmmap);
+  out->type=type;
+  for(i=0;i<ndim;++i) out->dsize[i]=dsize[i];
+  out->size=gal_dimension_total_size(ndim, dsize);
+  operands_set_refdata(p, out);
+  free(dsize);
+
+  /* Pop the operand and return the dataset. */
+  *hdu=operands->hdu;
+  *filename=operands->filename;
+  p->operands=operands->next;
+  free(operands);
+  ++p->popcounter;
+  return out;
+}
+
+
+
+
+
 /* Wrapper to use the 'operands_pop' function with the 'set-' operator. */
 gal_data_t *
 operands_pop_wrapper_set(void *in)
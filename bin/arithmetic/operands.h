@@ -32,9 +32,18 @@ operands_add(struct arithmeticparams *p, char *filename, gal_data_t *data);
 gal_data_t *
 operands_pop(struct arithmeticparams *p, char *operator);
 
+gal_data_t *
+operands_pop_lazy(struct arithmeticparams *p, char **filename, char **hdu);
+
 gal_data_t *
 operands_pop_wrapper_set(void *in);
 
+void
+operands_add_fused(struct arithmeticparams *p, struct fused_node *node);
+
+struct fused_node *
+operands_pop_fused(struct arithmeticparams *p);
+
 void
 operands_set_name(struct arithmeticparams *p, char *token);
 
@@ -52,6 +52,8 @@ enum option_keys_enum
      automatically). */
   UI_KEY_ENVSEED         = 1000,
   UI_KEY_ARGUMENTS,
+  UI_KEY_STREAMROWS,
+  UI_KEY_STACKMEMORY,
 };
 
 
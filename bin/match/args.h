@@ -161,7 +161,7 @@ struct argp_option program_options[] =
       UI_KEY_KDTREE,
       "STR",
       0,
-      "build, internal, disable, CUSTOM-FITS-FILE.",
+      "build, internal, disable, sky, CUSTOM-FITS-FILE.",
       UI_GROUP_CATALOGMATCH,
       &p->kdtree,
       GAL_TYPE_STRING,
@@ -182,6 +182,45 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET,
     },
+    {
+      "kdtreelayout",
+      UI_KEY_KDTREELAYOUT,
+      "STR",
+      0,
+      "Layout of built k-d tree: leftright, implicit.",
+      UI_GROUP_CATALOGMATCH,
+      &p->kdtreelayout,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_MANDATORY,
+      GAL_OPTIONS_NOT_SET,
+    },
+    {
+      "allmatches",
+      UI_KEY_ALLMATCHES,
+      0,
+      0,
+      "All matches within aperture (not just nearest).",
+      UI_GROUP_CATALOGMATCH,
+      &p->allmatches,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "nearest",
+      UI_KEY_NEAREST,
+      "INT",
+      0,
+      "Up to INT nearest matches within aperture.",
+      UI_GROUP_CATALOGMATCH,
+      &p->nearest,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GT_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
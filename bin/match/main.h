@@ -51,6 +51,7 @@ enum kdtree_modes
   MATCH_KDTREE_INTERNAL,
   MATCH_KDTREE_DISABLE,
   MATCH_KDTREE_FILE,
+  MATCH_KDTREE_SKY,
 };
 
 
@@ -70,8 +71,11 @@ struct matchparams
   gal_data_t        *aperture;  /* Acceptable matching aperture.        */
   char                *kdtree;  /* The mode to use k-d tree mode.       */
   char             *kdtreehdu;  /* k-d tree HDU when its a (FITS) file. */
+  char          *kdtreelayout;  /* Layout of the k-d tree to build.     */
   uint8_t         logasoutput;  /* Don't rearrange inputs, out is log.  */
   uint8_t          notmatched;  /* Output is rows that don't match.     */
+  uint8_t          allmatches;  /* All matches within the aperture.     */
+  size_t              nearest;  /* Only this many nearest matches.      */
 
   /* Internal */
   int                    mode;  /* Mode of operation: image or catalog. */
@@ -86,6 +90,7 @@ struct matchparams
   char              *out2name;  /* Name of second matched output.       */
   gal_list_str_t  *stdinlines;  /* Lines given by Standard input.       */
   int              kdtreemode;  /* The k-d tree mode.                   */
+  int             kdtreelayid;  /* Code of the k-d tree layout.         */
   gal_data_t      *kdtreedata;  /* The k-d tree data.                   */
   size_t           kdtreeroot;  /* The root node of the k-d tree.       */
 
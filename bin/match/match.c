@@ -227,7 +227,8 @@ static void
 match_arrange_in_new_col(struct matchparams *p, gal_data_t *in,
                          size_t *permutation, size_t nummatched)
 {
-  size_t c=0, i, n;
+  size_t c=0, i, j, n;
+  char **strin, **strout;
   size_t istart=p->notmatched ? nummatched : 0;
   size_t iend=p->notmatched ? in->dsize[0] : nummatched;
   size_t outrows=p->notmatched ? in->dsize[0] - nummatched : nummatched;
@@ -241,11 +242,28 @@ match_arrange_in_new_col(struct matchparams *p, gal_data_t *in,
                                              &in->mmapname, p->cp.quietmmap,
                                              __func__, "out");
 
-  /* Copy the matched rows into the output array. */
-  for(i=istart;i<iend;++i)
-    memcpy(gal_pointer_increment(out,       n*c++,            in->type),
-           gal_pointer_increment(in->array, n*permutation[i], in->type),
-           gal_type_sizeof(in->type) * n);
+  /* Copy the matched rows into the output array. With '--allmatches' or
+     '--nearest', a row can be present in many matches, so the strings are
+     copied (and those of the input are freed). In the other modes, each
+     row is used at most once, so only the pointers are copied. */
+  if( in->type==GAL_TYPE_STRING && (p->allmatches || p->nearest) )
+    {
+      strin=in->array;
+      strout=out;
+      for(i=istart;i<iend;++i)
+        {
+          for(j=0;j<n;++j)
+            gal_checkset_allocate_copy(strin[n*permutation[i]+j],
+                                       &strout[n*c+j]);
+          ++c;
+        }
+      for(i=0;i<in->size;++i) free(strin[i]);
+    }
+  else
+    for(i=istart;i<iend;++i)
+      memcpy(gal_pointer_increment(out,       n*c++,            in->type),
+             gal_pointer_increment(in->array, n*permutation[i], in->type),
+             gal_type_sizeof(in->type) * n);
 
   /**********************************/
   /* Add a check so if the column is a string, we free the strings that
@@ -559,6 +577,36 @@ match_catalog_write_one_col(struct matchparams *p, gal_data_t *a,
 
 
 
+/* Construct the k-d tree of the first input with the requested layout.
+   The left/right layout is limited to 2^32-1 rows, so for larger catalogs
+   the implicit layout is used (its root is always the first row). */
+static gal_data_t *
+match_catalog_kdtree_create(struct matchparams *p, size_t *root)
+{
+  if( p->kdtreelayid==GAL_KDTREE_LAYOUT_LEFTRIGHT
+      && p->cols1->size>=GAL_BLANK_UINT32 )
+    {
+      if(!p->cp.quiet)
+        error(EXIT_SUCCESS, 0, "WARNING: the first input has %zu rows, "
+              "which is too many for the 'leftright' k-d tree layout, "
+              "so the 'implicit' layout will be used",
+              p->cols1->size);
+      p->kdtreelayid=GAL_KDTREE_LAYOUT_IMPLICIT;
+    }
+
+  /* Build the tree. */
+  if(p->kdtreelayid==GAL_KDTREE_LAYOUT_IMPLICIT)
+    {
+      *root=0;
+      return gal_kdtree_create_implicit(p->cols1, p->cp.numthreads);
+    }
+  return gal_kdtree_create(p->cols1, root, p->cp.numthreads);
+}
+
+
+
+
+
 static void
 match_catalog_kdtree_build(struct matchparams *p)
 {
@@ -575,7 +623,7 @@ match_catalog_kdtree_build(struct matchparams *p)
   /* Construct a k-d tree from 'p->cols1': the index of root is stored in
      'root'. */
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
-  kdtree = gal_kdtree_create(p->cols1, &root);
+  kdtree = match_catalog_kdtree_create(p, &root);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "k-d tree constructed (%zu rows).",
@@ -632,7 +680,7 @@ match_catalog_kdtree(struct matchparams *p, size_t *nummatched)
       if(p->kdtreemode==MATCH_KDTREE_INTERNAL)
         {
           if(!p->cp.quiet) gettimeofday(&t1, NULL);
-          p->kdtreedata = gal_kdtree_create(p->cols1, &p->kdtreeroot);
+          p->kdtreedata = match_catalog_kdtree_create(p, &p->kdtreeroot);
           if(!p->cp.quiet)
             gal_timing_report(&t1, "Internal k-d tree constructed.", 1);
         }
@@ -643,10 +691,17 @@ match_catalog_kdtree(struct matchparams *p, size_t *nummatched)
           gettimeofday(&t1, NULL);
           printf("  - Match using the k-d tree ...\n");
         }
-      out = gal_match_kdtree(p->cols1, p->cols2, p->kdtreedata,
-                             p->kdtreeroot, p->aperture->array,
-                             p->cp.numthreads, p->cp.minmapsize,
-                             p->cp.quietmmap, nummatched);
+      out = ( (p->allmatches || p->nearest)
+              ? gal_match_kdtree_neighbours(p->cols1, p->cols2,
+                                            p->kdtreedata, p->kdtreeroot,
+                                            p->aperture->array, p->nearest,
+                                            p->cp.numthreads,
+                                            p->cp.minmapsize,
+                                            p->cp.quietmmap, nummatched)
+              : gal_match_kdtree(p->cols1, p->cols2, p->kdtreedata,
+                                 p->kdtreeroot, p->aperture->array,
+                                 p->cp.numthreads, p->cp.minmapsize,
+                                 p->cp.quietmmap, nummatched) );
       if(!p->cp.quiet)
         {
           if( asprintf(&msg, "... %zu matches found, done!",
@@ -709,6 +764,43 @@ match_catalog_sort_based(struct matchparams *p, size_t *nummatched)
 
 
 
+/* Match on the celestial sphere (RA and Dec in degrees). */
+static gal_data_t *
+match_catalog_sky(struct matchparams *p, size_t *nummatched)
+{
+  char *msg;
+  gal_data_t *mcols;
+  struct timeval t1;
+
+  /* Let the user know that the matching has started. */
+  if(!p->cp.quiet)
+    {
+      gettimeofday(&t1, NULL);
+      printf("  - Matching on the celestial sphere ...\n");
+    }
+
+  /* Do the matching. */
+  mcols=gal_match_sky(p->cols1, p->cols2, p->aperture->array,
+                      p->cp.numthreads, p->cp.minmapsize,
+                      p->cp.quietmmap, nummatched);
+
+  /* Let the user know that it finished. */
+  if(!p->cp.quiet)
+    {
+      if( asprintf(&msg, "... %zu matches found, done!", *nummatched)<0 )
+        error(EXIT_FAILURE, errno, "asprintf allocation");
+      gal_timing_report(&t1, msg, 1);
+      free(msg);
+    }
+
+  /* Return the permutations. */
+  return mcols;
+}
+
+
+
+
+
 static void
 match_catalog(struct matchparams *p)
 {
@@ -718,7 +810,9 @@ match_catalog(struct matchparams *p)
   size_t nummatched, *acolmatch=NULL, *bcolmatch=NULL;
 
   /* If we want to use kd-tree for matching. */
-  if(p->kdtreemode!=MATCH_KDTREE_DISABLE)
+  if(p->kdtreemode==MATCH_KDTREE_SKY)
+    mcols=match_catalog_sky(p, &nummatched);
+  else if(p->kdtreemode!=MATCH_KDTREE_DISABLE)
     {
       /* The main processing function. */
       mcols=match_catalog_kdtree(p, &nummatched);
@@ -29,6 +29,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 
 #include <gnuastro/fits.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/threads.h>
 
 #include <gnuastro-internal/timing.h>
@@ -225,14 +226,29 @@ ui_check_only_options(struct matchparams *p)
     if(      !strcmp(p->kdtree,"build")    ) p->kdtreemode=MATCH_KDTREE_BUILD;
     else if( !strcmp(p->kdtree,"internal") ) p->kdtreemode=MATCH_KDTREE_INTERNAL;
     else if( !strcmp(p->kdtree,"disable")  ) p->kdtreemode=MATCH_KDTREE_DISABLE;
+    else if( !strcmp(p->kdtree,"sky")      ) p->kdtreemode=MATCH_KDTREE_SKY;
     else if( gal_fits_name_is_fits(p->kdtree) ) p->kdtreemode=MATCH_KDTREE_FILE;
     else
       error(EXIT_FAILURE, 0, "'%s' is not valid for '--kdtree'. The "
             "following values are accepted: 'build' (to build the k-d tree in "
             "the file given to '--output'), 'internal' (to force internal "
             "usage of a k-d tree for the matching), 'disable' (to not use a "
-            "k-d tree at all), a FITS file name (the file to read a created "
-            "k-d tree from)", p->kdtree);
+            "k-d tree at all), 'sky' (to match RA and Dec on the celestial "
+            "sphere without a k-d tree), a FITS file name (the file to read "
+            "a created k-d tree from)", p->kdtree);
+
+    /* Set the layout of the k-d tree (when it is built). */
+    if(      !strcmp(p->kdtreelayout,"leftright") )
+      p->kdtreelayid=GAL_KDTREE_LAYOUT_LEFTRIGHT;
+    else if( !strcmp(p->kdtreelayout,"implicit")  )
+      p->kdtreelayid=GAL_KDTREE_LAYOUT_IMPLICIT;
+    else
+      error(EXIT_FAILURE, 0, "'%s' is not valid for '--kdtreelayout'. "
+            "The following values are accepted: 'leftright' (two 32-bit "
+            "columns with the index of the left and right child of each "
+            "row) and 'implicit' (one 64-bit column with the rows in the "
+            "order of a balanced tree; faster and without a limit on "
+            "the number of rows)", p->kdtreelayout);
 
     /* Make sure that the k-d tree build mode is not called with
        '--outcols'. */
@@ -254,6 +270,26 @@ ui_check_only_options(struct matchparams *p)
             "you can use the 'astfits %s' command to see the full list",
             p->kdtree);
   }
+
+  /* Checks for the options that return more than one match per row. */
+  if(p->allmatches || p->nearest)
+    {
+      if(p->allmatches && p->nearest)
+        error(EXIT_FAILURE, 0, "the '--allmatches' and '--nearest' "
+              "options cannot be called together. With '--allmatches' "
+              "all the matches within the aperture are returned, while "
+              "'--nearest' only returns the given number of nearest "
+              "matches within the aperture");
+      if(p->notmatched)
+        error(EXIT_FAILURE, 0, "the '--notmatched' option cannot be "
+              "called with '--allmatches' or '--nearest'");
+      if( p->kdtreemode!=MATCH_KDTREE_INTERNAL
+          && p->kdtreemode!=MATCH_KDTREE_FILE )
+        error(EXIT_FAILURE, 0, "the '--allmatches' and '--nearest' "
+              "options need a k-d tree for the matching, so they can "
+              "only be used when '--kdtree' is 'internal' or a FITS "
+              "file");
+    }
 }
 
 
@@ -656,6 +692,12 @@ ui_set_columns_sanity_check_read_aperture(struct matchparams *p)
               p->coord ? "coord" : "ccol2", ccol2n);
     }
 
+  /* Matching on the celestial sphere is only for RA and Dec. */
+  if( p->kdtreemode==MATCH_KDTREE_SKY && ccol1n!=2 )
+    error(EXIT_FAILURE, 0, "with '--kdtree=sky', only two coordinates "
+          "(RA and Dec, in degrees) can be matched, but %zu columns were "
+          "given to '--ccol1'", ccol1n);
+
   /* Read/check the aperture values. */
   if(p->aperture)
     switch(ccol1n)
@@ -667,7 +709,14 @@ ui_set_columns_sanity_check_read_aperture(struct matchparams *p)
                 p->aperture->size);
         break;
 
-      case 2: ui_read_columns_aperture_2d(p); break;
+      case 2:
+        ui_read_columns_aperture_2d(p);
+        if( p->kdtreemode==MATCH_KDTREE_SKY
+            && ((double *)(p->aperture->array))[1]!=1.0 )
+          error(EXIT_FAILURE, 0, "with '--kdtree=sky', only circular "
+                "apertures are currently supported: please give a "
+                "single value (the radius in degrees) to '--aperture'");
+        break;
       case 3: ui_read_columns_aperture_3d(p); break;
       default:
         error(EXIT_FAILURE, 0, "%zu dimensional matches are not currently "
@@ -806,20 +855,16 @@ ui_read_kdtree(struct matchparams *p)
                                p->cp.numthreads, p->cp.minmapsize,
                                p->cp.quietmmap, NULL, "--kdtreehdu");
 
-  /* It has to have only two columns, with an unsigned 32-bit integer
-     type in each. */
-  if( gal_list_data_number(p->kdtreedata)!=2 )
-    error(EXIT_FAILURE, 0, "%s (hdu: %s, that was given to "
-          "'--kdtree') has %zu column(s), but should contain 2 "
-          "columns. " UI_READ_KDTREE_FIXED_MSG,
-          p->kdtree, p->kdtreehdu, gal_list_data_number(p->kdtreedata),
-          p->input1name, p->cp.hdu, strarr1[0], strarr1[1]);
-  if( p->kdtreedata->type!=GAL_TYPE_UINT32
-      || p->kdtreedata->next->type!=GAL_TYPE_UINT32 )
+  /* It has to have either two columns with an unsigned 32-bit integer
+     type (left/right layout), or one signed 64-bit integer column
+     (implicit layout). */
+  if( gal_kdtree_layout(p->kdtreedata)==GAL_KDTREE_LAYOUT_INVALID )
     error(EXIT_FAILURE, 0, "%s (hdu: %s, that was given to "
-          "'--kdtree') doesn't have unsigned 32-bit integer columns. "
-          UI_READ_KDTREE_FIXED_MSG, p->kdtree, p->kdtreehdu,
-          p->input1name, p->cp.hdu, strarr1[0], strarr1[1]);
+          "'--kdtree') should either have two unsigned 32-bit integer "
+          "columns (left/right layout), or one signed 64-bit integer "
+          "column (implicit layout). " UI_READ_KDTREE_FIXED_MSG,
+          p->kdtree, p->kdtreehdu, p->input1name, p->cp.hdu,
+          strarr1[0], strarr1[1]);
   if( p->kdtreedata->size!=p->cols1->size )
     error(EXIT_FAILURE, 0, "%s (hdu: %s, that was given to "
           "'--kdtree') doesn't have the same number of rows as "
@@ -896,6 +941,7 @@ ui_read_columns(struct matchparams *p)
   if( !p->cp.quiet
       && p->kdtreemode!=MATCH_KDTREE_BUILD
       && p->kdtreemode!=MATCH_KDTREE_DISABLE
+      && p->kdtreemode!=MATCH_KDTREE_SKY
       && p->cols1->size > (2*p->cols2->size) )
     error(EXIT_SUCCESS, 0, "TIP: the matching speed will GREATLY IMPROVE "
           "if you swap the two inputs. Currently the second input has "
@@ -1235,7 +1281,10 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct matchparams *p)
              ( p->kdtreemode==MATCH_KDTREE_DISABLE
                ? " (sort-based match only uses a single thread)" : ""));
       printf("  - Match algorithm: %s\n",
-             p->kdtree ? "k-d tree" : "sort-based");
+             ( p->kdtreemode==MATCH_KDTREE_SKY
+               ? "celestial sphere (declination zones)"
+               : ( p->kdtreemode==MATCH_KDTREE_DISABLE
+                   ? "sort-based" : "k-d tree" ) ));
       printf("  - Input-1: %s; %zu rows\n",
              gal_fits_name_save_as_string(p->input1name, p->cp.hdu),
              p->cols1->size);
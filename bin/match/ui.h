@@ -59,6 +59,9 @@ enum option_keys_enum
   UI_KEY_NOTMATCHED      = 1000,
   UI_KEY_OUTCOLS,
   UI_KEY_KDTREEHDU,
+  UI_KEY_KDTREELAYOUT,
+  UI_KEY_ALLMATCHES,
+  UI_KEY_NEAREST,
 };
 
 
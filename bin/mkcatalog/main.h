@@ -288,6 +288,8 @@ struct mkcatalogparams
   gal_data_t             *sky;  /* Sky.                                 */
   gal_data_t             *std;  /* Sky standard deviation.              */
   gal_data_t          *upmask;  /* Upper limit magnitude mask.          */
+  gal_data_t        *upcumbad;  /* Cumulative num. of unusable pixels.  */
+  gal_data_t       *objindexs;  /* Offsets and indexs of all objects.   */
   float                medstd;  /* Median standard deviation value.     */
   float               cpscorr;  /* Counts-per-second correction.        */
   int32_t            *outlabs;  /* Labels in output cat (when necessary)*/
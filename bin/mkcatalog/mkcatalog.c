@@ -35,6 +35,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/wcs.h>
 #include <gnuastro/data.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/list.h>
+#include <gnuastro/label.h>
 #include <gnuastro/units.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
@@ -122,6 +124,16 @@ mkcatalog_single_object_init(struct mkcatalogparams *p,
                                              OCOL_NUMCOLS, 0, __func__,
                                              "pp->oi");
 
+  /* The buffers to keep the pixels of each object are allocated when the
+     first object is parsed ('pixind' will point to the compact index of
+     all objects, see 'parse_gather'). */
+  pp->pixsize         = 0;
+  pp->pixind          = NULL;
+  pp->pixv            = NULL;
+  pp->pixc            = NULL;
+  pp->pixsky          = NULL;
+  pp->pixstd          = NULL;
+
   /* If we have second order measurements, allocate the array keeping the
      temporary shift values for each object of this thread. Note that the
      clumps catalog (if requested), will have the same measurements, so its
@@ -204,24 +216,25 @@ mkcatalog_single_object(void *in_prm)
   /* Initialize and allocate all the necessary values. */
   mkcatalog_single_object_init(p, &pp);
 
-  /* Fill the desired columns for all the objects given to this thread. */
-  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+  /* Fill the desired columns for all the objects. The objects can have
+     very different sizes, so they are distributed dynamically between
+     the threads (largest first). */
+  while( (i=gal_threads_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* For easy reading. Note that the object IDs start from one while
          the array positions start from 0. */
       pp.ci       = NULL;
-      pp.object   = ( p->outlabs
-                      ? p->outlabs[ tprm->indexs[i] ]
-                      : tprm->indexs[i] + 1 );
-      pp.tile     = &p->tiles[   tprm->indexs[i] ];
+      pp.object   = p->outlabs ? p->outlabs[ i ] : i + 1;
+      pp.tile     = &p->tiles[ i ];
 
-      /* Initialize the parameters for this object/tile. */
+      /* Initialize the parameters for this object/tile and put the
+         pixels of this object into the buffers of 'pp'. */
       parse_initialize(&pp);
 
-      /* Get the first pass information. */
+      /* Get the measurements over the whole object. */
       parse_objects(&pp);
 
-      /* Currently the second pass is only necessary when there is a clumps
+      /* The clump measurements are only necessary when there is a clumps
          image. */
       if(p->clumps)
         {
@@ -235,12 +248,12 @@ mkcatalog_single_object(void *in_prm)
              number generator seeds of each clump. */
           mkcatalog_clump_starting_index(&pp);
 
-          /* Get the second pass information. */
+          /* Get the measurements over the clumps. */
           parse_clumps(&pp);
         }
 
-      /* If an order-based calculation is requested, another pass is
-         necessary. */
+      /* If an order-based calculation is requested, the values need to be
+         sorted. */
       if(    p->oiflag[ OCOL_MEDIAN        ]
           || p->oiflag[ OCOL_MAXIMUM       ]
           || p->oiflag[ OCOL_HALFMAXSUM    ]
@@ -267,6 +280,10 @@ mkcatalog_single_object(void *in_prm)
   /* Clean up. */
   free(pp.oi);
   free(pp.shift);
+  free(pp.pixv);
+  free(pp.pixc);
+  free(pp.pixsky);
+  free(pp.pixstd);
   gal_data_free(pp.up_vals);
   if(pp.rng) gsl_rng_free(pp.rng);
   gal_data_array_free(pp.vector, VEC_NUM, 1);
@@ -792,14 +809,45 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
 void
 mkcatalog(struct mkcatalogparams *p)
 {
+  size_t i, lab, *costs, *offsets;
+
   /* When more than one thread is to be used, initialize the mutex: we need
      it to assign a column to the clumps in the final catalog. */
   if( p->cp.numthreads > 1 ) pthread_mutex_init(&p->mutex, NULL);
 
+  /* Prepare the (read-only) information that is necessary for the
+     upper-limit measurements on all threads. */
+  if(p->upperlimit) upperlimit_prepare(p);
+
+  /* Find the indexs of the pixels of all the objects in one pass over the
+     labeled image (they will be in one array, with the offsets of each
+     label in 'p->objindexs' and the indexs in 'p->objindexs->next'). When
+     some labels are not in the output, the largest label is the last
+     one of 'p->outlabs'. */
+  p->objindexs=gal_label_indexs_compact(p->objects,
+                                        ( p->outlabs && p->numobjects
+                                          ? p->outlabs[p->numobjects-1]
+                                          : p->numobjects ),
+                                        p->cp.numthreads, p->cp.minmapsize,
+                                        p->cp.quietmmap);
+  offsets=p->objindexs->array;
+
+  /* The cost of each object is estimated by its number of pixels. */
+  costs=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->numobjects ?
+                             p->numobjects : 1, 0, __func__, "costs");
+  for(i=0;i<p->numobjects;++i)
+    {
+      lab = p->outlabs ? p->outlabs[i] : i+1;
+      costs[i]=offsets[lab+1]-offsets[lab];
+    }
+
   /* Do the processing on each thread. */
-  gal_threads_spin_off(mkcatalog_single_object, p, p->numobjects,
-                       p->cp.numthreads, p->cp.minmapsize,
-                       p->cp.quietmmap);
+  gal_threads_spin_off_costs(mkcatalog_single_object, p, p->numobjects,
+                             p->cp.numthreads, p->cp.minmapsize,
+                             p->cp.quietmmap, costs);
+  gal_list_data_free(p->objindexs);
+  p->objindexs=NULL;
+  free(costs);
 
   /* Post-thread processing, for example to convert image coordinates to RA
      and Dec. */
@@ -42,6 +42,13 @@ struct mkcatalog_passparams
   float             *st_sky;    /* Starting pointer for Sky array.      */
   float             *st_std;    /* Starting pointer for Sky STD array.  */
   size_t   start_end_inc[2];    /* Starting and ending indexs.          */
+  size_t             numpix;    /* Number of pixels in this object.     */
+  size_t            pixsize;    /* Allocated size of the pixel buffers. */
+  size_t            *pixind;    /* Index of each pixel (not allocated).*/
+  float               *pixv;    /* Value of each pixel.                 */
+  int32_t             *pixc;    /* Clump label of each pixel.           */
+  float             *pixsky;    /* Sky value over each pixel.           */
+  float             *pixstd;    /* Sky STD (or variance) of each pixel. */
   size_t             *shift;    /* Shift coordinates.                   */
   gsl_rng              *rng;    /* Random number generator.             */
   size_t    clumpstartindex;    /* Clump starting row in final catalog. */
@@ -48,8 +48,137 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* Allocate the buffers that will keep the pixels of the object. Only the
+   buffers that are necessary for the requested columns are allocated. The
+   objects are given to the threads in order of decreasing area, so the
+   first object of each thread usually needs the largest buffers and they
+   will rarely be re-allocated. */
+static void
+parse_gather_allocate(struct mkcatalog_passparams *pp)
+{
+  struct mkcatalogparams *p=pp->p;
+  uint8_t *oif=p->oiflag, *cif=p->ciflag;
+  size_t size=pp->numpix, f=GAL_TYPE_FLOAT32;
+
+  /* If the current buffers are large enough, don't do anything. */
+  if(size<=pp->pixsize) return;
+
+  /* Free the previous buffers (the contents are not needed). */
+  free(pp->pixv);
+  free(pp->pixc);
+  free(pp->pixsky);
+  free(pp->pixstd);
+
+  /* Allocate the necessary buffers. */
+  pp->pixv   = ( p->values
+                 ? gal_pointer_allocate(f, size, 0, __func__, "pp->pixv")
+                 : NULL );
+  pp->pixc   = ( p->clumps
+                 ? gal_pointer_allocate(GAL_TYPE_INT32, size, 0, __func__,
+                                        "pp->pixc")
+                 : NULL );
+  pp->pixsky = ( ( p->sky
+                   && (    oif[ OCOL_SUMSKY ]
+                        || ( p->clumps && cif[ CCOL_SUMSKY ] ) ) )
+                 ? gal_pointer_allocate(f, size, 0, __func__, "pp->pixsky")
+                 : NULL );
+  pp->pixstd = ( ( p->std
+                   && (    oif[ OCOL_SUMVAR  ]
+                        || oif[ OCOL_SUM_VAR ]
+                        || ( p->clumps
+                             && (    cif[ CCOL_SUMVAR      ]
+                                  || cif[ CCOL_SUM_VAR     ]
+                                  || cif[ CCOL_RIV_SUM_VAR ] ) ) ) )
+                 ? gal_pointer_allocate(f, size, 0, __func__, "pp->pixstd")
+                 : NULL );
+  pp->pixsize=size;
+}
+
+
+
+
+
+/* Put the necessary information of each pixel of this object into the
+   contiguous buffers of 'pp'. The indexs of the object's pixels are
+   already within the compact index of all the objects (built once in
+   'mkcatalog'), so 'pp->pixind' just points to the respective part of it
+   and the tile doesn't need to be parsed. All the later passes (over the
+   object or its clumps) will only parse these buffers (not the full tile
+   of every input image). */
+static void
+parse_gather(struct mkcatalog_passparams *pp)
+{
+  struct mkcatalogparams *p=pp->p;
+  size_t ndim=p->objects->ndim, *dsize=p->objects->dsize;
+
+  size_t i, ind, tid=0, *c=NULL;
+  int32_t *clumps=p->clumps?p->clumps->array:NULL;
+  float *values=p->values?p->values->array:NULL;
+  float *std=p->std?p->std->array:NULL, *sky=p->sky?p->sky->array:NULL;
+  size_t *offsets=p->objindexs->array, *indexs=p->objindexs->next->array;
+
+  /* If the Sky or its standard deviation are given on a tile structure,
+     we need the coordinates to find the tile of each pixel. */
+  int fullsky = p->sky && p->sky->size==p->objects->size;
+  int fullstd = p->std && p->std->size==p->objects->size;
+  int tilesky = pp->pixsky && !fullsky && p->sky->size>1;
+  int tilestd = pp->pixstd && !fullstd && p->std->size>1;
+  if(tilesky || tilestd)
+    c=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__, "c");
+
+  /* Set the indexs of this object's pixels and make sure the buffers have
+     enough space. */
+  pp->pixind = indexs + offsets[ pp->object ];
+  pp->numpix = offsets[ pp->object+1 ] - offsets[ pp->object ];
+  parse_gather_allocate(pp);
+
+  /* Go over the pixels of this object. */
+  for(i=0;i<pp->numpix;++i)
+    {
+      /* Index and value. */
+      ind=pp->pixind[i];
+      if(pp->pixv) pp->pixv[i] = values[ind];
+
+      /* Clump label. The number of clumps in this object is the largest
+         clump ID over it. */
+      if(pp->pixc)
+        {
+          pp->pixc[i] = clumps[ind];
+          if( clumps[ind]>0 )
+            pp->clumpsinobj = ( clumps[ind] > pp->clumpsinobj
+                                ? clumps[ind] : pp->clumpsinobj );
+        }
+
+      /* ID of the tile that this pixel belongs to. */
+      if(c)
+        {
+          gal_dimension_index_to_coord(ind, ndim, dsize, c);
+          tid=gal_tile_full_id_from_coord(&p->cp.tl, c);
+        }
+
+      /* Sky and its standard deviation. */
+      if(pp->pixsky)
+        pp->pixsky[i] = ( fullsky
+                          ? sky[ind]                           /* Full. */
+                          : ( tilesky ? sky[tid]               /* Tile. */
+                                      : sky[0] ) );        /* 1 value. */
+      if(pp->pixstd)
+        pp->pixstd[i] = ( fullstd
+                          ? std[ind]
+                          : ( tilestd ? std[tid] : std[0] ) );
+    }
+
+  /* Clean up. */
+  if(c) free(c);
+}
+
+
+
+
+
 /* Both passes are going to need their starting pointers set, so we'll do
-   that here. */
+   that here. After this function, the pixels of the object are in the
+   buffers of 'pp' (see 'parse_gather'). */
 void
 parse_initialize(struct mkcatalog_passparams *pp)
 {
@@ -110,6 +239,9 @@ parse_initialize(struct mkcatalog_passparams *pp)
                      ? (float *)(p->std->array) + start_end[0]
                      : NULL )
                  : NULL );
+
+  /* Put the pixels of this object into the buffers. */
+  parse_gather(pp);
 }
 
 
@@ -325,17 +457,11 @@ parse_objects(struct mkcatalog_passparams *pp)
   double *oi=pp->oi;
   gal_data_t *xybin=NULL;
   size_t *tsize=pp->tile->dsize;
+  size_t i, d, tc[3], pind=0;
+  float *V=NULL, var, sval, varval, skyval;
   uint8_t *u, *uf, goodvalue, *xybinarr=NULL;
   double minima_v=FLT_MAX, maxima_v=-FLT_MAX;
-  size_t d, pind=0, increment=0, num_increment=1;
-  int32_t *O, *OO, *C=NULL, *objarr=p->objects->array;
-  float var, sval, varval, skyval, *V=NULL, *SK=NULL, *ST=NULL;
-  float *std=p->std?p->std->array:NULL, *sky=p->sky?p->sky->array:NULL;
-
-  /* If tile processing isn't necessary, set 'tid' to a blank value. */
-  size_t tid = ( ( (p->sky     && p->sky->size>1 && pp->st_sky == NULL )
-                   || ( p->std && p->std->size>1 && pp->st_std == NULL ) )
-                 ? 0 : GAL_BLANK_SIZE_T );
+  int32_t *C=NULL;
 
   /* Coordinate shift. */
   size_t *sc = ( pp->shift
@@ -363,17 +489,15 @@ parse_objects(struct mkcatalog_passparams *pp)
                  || oif[ OCOL_MAXVZ   ]
                  || oif[ OCOL_MINVNUM ]
                  || oif[ OCOL_MAXVNUM ]
-                 || sc
-                 /* When the sky and its STD are tiles, we'll also need
-                    the coordinate to find which tile a pixel belongs
-                    to. */
-                 || tid==GAL_BLANK_SIZE_T )
+                 || sc )
                ? gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
                                       "c")
                : NULL );
 
   /* If any of the projection measurements are necessary, we need to
-     allocate an array to keep the projected space. */
+     allocate an array to keep the projected space. The position of each
+     pixel in the projection is found from its coordinates, so we also
+     need the coordinates of the tile's first pixel. */
   if(    oif[ OCOL_NUMALLXY           ]
       || oif[ OCOL_NUMXY              ]
       || oif[ OCOL_SUMPROJINSLICE     ]
@@ -388,240 +512,205 @@ parse_objects(struct mkcatalog_passparams *pp)
                            1, p->cp.minmapsize, p->cp.quietmmap,
                            NULL, NULL, NULL);
       xybinarr=xybin->array;
+      gal_dimension_index_to_coord(pp->start_end_inc[0], ndim, dsize, tc);
+      if(c==NULL)
+        c=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__, "c");
     }
 
-  /* Parse each contiguous patch of memory covered by this object. */
-  while( pp->start_end_inc[0] + increment <= pp->start_end_inc[1] )
+  /* Parse the pixels of this object (that were gathered in
+     'parse_gather'). */
+  for(i=0;i<pp->numpix;++i)
     {
-      /* Set the contiguous range to parse. The pixel-to-pixel counting
-         along the fastest dimension will be done over the 'O' pointer. */
-      if( p->clumps            ) C  = pp->st_c   + increment;
-      if( p->values            ) V  = pp->st_v   + increment;
-      if( p->sky && pp->st_sky ) SK = pp->st_sky + increment;
-      if( p->std && pp->st_std ) ST = pp->st_std + increment;
-      OO = ( O = pp->st_o + increment ) + tsize[ndim-1];
+      /* Pointers to this pixel's value and clump label. */
+      if(pp->pixv) V = pp->pixv + i;
+      if(pp->pixc) C = pp->pixc + i;
 
-      /* Parse the tile. */
-      do
+      /* Convert the index to coordinate and find the position of this
+         pixel in the projection. */
+      if(c)
         {
-          /* If this pixel belongs to the requested object then do the
-             processing.  */
-          if( *O==pp->object )
-            {
-              /* INTERNAL: Get the number of clumps in this object: it is
-                 the largest clump ID over each object. */
-              if( p->clumps && *C>0 )
-                pp->clumpsinobj = *C > pp->clumpsinobj?*C:pp->clumpsinobj;
-
-
-              /* Add to the area of this object. */
-              if(xybin) xybinarr[ pind ]=1;
-              if(oif[ OCOL_NUMALL   ]) oi[ OCOL_NUMALL ]++;
+          gal_dimension_index_to_coord(pp->pixind[i], ndim, dsize, c);
+          if(xybin) pind = (c[1]-tc[1]) * tsize[2] + c[2]-tc[2];
+        }
 
+      /* Add to the area of this object. */
+      if(xybin) xybinarr[ pind ]=1;
+      if(oif[ OCOL_NUMALL   ]) oi[ OCOL_NUMALL ]++;
+      if(p->clumps && *C>0 && oif[ OCOL_C_NUMALL ]) oi[ OCOL_C_NUMALL ]++;
 
-              /* Geometric coordinate measurements. */
-              if(c)
-                {
-                  /* Convert the index to coordinate. */
-                  gal_dimension_index_to_coord(O-objarr, ndim, dsize, c);
-
-                  /* If we need tile-ID, get the tile ID now. */
-                  if(tid!=GAL_BLANK_SIZE_T)
-                    tid=gal_tile_full_id_from_coord(&p->cp.tl, c);
-
-                  /* Do the general geometric (independent of pixel value)
-                     calculations. */
-                  if(oif[ OCOL_GX ]) oi[ OCOL_GX ] += c[ ndim-1 ]+1;
-                  if(oif[ OCOL_GY ]) oi[ OCOL_GY ] += c[ ndim-2 ]+1;
-                  if(oif[ OCOL_GZ ]) oi[ OCOL_GZ ] += c[ ndim-3 ]+1;
-                  if(pp->shift)
-                    {
-                      /* Calculate the shifted coordinates for second order
-                         calculations. The coordinate is incremented
-                         because from now on, the positions are in the FITS
-                         standard (starting from one).  */
-                      for(d=0;d<ndim;++d) sc[d] = c[d] + 1 - pp->shift[d];
-
-                      /* Include the shifted values, note that the second
-                         order moments are never needed independently, they
-                         are used together to find the ellipticity
-                         parameters. */
-                      oi[ OCOL_GXX ] += sc[1] * sc[1];
-                      oi[ OCOL_GYY ] += sc[0] * sc[0];
-                      oi[ OCOL_GXY ] += sc[1] * sc[0];
-                    }
-                  if(p->clumps && *C>0)
-                    {
-                      if(oif[ OCOL_C_NUMALL ]) oi[ OCOL_C_NUMALL ]++;
-                      if(oif[ OCOL_C_GX ]) oi[ OCOL_C_GX ] += c[ndim-1]+1;
-                      if(oif[ OCOL_C_GY ]) oi[ OCOL_C_GY ] += c[ndim-2]+1;
-                      if(oif[ OCOL_C_GZ ]) oi[ OCOL_C_GZ ] += c[ndim-3]+1;
-                    }
-                }
 
+      /* Geometric coordinate measurements. */
+      if(c)
+        {
+          /* Do the general geometric (independent of pixel value)
+             calculations. */
+          if(oif[ OCOL_GX ]) oi[ OCOL_GX ] += c[ ndim-1 ]+1;
+          if(oif[ OCOL_GY ]) oi[ OCOL_GY ] += c[ ndim-2 ]+1;
+          if(oif[ OCOL_GZ ]) oi[ OCOL_GZ ] += c[ ndim-3 ]+1;
+          if(pp->shift)
+            {
+              /* Calculate the shifted coordinates for second order
+                 calculations. The coordinate is incremented because from
+                 now on, the positions are in the FITS standard (starting
+                 from one).  */
+              for(d=0;d<ndim;++d) sc[d] = c[d] + 1 - pp->shift[d];
+
+              /* Include the shifted values, note that the second order
+                 moments are never needed independently, they are used
+                 together to find the ellipticity parameters. */
+              oi[ OCOL_GXX ] += sc[1] * sc[1];
+              oi[ OCOL_GYY ] += sc[0] * sc[0];
+              oi[ OCOL_GXY ] += sc[1] * sc[0];
+            }
+          if(p->clumps && *C>0)
+            {
+              if(oif[ OCOL_C_GX ]) oi[ OCOL_C_GX ] += c[ndim-1]+1;
+              if(oif[ OCOL_C_GY ]) oi[ OCOL_C_GY ] += c[ndim-2]+1;
+              if(oif[ OCOL_C_GZ ]) oi[ OCOL_C_GZ ] += c[ndim-3]+1;
+            }
+        }
 
-              /* Value related measurements. */
-              goodvalue=0;
-              if( p->values && !( p->hasblank && isnan(*V) ) )
-                {
-                  /* For the standard-deviation measurements later. */
-                  goodvalue=1;
 
-                  /* General flux summations. */
-                  if(xybin) xybinarr[ pind ]=2;
-                  if(oif[ OCOL_NUM ])   oi[ OCOL_NUM   ]++;
-                  if(oif[ OCOL_SUM ])   oi[ OCOL_SUM   ] += *V;
-                  if(oif[ OCOL_SUMP2 ]) oi[ OCOL_SUMP2 ] += *V * *V;
+      /* Value related measurements. */
+      goodvalue=0;
+      if( p->values && !( p->hasblank && isnan(*V) ) )
+        {
+          /* For the standard-deviation measurements later. */
+          goodvalue=1;
 
-                  /* Get the necessary clump information. */
-                  if(p->clumps && *C>0)
-                    {
-                      if(oif[ OCOL_C_NUM ]) oi[ OCOL_C_NUM ]++;
-                      if(oif[ OCOL_C_SUM ]) oi[ OCOL_C_SUM ] += *V;
-                    }
+          /* General flux summations. */
+          if(xybin) xybinarr[ pind ]=2;
+          if(oif[ OCOL_NUM ])   oi[ OCOL_NUM   ]++;
+          if(oif[ OCOL_SUM ])   oi[ OCOL_SUM   ] += *V;
+          if(oif[ OCOL_SUMP2 ]) oi[ OCOL_SUMP2 ] += *V * *V;
 
-                  /* Get the extrema of the values. Note that if the minima
-                     or maxima value's coordinates are requested in any
-                     dimension, then 'OCOL_MINVNUM' or 'OCOL_MAXVNUM' will
-                     be activated). */
-                  if( oif[ OCOL_MINVNUM ] && *V<=minima_v )
-                    {
-                      /* If the value is smaller than the smallest found so
-                         far, reset the counter to one, and reset the sum
-                         of positions this one's position. */
-                      if( *V<minima_v )
-                        {
-                          minima_v = *V;
-                          oi[ OCOL_MINVNUM ]=1;
-                          if(oif[OCOL_MINVX])oi[OCOL_MINVX]=c[ndim-1]+1;
-                          if(oif[OCOL_MINVY])oi[OCOL_MINVY]=c[ndim-2]+1;
-                          if(oif[OCOL_MINVZ])oi[OCOL_MINVZ]=c[ndim-3]+1;
-                        }
-                      else
-                        {
-                          oi[ OCOL_MINVNUM ]++;
-                          if(oif[OCOL_MINVX])oi[OCOL_MINVX]+=c[ndim-1]+1;
-                          if(oif[OCOL_MINVY])oi[OCOL_MINVY]+=c[ndim-2]+1;
-                          if(oif[OCOL_MINVZ])oi[OCOL_MINVZ]+=c[ndim-3]+1;
-                        }
-                    }
-                  if( oif[ OCOL_MAXVNUM ] && *V>=maxima_v )
-                    {
-                      if( *V>maxima_v )
-                        {
-                          maxima_v = *V;
-                          oi[ OCOL_MAXVNUM ]=1;
-                          if(oif[OCOL_MAXVX])oi[OCOL_MAXVX]=c[ndim-1]+1;
-                          if(oif[OCOL_MAXVY])oi[OCOL_MAXVY]=c[ndim-2]+1;
-                          if(oif[OCOL_MAXVZ])oi[OCOL_MAXVZ]=c[ndim-3]+1;
-                        }
-                      else
-                        {
-                          oi[ OCOL_MAXVNUM ]++;
-                          if(oif[OCOL_MAXVX])oi[OCOL_MAXVX]+=c[ndim-1]+1;
-                          if(oif[OCOL_MAXVY])oi[OCOL_MAXVY]+=c[ndim-2]+1;
-                          if(oif[OCOL_MAXVZ])oi[OCOL_MAXVZ]+=c[ndim-3]+1;
-                        }
-                    }
+          /* Get the necessary clump information. */
+          if(p->clumps && *C>0)
+            {
+              if(oif[ OCOL_C_NUM ]) oi[ OCOL_C_NUM ]++;
+              if(oif[ OCOL_C_SUM ]) oi[ OCOL_C_SUM ] += *V;
+            }
 
-                  /* For flux weighted centers, we can only use positive
-                     values, so do those measurements here. */
-                  if( *V > 0.0f )
-                    {
-                      if(oif[ OCOL_NUMWHT ]) oi[ OCOL_NUMWHT ]++;
-                      if(oif[ OCOL_SUMWHT ]) oi[ OCOL_SUMWHT ] += *V;
-                      if(oif[ OCOL_VX ]) oi[ OCOL_VX ] += *V*(c[ndim-1]+1);
-                      if(oif[ OCOL_VY ]) oi[ OCOL_VY ] += *V*(c[ndim-2]+1);
-                      if(oif[ OCOL_VZ ]) oi[ OCOL_VZ ] += *V*(c[ndim-3]+1);
-                      if(pp->shift)
-                        {
-                          oi[ OCOL_VXX    ] += *V * sc[1] * sc[1];
-                          oi[ OCOL_VYY    ] += *V * sc[0] * sc[0];
-                          oi[ OCOL_VXY    ] += *V * sc[1] * sc[0];
-                        }
-                      if(p->clumps && *C>0)
-                        {
-                          if(oif[ OCOL_C_NUMWHT ]) oi[ OCOL_C_NUMWHT ]++;
-                          if(oif[ OCOL_C_SUMWHT ]) oi[ OCOL_C_SUMWHT ]+=*V;
-                          if(oif[ OCOL_C_VX ])
-                            oi[   OCOL_C_VX ] += *V * (c[ ndim-1 ]+1);
-                          if(oif[ OCOL_C_VY ])
-                            oi[   OCOL_C_VY ] += *V * (c[ ndim-2 ]+1);
-                          if(oif[ OCOL_C_VZ ])
-                            oi[   OCOL_C_VZ ] += *V * (c[ ndim-3 ]+1);
-                        }
-                    }
+          /* Get the extrema of the values. Note that if the minima or
+             maxima value's coordinates are requested in any dimension,
+             then 'OCOL_MINVNUM' or 'OCOL_MAXVNUM' will be activated). */
+          if( oif[ OCOL_MINVNUM ] && *V<=minima_v )
+            {
+              /* If the value is smaller than the smallest found so far,
+                 reset the counter to one, and reset the sum of positions
+                 this one's position. */
+              if( *V<minima_v )
+                {
+                  minima_v = *V;
+                  oi[ OCOL_MINVNUM ]=1;
+                  if(oif[OCOL_MINVX])oi[OCOL_MINVX]=c[ndim-1]+1;
+                  if(oif[OCOL_MINVY])oi[OCOL_MINVY]=c[ndim-2]+1;
+                  if(oif[OCOL_MINVZ])oi[OCOL_MINVZ]=c[ndim-3]+1;
                 }
-
-
-              /* Sky value based measurements. */
-              if(p->sky && oif[ OCOL_SUMSKY ])
+              else
                 {
-                  skyval = ( pp->st_sky
-                             ? (isnan(*SK)?0:*SK)        /* Full array  */
-                             : ( p->sky->size>1
-                                 ? (isnan(sky[tid])?0:sky[tid]) /* Tile */
-                                 : sky[0] ) );           /* Single value*/
-                  if(!isnan(skyval))
-                    {
-                      oi[ OCOL_NUMSKY  ]++;
-                      oi[ OCOL_SUMSKY  ] += skyval;
-                    }
+                  oi[ OCOL_MINVNUM ]++;
+                  if(oif[OCOL_MINVX])oi[OCOL_MINVX]+=c[ndim-1]+1;
+                  if(oif[OCOL_MINVY])oi[OCOL_MINVY]+=c[ndim-2]+1;
+                  if(oif[OCOL_MINVZ])oi[OCOL_MINVZ]+=c[ndim-3]+1;
                 }
-
-
-              /* Sky standard deviation based measurements.*/
-              if(p->std)
+            }
+          if( oif[ OCOL_MAXVNUM ] && *V>=maxima_v )
+            {
+              if( *V>maxima_v )
                 {
-                  /* Calculate the variance and save it in the output if
-                     necessary. */
-                  sval=pp->st_std ? *ST : (p->std->size>1?std[tid]:std[0]);
-                  var = p->variance ? sval : sval*sval;
-                  if(oif[ OCOL_SUMVAR ] && (!isnan(var)))
-                    {
-                      oi[ OCOL_NUMVAR  ]++;
-                      oi[ OCOL_SUMVAR  ] += var;
-                    }
+                  maxima_v = *V;
+                  oi[ OCOL_MAXVNUM ]=1;
+                  if(oif[OCOL_MAXVX])oi[OCOL_MAXVX]=c[ndim-1]+1;
+                  if(oif[OCOL_MAXVY])oi[OCOL_MAXVY]=c[ndim-2]+1;
+                  if(oif[OCOL_MAXVZ])oi[OCOL_MAXVZ]=c[ndim-3]+1;
+                }
+              else
+                {
+                  oi[ OCOL_MAXVNUM ]++;
+                  if(oif[OCOL_MAXVX])oi[OCOL_MAXVX]+=c[ndim-1]+1;
+                  if(oif[OCOL_MAXVY])oi[OCOL_MAXVY]+=c[ndim-2]+1;
+                  if(oif[OCOL_MAXVZ])oi[OCOL_MAXVZ]+=c[ndim-3]+1;
+                }
+            }
 
-                  /* For each pixel, we have a sky contribution to the
-                     counts and the signal's contribution. The standard
-                     deviation in the sky is simply 'sval', but the
-                     standard deviation of the signal (independent of the
-                     sky) is 'sqrt(*V)'. Therefore the total variance of
-                     this pixel is the variance of the sky added with the
-                     absolute value of its sky-subtracted flux. We use the
-                     absolute value, because especially as the signal gets
-                     noisy there will be negative values, and we don't want
-                     them to decrease the variance. */
-                  if(oif[ OCOL_SUM_VAR ] && goodvalue)
-                    {
-                      varval=p->variance ? var : sval;
-                      if(!isnan(varval))
-                        {
-                          oi[ OCOL_SUM_VAR_NUM  ]++;
-                          oi[ OCOL_SUM_VAR      ] += varval + fabs(*V);
-                        }
-                    }
+          /* For flux weighted centers, we can only use positive values,
+             so do those measurements here. */
+          if( *V > 0.0f )
+            {
+              if(oif[ OCOL_NUMWHT ]) oi[ OCOL_NUMWHT ]++;
+              if(oif[ OCOL_SUMWHT ]) oi[ OCOL_SUMWHT ] += *V;
+              if(oif[ OCOL_VX ]) oi[ OCOL_VX ] += *V*(c[ndim-1]+1);
+              if(oif[ OCOL_VY ]) oi[ OCOL_VY ] += *V*(c[ndim-2]+1);
+              if(oif[ OCOL_VZ ]) oi[ OCOL_VZ ] += *V*(c[ndim-3]+1);
+              if(pp->shift)
+                {
+                  oi[ OCOL_VXX    ] += *V * sc[1] * sc[1];
+                  oi[ OCOL_VYY    ] += *V * sc[0] * sc[0];
+                  oi[ OCOL_VXY    ] += *V * sc[1] * sc[0];
+                }
+              if(p->clumps && *C>0)
+                {
+                  if(oif[ OCOL_C_NUMWHT ]) oi[ OCOL_C_NUMWHT ]++;
+                  if(oif[ OCOL_C_SUMWHT ]) oi[ OCOL_C_SUMWHT ]+=*V;
+                  if(oif[ OCOL_C_VX ])
+                    oi[   OCOL_C_VX ] += *V * (c[ ndim-1 ]+1);
+                  if(oif[ OCOL_C_VY ])
+                    oi[   OCOL_C_VY ] += *V * (c[ ndim-2 ]+1);
+                  if(oif[ OCOL_C_VZ ])
+                    oi[   OCOL_C_VZ ] += *V * (c[ ndim-3 ]+1);
                 }
             }
+        }
 
-          /* Increment the other pointers. */
-          if( xybin                ) ++pind;
-          if( p->values            ) ++V;
-          if( p->clumps            ) ++C;
-          if( p->sky && pp->st_sky ) ++SK;
-          if( p->std && pp->st_std ) ++ST;
+
+      /* Sky value based measurements. When the Sky is not a single value,
+         blank Sky values are counted as zero. */
+      if(pp->pixsky && oif[ OCOL_SUMSKY ])
+        {
+          skyval = pp->pixsky[i];
+          if( (pp->st_sky || p->sky->size>1) && isnan(skyval) )
+            skyval=0;
+          if(!isnan(skyval))
+            {
+              oi[ OCOL_NUMSKY  ]++;
+              oi[ OCOL_SUMSKY  ] += skyval;
+            }
         }
-      while(++O<OO);
 
-      /* Increment to the next contiguous region of this tile. */
-      increment += ( gal_tile_block_increment(p->objects, tsize,
-                                              num_increment++, NULL) );
 
-      /* If a 2D projection is requested, see if we should initialize (set
-         to zero) the projection-index ('pind') not. */
-      if(xybin && (num_increment-1)%tsize[1]==0 )
-        pind=0;
+      /* Sky standard deviation based measurements.*/
+      if(pp->pixstd)
+        {
+          /* Calculate the variance and save it in the output if
+             necessary. */
+          sval = pp->pixstd[i];
+          var = p->variance ? sval : sval*sval;
+          if(oif[ OCOL_SUMVAR ] && (!isnan(var)))
+            {
+              oi[ OCOL_NUMVAR  ]++;
+              oi[ OCOL_SUMVAR  ] += var;
+            }
+
+          /* For each pixel, we have a sky contribution to the counts and
+             the signal's contribution. The standard deviation in the sky
+             is simply 'sval', but the standard deviation of the signal
+             (independent of the sky) is 'sqrt(*V)'. Therefore the total
+             variance of this pixel is the variance of the sky added with
+             the absolute value of its sky-subtracted flux. We use the
+             absolute value, because especially as the signal gets noisy
+             there will be negative values, and we don't want them to
+             decrease the variance. */
+          if(oif[ OCOL_SUM_VAR ] && goodvalue)
+            {
+              varval=p->variance ? var : sval;
+              if(!isnan(varval))
+                {
+                  oi[ OCOL_SUM_VAR_NUM  ]++;
+                  oi[ OCOL_SUM_VAR      ] += varval + fabs(*V);
+                }
+            }
+        }
     }
 
   /* Write the projected area columns. */
@@ -724,21 +813,15 @@ parse_clumps(struct mkcatalog_passparams *pp)
   size_t ndim=p->objects->ndim, *dsize=p->objects->dsize;
 
   double *ci, *cir;
+  int32_t *C, nlab;
   gal_data_t *xybin=NULL;
-  int32_t *O, *OO, *C=NULL, nlab;
-  size_t cind, *tsize=pp->tile->dsize;
+  size_t cind, tc[3], *tsize=pp->tile->dsize;
   double *minima_v=NULL, *maxima_v=NULL;
-  uint8_t *u, *uf, goodvalue, *cif=p->ciflag;
+  uint8_t goodvalue, *u, *uf, *cif=p->ciflag;
   size_t nngb=gal_dimension_num_neighbors(ndim);
-  size_t i, ii, d, pind=0, increment=0, num_increment=1;
-  float var, sval, varval, skyval, *V=NULL, *SK=NULL, *ST=NULL;
+  size_t i, ii, d, pix, pind=0;
+  float var, sval, varval, skyval, *V=NULL;
   int32_t *objects=p->objects->array, *clumps=p->clumps->array;
-  float *std=p->std?p->std->array:NULL, *sky=p->sky?p->sky->array:NULL;
-
-  /* If tile processing isn't necessary, set 'tid' to a blank value. */
-  size_t tid = ( ( (p->sky     && p->sky->size>1 && pp->st_sky == NULL )
-                   || ( p->std && p->std->size>1 && pp->st_std == NULL ) )
-                 ? 0 : GAL_BLANK_SIZE_T );
 
   /* Coordinate shift. */
   size_t *sc = ( pp->shift
@@ -767,8 +850,7 @@ parse_clumps(struct mkcatalog_passparams *pp)
                   || cif[ CCOL_MAXVZ ]
                   || cif[ CCOL_MINVNUM ]
                   || cif[ CCOL_MAXVNUM ]
-                  || sc
-                  || tid==GAL_BLANK_SIZE_T )
+                  || sc )
                 ? gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0,
                                        __func__, "c")
                 : NULL );
@@ -783,7 +865,7 @@ parse_clumps(struct mkcatalog_passparams *pp)
   size_t *dinc = ngblabs ? gal_dimension_increment(ndim, dsize) : NULL;
 
   /* If an XY projection area is requested, we'll need to allocate an array
-     to keep the projected space.*/
+     to keep the projected space (see 'parse_objects').*/
   if( cif[    CCOL_NUMALLXY ]
       || cif[ CCOL_NUMXY    ] )
     {
@@ -792,6 +874,9 @@ parse_clumps(struct mkcatalog_passparams *pp)
         gal_data_initialize(&xybin[i], NULL, GAL_TYPE_UINT8, 2, &tsize[1],
                             NULL, 1, p->cp.minmapsize, p->cp.quietmmap,
                             NULL, NULL, NULL);
+      gal_dimension_index_to_coord(pp->start_end_inc[0], ndim, dsize, tc);
+      if(c==NULL)
+        c=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__, "c");
     }
 
   /* For the extrema columns. */
@@ -802,307 +887,240 @@ parse_clumps(struct mkcatalog_passparams *pp)
       || cif[ CCOL_MAXVY   ] || cif[ CCOL_MAXVZ ] )
     maxima_v=parse_init_extrema(cif, GAL_TYPE_FLOAT64, pp->clumpsinobj, 1);
 
-  /* Parse each contiguous patch of memory covered by this object. */
-  while( pp->start_end_inc[0] + increment <= pp->start_end_inc[1] )
+  /* Parse the pixels of this object (that were gathered in
+     'parse_gather'). */
+  for(pix=0;pix<pp->numpix;++pix)
     {
-      /* Set the contiguous range to parse. The pixel-to-pixel counting
-         along the fastest dimension will be done over the 'O' pointer. */
-      C = pp->st_c + increment;
-      if( p->values            ) V  = pp->st_v   + increment;
-      if( p->sky && pp->st_sky ) SK = pp->st_sky + increment;
-      if( p->std && pp->st_std ) ST = pp->st_std + increment;
-      OO = ( O = pp->st_o + increment ) + tsize[ndim-1];
+      /* Pointers to this pixel's value and clump label. */
+      C = pp->pixc + pix;
+      if(pp->pixv) V = pp->pixv + pix;
 
-      /* Parse the tile */
-      do
+      /* We are on a clump. */
+      if(*C>0)
         {
-          /* If this pixel belongs to the requested object then do the
-             processing. */
-          if( *O==pp->object )
+          /* Pointer to make things easier. Note that the clump labels
+             start from 1, but the array indexs from 0.*/
+          cind = *C-1;
+          ci=&pp->ci[ cind * CCOL_NUMCOLS ];
+
+          /* Get "C" the coordinates of this point and its position in the
+             projection. */
+          if(c)
             {
-              /* We are on a clump. */
-              if(p->clumps && *C>0)
+              gal_dimension_index_to_coord(pp->pixind[pix], ndim, dsize, c);
+              if(xybin) pind = (c[1]-tc[1]) * tsize[2] + c[2]-tc[2];
+            }
+
+          /* Add to the area of this object. */
+          if( cif[ CCOL_NUMALL ]
+              || cif[ CCOL_MINX ] || cif[ CCOL_MAXX ]
+              || cif[ CCOL_MINY ] || cif[ CCOL_MAXY ]
+              || cif[ CCOL_MINZ ] || cif[ CCOL_MAXZ ] )
+            ci[ CCOL_NUMALL ]++;
+          if(cif[ CCOL_NUMALLXY ])
+            ((uint8_t *)(xybin[cind].array))[ pind ] = 1;
+
+          /* Raw-position related measurements. */
+          if(c)
+            {
+              /* Position extrema measurements. */
+              if(cif[ CCOL_MINX ]) ci[CCOL_MINX]=CMIN(CCOL_MINX, ndim-1);
+              if(cif[ CCOL_MAXX ]) ci[CCOL_MAXX]=CMAX(CCOL_MAXX, ndim-1);
+              if(cif[ CCOL_MINY ]) ci[CCOL_MINY]=CMIN(CCOL_MINY, ndim-2);
+              if(cif[ CCOL_MAXY ]) ci[CCOL_MAXY]=CMAX(CCOL_MAXY, ndim-2);
+              if(cif[ CCOL_MINZ ]) ci[CCOL_MINZ]=CMIN(CCOL_MINZ, ndim-3);
+              if(cif[ CCOL_MAXZ ]) ci[CCOL_MAXZ]=CMAX(CCOL_MAXZ, ndim-3);
+
+              /* General geometric (independent of pixel value)
+                 calculations. */
+              if(cif[ CCOL_GX ]) ci[ CCOL_GX ] += c[ ndim-1 ]+1;
+              if(cif[ CCOL_GY ]) ci[ CCOL_GY ] += c[ ndim-2 ]+1;
+              if(cif[ CCOL_GZ ]) ci[ CCOL_GZ ] += c[ ndim-3 ]+1;
+              if(pp->shift)
+                {
+                  /* Shifted coordinates for second order moments, see
+                     explanations in 'parse_objects'.*/
+                  for(d=0;d<ndim;++d) sc[d] = c[d]+1-pp->shift[d];
+
+                  /* Raw second-order measurements. */
+                  ci[ CCOL_GXX ] += sc[1] * sc[1];
+                  ci[ CCOL_GYY ] += sc[0] * sc[0];
+                  ci[ CCOL_GXY ] += sc[1] * sc[0];
+                }
+            }
+
+          /* Value related measurements, see 'parse_objects' for
+             comments. */
+          goodvalue=0;
+          if( p->values && !( p->hasblank && isnan(*V) ) )
+            {
+              /* For the standard-deviation measurement. */
+              goodvalue=1;
+
+              /* Fill in the necessary information. */
+              if(cif[ CCOL_NUM   ]) ci[ CCOL_NUM   ]++;
+              if(cif[ CCOL_SUM   ]) ci[ CCOL_SUM   ] += *V;
+              if(cif[ CCOL_SUMP2 ]) ci[ CCOL_SUMP2 ] += *V * *V;
+              if(cif[ CCOL_NUMXY ])
+                ((uint8_t *)(xybin[cind].array))[ pind ] = 2;
+
+              /* Minimum/maximum pixel positions. */
+              if( cif[ CCOL_MINVNUM ] && *V<=minima_v[cind] )
                 {
-                  /* Pointer to make things easier. Note that the clump
-                     labels start from 1, but the array indexs from 0.*/
-                  cind = *C-1;
-                  ci=&pp->ci[ cind * CCOL_NUMCOLS ];
-
-                  /* Add to the area of this object. */
-                  if( cif[ CCOL_NUMALL ]
-                      || cif[ CCOL_MINX ] || cif[ CCOL_MAXX ]
-                      || cif[ CCOL_MINY ] || cif[ CCOL_MAXY ]
-                      || cif[ CCOL_MINZ ] || cif[ CCOL_MAXZ ] )
-                    ci[ CCOL_NUMALL ]++;
-                  if(cif[ CCOL_NUMALLXY ])
-                    ((uint8_t *)(xybin[cind].array))[ pind ] = 1;
-
-                  /* Raw-position related measurements. */
-                  if(c)
+                  if( *V<minima_v[cind] )
                     {
-                      /* Get "C" the coordinates of this point. */
-                      gal_dimension_index_to_coord(O-objects, ndim,
-                                                   dsize, c);
-
-                      /* Position extrema measurements. */
-                      if(cif[ CCOL_MINX ])
-                        ci[CCOL_MINX]=CMIN(CCOL_MINX, ndim-1);
-                      if(cif[ CCOL_MAXX ])
-                        ci[CCOL_MAXX]=CMAX(CCOL_MAXX, ndim-1);
-                      if(cif[ CCOL_MINY ])
-                        ci[CCOL_MINY]=CMIN(CCOL_MINY, ndim-2);
-                      if(cif[ CCOL_MAXY ])
-                        ci[CCOL_MAXY]=CMAX(CCOL_MAXY, ndim-2);
-                      if(cif[ CCOL_MINZ ])
-                        ci[CCOL_MINZ]=CMIN(CCOL_MINZ, ndim-3);
-                      if(cif[ CCOL_MAXZ ])
-                        ci[CCOL_MAXZ]=CMAX(CCOL_MAXZ, ndim-3);
-
-                      /* If we need tile-ID, get the tile ID now. */
-                      if(tid!=GAL_BLANK_SIZE_T)
-                        tid=gal_tile_full_id_from_coord(&p->cp.tl, c);
-
-                      /* General geometric (independent of pixel value)
-                         calculations. */
-                      if(cif[ CCOL_GX ]) ci[ CCOL_GX ] += c[ ndim-1 ]+1;
-                      if(cif[ CCOL_GY ]) ci[ CCOL_GY ] += c[ ndim-2 ]+1;
-                      if(cif[ CCOL_GZ ]) ci[ CCOL_GZ ] += c[ ndim-3 ]+1;
-                      if(pp->shift)
-                        {
-                          /* Shifted coordinates for second order moments,
-                             see explanations in the first pass.*/
-                          for(d=0;d<ndim;++d) sc[d] = c[d]+1-pp->shift[d];
-
-                          /* Raw second-order measurements. */
-                          ci[ CCOL_GXX ] += sc[1] * sc[1];
-                          ci[ CCOL_GYY ] += sc[0] * sc[0];
-                          ci[ CCOL_GXY ] += sc[1] * sc[0];
-                        }
+                      minima_v[cind] = *V;
+                      ci[ CCOL_MINVNUM ]=1;
+                      if(cif[CCOL_MINVX]) ci[ CCOL_MINVX ] = c[ ndim-1 ]+1;
+                      if(cif[CCOL_MINVY]) ci[ CCOL_MINVY ] = c[ ndim-2 ]+1;
+                      if(cif[CCOL_MINVZ]) ci[ CCOL_MINVZ ] = c[ ndim-3 ]+1;
                     }
-
-                  /* Value related measurements, see 'parse_objects' for
-                     comments. */
-                  goodvalue=0;
-                  if( p->values && !( p->hasblank && isnan(*V) ) )
+                  else
                     {
-                      /* For the standard-deviation measurement. */
-                      goodvalue=1;
-
-                      /* Fill in the necessary information. */
-                      if(cif[ CCOL_NUM   ]) ci[ CCOL_NUM   ]++;
-                      if(cif[ CCOL_SUM   ]) ci[ CCOL_SUM   ] += *V;
-                      if(cif[ CCOL_SUMP2 ]) ci[ CCOL_SUMP2 ] += *V * *V;
-                      if(cif[ CCOL_NUMXY ])
-                        ((uint8_t *)(xybin[cind].array))[ pind ] = 2;
-
-                      /* Minimum/maximum pixel positions. */
-                      if( cif[ CCOL_MINVNUM ] && *V<=minima_v[cind] )
-                        {
-                          if( *V<minima_v[cind] )
-                            {
-                              minima_v[cind] = *V;
-                              ci[ CCOL_MINVNUM ]=1;
-                              if(cif[CCOL_MINVX])
-                                ci[ CCOL_MINVX ] = c[ ndim-1 ]+1;
-                              if(cif[CCOL_MINVY])
-                                ci[ CCOL_MINVY ] = c[ ndim-2 ]+1;
-                              if(cif[CCOL_MINVZ])
-                                ci[ CCOL_MINVZ ] = c[ ndim-3 ]+1;
-                            }
-                          else
-                            {
-                              ci[ CCOL_MINVNUM ]++;
-                              if(cif[CCOL_MINVX])
-                                ci[  CCOL_MINVX ] += c[ ndim-1 ]+1;
-                              if(cif[CCOL_MINVY])
-                                ci[  CCOL_MINVY ] += c[ ndim-2 ]+1;
-                              if(cif[CCOL_MINVZ])
-                                ci[  CCOL_MINVZ ] += c[ ndim-3 ]+1;
-                            }
-                        }
-                      if( cif[ CCOL_MAXVNUM ] && *V>=maxima_v[cind] )
-                        {
-                          if( *V>maxima_v[cind] )
-                            {
-                              maxima_v[cind] = *V;
-                              ci[ CCOL_MAXVNUM ]=1;
-                              if(cif[CCOL_MAXVX])
-                                ci[  CCOL_MAXVX ] = c[ ndim-1 ]+1;
-                              if(cif[CCOL_MAXVY])
-                                ci[  CCOL_MAXVY ] = c[ ndim-2 ]+1;
-                              if(cif[CCOL_MAXVZ])
-                                ci[  CCOL_MAXVZ ] = c[ ndim-3 ]+1;
-                            }
-                          else
-                            {
-                              ci[ CCOL_MAXVNUM ]++;
-                              if(cif[CCOL_MAXVX])
-                                ci[  CCOL_MAXVX ] += c[ ndim-1 ]+1;
-                              if(cif[CCOL_MAXVY])
-                                ci[  CCOL_MAXVY ] += c[ ndim-2 ]+1;
-                              if(cif[CCOL_MAXVZ])
-                                ci[  CCOL_MAXVZ ] += c[ ndim-3 ]+1;
-                            }
-                        }
-
-                      /* Columns that need positive values. */
-                      if( *V > 0.0f )
-                        {
-                          if(cif[ CCOL_NUMWHT ]) ci[ CCOL_NUMWHT ]++;
-                          if(cif[ CCOL_SUMWHT ]) ci[ CCOL_SUMWHT ] += *V;
-                          if(cif[ CCOL_VX ])
-                            ci[   CCOL_VX ] += *V * (c[ ndim-1 ]+1);
-                          if(cif[ CCOL_VY ])
-                            ci[   CCOL_VY ] += *V * (c[ ndim-2 ]+1);
-                          if(cif[ CCOL_VZ ])
-                            ci[   CCOL_VZ ] += *V * (c[ ndim-3 ]+1);
-                          if(pp->shift)
-                            {
-                              ci[ CCOL_VXX ] += *V * sc[1] * sc[1];
-                              ci[ CCOL_VYY ] += *V * sc[0] * sc[0];
-                              ci[ CCOL_VXY ] += *V * sc[1] * sc[0];
-                            }
-                        }
+                      ci[ CCOL_MINVNUM ]++;
+                      if(cif[CCOL_MINVX]) ci[ CCOL_MINVX ] += c[ ndim-1 ]+1;
+                      if(cif[CCOL_MINVY]) ci[ CCOL_MINVY ] += c[ ndim-2 ]+1;
+                      if(cif[CCOL_MINVZ]) ci[ CCOL_MINVZ ] += c[ ndim-3 ]+1;
                     }
-
-                  /* Sky based measurements. */
-                  if(p->sky && cif[ CCOL_SUMSKY ])
+                }
+              if( cif[ CCOL_MAXVNUM ] && *V>=maxima_v[cind] )
+                {
+                  if( *V>maxima_v[cind] )
                     {
-                      skyval = ( pp->st_sky
-                                 ? *SK             /* Full. */
-                                 : ( p->sky->size>1
-                                     ? sky[tid]    /* Tile. */
-                                     : sky[0] ) ); /* 1 value. */
-                      if(!isnan(skyval))
-                        {
-                          ci[ CCOL_NUMSKY  ]++;
-                          ci[ CCOL_SUMSKY  ] += skyval;
-                        }
+                      maxima_v[cind] = *V;
+                      ci[ CCOL_MAXVNUM ]=1;
+                      if(cif[CCOL_MAXVX]) ci[ CCOL_MAXVX ] = c[ ndim-1 ]+1;
+                      if(cif[CCOL_MAXVY]) ci[ CCOL_MAXVY ] = c[ ndim-2 ]+1;
+                      if(cif[CCOL_MAXVZ]) ci[ CCOL_MAXVZ ] = c[ ndim-3 ]+1;
                     }
-
-                  /* Sky Standard deviation based measurements, see
-                     'parse_objects' for comments. */
-                  if(p->std)
+                  else
                     {
-                      sval = ( pp->st_std
-                               ? *ST
-                               : (p->std->size>1 ? std[tid] : std[0]) );
-                      var = p->variance ? sval : sval*sval;
-                      if(cif[ CCOL_SUMVAR  ] && (!isnan(var)))
-                        {
-                          ci[ CCOL_NUMVAR ]++;
-                          ci[ CCOL_SUMVAR ] += var;
-                        }
-                      if(cif[ CCOL_SUM_VAR ] && goodvalue)
-                        {
-                          varval=p->variance ? var : sval;
-                          if(!isnan(varval))
-                            {
-                              ci[ CCOL_SUM_VAR_NUM ]++;
-                              ci[ CCOL_SUM_VAR     ] += varval + fabs(*V);
-                            }
-                        }
+                      ci[ CCOL_MAXVNUM ]++;
+                      if(cif[CCOL_MAXVX]) ci[ CCOL_MAXVX ] += c[ ndim-1 ]+1;
+                      if(cif[CCOL_MAXVY]) ci[ CCOL_MAXVY ] += c[ ndim-2 ]+1;
+                      if(cif[CCOL_MAXVZ]) ci[ CCOL_MAXVZ ] += c[ ndim-3 ]+1;
                     }
                 }
 
-              /* This pixel is on the diffuse region (and the object
-                 actually has clumps). If any river-based measurements are
-                 necessary check to see if it is touching a clump or not,
-                 but only if this object actually has any clumps. */
-              else if(ngblabs && pp->clumpsinobj)
+              /* Columns that need positive values. */
+              if( *V > 0.0f )
                 {
-                  /* We are on a diffuse (possibly a river) pixel. So the
-                     value of this pixel has to be added to any of the
-                     clumps in touches. But since it might touch a labeled
-                     region more than once, we use 'ngblabs' to keep track
-                     of which label we have already added its value
-                     to. 'ii' is the number of different labels this river
-                     pixel has already been considered for. 'ngblabs' will
-                     keep the list labels. */
-                  ii=0;
-                  memset(ngblabs, 0, nngb*sizeof *ngblabs);
-
-                  /* Go over the neighbors and see if this pixel is
-                     touching a clump or not. */
-                  GAL_DIMENSION_NEIGHBOR_OP(O-objects, ndim, dsize, ndim,
-                                            dinc,
-                     {
-                       /* Neighbor's label (mainly for easy reading). */
-                       nlab=clumps[nind];
+                  if(cif[ CCOL_NUMWHT ]) ci[ CCOL_NUMWHT ]++;
+                  if(cif[ CCOL_SUMWHT ]) ci[ CCOL_SUMWHT ] += *V;
+                  if(cif[ CCOL_VX ]) ci[ CCOL_VX ] += *V * (c[ ndim-1 ]+1);
+                  if(cif[ CCOL_VY ]) ci[ CCOL_VY ] += *V * (c[ ndim-2 ]+1);
+                  if(cif[ CCOL_VZ ]) ci[ CCOL_VZ ] += *V * (c[ ndim-3 ]+1);
+                  if(pp->shift)
+                    {
+                      ci[ CCOL_VXX ] += *V * sc[1] * sc[1];
+                      ci[ CCOL_VYY ] += *V * sc[0] * sc[0];
+                      ci[ CCOL_VXY ] += *V * sc[1] * sc[0];
+                    }
+                }
+            }
 
-                       /* We only want neighbors that are a clump and part
-                          of this object and part of the same object. */
-                       if( nlab>0 && objects[nind]==pp->object)
-                         {
-                           /* Go over all already checked labels and make
-                              sure this clump hasn't already been
-                              considered. */
-                           for(i=0;i<ii;++i) if(ngblabs[i]==nlab) break;
-
-                           /* It hasn't been considered yet: */
-                           if(i==ii)
-                             {
-                               /* Make sure it won't be considered any
-                                  more. */
-                               ngblabs[ii++] = nlab;
-
-                               /* To help in reading. */
-                               cir=&pp->ci[ (nlab-1) * CCOL_NUMCOLS ];
-
-                               /* Write in the necessary values. */
-                               if(cif[ CCOL_RIV_NUM  ])
-                                 cir[ CCOL_RIV_NUM ]++;
-
-                               /* Total sum of values in river. */
-                               if(cif[ CCOL_RIV_SUM  ])
-                                 cir[ CCOL_RIV_SUM ] += *V;
-
-                               /* Minimum river value. */
-                               if(cif[CCOL_RIV_MIN])
-                                 if(cir[CCOL_RIV_NUM]==1
-                                    || *V < cir[CCOL_RIV_MIN])
-                                   cir[CCOL_RIV_MIN]=*V;
-
-                               /* Maximum river value. */
-                               if(cif[CCOL_RIV_MAX])
-                                 if(cir[CCOL_RIV_NUM]==1
-                                    || *V > cir[CCOL_RIV_MAX])
-                                   cir[CCOL_RIV_MAX]=*V;
-
-                               /* Sum of variances within river. */
-                               if(cif[ CCOL_RIV_SUM_VAR  ])
-                                 {
-                                   sval = ( pp->st_std
-                                            ? *ST
-                                            : ( p->std->size>1
-                                                ? std[tid]
-                                                : std[0] )     );
-                                   cir[ CCOL_RIV_SUM_VAR ] += fabs(*V)
-                                     + (p->variance ? sval : sval*sval);
-                                 }
-                             }
-                         }
-                     });
+          /* Sky based measurements. */
+          if(pp->pixsky && cif[ CCOL_SUMSKY ])
+            {
+              skyval = pp->pixsky[pix];
+              if(!isnan(skyval))
+                {
+                  ci[ CCOL_NUMSKY  ]++;
+                  ci[ CCOL_SUMSKY  ] += skyval;
                 }
             }
 
-          /* Increment the other pointers. */
-          ++C;
-          if( xybin                ) ++pind;
-          if( p->values            ) ++V;
-          if( p->sky && pp->st_sky ) ++SK;
-          if( p->std && pp->st_std ) ++ST;
+          /* Sky Standard deviation based measurements, see
+             'parse_objects' for comments. */
+          if(pp->pixstd)
+            {
+              sval = pp->pixstd[pix];
+              var = p->variance ? sval : sval*sval;
+              if(cif[ CCOL_SUMVAR  ] && (!isnan(var)))
+                {
+                  ci[ CCOL_NUMVAR ]++;
+                  ci[ CCOL_SUMVAR ] += var;
+                }
+              if(cif[ CCOL_SUM_VAR ] && goodvalue)
+                {
+                  varval=p->variance ? var : sval;
+                  if(!isnan(varval))
+                    {
+                      ci[ CCOL_SUM_VAR_NUM ]++;
+                      ci[ CCOL_SUM_VAR     ] += varval + fabs(*V);
+                    }
+                }
+            }
         }
-      while(++O<OO);
 
-      /* Increment to the next contiguous region of this tile. */
-      increment += ( gal_tile_block_increment(p->objects, tsize,
-                                              num_increment++, NULL) );
+      /* This pixel is on the diffuse region (and the object actually has
+         clumps). If any river-based measurements are necessary check to
+         see if it is touching a clump or not, but only if this object
+         actually has any clumps. */
+      else if(ngblabs && pp->clumpsinobj)
+        {
+          /* We are on a diffuse (possibly a river) pixel. So the value of
+             this pixel has to be added to any of the clumps in
+             touches. But since it might touch a labeled region more than
+             once, we use 'ngblabs' to keep track of which label we have
+             already added its value to. 'ii' is the number of different
+             labels this river pixel has already been considered
+             for. 'ngblabs' will keep the list labels. */
+          ii=0;
+          memset(ngblabs, 0, nngb*sizeof *ngblabs);
+
+          /* Go over the neighbors and see if this pixel is touching a
+             clump or not. */
+          GAL_DIMENSION_NEIGHBOR_OP(pp->pixind[pix], ndim, dsize, ndim,
+                                    dinc,
+             {
+               /* Neighbor's label (mainly for easy reading). */
+               nlab=clumps[nind];
+
+               /* We only want neighbors that are a clump and part of this
+                  object and part of the same object. */
+               if( nlab>0 && objects[nind]==pp->object)
+                 {
+                   /* Go over all already checked labels and make sure this
+                      clump hasn't already been considered. */
+                   for(i=0;i<ii;++i) if(ngblabs[i]==nlab) break;
+
+                   /* It hasn't been considered yet: */
+                   if(i==ii)
+                     {
+                       /* Make sure it won't be considered any more. */
+                       ngblabs[ii++] = nlab;
+
+                       /* To help in reading. */
+                       cir=&pp->ci[ (nlab-1) * CCOL_NUMCOLS ];
+
+                       /* Write in the necessary values. */
+                       if(cif[ CCOL_RIV_NUM  ]) cir[ CCOL_RIV_NUM ]++;
+
+                       /* Total sum of values in river. */
+                       if(cif[ CCOL_RIV_SUM  ]) cir[ CCOL_RIV_SUM ] += *V;
+
+                       /* Minimum river value. */
+                       if(cif[CCOL_RIV_MIN])
+                         if(cir[CCOL_RIV_NUM]==1 || *V < cir[CCOL_RIV_MIN])
+                           cir[CCOL_RIV_MIN]=*V;
+
+                       /* Maximum river value. */
+                       if(cif[CCOL_RIV_MAX])
+                         if(cir[CCOL_RIV_NUM]==1 || *V > cir[CCOL_RIV_MAX])
+                           cir[CCOL_RIV_MAX]=*V;
 
-      /* If a 2D projection is requested, see if we should initialize (set
-         to zero) the projection-index ('pind') not. */
-      if(xybin && (num_increment-1) % tsize[1]==0 )
-        pind=0;
+                       /* Sum of variances within river. */
+                       if(cif[ CCOL_RIV_SUM_VAR  ])
+                         {
+                           sval = pp->pixstd[pix];
+                           cir[ CCOL_RIV_SUM_VAR ] += fabs(*V)
+                             + (p->variance ? sval : sval*sval);
+                         }
+                     }
+                 }
+             });
+        }
     }
 
 
@@ -1274,16 +1292,15 @@ parse_order_based(struct mkcatalog_passparams *pp)
 {
   struct mkcatalogparams *p=pp->p;
 
-  float *V;
   double *ci;
+  int32_t *C;
+  float *V, *objv=NULL;
   float *sigcliparr;
   gal_data_t *result;
   uint8_t clipflags=0;
-  int32_t *O, *OO, *C=NULL;
-  size_t i, increment=0, num_increment=1;
+  size_t i, counter=0, *ccounter=NULL;
   gal_data_t *objvals=NULL, **clumpsvals=NULL;
-  size_t *tsize=pp->tile->dsize, ndim=p->objects->ndim;
-  size_t counter=0, *ccounter=NULL, tmpsize=pp->oi[OCOL_NUM];
+  size_t tmpsize=pp->oi[OCOL_NUM];
 
   /* It may happen that there are no usable pixels for this object (and
      thus its possible clumps). In this case `tmpsize' will be zero and we
@@ -1320,11 +1337,22 @@ parse_order_based(struct mkcatalog_passparams *pp)
       return;
     }
 
-  /* We know we have pixels to use, so allocate space for the values within
-     the object. */
-  objvals=gal_data_alloc(NULL, p->values->type, 1, &tmpsize, NULL, 0,
-                         p->cp.minmapsize, p->cp.quietmmap, NULL, NULL,
-                         NULL);
+  /* We know we have pixels to use. When all the pixels of the object are
+     usable (no blank value), the buffer of the object's values (from
+     'parse_gather') is used directly (it is not necessary after this
+     step, so it can be sorted in place). Otherwise, allocate space for
+     the usable values within the object. */
+  if(tmpsize==pp->numpix)
+    objvals=gal_data_alloc(pp->pixv, GAL_TYPE_FLOAT32, 1, &tmpsize, NULL,
+                           0, p->cp.minmapsize, p->cp.quietmmap, NULL,
+                           NULL, NULL);
+  else
+    {
+      objvals=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &tmpsize, NULL, 0,
+                             p->cp.minmapsize, p->cp.quietmmap, NULL, NULL,
+                             NULL);
+      objv=objvals->array;
+    }
 
   /* Clump preparations. */
   if(p->clumps)
@@ -1343,7 +1371,7 @@ parse_order_based(struct mkcatalog_passparams *pp)
         {
           tmpsize=pp->ci[ i * CCOL_NUMCOLS + CCOL_NUM ];
           clumpsvals[i] = ( tmpsize
-                            ? gal_data_alloc(NULL, p->values->type, 1,
+                            ? gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1,
                                              &tmpsize, NULL, 0,
                                              p->cp.minmapsize,
                                              p->cp.quietmmap,
@@ -1353,45 +1381,27 @@ parse_order_based(struct mkcatalog_passparams *pp)
     }
 
 
-  /* Parse each contiguous patch of memory covered by this object. */
-  while( pp->start_end_inc[0] + increment <= pp->start_end_inc[1] )
+  /* Parse the pixels of this object and copy the usable values ('objv'
+     is only non-NULL when the object's values need to be copied). */
+  for(i=0;i<pp->numpix;++i)
     {
-      /* Set the contiguous range to parse. The pixel-to-pixel counting
-         along the fastest dimension will be done over the 'O' pointer. */
-      V = pp->st_v + increment;
-      if(p->clumps) C = pp->st_c + increment;
-      OO = ( O = pp->st_o + increment ) + tsize[ndim-1];
-
-      /* Parse the next contiguous region of this tile. */
-      do
+      /* 'hasblank' is constant, so when the values doesn't have any blank
+         values, the 'isnan' will never be checked. */
+      V=pp->pixv+i;
+      if( !( p->hasblank && isnan(*V) ) )
         {
-          /* If this pixel belongs to the requested object, then do the
-             processing. 'hasblank' is constant, so when the values doesn't
-             have any blank values, the 'isnan' will never be checked. */
-          if( *O==pp->object && !( p->hasblank && isnan(*V) ) )
+          /* Copy the value for the whole object. */
+          if(objv) objv[ counter++ ] = *V;
+
+          /* We are also on a clump. */
+          if(p->clumps)
             {
-              /* Copy the value for the whole object. */
-              memcpy( gal_pointer_increment(objvals->array, counter++,
-                                             p->values->type), V,
-                      gal_type_sizeof(p->values->type) );
-
-              /* We are also on a clump. */
-              if(p->clumps && *C>0 && clumpsvals[*C-1]!=NULL)
-                memcpy( gal_pointer_increment(clumpsvals[*C-1]->array,
-                                              ccounter[*C-1]++,
-                                              p->values->type), V,
-                        gal_type_sizeof(p->values->type) );
+              C=pp->pixc+i;
+              if( *C>0 && clumpsvals[*C-1]!=NULL )
+                ((float *)(clumpsvals[*C-1]->array))[ ccounter[*C-1]++ ]
+                  = *V;
             }
-
-          /* Increment the other pointers. */
-          ++V;
-          if(p->clumps) ++C;
         }
-      while(++O<OO);
-
-      /* Increment to the next contiguous region of this tile. */
-      increment += ( gal_tile_block_increment(p->objects, tsize,
-                                              num_increment++, NULL) );
     }
 
 
@@ -1446,7 +1456,9 @@ parse_order_based(struct mkcatalog_passparams *pp)
       || p->oiflag[ OCOL_FRACMAX2NUM ] )
     parse_area_of_frac_sum(pp, objvals, pp->oi, 1);
 
-  /* Clean up the object values. */
+  /* Clean up the object values (if the buffer of 'pp' was used, it should
+     not be freed here). */
+  if(objv==NULL) objvals->array=NULL;
   gal_data_free(objvals);
 
 
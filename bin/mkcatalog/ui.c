@@ -1862,8 +1862,9 @@ ui_preparations(struct mkcatalogparams *p)
      values), because playing with the output columns can cause bad
      bugs. If the user wants performance, they are encouraged to run
      MakeCatalog with '--noclumpsort' and avoid the whole process all
-     together. */
-  if(p->clumps && !p->noclumpsort && p->cp.numthreads>1)
+     together. Note that this is also necessary on a single thread: the
+     objects are processed by decreasing size (not by their ID). */
+  if(p->clumps && !p->noclumpsort)
     {
       p->hostobjid_c=gal_pointer_allocate(GAL_TYPE_SIZE_T,
                                           p->clumpcols->size, 0, __func__,
@@ -2074,6 +2075,7 @@ ui_free_report(struct mkcatalogparams *p, struct timeval *t1)
   gal_data_free(p->std);
   gal_data_free(p->values);
   gal_data_free(p->upmask);
+  gal_data_free(p->upcumbad);
   gal_data_free(p->clumps);
   gal_data_free(p->objects);
   if(p->outlabs) free(p->outlabs);
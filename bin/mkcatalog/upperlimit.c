@@ -44,6 +44,97 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/*********************************************************************/
+/*******************        Footprint checks      ********************/
+/*********************************************************************/
+/* A random position is only usable when none of the pixels of the
+   footprint (the object or clump) fall on a labeled, masked or blank
+   pixel. To avoid checking every pixel of the footprint in every random
+   position, the cumulative number of unusable pixels (over the flattened
+   image) is kept here: the number of unusable pixels in any contiguous
+   range of pixels is then the difference of two elements. The counts are
+   kept in 32-bit integers: if they overflow, their differences (for
+   ranges that are shorter than 2^32 pixels) are still correct. */
+void
+upperlimit_prepare(struct mkcatalogparams *p)
+{
+  size_t i, size=p->objects->size+1;
+  float *V=p->values->array;
+  int32_t *O=p->objects->array;
+  uint8_t *M=p->upmask ? p->upmask->array : NULL;
+  uint32_t *cum;
+
+  /* Allocate the array (it has one more element than the image). */
+  p->upcumbad=gal_data_alloc(NULL, GAL_TYPE_UINT32, 1, &size, NULL, 0,
+                             p->cp.minmapsize, p->cp.quietmmap, NULL,
+                             NULL, NULL);
+  cum=p->upcumbad->array;
+
+  /* Fill it with the number of unusable pixels before each pixel. */
+  cum[0]=0;
+  for(i=0;i<p->objects->size;++i)
+    cum[i+1] = cum[i] + ( O[i]
+                          || ( M && M[i] )
+                          || ( p->hasblank && isnan(V[i]) ) );
+}
+
+
+
+
+
+/* Make the contiguous runs of pixels in the footprint of the object (when
+   'clumplab==0') or one of its clumps. Each run is a pair of numbers in
+   the output: its first pixel's index (relative to the first pixel of
+   'tile') and its length. Since the relative index of a pixel is
+   independent of the position of the tile, these runs can be used for
+   any random position. The pixels of the object are already in the
+   buffers of 'pp' (in the same order that the tile is parsed). */
+static size_t *
+upperlimit_footprint(struct mkcatalog_passparams *pp, gal_data_t *tile,
+                     int32_t clumplab, size_t *numruns)
+{
+  size_t i, rel, n=0, *runs;
+  size_t tstart=gal_pointer_num_between(pp->p->objects->array,
+                                        tile->array, pp->p->objects->type);
+
+  /* Allocate the space for the runs (at most, every pixel is one run). */
+  runs=gal_pointer_allocate(GAL_TYPE_SIZE_T, 2*(pp->numpix?pp->numpix:1),
+                            0, __func__, "runs");
+
+  /* Go over the pixels and add them to the last run if they are after its
+     last pixel, otherwise, start a new run. */
+  for(i=0;i<pp->numpix;++i)
+    if( clumplab==0 || pp->pixc[i]==clumplab )
+      {
+        rel=pp->pixind[i]-tstart;
+        if( n && rel==runs[2*n-2]+runs[2*n-1] ) ++runs[2*n-1];
+        else { runs[2*n]=rel; runs[2*n+1]=1; ++n; }
+      }
+
+  /* Return the runs. */
+  *numruns=n;
+  return runs;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /*******************       Tiles for clumps       ********************/
 /*********************************************************************/
@@ -51,12 +142,10 @@ static gal_data_t *
 upperlimit_make_clump_tiles(struct mkcatalog_passparams *pp)
 {
   gal_data_t *objects=pp->p->objects;
-  size_t ndim=objects->ndim, *tsize=pp->tile->dsize;
+  size_t ndim=objects->ndim;
 
   gal_data_t *tiles=NULL;
-  size_t increment=0, num_increment=1;
   size_t i, d, *min, *max, width=2*ndim;
-  int32_t *O, *OO, *C, *start=objects->array;
   size_t *coord=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
                                      "coord");
   size_t *minmax=gal_pointer_allocate(GAL_TYPE_SIZE_T,
@@ -73,45 +162,26 @@ upperlimit_make_clump_tiles(struct mkcatalog_passparams *pp)
         minmax[ i * width + ndim + d ] = 0;                /* Maximum. */
       }
 
-  /* Parse over the object and get the clump's minimum and maximum
-     positions.*/
-  while( pp->start_end_inc[0] + increment <= pp->start_end_inc[1] )
-    {
-      /* Set the pointers for this tile. */
-      C  = pp->st_c + increment;
-      OO = ( O = pp->st_o + increment ) + tsize[ndim-1];
-
-      /* Go over the contiguous region. */
-      do
-        {
-          /* Only consider clumps. */
-          if( *O==pp->object && *C>0 )
-            {
-              /* Get the coordinates of this pixel. */
-              gal_dimension_index_to_coord(O-start, ndim, objects->dsize,
-                                           coord);
-
-              /* Check to see if this coordinate is the smallest/largest
-                 found so far for this label. Note that labels start from
-                 1, while indexs here start from zero. */
-              min = &minmax[ (*C-1) * width        ];
-              max = &minmax[ (*C-1) * width + ndim ];
-              for(d=0;d<ndim;++d)
-                {
-                  if( coord[d] < min[d] ) min[d] = coord[d];
-                  if( coord[d] > max[d] ) max[d] = coord[d];
-                }
-            }
-
-          /* Increment the other pointers. */
-          ++C;
-        }
-      while(++O<OO);
-
-      /* Increment to the next contiguous region. */
-      increment += ( gal_tile_block_increment(objects, tsize, num_increment++,
-                                              NULL) );
-    }
+  /* Parse over the pixels of the object and get the clump's minimum and
+     maximum positions.*/
+  for(i=0;i<pp->numpix;++i)
+    if( pp->pixc[i]>0 )
+      {
+        /* Get the coordinates of this pixel. */
+        gal_dimension_index_to_coord(pp->pixind[i], ndim, objects->dsize,
+                                     coord);
+
+        /* Check to see if this coordinate is the smallest/largest found
+           so far for this label. Note that labels start from 1, while
+           indexs here start from zero. */
+        min = &minmax[ (pp->pixc[i]-1) * width        ];
+        max = &minmax[ (pp->pixc[i]-1) * width + ndim ];
+        for(d=0;d<ndim;++d)
+          {
+            if( coord[d] < min[d] ) min[d] = coord[d];
+            if( coord[d] > max[d] ) max[d] = coord[d];
+          }
+      }
 
   /* For a check.
   for(i=0;i<pp->clumpsinobj;++i)
@@ -559,14 +629,12 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
   size_t ndim=p->objects->ndim, *dsize=p->objects->dsize;
 
   double sum;
-  void *tarray;
-  uint8_t *M=NULL, *st_m=NULL;
   int continueparse, writecheck=0;
   struct gal_list_f32_t *check_s=NULL;
-  size_t d, counter=0, se_inc[2], nfailed=0;
-  float *V, *st_v, *uparr=pp->up_vals->array;
-  size_t min[3], max[3], increment, num_increment;
-  int32_t *O, *OO, *oO, *st_o, *st_oo, *st_oc, *oC=NULL;
+  size_t d, r, start, numruns, *runs;
+  size_t min[3], max[3], counter=0, nfailed=0;
+  uint32_t *cum=p->upcumbad->array, *cs;
+  float *V, *VV, *values=p->values->array, *uparr=pp->up_vals->array;
   size_t hw2, hw0=tile->dsize[0]/2, hw1=tile->dsize[1]/2;
   size_t maxfails = p->upnum * MKCATALOG_UPPERLIMIT_MAXFAILS_MULTIP;
   struct gal_list_sizet_t *check_x=NULL, *check_y=NULL, *check_z=NULL;
@@ -589,7 +657,6 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
 
 
   /* Initializations. */
-  tarray=tile->array;
   gsl_rng_set(pp->rng, seed);
   pp->up_vals->flag &= ~GAL_DATA_FLAG_SORT_CH;
   hw2 = tile->ndim==3 ? tile->dsize[2]/2 : GAL_BLANK_SIZE_T;
@@ -599,87 +666,40 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
   upperlimit_random_range(pp, tile, min, max, clumplab);
 
 
-  /* 'se_inc' is just used temporarily, the important thing here is
-     'st_oo'. */
-  st_oo = ( clumplab
-            ? gal_tile_start_end_ind_inclusive(tile, p->objects, se_inc)
-            : pp->st_o );
-  st_oc = clumplab ? (int32_t *)(p->clumps->array) + se_inc[0] : NULL;
+  /* The contiguous runs of pixels in the footprint. */
+  runs=upperlimit_footprint(pp, tile, clumplab, &numruns);
 
 
   /* Continue measuring randomly until we get the desired total number. */
   while(nfailed<maxfails && counter<p->upnum)
     {
-      /* Get the random coordinates. */
+      /* Get the random coordinates and the index of the tile's first
+         pixel in this random position. */
       for(d=0;d<ndim;++d)
         rcoord[d] = upperlimit_random_position(pp, tile, d, min, max);
-
-      /* Set the tile's new starting pointer. */
-      tile->array = gal_pointer_increment(p->objects->array,
-                          gal_dimension_coord_to_index(ndim, dsize, rcoord),
-                                          p->objects->type);
-
-      /* Starting and ending coordinates for this random position, note
-         that in 'pp' we have the starting and ending coordinates of the
-         actual tile. */
-      increment     = 0;
-      num_increment = 1;
-      continueparse = 1;
-      sum           = 0.0f;
-
-      /* Starting pointers for the random tile. */
-      st_v   = gal_tile_start_end_ind_inclusive(tile, p->values, se_inc);
-      st_o               = (int32_t *)(p->objects->array) + se_inc[0];
-      if(p->upmask) st_m = (uint8_t *)(p->upmask->array)  + se_inc[0];
-
-      /* Parse over this object/clump. */
-      while( se_inc[0] + increment <= se_inc[1] )
+      start=gal_dimension_coord_to_index(ndim, dsize, rcoord);
+
+      /* If any pixel of the footprint is over a non-zero object code, or
+         is masked, or has a blank value, this position is not usable. So
+         before summing the values, check the number of unusable pixels
+         under each run of the footprint. */
+      continueparse=1;
+      for(r=0;r<numruns;++r)
         {
-          /* Set the pointers. */
-          V               = st_v  + increment;    /* Random tile.   */
-          O               = st_o  + increment;    /* Random tile.   */
-          if(st_m) M      = st_m  + increment;    /* Random tile.   */
-          oO              = st_oo + increment;    /* Original tile. */
-          if(clumplab) oC = st_oc + increment;    /* Original tile. */
-
-
-          /* Parse over this contiguous region, similar to the first and
-             second pass functions. */
-          OO = O + tile->dsize[ndim-1];
-          do
-            {
-              /* Only use pixels over this object/clump. */
-              if( *oO==pp->object && ( oC==NULL || *oC==clumplab ) )
-                {
-                  /* If this pixel is a non-zero object code, or is masked,
-                     or has a blank value, then stop parsing. */
-                  if( *O || (M && *M) || ( p->hasblank && isnan(*V) ) )
-                    continueparse=0;
-                  else
-                    sum += *V;
-                }
-
-              /* Increment the other pointers. */
-              ++V;
-              ++oO;
-              if(M) ++M;
-              if(oC) ++oC;
-            }
-          while(continueparse && ++O<OO);
-
-
-          /* Increment to the next contiguous region of this tile. */
-          if(continueparse)
-            increment += ( gal_tile_block_increment(p->objects, dsize,
-                                                    num_increment++, NULL) );
-          else break;
+          cs = cum + start + runs[2*r];
+          if( cs[ runs[2*r+1] ] - cs[0] ) { continueparse=0; break; }
         }
 
-
-      /* Further processing is only necessary if this random tile was fully
-         parsed. If it was, we must reset 'nfailed' to zero again. */
+      /* Further processing is only necessary if this random position is
+         usable. If it was, we must reset 'nfailed' to zero again. */
+      sum=0.0f;
       if(continueparse)
         {
+          for(r=0;r<numruns;++r)
+            {
+              VV = ( V = values + start + runs[2*r] ) + runs[2*r+1];
+              do sum += *V; while(++V<VV);
+            }
           nfailed=0;
           uparr[ counter++ ] = sum;
         }
@@ -721,9 +741,9 @@ upperlimit_one_tile(struct mkcatalog_passparams *pp, gal_data_t *tile,
   /* Do the measurement on the random distribution. */
   upperlimit_measure(pp, clumplab, counter==p->upnum);
 
-  /* Reset the tile's array pointer, clean up and return. */
+  /* Clean up and return. */
+  free(runs);
   free(rcoord);
-  tile->array=tarray;
   gal_list_f32_free(check_s);
   gal_list_sizet_free(check_x);
   gal_list_sizet_free(check_y);
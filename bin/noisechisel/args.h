@@ -85,6 +85,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "cache",
+      UI_KEY_CACHE,
+      "FITS",
+      0,
+      "Cache of convolution and thresholds for re-runs.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->cachename,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "widekernel",
       UI_KEY_WIDEKERNEL,
@@ -0,0 +1,384 @@
+/*********************************************************************
+NoiseChisel - Detect signal in a noisy dataset.
+NoiseChisel is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <gnuastro/fits.h>
+#include <gnuastro/array.h>
+
+#include <gnuastro-internal/timing.h>
+#include <gnuastro-internal/checkset.h>
+
+#include "main.h"
+
+#include "ui.h"
+#include "cache.h"
+
+
+
+
+
+
+
+
+/****************************************************************
+ ************         Keys of the cached stages       ************
+ ****************************************************************/
+/* The cache file is a multi-extension FITS file. The key (a hash of all
+   the inputs and options that a stage depends on) of each stage is
+   written as a keyword in the primary HDU (with the names below), and the
+   datasets of each stage are in the named HDUs after it. A stage in the
+   cache is only used when its key is identical to the key of the current
+   run. */
+static char *cache_keynames[CACHE_NUMSTAGES]=
+  {"CACHECNV", "CACHEQRW", "CACHEQTH"};
+
+static char *cache_hdus_raw[CACHE_NUM_QTHRESH]=
+  {"QTHRESH-ERODE-RAW", "QTHRESH-NOERODE-RAW", "QTHRESH-EXPAND-RAW"};
+
+static char *cache_hdus_qthresh[CACHE_NUM_QTHRESH]=
+  {"QTHRESH-ERODE", "QTHRESH-NOERODE", "QTHRESH-EXPAND"};
+
+/* Parameters of the 64-bit FNV-1a hash. */
+#define CACHE_FNV_OFFSET 14695981039346656037ULL
+#define CACHE_FNV_PRIME  1099511628211ULL
+
+
+
+
+
+/* Add the bytes of 'data' to the hash 'h'. */
+static uint64_t
+cache_hash(uint64_t h, void *data, size_t size)
+{
+  unsigned char *d=data, *df=d+size;
+  while(d<df) { h ^= *d++; h *= CACHE_FNV_PRIME; }
+  return h;
+}
+
+
+
+
+
+/* Add the size and pixels of a dataset to the hash. The pixels are added
+   in 64-bit words (each word is mixed into the hash before the next, so
+   the key depends on the position of every pixel). This is much faster
+   than going over every byte, so the large inputs of NoiseChisel can be
+   hashed in a small fraction of the time it takes to convolve them. */
+static uint64_t
+cache_hash_data(uint64_t h, gal_data_t *data)
+{
+  uint64_t w;
+  unsigned char *d=data->array;
+  size_t i, nbytes=data->size*gal_type_sizeof(data->type);
+
+  /* Add the size of the dataset. */
+  h=cache_hash(h, &data->ndim, sizeof data->ndim);
+  h=cache_hash(h, data->dsize, data->ndim * sizeof *data->dsize);
+
+  /* Add the pixels (the last bytes that don't fill a word are added one
+     by one). */
+  for(i=0; i+sizeof w <= nbytes; i+=sizeof w)
+    {
+      memcpy(&w, d+i, sizeof w);
+      h ^= w;
+      h *= CACHE_FNV_PRIME;
+    }
+  return cache_hash(h, d+i, nbytes-i);
+}
+
+
+
+
+
+/* Find the key of each stage from all the inputs and options that it
+   depends on. */
+static void
+cache_keys(struct noisechiselparams *p)
+{
+  size_t ndim=p->input->ndim;
+  uint64_t h=CACHE_FNV_OFFSET;
+  struct gal_options_common_params *cp=&p->cp;
+  struct gal_tile_two_layer_params *tl=&cp->tl;
+
+  /* Convolution: the version of Gnuastro, the input (or the given
+     convolved image), the kernel(s) and the tessellation. */
+  h=cache_hash(h, PACKAGE_VERSION, strlen(PACKAGE_VERSION));
+  h=cache_hash_data(h, p->input);
+  if(p->convolvedname) h=cache_hash_data(h, p->conv);
+  if(p->kernel)        h=cache_hash_data(h, p->kernel);
+  if(p->widekernel)    h=cache_hash_data(h, p->widekernel);
+  h=cache_hash(h, tl->tilesize, ndim * sizeof *tl->tilesize);
+  h=cache_hash(h, tl->numchannels, ndim * sizeof *tl->numchannels);
+  h=cache_hash(h, &tl->remainderfrac, sizeof tl->remainderfrac);
+  h=cache_hash(h, &tl->workoverch, sizeof tl->workoverch);
+  p->cachekey[CACHE_CONVOLVED]=h;
+
+  /* Quantile threshold on each tile. */
+  h=cache_hash(h, &p->qthresh, sizeof p->qthresh);
+  h=cache_hash(h, &p->noerodequant, sizeof p->noerodequant);
+  h=cache_hash(h, &p->detgrowquant, sizeof p->detgrowquant);
+  h=cache_hash(h, &p->meanmedqdiff, sizeof p->meanmedqdiff);
+  p->cachekey[CACHE_QTHRESH_RAW]=h;
+
+  /* Removal of outliers, interpolation and smoothing. */
+  h=cache_hash(h, &p->outliernumngb, sizeof p->outliernumngb);
+  h=cache_hash(h, &p->outliersigma, sizeof p->outliersigma);
+  h=cache_hash(h, p->outliersclip, sizeof p->outliersclip);
+  h=cache_hash(h, &cp->interpmetric, sizeof cp->interpmetric);
+  h=cache_hash(h, &cp->interpnumngb, sizeof cp->interpnumngb);
+  h=cache_hash(h, &cp->interponlyblank, sizeof cp->interponlyblank);
+  h=cache_hash(h, &p->smoothwidth, sizeof p->smoothwidth);
+  p->cachekey[CACHE_QTHRESH]=h;
+}
+
+
+
+
+
+/* Find the keys of the stages in this run, and see which stages in the
+   cache file (if it exists) can be used. */
+void
+cache_prepare(struct noisechiselparams *p)
+{
+  size_t i;
+  char **strarr, keystr[17];
+  gal_data_t *keys=gal_data_array_calloc(CACHE_NUMSTAGES);
+
+  /* Find the keys of this run. */
+  cache_keys(p);
+
+  /* If the cache file doesn't exist yet, no stage can be used. */
+  for(i=0;i<CACHE_NUMSTAGES;++i) p->cachevalid[i]=0;
+  if( gal_checkset_check_file_return(p->cachename) )
+    {
+      /* Read the keys of the stages in the file. */
+      for(i=0;i<CACHE_NUMSTAGES;++i)
+        {
+          keys[i].name=cache_keynames[i];
+          keys[i].type=GAL_TYPE_STRING;
+          keys[i].next = i==CACHE_NUMSTAGES-1 ? NULL : &keys[i+1];
+        }
+      gal_fits_key_read(p->cachename, "0", keys, 0, 0, "--cache");
+
+      /* Compare them with the keys of this run. */
+      for(i=0;i<CACHE_NUMSTAGES;++i)
+        if(keys[i].status==0)
+          {
+            strarr=keys[i].array;
+            sprintf(keystr, "%016"PRIx64, p->cachekey[i]);
+            p->cachevalid[i] = strcmp(strarr[0], keystr)==0;
+          }
+    }
+
+  /* A stage can only be used when all the stages before it can also be
+     used (in case the file was edited by hand). */
+  for(i=1;i<CACHE_NUMSTAGES;++i)
+    if(p->cachevalid[i-1]==0) p->cachevalid[i]=0;
+
+  /* Clean up ('name' wasn't allocated). */
+  for(i=0;i<CACHE_NUMSTAGES;++i) keys[i].name=NULL;
+  gal_data_array_free(keys, CACHE_NUMSTAGES, 1);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ************          Read the cached stages         ************
+ ****************************************************************/
+static gal_data_t *
+cache_read_hdu(struct noisechiselparams *p, char *hdu, uint8_t type)
+{
+  return gal_array_read_one_ch_to_type(p->cachename, hdu, NULL, type,
+                                       p->cp.minmapsize, p->cp.quietmmap,
+                                       "--cache");
+}
+
+
+
+
+
+/* Read the convolved image(s) that aren't already available from the
+   cache (if the stage can be used). Return 1 if anything was read. */
+int
+cache_read_convolved(struct noisechiselparams *p)
+{
+  int out=0;
+
+  if(p->cachevalid[CACHE_CONVOLVED]==0) return 0;
+
+  if(p->conv==NULL && p->kernel)
+    {
+      p->conv=cache_read_hdu(p, "CONVOLVED", GAL_TYPE_FLOAT32);
+      out=1;
+    }
+  if(p->widekernel && p->wconv==NULL)
+    {
+      p->wconv=cache_read_hdu(p, "CONVOLVED-WIDER", GAL_TYPE_FLOAT32);
+      out=1;
+    }
+  return out;
+}
+
+
+
+
+
+/* Read the quantile thresholds of the given stage (the raw thresholds of
+   each tile, or the final interpolated ones) into 'thresh'. With the
+   final stage, the tiles that shouldn't be used for the Sky are also
+   read. Return 1 if the stage was read. */
+int
+cache_read_qthresh(struct noisechiselparams *p, int stage,
+                   gal_data_t **thresh)
+{
+  size_t i;
+  char **hdus = stage==CACHE_QTHRESH ? cache_hdus_qthresh : cache_hdus_raw;
+
+  /* If this stage can't be used, don't read anything. */
+  if(p->cachevalid[stage]==0) return 0;
+
+  /* Read the thresholds (the expansion threshold is only necessary when
+     '--detgrowquant' isn't 1). */
+  for(i=0;i<CACHE_NUM_QTHRESH;++i)
+    thresh[i] = ( i<2 || p->detgrowquant!=1.0f
+                  ? cache_read_hdu(p, hdus[i], p->input->type)
+                  : NULL );
+
+  /* The tiles to not use in the Sky estimation. */
+  if(stage==CACHE_QTHRESH)
+    p->noskytiles=cache_read_hdu(p, "NOSKYTILES", GAL_TYPE_UINT8);
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ************           Write the cache file          ************
+ ****************************************************************/
+/* Write one dataset in the cache file (in an HDU with the given name). */
+static void
+cache_write_hdu(struct noisechiselparams *p, gal_data_t *data, char *hdu)
+{
+  char *name;
+
+  if(data==NULL) return;
+  name=data->name;
+  data->name=hdu;
+  gal_fits_img_write(data, p->cachename, NULL, 0);
+  data->name=name;
+}
+
+
+
+
+
+/* Write all the stages into a new cache file. 'raw' are the quantile
+   thresholds of each tile before the removal of outliers and 'thresh'
+   are the final (interpolated and smoothed) thresholds. */
+void
+cache_write(struct noisechiselparams *p, gal_data_t **raw,
+            gal_data_t **thresh)
+{
+  size_t i;
+  char *keystr, *msg;
+  gal_fits_list_key_t *keys=NULL;
+
+  /* Delete the old cache file (if it exists). */
+  gal_checkset_writable_remove(p->cachename, p->inputname, 0,
+                               p->cp.dontdelete);
+
+  /* Write the keys of all the stages in the primary HDU. */
+  for(i=0;i<CACHE_NUMSTAGES;++i)
+    {
+      if( asprintf(&keystr, "%016"PRIx64, p->cachekey[i])<0 )
+        error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+      gal_fits_key_list_add_end(&keys, GAL_TYPE_STRING, cache_keynames[i],
+                                0, keystr, 1, "Key of cached stage.", 0,
+                                NULL, 0);
+    }
+  gal_fits_key_write(keys, p->cachename, "0", "NONE", 1, 1);
+
+  /* The convolved image(s): when the convolved image was given with
+     '--convolved', there is no need to keep it. */
+  if(p->conv!=p->input && p->convolvedname==NULL)
+    cache_write_hdu(p, p->conv, "CONVOLVED");
+  cache_write_hdu(p, p->wconv, "CONVOLVED-WIDER");
+
+  /* The quantile thresholds. */
+  for(i=0;i<CACHE_NUM_QTHRESH;++i)
+    {
+      cache_write_hdu(p, raw[i], cache_hdus_raw[i]);
+      cache_write_hdu(p, thresh[i], cache_hdus_qthresh[i]);
+    }
+  cache_write_hdu(p, p->noskytiles, "NOSKYTILES");
+
+  /* Report it. */
+  if(!p->cp.quiet)
+    {
+      if( asprintf(&msg, "Cache written to '%s'.", p->cachename)<0 )
+        error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
+      gal_timing_report(NULL, msg, 1);
+      free(msg);
+    }
+}
@@ -0,0 +1,44 @@
+/*********************************************************************
+NoiseChisel - Detect signal in a noisy dataset.
+NoiseChisel is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef CACHE_H
+#define CACHE_H
+
+/* The quantile thresholds are kept in arrays of this many datasets: the
+   erosion, no-erosion and expansion thresholds (the last may be NULL). */
+#define CACHE_NUM_QTHRESH 3
+
+void
+cache_prepare(struct noisechiselparams *p);
+
+int
+cache_read_convolved(struct noisechiselparams *p);
+
+int
+cache_read_qthresh(struct noisechiselparams *p, int stage,
+                   gal_data_t **thresh);
+
+void
+cache_write(struct noisechiselparams *p, gal_data_t **raw,
+            gal_data_t **thresh);
+
+#endif
@@ -121,7 +121,8 @@ detection_initial(struct noisechiselparams *p)
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   gal_binary_erode(p->binary, p->erode,
                    detection_ngb_to_connectivity(p->input->ndim,
-                                                 p->erodengb), 1);
+                                                 p->erodengb), 1,
+                   p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Eroded %zu time%s (%zu-connected).", p->erode,
@@ -147,7 +148,8 @@ detection_initial(struct noisechiselparams *p)
   if(!p->cp.quiet) gettimeofday(&t1, NULL);
   gal_binary_open(p->binary, p->opening,
                   detection_ngb_to_connectivity(p->input->ndim,
-                                                p->openingngb), 1);
+                                                p->openingngb), 1,
+                  p->cp.numthreads);
   if(!p->cp.quiet)
     {
       if( asprintf(&msg, "Opened (depth: %zu, %zu-connected).",
@@ -169,7 +171,8 @@ detection_initial(struct noisechiselparams *p)
 
   /* Label the connected components. */
   p->numinitialdets=gal_binary_connected_components(p->binary, &p->olabel,
-                                                    p->binary->ndim);
+                                                    p->binary->ndim,
+                                                    p->cp.numthreads);
   if(p->detectionname)
     {
       p->olabel->name="OPENED-AND-LABELED";
@@ -283,11 +286,13 @@ detection_fill_holes_open(void *in_prm)
   copy->array=&fho_prm->copyspace[p->maxltcontig*tprm->id];
 
 
-  /* Go over all the tiles given to this thread. */
-  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+  /* Go over all the tiles given to this thread. The cost of each tile
+     depends on its detected pixels, so the tiles are distributed
+     dynamically between the threads. */
+  while( (i=gal_threads_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* For easy reading. */
-      tile=&p->ltl.tiles[tprm->indexs[i]];
+      tile=&p->ltl.tiles[i];
 
       /* Change the tile pointers (temporarily). */
       tarray=tile->array;
@@ -328,7 +333,7 @@ detection_fill_holes_open(void *in_prm)
       /* Open all the regions. */
       gal_binary_open(copy, p->dopening,
                       detection_ngb_to_connectivity(p->input->ndim,
-                                                    p->dopeningngb), 1);
+                                                    p->dopeningngb), 1, 1);
 
       /* Write the copied region back into the large input and AFTERWARDS,
          correct the tile's pointers, the pointers must not be corrected
@@ -480,7 +485,8 @@ detection_pseudo_find(struct noisechiselparams *p, gal_data_t *workbin,
       do if(*b==GAL_BLANK_UINT8) *b = !s0d1; while(++b<bf);
     }
   */
-  return gal_binary_connected_components(workbin, &worklab, con);
+  return gal_binary_connected_components(workbin, &worklab, con,
+                                         p->cp.numthreads);
 }
 
 
@@ -1081,12 +1087,13 @@ detection_quantile_expand(struct noisechiselparams *p, gal_data_t *workbin)
       o=p->olabel->array;
       bf=(b=workbin->array)+workbin->size;
       do *b = (*o++ == 1); while(++b<bf);
-      workbin=gal_binary_dilate(workbin, 1, 1, 1);
+      workbin=gal_binary_dilate(workbin, 1, 1, 1, p->cp.numthreads);
       gal_binary_holes_fill(workbin, 1, p->detgrowmaxholesize);
 
       /* Get the labeled image. */
       numexpanded=gal_binary_connected_components(workbin, &p->olabel,
-                                                  workbin->ndim);
+                                                  workbin->ndim,
+                                                  p->cp.numthreads);
 
       /* Set all the input's blank pixels to blank in the labeled and
          binary arrays. */
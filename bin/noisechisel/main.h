@@ -37,6 +37,21 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* Stages of NoiseChisel that are kept in the cache file (see
+   'cache.c'). Each stage depends on all the stages before it. */
+enum cache_stages
+  {
+    CACHE_CONVOLVED,            /* Convolved image(s).                    */
+    CACHE_QTHRESH_RAW,          /* Quantile thresholds on each tile.      */
+    CACHE_QTHRESH,              /* Thresholds after interpolation.        */
+
+    CACHE_NUMSTAGES,            /* Number of stages (must be last).       */
+  };
+
+
+
+
+
 /* Main program parameters structure */
 struct noisechiselparams
 {
@@ -48,6 +63,7 @@ struct noisechiselparams
   char                  *khdu;  /* Kernel HDU.                            */
   char         *convolvedname;  /* Convolved image (to avoid convolution).*/
   char                  *chdu;  /* HDU of convolved image.                */
+  char             *cachename;  /* Cache file of the expensive stages.    */
   char        *widekernelname;  /* Name of wider kernel to be used.       */
   char                  *whdu;  /* Wide kernel HDU.                       */
 
@@ -97,6 +113,8 @@ struct noisechiselparams
   char          *detsn_D_name;  /* Final detection S/N name.              */
   char         *detectionname;  /* Name of detection steps file.          */
   char               *skyname;  /* Name of Sky estimation steps file.     */
+  uint64_t cachekey[CACHE_NUMSTAGES]; /* Key of each stage in this run.   */
+  uint8_t cachevalid[CACHE_NUMSTAGES]; /* Stage in cache file is usable.  */
 
   gal_data_t           *input;  /* Input image.                           */
   gal_data_t          *kernel;  /* Sharper kernel.                        */
@@ -28,6 +28,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 
 #include <gnuastro/fits.h>
+#include <gnuastro/list.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/convolve.h>
 
@@ -38,6 +39,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include "ui.h"
 #include "sky.h"
+#include "cache.h"
 #include "detection.h"
 #include "threshold.h"
 
@@ -53,11 +55,74 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /***********************************************************************/
 /*************  Wrapper functions (for clean high-level) ***************/
 /***********************************************************************/
+/* Convolve the input with the given kernel. When the kernel is separable
+   (for example a Gaussian that isn't truncated), the two 1D convolutions
+   are much faster. */
+static gal_data_t *
+noisechisel_convolve_kernel(struct noisechiselparams *p, gal_data_t *kernel)
+{
+  gal_data_t *out, *kernels;
+  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+
+  if( (kernels=gal_convolve_kernel_separate(kernel)) )
+    {
+      out=gal_convolve_spatial_separable(tl->tiles, kernels,
+                                         p->cp.numthreads, 1,
+                                         tl->workoverch, 0);
+      gal_list_data_free(kernels);
+    }
+  else
+    out=gal_convolve_spatial(tl->tiles, kernel, p->cp.numthreads, 1,
+                             tl->workoverch, 0);
+  return out;
+}
+
+
+
+
+
+/* When both kernels are needed and neither is separable, convolve the
+   input with both in one pass over the tiles (the pixels around each tile
+   are read from memory once). Return 1 if the convolution was done here.
+   The kernels are copied into a separate list, so their own 'next'
+   pointers are not touched. */
+static int
+noisechisel_convolve_both(struct noisechiselparams *p)
+{
+  gal_data_t *kernels=NULL, *sep;
+  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+
+  /* A separable kernel is much faster to convolve on its own. */
+  if( (sep=gal_convolve_kernel_separate(p->kernel))
+      || (sep=gal_convolve_kernel_separate(p->widekernel)) )
+    { gal_list_data_free(sep); return 0; }
+
+  /* Convolve with both kernels (the output is a list in the same order as
+     the kernels). */
+  gal_list_data_add(&kernels, gal_data_copy(p->widekernel));
+  gal_list_data_add(&kernels, gal_data_copy(p->kernel));
+  p->conv=gal_convolve_spatial_multi(tl->tiles, kernels, p->cp.numthreads,
+                                     1, tl->workoverch, 0);
+  p->wconv=p->conv->next;
+  p->conv->next=NULL;
+
+  /* Clean up and return. */
+  gal_list_data_free(kernels);
+  return 1;
+}
+
+
+
+
+
 static void
 noisechisel_convolve(struct noisechiselparams *p)
 {
   struct timeval t1;
-  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+
+  /* If the convolved image(s) are in the cache, read them. */
+  if( p->cachename && cache_read_convolved(p) && !p->cp.quiet )
+    gal_timing_report(NULL, "Convolved image(s) read from cache.", 1);
 
   /* Convovle with sharper kernel. */
   if(p->conv==NULL)
@@ -65,19 +130,28 @@ noisechisel_convolve(struct noisechiselparams *p)
       /* Do the convolution if a kernel was requested. */
       if(p->kernel)
         {
-          /* Make the convolved image. */
+          /* Make the convolved image(s): when a wider kernel is also
+             needed, both may be done together. */
           if(!p->cp.quiet) gettimeofday(&t1, NULL);
-          p->conv = gal_convolve_spatial(tl->tiles, p->kernel,
-                                         p->cp.numthreads, 1,
-                                         tl->workoverch, 0);
-
-          /* Report and write check images if necessary. */
-          if(!p->cp.quiet)
+          if( p->widekernel && p->wconv==NULL
+              && noisechisel_convolve_both(p) )
             {
-              if(p->widekernel)
-                gal_timing_report(&t1, "Convolved with sharper kernel.", 1);
-              else
-                gal_timing_report(&t1, "Convolved with given kernel.", 1);
+              if(!p->cp.quiet)
+                gal_timing_report(&t1, "Convolved with sharper and wider "
+                                  "kernels.", 1);
+            }
+          else
+            {
+              p->conv = noisechisel_convolve_kernel(p, p->kernel);
+              if(!p->cp.quiet)
+                {
+                  if(p->widekernel)
+                    gal_timing_report(&t1, "Convolved with sharper "
+                                      "kernel.", 1);
+                  else
+                    gal_timing_report(&t1, "Convolved with given "
+                                      "kernel.", 1);
+                }
             }
         }
       else
@@ -102,17 +176,18 @@ noisechisel_convolve(struct noisechiselparams *p)
         gal_fits_img_write(p->conv, p->detectionname, NULL, 0);
     }
 
-  /* Convolve with wider kernel (if requested). */
+  /* Convolve with wider kernel (if requested and not read from the
+     cache or already done with the sharper kernel). */
   if(p->widekernel)
     {
-      if(!p->cp.quiet) gettimeofday(&t1, NULL);
-      p->wconv=gal_convolve_spatial(tl->tiles, p->widekernel,
-                                    p->cp.numthreads, 1,
-                                    tl->workoverch, 0);
+      if(p->wconv==NULL)
+        {
+          if(!p->cp.quiet) gettimeofday(&t1, NULL);
+          p->wconv=noisechisel_convolve_kernel(p, p->widekernel);
+          if(!p->cp.quiet)
+            gal_timing_report(&t1, "Convolved with wider kernel.", 1);
+        }
       gal_checkset_allocate_copy("CONVOLVED-WIDER", &p->wconv->name);
-
-      if(!p->cp.quiet)
-        gal_timing_report(&t1, "Convolved with wider kernel.", 1);
     }
 }
 
@@ -43,6 +43,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include "main.h"
 
 #include "ui.h"
+#include "cache.h"
 #include "threshold.h"
 
 
@@ -396,6 +397,7 @@ qthresh_on_tile(void *in_prm)
   struct noisechiselparams *p=qprm->p;
 
   void *tarray=NULL;
+  double quants[3];
   int type=qprm->erode_th->type;
   gal_data_t *meanconv = p->wconv ? p->wconv : p->conv;
   size_t i, tind, twidth=gal_type_sizeof(type), ndim=p->input->ndim;
@@ -423,26 +425,21 @@ qthresh_on_tile(void *in_prm)
       tile = &p->cp.tl.tiles[tind];
 
 
-      /* Temporarily change the tile's pointers so we can do the work on
-         the convolved image, then copy the desired contents into the
-         already allocated 'usage' array. */
+      /* Temporarily change the tile's pointers so we can find the mean's
+         quantile on the convolved image. The quantile function is found
+         in one pass over the tile's pixels, without copying or sorting
+         them. */
       tarray=tile->array; tblock=tile->block;
       tile->array=gal_tile_block_relative_to_other(tile, meanconv);
       tile->block=meanconv;
-      gal_data_copy_to_allocated(tile, usage);
-      tile->array=tarray;
-      tile->block=tblock;
-
-
-      /* Find the mean's quantile on this tile, note that we have already
-         copied the tile's dataset to a newly allocated place. So we have
-         set the 'inplace' flag to '1' to avoid extra allocation. */
-      mean=gal_statistics_mean(usage);
-      num=gal_statistics_number(usage);
-      mean=gal_data_copy_to_new_type_free(mean, usage->type);
+      mean=gal_statistics_mean(tile);
+      num=gal_statistics_number(tile);
+      mean=gal_data_copy_to_new_type_free(mean, type);
       meanquant = ( *(size_t *)(num->array)
-                    ? gal_statistics_quantile_function(usage, mean, 1)
+                    ? gal_statistics_quantile_function_nosort(tile, mean)
                     : NULL );
+      tile->array=tarray;
+      tile->block=tblock;
 
       /* Only continue if the mean's quantile is close enough to the
          median.  */
@@ -456,39 +453,31 @@ qthresh_on_tile(void *in_prm)
              easily. But for the quantile threshold, we want to use the
              sharper convolved image to loose less of the spatial
              information. */
-          if(meanconv!=p->conv)
-            {
-              tarray=tile->array; tblock=tile->block;
-              tile->array=gal_tile_block_relative_to_other(tile, p->conv);
-              tile->block=p->conv;
-              usage->ndim=ndim;           /* Since usage was modified in */
-              usage->size=p->maxtcontig;  /* place, it needs to be       */
-              gal_data_copy_to_allocated(tile, usage);/* re-initialized. */
-              tile->array=tarray; tile->block=tblock;
-            }
-
-          /* Get the erosion quantile for this tile and save it. Note that
-             the type of 'qvalue' is the same as the input dataset. */
-          qvalue=gal_statistics_quantile(usage, p->qthresh, 1);
+          tarray=tile->array; tblock=tile->block;
+          tile->array=gal_tile_block_relative_to_other(tile, p->conv);
+          tile->block=p->conv;
+          gal_data_copy_to_allocated(tile, usage);
+          tile->array=tarray; tile->block=tblock;
+
+          /* Find all the quantiles of this tile together (with partial
+             sorting), then save them. Since the tile is already copied
+             into 'usage', the 'inplace' flag is set to '1' to avoid extra
+             allocation. Note that the type of 'qvalue' is the same as the
+             input dataset. */
+          quants[0]=p->qthresh;
+          quants[1]=p->noerodequant;
+          quants[2]=p->detgrowquant;
+          qvalue=gal_statistics_quantiles_select(usage, quants,
+                                                 qprm->expand_th ? 3 : 2, 1);
           memcpy(gal_pointer_increment(qprm->erode_th->array, tind, type),
                  qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the no-erode quantile. */
-          qvalue=gal_statistics_quantile(usage, p->noerodequant, 1);
           memcpy(gal_pointer_increment(qprm->noerode_th->array, tind, type),
-                 qvalue->array, twidth);
-          gal_data_free(qvalue);
-
-          /* Same for the expansion quantile. */
+                 gal_pointer_increment(qvalue->array, 1, type), twidth);
           if(qprm->expand_th)
-            {
-              qvalue=gal_statistics_quantile(usage, p->detgrowquant, 1);
-              memcpy(gal_pointer_increment(qprm->expand_th->array, tind,
-                                            type),
-                     qvalue->array, twidth);
-              gal_data_free(qvalue);
-            }
+            memcpy(gal_pointer_increment(qprm->expand_th->array, tind,
+                                         type),
+                   gal_pointer_increment(qvalue->array, 2, type), twidth);
+          gal_data_free(qvalue);
         }
       else
         {
@@ -579,102 +568,64 @@ threshold_good_error(size_t number, int before0_after1, size_t interpnumngb)
 
 
 
-void
-threshold_quantile_find_apply(struct noisechiselparams *p)
+/* Find the quantile thresholds on each tile. */
+static void
+threshold_quantile_find(struct noisechiselparams *p,
+                        struct qthreshparams *qprm)
 {
-  char *msg;
-  size_t nval;
-  gal_data_t *num;
-  struct timeval t1;
-  struct qthreshparams qprm;
   struct gal_options_common_params *cp=&p->cp;
   struct gal_tile_two_layer_params *tl=&cp->tl;
 
-
-  /* Get the starting time if necessary. */
-  if(!p->cp.quiet) gettimeofday(&t1, NULL);
-
-
-  /* Add image to check image if requested. If the user has asked for
-     'oneelempertile', then the size of values is not going to be the same
-     as the input, making it hard to inspect visually. So we'll only put
-     the full input when 'oneelempertile' isn't requested. */
-  if(p->qthreshname && !tl->oneelempertile)
-    {
-      gal_fits_img_write(p->conv ? p->conv : p->input, p->qthreshname,
-                         NULL, 0);
-      if(p->wconv)
-        gal_fits_img_write(p->wconv ? p->wconv : p->input, p->qthreshname,
-                           NULL, 0);
-    }
-
-
   /* Allocate space for the quantile threshold values. */
-  qprm.erode_th=gal_data_alloc(NULL, p->input->type, p->input->ndim,
-                               tl->numtiles, NULL, 0, cp->minmapsize,
-                               p->cp.quietmmap, NULL, p->input->unit,
-                               NULL);
-  qprm.noerode_th=gal_data_alloc(NULL, p->input->type, p->input->ndim,
-                                 tl->numtiles, NULL, 0, cp->minmapsize,
-                                 p->cp.quietmmap, NULL, p->input->unit,
-                                 NULL);
-  qprm.expand_th = ( p->detgrowquant!=1.0f
-                     ? gal_data_alloc(NULL, p->input->type, p->input->ndim,
-                                      tl->numtiles, NULL, 0, cp->minmapsize,
-                                      p->cp.quietmmap, NULL, p->input->unit,
-                                      NULL)
-                     : NULL );
+  qprm->erode_th=gal_data_alloc(NULL, p->input->type, p->input->ndim,
+                                tl->numtiles, NULL, 0, cp->minmapsize,
+                                p->cp.quietmmap, NULL, p->input->unit,
+                                NULL);
+  qprm->noerode_th=gal_data_alloc(NULL, p->input->type, p->input->ndim,
+                                  tl->numtiles, NULL, 0, cp->minmapsize,
+                                  p->cp.quietmmap, NULL, p->input->unit,
+                                  NULL);
+  qprm->expand_th = ( p->detgrowquant!=1.0f
+                      ? gal_data_alloc(NULL, p->input->type,
+                                       p->input->ndim, tl->numtiles, NULL,
+                                       0, cp->minmapsize, p->cp.quietmmap,
+                                       NULL, p->input->unit, NULL)
+                      : NULL );
 
 
   /* Allocate temporary space for processing in each tile. */
-  qprm.usage=gal_pointer_allocate(p->input->type,
-                                  cp->numthreads * p->maxtcontig, 0,
-                                  __func__, "qprm.usage");
+  qprm->usage=gal_pointer_allocate(p->input->type,
+                                   cp->numthreads * p->maxtcontig, 0,
+                                   __func__, "qprm->usage");
 
 
-  /* Find the threshold on each tile, free the temporary processing space
-     and set the blank flag on both. Since they have the same blank
-     elements, it is only necessary to check one (with the 'updateflag'
-     value set to 1), then update the next. */
-  qprm.p=p;
-  gal_threads_spin_off(qthresh_on_tile, &qprm, tl->tottiles,
+  /* Find the threshold on each tile and free the temporary processing
+     space. */
+  qprm->p=p;
+  gal_threads_spin_off(qthresh_on_tile, qprm, tl->tottiles,
                        cp->numthreads, cp->minmapsize,
                        cp->quietmmap);
-  free(qprm.usage);
-  if( gal_blank_present(qprm.erode_th, 1) )
-    {
-      qprm.noerode_th->flag |= GAL_DATA_FLAG_HASBLANK;
-      if(qprm.expand_th) qprm.expand_th->flag  |= GAL_DATA_FLAG_HASBLANK;
-    }
-  qprm.noerode_th->flag |= GAL_DATA_FLAG_BLANK_CH;
-  if(qprm.expand_th) qprm.expand_th->flag  |= GAL_DATA_FLAG_BLANK_CH;
-  if(p->qthreshname)
-    {
-      qprm.erode_th->name="QTHRESH_ERODE";
-      qprm.noerode_th->name="QTHRESH_NOERODE";
-      gal_tile_full_values_write(qprm.erode_th, tl,
-                                 !p->ignoreblankintiles,
-                                 p->qthreshname, NULL, 0);
-      gal_tile_full_values_write(qprm.noerode_th, tl,
-                                 !p->ignoreblankintiles,
-                                 p->qthreshname, NULL, 0);
-      qprm.erode_th->name=qprm.noerode_th->name=NULL;
-
-      if(qprm.expand_th)
-        {
-          qprm.expand_th->name="QTHRESH_EXPAND";
-          gal_tile_full_values_write(qprm.expand_th, tl,
-                                     !p->ignoreblankintiles,
-                                     p->qthreshname, NULL, 0);
-          qprm.expand_th->name=NULL;
-        }
-    }
+  free(qprm->usage);
+}
 
 
+
+
+
+/* Remove the outlier tiles and interpolate (and smooth) the thresholds of
+   the good tiles over all the tiles. */
+static void
+threshold_quantile_interp(struct noisechiselparams *p,
+                          struct qthreshparams *qprm)
+{
+  size_t nval;
+  gal_data_t *num;
+  struct gal_options_common_params *cp=&p->cp;
+
   /* Remove the outliers. */
   if(p->outliernumngb)
-    gal_tileinternal_no_outlier_local(qprm.erode_th, qprm.noerode_th,
-                                      qprm.expand_th, &cp->tl,
+    gal_tileinternal_no_outlier_local(qprm->erode_th, qprm->noerode_th,
+                                      qprm->expand_th, &cp->tl,
                                       cp->interpmetric, p->outliernumngb,
                                       cp->numthreads, p->outliersclip,
                                       p->outliersigma, p->qthreshname,
@@ -683,7 +634,7 @@ threshold_quantile_find_apply(struct noisechiselparams *p)
 
   /* Use the no-outlier grid as a basis for later estimating the sky. To
      see this array on the image, use 'gal_tile_full_values_write'. */
-  p->noskytiles=gal_blank_flag(qprm.erode_th);
+  p->noskytiles=gal_blank_flag(qprm->erode_th);
   /* For a check:
   gal_tile_full_values_write(p->noskytiles, &cp->tl, 1,
                              "noskytiles.fits", NULL, NULL);
@@ -694,7 +645,7 @@ threshold_quantile_find_apply(struct noisechiselparams *p)
      interpolated number. Since this is a common problem for users, it is
      much more useful to do the check here rather than printing multiple
      errors in parallel. */
-  num=gal_statistics_number(qprm.erode_th);
+  num=gal_statistics_number(qprm->erode_th);
   nval=((size_t *)(num->array))[0];
   if( nval < cp->interpnumngb )
     threshold_good_error(nval, 1, cp->interpnumngb);
@@ -702,9 +653,128 @@ threshold_quantile_find_apply(struct noisechiselparams *p)
 
 
   /* Interpolate and smooth the derived values. */
-  threshold_interp_smooth(p, &qprm.erode_th, &qprm.noerode_th,
-                          qprm.expand_th ? &qprm.expand_th : NULL,
+  threshold_interp_smooth(p, &qprm->erode_th, &qprm->noerode_th,
+                          qprm->expand_th ? &qprm->expand_th : NULL,
                           p->qthreshname);
+}
+
+
+
+
+
+void
+threshold_quantile_find_apply(struct noisechiselparams *p)
+{
+  size_t i;
+  char *msg;
+  int cached=0;
+  struct timeval t1;
+  struct qthreshparams qprm;
+  gal_data_t *th[CACHE_NUM_QTHRESH];
+  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+  gal_data_t *raw[CACHE_NUM_QTHRESH]={NULL, NULL, NULL};
+
+
+  /* Get the starting time if necessary. */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+
+
+  /* Add image to check image if requested. If the user has asked for
+     'oneelempertile', then the size of values is not going to be the same
+     as the input, making it hard to inspect visually. So we'll only put
+     the full input when 'oneelempertile' isn't requested. */
+  if(p->qthreshname && !tl->oneelempertile)
+    {
+      gal_fits_img_write(p->conv ? p->conv : p->input, p->qthreshname,
+                         NULL, 0);
+      if(p->wconv)
+        gal_fits_img_write(p->wconv ? p->wconv : p->input, p->qthreshname,
+                           NULL, 0);
+    }
+
+
+  /* If the final thresholds are in the cache, there is no need to find
+     them. But when the user wants to check the steps, they have to be
+     found again (only the final result is in the cache). */
+  if( p->cachename && p->qthreshname==NULL
+      && cache_read_qthresh(p, CACHE_QTHRESH, th) )
+    {
+      cached=1;
+      qprm.erode_th=th[0];
+      qprm.noerode_th=th[1];
+      qprm.expand_th=th[2];
+    }
+  else
+    {
+      /* Find the threshold on each tile (or read them from the cache). */
+      if( p->cachename && cache_read_qthresh(p, CACHE_QTHRESH_RAW, th) )
+        {
+          qprm.erode_th=th[0];
+          qprm.noerode_th=th[1];
+          qprm.expand_th=th[2];
+        }
+      else
+        threshold_quantile_find(p, &qprm);
+
+
+      /* Set the blank flag on both. Since they have the same blank
+         elements, it is only necessary to check one (with the
+         'updateflag' value set to 1), then update the next. */
+      if( gal_blank_present(qprm.erode_th, 1) )
+        {
+          qprm.noerode_th->flag |= GAL_DATA_FLAG_HASBLANK;
+          if(qprm.expand_th) qprm.expand_th->flag |= GAL_DATA_FLAG_HASBLANK;
+        }
+      qprm.noerode_th->flag |= GAL_DATA_FLAG_BLANK_CH;
+      if(qprm.expand_th) qprm.expand_th->flag  |= GAL_DATA_FLAG_BLANK_CH;
+      if(p->qthreshname)
+        {
+          qprm.erode_th->name="QTHRESH_ERODE";
+          qprm.noerode_th->name="QTHRESH_NOERODE";
+          gal_tile_full_values_write(qprm.erode_th, tl,
+                                     !p->ignoreblankintiles,
+                                     p->qthreshname, NULL, 0);
+          gal_tile_full_values_write(qprm.noerode_th, tl,
+                                     !p->ignoreblankintiles,
+                                     p->qthreshname, NULL, 0);
+          qprm.erode_th->name=qprm.noerode_th->name=NULL;
+
+          if(qprm.expand_th)
+            {
+              qprm.expand_th->name="QTHRESH_EXPAND";
+              gal_tile_full_values_write(qprm.expand_th, tl,
+                                         !p->ignoreblankintiles,
+                                         p->qthreshname, NULL, 0);
+              qprm.expand_th->name=NULL;
+            }
+        }
+
+
+      /* The thresholds of each tile are modified in the next step, so
+         keep a copy to write in the cache. */
+      if(p->cachename)
+        {
+          raw[0]=gal_data_copy(qprm.erode_th);
+          raw[1]=gal_data_copy(qprm.noerode_th);
+          if(qprm.expand_th) raw[2]=gal_data_copy(qprm.expand_th);
+        }
+
+
+      /* Remove outliers, interpolate and smooth. */
+      threshold_quantile_interp(p, &qprm);
+
+
+      /* Write the cache (if the final thresholds weren't already
+         there). */
+      if(p->cachename && p->cachevalid[CACHE_QTHRESH]==0)
+        {
+          th[0]=qprm.erode_th;
+          th[1]=qprm.noerode_th;
+          th[2]=qprm.expand_th;
+          cache_write(p, raw, th);
+        }
+      for(i=0;i<CACHE_NUM_QTHRESH;++i) gal_data_free(raw[i]);
+    }
 
 
   /* We now have a threshold for all tiles, apply it. */
@@ -730,8 +800,9 @@ threshold_quantile_find_apply(struct noisechiselparams *p)
   gal_data_free(qprm.noerode_th);
   if(!p->cp.quiet)
     {
-      if( asprintf(&msg, "%.2f & %0.2f quantile thresholds applied.",
-                   p->qthresh, p->noerodequant)<0 )
+      if( asprintf(&msg, "%.2f & %0.2f quantile thresholds %s.",
+                   p->qthresh, p->noerodequant,
+                   cached ? "read from cache and applied" : "applied")<0 )
         error(EXIT_FAILURE, 0, "%s: asprintf allocation", __func__);
       gal_timing_report(&t1, msg, 2);
       free(msg);
@@ -44,6 +44,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include "main.h"
 
 #include "ui.h"
+#include "cache.h"
 #include "authors-cite.h"
 
 
@@ -274,6 +275,12 @@ ui_check_only_options(struct noisechiselparams *p)
               "HDU identifier acceptable by CFITSIO", p->widekernelname);
     }
 
+  /* The cache is a multi-extension FITS file. */
+  if(p->cachename && gal_fits_name_is_fits(p->cachename)==0)
+    error(EXIT_FAILURE, 0, "%s: the cache file (given to '--cache') "
+          "must be a FITS file (for example with a '.fits' suffix)",
+          p->cachename);
+
   /* If the S/N quantile is less than 0.1 (an arbitrary small value), this
      is probably due to forgetting that this is the purity level
      (higher-is-better), not the contamination level
@@ -360,22 +367,28 @@ ui_set_output_names(struct noisechiselparams *p)
   char *output=p->cp.output;
   char *basename = output ? output : p->inputname;
 
-  /* Main program output. */
+  /* Main program output. When the output name is given (possibly with
+     directory information), the check images will also be put in that
+     same directory. */
   if(output)
-    {
-      /* Delete the file if it already exists. */
-      gal_checkset_writable_remove(p->cp.output, p->inputname, 0,
-                                   p->cp.dontdelete);
-
-      /* When the output name is given (possibly with directory
-         information), the check images will also be put in that same
-         directory.. */
-      p->cp.keepinputdir=1;
-    }
+    p->cp.keepinputdir=1;
   else
     p->cp.output=gal_checkset_automatic_output(&p->cp, p->inputname,
                                                "_detected.fits");
 
+  /* The cache is read before the output is written (and it is kept for
+     later runs), so they can't be the same file. */
+  if(p->cachename && !strcmp(p->cachename, p->cp.output))
+    error(EXIT_FAILURE, 0, "%s: the cache file (given to '--cache') "
+          "can't be the same as the output file. Please give a different "
+          "name to '--cache' or '--output'", p->cachename);
+
+  /* Delete the given output file if it already exists (an automatic
+     output is deleted by 'gal_checkset_automatic_output'). */
+  if(output)
+    gal_checkset_writable_remove(p->cp.output, p->inputname, 0,
+                                 p->cp.dontdelete);
+
   /* Tile check. */
   if(p->cp.tl.checktiles)
     p->cp.tl.tilecheckname=gal_checkset_automatic_output(&p->cp, basename,
@@ -703,6 +716,9 @@ ui_preparations(struct noisechiselparams *p)
                            p->cp.minmapsize, p->cp.quietmmap, NULL,
                            "labels", NULL);
   p->binary->flag = p->olabel->flag = p->input->flag;
+
+  /* See which stages can be read from the cache. */
+  if(p->cachename) cache_prepare(p);
 }
 
 
@@ -814,6 +830,8 @@ ui_read_check_inputs_setup(int argc, char *argv[],
       if(p->widekernelname)
         printf("  - Wide Kernel: %s (hdu: %s)\n", p->widekernelname,
                p->whdu);
+      if(p->cachename)
+        printf("  - Cache: %s\n", p->cachename);
     }
 }
 
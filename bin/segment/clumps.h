@@ -39,9 +39,11 @@ struct clumps_params
   gal_data_t            *snind; /* Array of clump S/N index (for check).   */
 
   /* For detections. */
-  gal_data_t        *labindexs; /* Array of 'gal_data_t' with obj indexs.  */
+  gal_data_t        *labindexs; /* Offsets and indexs of all detections.   */
   size_t            totobjects; /* Total number of objects at any point.   */
   size_t             totclumps; /* Total number of clumps at any point.    */
+  size_t          *numclumps_d; /* Number of true clumps in each detection.*/
+  size_t         *numobjects_d; /* Number of objects in each detection.    */
 };
 
 
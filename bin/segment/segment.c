@@ -30,6 +30,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/list.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/label.h>
 #include <gnuastro/binary.h>
@@ -60,11 +61,36 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /***********************************************************************/
 /*****************            Preparations             *****************/
 /***********************************************************************/
+/* Convolve the input with the given kernel. When the kernel is separable
+   (for example a Gaussian that isn't truncated), the two 1D convolutions
+   are much faster. */
+static gal_data_t *
+segment_convolve_kernel(struct segmentparams *p, gal_data_t *kernel)
+{
+  gal_data_t *out, *kernels;
+  struct gal_tile_two_layer_params *tl=&p->cp.tl;
+
+  if( (kernels=gal_convolve_kernel_separate(kernel)) )
+    {
+      out=gal_convolve_spatial_separable(tl->tiles, kernels,
+                                         p->cp.numthreads, 1,
+                                         tl->workoverch, 0);
+      gal_list_data_free(kernels);
+    }
+  else
+    out=gal_convolve_spatial(tl->tiles, kernel, p->cp.numthreads, 1,
+                             tl->workoverch, 0);
+  return out;
+}
+
+
+
+
+
 static void
 segment_convolve(struct segmentparams *p)
 {
   struct timeval t1;
-  struct gal_tile_two_layer_params *tl=&p->cp.tl;
 
   /* Convovle with sharper kernel. */
   if(p->conv==NULL)
@@ -74,9 +100,7 @@ segment_convolve(struct segmentparams *p)
         {
           /* Make the convolved image. */
           if(!p->cp.quiet) gettimeofday(&t1, NULL);
-          p->conv = gal_convolve_spatial(tl->tiles, p->kernel,
-                                         p->cp.numthreads, 1,
-                                         tl->workoverch, 0);
+          p->conv = segment_convolve_kernel(p, p->kernel);
 
           /* Report and write check images if necessary. */
           if(!p->cp.quiet)
@@ -717,50 +741,94 @@ segment_relab_clumps_in_objects(struct clumps_thread_params *cltprm)
    contiguous (the labels are contiguous, not the objects!) within each
    detection and start from 1. However, for the final output, it is
    necessary that each object over the whole dataset have a unique
-   ID. Since multiple threads are working on separate objects at every
-   instance, this function will use a mutex to limit the reading and
-   writing to the variable keeping the total number of objects counter. */
-static void
-segment_relab_overall(struct clumps_thread_params *cltprm)
+   ID. The detections are processed on multiple threads (and the largest
+   detections are processed first), so the number of labels in each
+   detection is only kept there (in 'numclumps_d' and 'numobjects_d'). This
+   function is called after all the detections are processed: it finds the
+   first label of each detection (in the order of the detections, so the
+   labels don't depend on the order they were processed) and this worker
+   adds it to the labels of each detection. */
+static void *
+segment_relab_overall_worker(void *in_prm)
 {
-  struct clumps_params *clprm=cltprm->clprm;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct clumps_params *clprm=(struct clumps_params *)(tprm->params);
+  struct segmentparams *p=clprm->p;
 
   int32_t startinglab;
-  uint8_t noobjects=clprm->p->noobjects;
-  size_t *s=cltprm->indexs->array, *sf=s+cltprm->indexs->size;
-  int32_t *clabel=clprm->p->clabel->array, *olabel=clprm->p->olabel->array;
-
-  /* Lock the mutex if we are working on more than one thread. NOTE: it is
-     very important to keep the number of operations within the mutex to a
-     minimum so other threads don't get delayed. */
-  if(clprm->p->cp.numthreads>1)
-    pthread_mutex_lock(&clprm->labmutex);
-
-  /* Set the starting label for re-labeling (THIS HAS TO BE BEFORE
-     CORRECTING THE TOTAL NUMBER OF CLUMPS/OBJECTS). */
-  startinglab = noobjects ? clprm->totclumps : clprm->totobjects;
-
-  /* Save the total number of clumps and objects. */
-  clprm->totclumps  += cltprm->numtrueclumps;
-  if( !noobjects ) clprm->totobjects += cltprm->numobjects;
-
-  /* Unlock the mutex (if it was locked). */
-  if(clprm->p->cp.numthreads>1)
-    pthread_mutex_unlock(&clprm->labmutex);
+  size_t i, id, *s, *sf, *offsets=clprm->labindexs->array;
+  size_t *labinds=clprm->labindexs->next->array;
+  int32_t *clabel=p->clabel->array, *olabel=p->olabel->array;
 
-  /* Increase all the object labels by 'startinglab'. */
-  if( noobjects )
+  /* Go over the detections of this thread. The first label of each
+     detection was written in its element of 'numobjects_d' (or
+     'numclumps_d' when only clumps are desired). */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
     {
-      if(cltprm->numtrueclumps>0)
+      /* Pixels of this detection and its first label. */
+      id=tprm->indexs[i]+1;
+      s=labinds+offsets[id];
+      sf=labinds+offsets[id+1];
+      if(s==sf) continue;
+      startinglab = ( p->noobjects
+                      ? clprm->numclumps_d[id]
+                      : clprm->numobjects_d[id] );
+
+      /* Increase all the labels by 'startinglab'. */
+      if( p->noobjects )
         {
           do
             if(clabel[*s]>0)
               clabel[*s] += startinglab;
           while(++s<sf);
         }
+      else
+        do olabel[*s] += startinglab; while(++s<sf);
     }
-  else
-    do olabel[*s] += startinglab; while(++s<sf);
+
+  /* Wait until all the threads finish then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+segment_relab_overall(struct clumps_params *clprm)
+{
+  size_t i, n, *numlabs;
+  struct segmentparams *p=clprm->p;
+
+  /* When the processing stopped before the final labels (for example in
+     the check steps), the number of labels of the detections are not
+     set and there is nothing to do. */
+  if(p->numdetections==0 || clprm->numclumps_d[1]==GAL_BLANK_SIZE_T)
+    return;
+
+  /* Find the total number of clumps and objects, and replace the number
+     of labels in each detection with the number of labels in all the
+     detections before it (the first label of this detection, minus one). */
+  clprm->totclumps=clprm->totobjects=0;
+  numlabs = p->noobjects ? clprm->numclumps_d : clprm->numobjects_d;
+  for(i=1;i<p->numdetections+1;++i)
+    {
+      clprm->totclumps += clprm->numclumps_d[i];
+      if( !p->noobjects ) clprm->totobjects += clprm->numobjects_d[i];
+      n=numlabs[i];
+      numlabs[i] = p->noobjects ? clprm->totclumps : clprm->totobjects;
+      numlabs[i] -= n;
+    }
+
+  /* Correct the labels of each detection. */
+  gal_threads_spin_off(segment_relab_overall_worker, clprm,
+                       p->numdetections, p->cp.numthreads,
+                       p->cp.minmapsize, p->cp.quietmmap);
+
+  /* Reset the number of labels (for the next call). */
+  for(i=0;i<p->numdetections+1;++i)
+    clprm->numclumps_d[i]=clprm->numobjects_d[i]=GAL_BLANK_SIZE_T;
 }
 
 
@@ -793,22 +861,34 @@ segment_on_threads(void *in_prm)
   struct clumps_params *clprm=(struct clumps_params *)(tprm->params);
   struct segmentparams *p=clprm->p;
 
-  size_t i, *s, *sf;
-  gal_data_t *topinds;
+  gal_data_t *topinds, *indexs;
+  size_t i, *s, *sf, one=1, *labinds=clprm->labindexs->next->array;
   struct clumps_thread_params cltprm;
+  size_t *offsets=clprm->labindexs->array;
   int32_t *clabel=p->clabel->array, *olabel=p->olabel->array;
 
-  /* Initialize the general parameters for this thread. */
+  /* Initialize the general parameters for this thread. The indexs of each
+     detection are within the compact array of all the indexs, so the
+     'indexs' container of this thread will just point to the respective
+     part of it (it doesn't own its array). */
   cltprm.clprm = clprm;
+  indexs=gal_data_alloc(labinds, GAL_TYPE_SIZE_T, 1, &one, NULL, 0, -1, 1,
+                        NULL, NULL, NULL);
 
-  /* Go over all the detections given to this thread (counting from zero.) */
-  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+  /* Go over all the detections given to this thread (counting from
+     zero). The detections can have very different sizes, so they are
+     distributed dynamically between the threads (largest first). */
+  while( (i=gal_threads_next(tprm)) != GAL_BLANK_SIZE_T )
     {
       /* Set the ID of this detection, note that for the threads, we
          counted from zero, but the IDs start from 1, so we'll add a 1 to
          the ID given to this thread. */
-      cltprm.id     = tprm->indexs[i]+1;
-      cltprm.indexs = &clprm->labindexs[ cltprm.id ];
+      cltprm.id     = i+1;
+      indexs->flag  = 0;
+      indexs->array = labinds + offsets[ cltprm.id ];
+      indexs->size  = indexs->dsize[0] = ( offsets[ cltprm.id+1 ]
+                                           - offsets[ cltprm.id ] );
+      cltprm.indexs = indexs;
       cltprm.numinitclumps = cltprm.numtrueclumps = cltprm.numobjects = 0;
 
 
@@ -988,10 +1068,17 @@ segment_on_threads(void *in_prm)
             }
         }
 
-      /* Convert the object labels to their final value */
-      segment_relab_overall(&cltprm);
+      /* Keep the number of labels in this detection (the final labels
+         are set after all detections are processed, see
+         'segment_relab_overall'). */
+      clprm->numclumps_d[ cltprm.id ]  = cltprm.numtrueclumps;
+      clprm->numobjects_d[ cltprm.id ] = cltprm.numobjects;
     }
 
+  /* Clean up (the array of 'indexs' isn't its own). */
+  indexs->array=NULL;
+  gal_data_free(indexs);
+
   /* Wait until all the threads finish then return. */
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
@@ -1141,13 +1228,25 @@ static void
 segment_detections(struct segmentparams *p)
 {
   char *msg;
+  size_t i, *costs, *offsets;
   struct clumps_params clprm;
   gal_data_t *labindexs, *claborig, *demo=NULL;
 
 
-  /* Get the indexs of all the pixels in each label. */
-  labindexs=gal_label_indexs(p->olabel, p->numdetections, p->cp.minmapsize,
-                             p->cp.quietmmap);
+  /* Get the indexs of all the pixels in each label (in one array, with
+     the offsets of each label in 'labindexs' and the indexs in
+     'labindexs->next'). */
+  labindexs=gal_label_indexs_compact(p->olabel, p->numdetections,
+                                     p->cp.numthreads, p->cp.minmapsize,
+                                     p->cp.quietmmap);
+  offsets=labindexs->array;
+
+
+  /* The cost of each detection is estimated by its number of pixels, so
+     the largest detections are started first. */
+  costs=gal_pointer_allocate(GAL_TYPE_SIZE_T, p->numdetections ?
+                             p->numdetections : 1, 0, __func__, "costs");
+  for(i=0;i<p->numdetections;++i) costs[i]=offsets[i+2]-offsets[i+1];
 
 
   /* Initialize the necessary thread parameters. Note that since the object
@@ -1159,10 +1258,14 @@ segment_detections(struct segmentparams *p)
   clprm.snind = NULL;
   clprm.labindexs=labindexs;
   clprm.sn=gal_data_array_calloc(p->numdetections+1);
-
-
-  /* When more than one thread is to be used, initialize the mutex. */
-  if( p->cp.numthreads > 1 ) pthread_mutex_init(&clprm.labmutex, NULL);
+  clprm.numclumps_d=gal_pointer_allocate(GAL_TYPE_SIZE_T,
+                                         p->numdetections+1, 0, __func__,
+                                         "clprm.numclumps_d");
+  clprm.numobjects_d=gal_pointer_allocate(GAL_TYPE_SIZE_T,
+                                          p->numdetections+1, 0, __func__,
+                                          "clprm.numobjects_d");
+  for(i=0;i<p->numdetections+1;++i)
+    clprm.numclumps_d[i]=clprm.numobjects_d[i]=GAL_BLANK_SIZE_T;
 
 
   /* Spin off the threads to start the work. Note that several steps are
@@ -1197,9 +1300,11 @@ segment_detections(struct segmentparams *p)
                    claborig->size*gal_type_sizeof(claborig->type));
 
           /* (Re-)do everything until this step. */
-          gal_threads_spin_off(segment_on_threads, &clprm,
-                               p->numdetections, p->cp.numthreads,
-                               p->cp.minmapsize, p->cp.quietmmap);
+          gal_threads_spin_off_costs(segment_on_threads, &clprm,
+                                     p->numdetections, p->cp.numthreads,
+                                     p->cp.minmapsize, p->cp.quietmmap,
+                                     costs);
+          segment_relab_overall(&clprm);
 
           /* Set the extension name. */
           switch(clprm.step)
@@ -1325,9 +1430,10 @@ segment_detections(struct segmentparams *p)
   else
     {
       clprm.step=0;
-      gal_threads_spin_off(segment_on_threads, &clprm, p->numdetections,
-                           p->cp.numthreads, p->cp.minmapsize,
-                           p->cp.quietmmap);
+      gal_threads_spin_off_costs(segment_on_threads, &clprm,
+                                 p->numdetections, p->cp.numthreads,
+                                 p->cp.minmapsize, p->cp.quietmmap, costs);
+      segment_relab_overall(&clprm);
     }
 
 
@@ -1349,10 +1455,12 @@ segment_detections(struct segmentparams *p)
   segment_reproducible_labels(p);
 
 
-  /* Clean up allocated structures and destroy the mutex. */
+  /* Clean up allocated structures. */
   gal_data_array_free(clprm.sn, p->numdetections+1, 1);
-  gal_data_array_free(labindexs, p->numdetections+1, 1);
-  if( p->cp.numthreads>1 ) pthread_mutex_destroy(&clprm.labmutex);
+  gal_list_data_free(labindexs);
+  free(clprm.numobjects_d);
+  free(clprm.numclumps_d);
+  free(costs);
 }
 
 
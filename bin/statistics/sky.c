@@ -78,12 +78,13 @@ sky_on_thread(void *in_prm)
           tile->block=p->convolved;
         }
 
-      /* Calculate the mean's quantile. */
+      /* Calculate the mean's quantile (in one pass over the tile, without
+         copying or sorting it). */
       mean=gal_statistics_mean(tile);
       num=gal_statistics_number(tile);
       mean=gal_data_copy_to_new_type_free(mean, itype);
       meanquant = ( *(size_t *)(num->array)
-                    ? gal_statistics_quantile_function(tile, mean, 1)
+                    ? gal_statistics_quantile_function_nosort(tile, mean)
                     : NULL );
 
       /* Reset the pointers of 'tile'. */
@@ -1882,9 +1882,10 @@ struct multioperandparams
 
 
 
-#define MULTIOPERAND_MEDIAN(TYPE, QSORT_F) {                            \
+#define MULTIOPERAND_MEDIAN(TYPE) {                                     \
     int use;                                                            \
-    size_t n, j;                                                        \
+    TYPE low;                                                           \
+    size_t n, j, k;                                                     \
     float *o=p->out->array;                                             \
     TYPE *pixs=gal_pointer_allocate(p->list->type, p->dnum, 0,          \
                                     __func__, "pixs");                  \
@@ -1910,11 +1911,19 @@ struct multioperandparams
             if(use) pixs[n++]=a[i][j];                                  \
           }                                                             \
                                                                         \
-        /* Sort all the values for this pixel and return the median. */ \
+        /* Select the middle value (no need for a full sort). When */   \
+        /* the number of values is even, the other middle element is */ \
+        /* the largest of the elements before it. */                    \
         if(n)                                                           \
           {                                                             \
-            qsort(pixs, n, sizeof *pixs, QSORT_F);                      \
-            o[j] = n%2 ? pixs[n/2] : (pixs[n/2] + pixs[n/2-1])/2 ;      \
+            gal_qsort_select(pixs, n, n/2, p->list->type);              \
+            if(n%2) o[j]=pixs[n/2];                                     \
+            else                                                        \
+              {                                                         \
+                for(low=pixs[0], k=1; k<n/2; ++k)                       \
+                  if(pixs[k]>low) low=pixs[k];                          \
+                o[j] = (pixs[n/2] + low)/2;                             \
+              }                                                         \
           }                                                             \
         else                                                            \
           o[j]=NAN; /* Not using 'b' because input may be integer */    \
@@ -2116,7 +2125,7 @@ struct multioperandparams
 
 
 
-#define MULTIOPERAND_TYPE_SET(TYPE, QSORT_F) {                          \
+#define MULTIOPERAND_TYPE_SET(TYPE) {                                   \
     TYPE b, **a;                                                        \
     gal_data_t *tmp;                                                    \
     size_t i=0, tind;                                                   \
@@ -2167,7 +2176,7 @@ struct multioperandparams
         break;                                                          \
                                                                         \
       case GAL_ARITHMETIC_OP_MEDIAN:                                    \
-        MULTIOPERAND_MEDIAN(TYPE, QSORT_F);                             \
+        MULTIOPERAND_MEDIAN(TYPE);                                      \
         break;                                                          \
                                                                         \
       case GAL_ARITHMETIC_OP_QUANTILE:                                  \
@@ -2225,34 +2234,34 @@ multioperand_on_thread(void *in_prm)
   switch(p->list->type)
     {
     case GAL_TYPE_UINT8:
-      MULTIOPERAND_TYPE_SET(uint8_t,   gal_qsort_uint8_i);
+      MULTIOPERAND_TYPE_SET(uint8_t);
       break;
     case GAL_TYPE_INT8:
-      MULTIOPERAND_TYPE_SET(int8_t,    gal_qsort_int8_i);
+      MULTIOPERAND_TYPE_SET(int8_t);
       break;
     case GAL_TYPE_UINT16:
-      MULTIOPERAND_TYPE_SET(uint16_t,  gal_qsort_uint16_i);
+      MULTIOPERAND_TYPE_SET(uint16_t);
       break;
     case GAL_TYPE_INT16:
-      MULTIOPERAND_TYPE_SET(int16_t,   gal_qsort_int16_i);
+      MULTIOPERAND_TYPE_SET(int16_t);
       break;
     case GAL_TYPE_UINT32:
-      MULTIOPERAND_TYPE_SET(uint32_t,  gal_qsort_uint32_i);
+      MULTIOPERAND_TYPE_SET(uint32_t);
       break;
     case GAL_TYPE_INT32:
-      MULTIOPERAND_TYPE_SET(int32_t,   gal_qsort_int32_i);
+      MULTIOPERAND_TYPE_SET(int32_t);
       break;
     case GAL_TYPE_UINT64:
-      MULTIOPERAND_TYPE_SET(uint64_t,  gal_qsort_uint64_i);
+      MULTIOPERAND_TYPE_SET(uint64_t);
       break;
     case GAL_TYPE_INT64:
-      MULTIOPERAND_TYPE_SET(int64_t,   gal_qsort_int64_i);
+      MULTIOPERAND_TYPE_SET(int64_t);
       break;
     case GAL_TYPE_FLOAT32:
-      MULTIOPERAND_TYPE_SET(float,     gal_qsort_float32_i);
+      MULTIOPERAND_TYPE_SET(float);
       break;
     case GAL_TYPE_FLOAT64:
-      MULTIOPERAND_TYPE_SET(double,    gal_qsort_float64_i);
+      MULTIOPERAND_TYPE_SET(double);
       break;
     default:
       error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
@@ -2474,11 +2483,11 @@ arithmetic_multioperand_clip_fill_worker(void *in_prm)
          outside the range can mask a very large portion of the input
          (after "filling" holes). */
       tmp = ( ndim==1
-              ? gal_binary_erode(tmp, 1, 1, 1)
-              : gal_binary_dilate(tmp, 1, 1, 1) );
+              ? gal_binary_erode(tmp, 1, 1, 1, 1)
+              : gal_binary_dilate(tmp, 1, 1, 1, 1) );
       gal_binary_holes_fill(tmp, ndim, tmp->size/50);
-      tmp=gal_binary_erode(tmp, 2, ndim, 1);
-      tmp=gal_binary_dilate(tmp, 2, ndim, 1);
+      tmp=gal_binary_erode(tmp, 2, ndim, 1, 1);
+      tmp=gal_binary_dilate(tmp, 2, ndim, 1, 1);
 
       /* Set all the 1-vaued pixels in the binary image to NaN in the
          input. */
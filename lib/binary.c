@@ -33,6 +33,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/blank.h>
 #include <gnuastro/binary.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
 
 
@@ -81,213 +82,288 @@ binary_erode_dilate_1d(gal_data_t *input, int dilate0_erode1)
 
 
 
-static void
-binary_erode_dilate_2d_4con(gal_data_t *input, int dilate0_erode1)
+/* Parameters for erosion and dilation on bit-packed datasets. Each row
+   (along the fastest dimension) is packed into 64-bit words: bit 'j' of
+   word 'k' is the pixel '64*k+j' of the row. Two bit-planes are necessary
+   because pixels that are not 0 or 1 (for example blank pixels) must not
+   change and must not affect their neighbors: 'ones' keeps the pixels
+   with a value of 1 and 'zeros' keeps the pixels with a value of 0. Since
+   all the pixels of an iteration must be updated together, there are two
+   buffers for each plane and 'curr' is the one with the current state. */
+struct binary_packed_params
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
-
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can "
-          "fix this problem. The value to 'dilate0_erode1' is %u while it "
-          "should be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values. */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
+  uint8_t              *byt;  /* Input/output array.                     */
+  size_t              ndim;  /* Number of dimensions.                    */
+  size_t            *dsize;  /* Size of each dimension.                  */
+  size_t            nrows;   /* Number of rows (along fastest dimension).*/
+  size_t            ncols;   /* Number of pixels in each row.            */
+  size_t           nwords;   /* Number of 64-bit words in each row.      */
+  size_t           *bands;   /* First row of each band (and the end).    */
+  size_t          *rowinc;   /* Rows to next element in slower dims.     */
+  uint64_t       *ones[2];   /* Pixels with a value of 1.                */
+  uint64_t      *zeros[2];   /* Pixels with a value of 0.                */
+  size_t             curr;   /* Buffer that has the current state.       */
+  int      dilate0_erode1;   /* Dilate (0) or erode (1).                 */
+  uint8_t           stage;   /* Packing, iterating or unpacking.         */
+  size_t           numoff;   /* Number of neighboring rows.              */
+  int            *offsets;   /* Offset of each neighboring row.          */
+  uint8_t           *full;   /* Neighbors within the row also count.     */
+};
+
+/* Stages of the bit-packed erosion or dilation. */
+enum binary_packed_stages
+{
+  BINARY_PACKED_PACK,
+  BINARY_PACKED_ITERATE,
+  BINARY_PACKED_UNPACK,
+};
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f || byt[nc]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nc-1]==b && (byt[nc-2]==f || byt[2*nc-1]==f))
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[(nr-1)*nc]==b
-     && (byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
 
-  if(byt[nr*nc-1]==b
-     && (byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
 
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && (byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
+/* Pack the rows of a band into the two bit-planes. */
+static void
+binary_packed_pack(struct binary_packed_params *p, size_t band)
+{
+  uint8_t *row;
+  size_t r, j, k;
+  uint64_t *o, *z;
 
-  for(j=1;j<nc-1;++j)
+  for(r=p->bands[band]; r<p->bands[band+1]; ++r)
     {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      row=p->byt + r*p->ncols;
+      o=p->ones[p->curr]  + r*p->nwords;
+      z=p->zeros[p->curr] + r*p->nwords;
+      for(k=0;k<p->nwords;++k) o[k]=z[k]=0;
+      for(j=0;j<p->ncols;++j)
+        {
+          o[j/64] |= (uint64_t)(row[j]==1) << (j%64);
+          z[j/64] |= (uint64_t)(row[j]==0) << (j%64);
+        }
     }
+}
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=i*nc;
-      if(byt[ind]==b
-         && (byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
-      {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f     || byt[ind+1]==f
-               || byt[ind+nc]==f || byt[ind-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
-      }
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+
+/* Write the bit-planes of a band back into the 'uint8_t' array: only the
+   pixels that were originally 0 or 1 can have changed. */
+static void
+binary_packed_unpack(struct binary_packed_params *p, size_t band)
+{
+  size_t r, j;
+  uint8_t *row;
+  uint64_t *o, *z;
+
+  for(r=p->bands[band]; r<p->bands[band+1]; ++r)
+    {
+      row=p->byt + r*p->ncols;
+      o=p->ones[p->curr]  + r*p->nwords;
+      z=p->zeros[p->curr] + r*p->nwords;
+      for(j=0;j<p->ncols;++j)
+        if( (o[j/64] | z[j/64]) >> (j%64) & 1 )
+          row[j] = o[j/64] >> (j%64) & 1;
+    }
 }
 
 
 
 
 
-/* 8 connected dilation and erosion. b0_f1==0: Dilate the
-   foreground. b0_f1==1: Erode the foreground. */
+/* One erosion or dilation on the rows of a band. For each row, the
+   foreground pixels of all its neighboring rows (and the neighbors within
+   each row when they are also neighbors) are merged with a bitwise OR
+   into 'n'. Background pixels that have a foreground neighbor become
+   foreground. */
 static void
-binary_erode_dilate_2d_8con(gal_data_t *input, unsigned char dilate0_erode1)
+binary_packed_iterate(struct binary_packed_params *p, size_t band,
+                      uint64_t *n)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, j, ind, nr=input->dsize[0], nc=input->dsize[1];
+  int *off;
+  size_t d, r, k, o, rr, c, nw=p->nwords, sdim=p->ndim-1;
+  uint64_t *f, *bg, *fout, *bgout, *fplane, *bgplane, nf;
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
+  /* Set the foreground and background planes. */
+  fplane  = p->dilate0_erode1 ? p->zeros[p->curr] : p->ones[p->curr];
+  bgplane = p->dilate0_erode1 ? p->ones[p->curr]  : p->zeros[p->curr];
 
-  /* Check the 4 corners: */
-  if(byt[0]==b && (byt[1]==f
-                   || byt[nc]==f || byt[nc+1]==f) )
-    byt[0]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nc-1]==b && (byt[nc-2]==f
-                      || byt[2*nc-1]==f
-                      || byt[2*nc-2]==f) )
-    byt[nc-1]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[(nr-1)*nc]==b
-     && ( byt[(nr-2)*nc]==f || byt[(nr-1)*nc+1]==f
-          || byt[(nr-2)*nc+1]==f) )
-    byt[(nr-1)*nc]=GAL_BINARY_TMP_VALUE;
-
-  if(byt[nr*nc-1]==b
-     && ( byt[nr*nc-2]==f || byt[nr*nc-1-nc]==f
-          || byt[nr*nc-2-nc]==f) )
-    byt[nr*nc-1]=GAL_BINARY_TMP_VALUE;
-
-  /* Check the 4 sides: */
-  for(j=1;j<nc-1;++j)
-    if(byt[j]==b
-       && ( byt[j+1]==f || byt[j-1]==f || byt[j+nc]==f
-            || byt[j-1+nc]==f || byt[j+1+nc]==f) )
-      byt[j]=GAL_BINARY_TMP_VALUE;
-
-  for(j=1;j<nc-1;++j)
+  /* Go over the rows. */
+  for(r=p->bands[band]; r<p->bands[band+1]; ++r)
     {
-      ind=(nr-1)*nc+j;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind-1]==f || byt[ind-nc]==f
-              || byt[ind-1-nc]==f || byt[ind+1-nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
+      /* Merge the foreground of all the neighbors. */
+      for(k=0;k<nw;++k) n[k]=0;
+      for(o=0;o<p->numoff;++o)
+        {
+          /* See if this neighboring row is within the dataset and find
+             its index. */
+          rr=r;
+          off=p->offsets+o*sdim;
+          for(d=0;d<sdim;++d)
+            {
+              c=r/p->rowinc[d]%p->dsize[d];
+              if( (off[d]<0 && c==0) || (off[d]>0 && c==p->dsize[d]-1) )
+                break;
+              if(off[d]<0)      rr-=p->rowinc[d];
+              else if(off[d]>0) rr+=p->rowinc[d];
+            }
+          if(d<sdim) continue;
+
+          /* Add its foreground pixels. */
+          f=fplane+rr*nw;
+          if(p->full[o])
+            for(k=0;k<nw;++k)
+              n[k] |= ( f[k] | f[k]<<1 | f[k]>>1
+                        | ( k      ? f[k-1]>>63 : 0 )
+                        | ( k+1<nw ? f[k+1]<<63 : 0 ) );
+          else
+            for(k=0;k<nw;++k) n[k] |= f[k];
+        }
+
+      /* Update the pixels. */
+      f     = fplane  + r*nw;
+      bg    = bgplane + r*nw;
+      fout  = ( p->dilate0_erode1 ? p->zeros : p->ones )[!p->curr] + r*nw;
+      bgout = ( p->dilate0_erode1 ? p->ones : p->zeros )[!p->curr] + r*nw;
+      for(k=0;k<nw;++k)
+        {
+          nf       = bg[k] & n[k];
+          fout[k]  = f[k] | nf;
+          bgout[k] = bg[k] & ~nf;
+        }
     }
+}
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=i*nc;
-      if(byt[ind]==b
-         && ( byt[ind+1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-              || byt[ind+1-nc]==f || byt[ind+1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  for(i=1;i<nr-1;++i)
-    {
-      ind=(i+1)*nc-1;
-      if(byt[ind]==b
-         && (byt[ind-1]==f || byt[ind+nc]==f || byt[ind-nc]==f
-             || byt[ind-1-nc]==f || byt[ind-1+nc]==f) )
-        byt[ind]=GAL_BINARY_TMP_VALUE;
-    }
 
-  /* Check the body: */
-  for(i=1;i<nr-1;++i)
-    for(j=1;j<nc-1;++j)
+
+
+/* Worker function for each band of rows. */
+static void *
+binary_packed_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_packed_params *p=(struct binary_packed_params *)tprm->params;
+
+  size_t i;
+  uint64_t *n=NULL;
+
+  /* Space to keep the neighbors of each row. */
+  if(p->stage==BINARY_PACKED_ITERATE)
+    n=gal_pointer_allocate(GAL_TYPE_UINT64, p->nwords, 0, __func__, "n");
+
+  /* Go over all the bands given to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    switch(p->stage)
       {
-        ind=i*nc+j;
-        if(byt[ind]==b
-           && (byt[ind-1]==f        || byt[ind+1]==f
-               || byt[ind+nc]==f    || byt[ind-nc]==f
-               || byt[ind-1-nc]==f  || byt[ind+1+nc]==f
-               || byt[ind-1+nc]==f  || byt[ind+1-nc]==f) )
-          byt[ind]=GAL_BINARY_TMP_VALUE;
+      case BINARY_PACKED_PACK:    binary_packed_pack(p, tprm->indexs[i]);
+        break;
+      case BINARY_PACKED_ITERATE: binary_packed_iterate(p, tprm->indexs[i],
+                                                        n);
+        break;
+      case BINARY_PACKED_UNPACK:  binary_packed_unpack(p, tprm->indexs[i]);
+        break;
+      default:
+        error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix "
+              "the problem. The stage code %u isn't recognized", __func__,
+              PACKAGE_BUGREPORT, p->stage);
       }
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+nr*nc;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+  /* Clean up, wait for the other threads to finish, then return. */
+  free(n);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
 }
 
 
 
 
 
-/* This is a general erosion and dilation function. It is less efficient
-   than the more specialized cases above. */
+/* Erosion or dilation ('num' times) of a dataset with two or more
+   dimensions. The dataset is packed into bits only once, then all the
+   'num' iterations are done on the packed bits: each 64-bit word covers
+   64 pixels of a row, and the neighbors along the row are found with bit
+   shifts. The rows are divided between the threads in bands. */
 static void
-binary_erode_dilate_general(gal_data_t *input, unsigned char dilate0_erode1,
-                            int connectivity)
+binary_erode_dilate_packed(gal_data_t *input, size_t num,
+                           int dilate0_erode1, int connectivity,
+                           size_t numthreads)
 {
-  uint8_t f, b, *pt, *fpt, *byt=input->array;
-  size_t i, *dinc=gal_dimension_increment(input->ndim, input->dsize);
+  int *off;
+  size_t i, d, nnz, numbands, numcomb, tmp, sdim=input->ndim-1;
+  struct binary_packed_params p={.byt=input->array, .ndim=input->ndim,
+                                 .dsize=input->dsize, .curr=0,
+                                 .dilate0_erode1=dilate0_erode1};
 
-  /* Do a sanity check: */
-  if(dilate0_erode1!=1 && dilate0_erode1!=0)
-    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s so we can fix "
-          "this problem. The value to dilate0_erode1 is %u while it should "
-          "be 0 or 1", __func__, PACKAGE_BUGREPORT, dilate0_erode1);
-
-  /* Set the foreground and background values: */
-  if(dilate0_erode1==0) {f=1; b=0;}
-  else                  {f=0; b=1;}
+  /* Sanity check. */
+  if(connectivity<1 || connectivity>input->ndim)
+    error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity in a "
+          "%zuD dataset", __func__, connectivity, input->ndim);
+
+  /* Sizes of the bit-planes. */
+  p.ncols=input->dsize[sdim];
+  p.nrows=input->size/p.ncols;
+  p.nwords=p.ncols/64 + (p.ncols%64 ? 1 : 0);
+  for(i=0;i<2;++i)
+    {
+      p.ones[i]=gal_pointer_allocate(GAL_TYPE_UINT64, p.nrows*p.nwords, 0,
+                                     __func__, "p.ones[i]");
+      p.zeros[i]=gal_pointer_allocate(GAL_TYPE_UINT64, p.nrows*p.nwords, 0,
+                                      __func__, "p.zeros[i]");
+    }
 
-  /* Go over the neighbors of each pixel. */
-  for(i=0;i<input->size;++i)
-    if(byt[i]==b)
-      GAL_DIMENSION_NEIGHBOR_OP(i, input->ndim, input->dsize, connectivity,
-                                dinc,{
-                                  if(byt[i]!=GAL_BINARY_TMP_VALUE
-                                     && byt[nind]==f)
-                                    byt[i]=GAL_BINARY_TMP_VALUE;
-                                });
+  /* Number of rows to the next element of each slower dimension. */
+  p.rowinc=gal_pointer_allocate(GAL_TYPE_SIZE_T, sdim ? sdim : 1, 0,
+                                __func__, "p.rowinc");
+  for(d=sdim;d--;)
+    p.rowinc[d] = d==sdim-1 ? 1 : p.rowinc[d+1]*input->dsize[d+1];
+
+  /* The neighboring rows: all the combinations of -1, 0 and 1 along the
+     slower dimensions that have a number of non-zero elements that is
+     less than or equal to the connectivity. When it is less than the
+     connectivity, the neighbors within the row are also neighbors. */
+  for(d=0, numcomb=1; d<sdim; ++d) numcomb*=3;
+  p.offsets=gal_pointer_allocate(GAL_TYPE_INT32, numcomb*(sdim?sdim:1), 0,
+                                 __func__, "p.offsets");
+  p.full=gal_pointer_allocate(GAL_TYPE_UINT8, numcomb, 0, __func__,
+                              "p.full");
+  for(p.numoff=i=0; i<numcomb; ++i)
+    {
+      nnz=0;
+      tmp=i;
+      off=p.offsets+p.numoff*sdim;
+      for(d=0;d<sdim;++d) { off[d]=(int)(tmp%3)-1; tmp/=3; nnz+=off[d]!=0; }
+      if(nnz<=connectivity) p.full[p.numoff++] = nnz<connectivity;
+    }
 
-  /* Set all the changed pixels to the proper values: */
-  fpt=(pt=byt)+input->size;
-  do *pt = *pt==GAL_BINARY_TMP_VALUE ? f : *pt; while(++pt<fpt);
+  /* Divide the rows into bands. */
+  numbands = numthreads>p.nrows ? p.nrows : (numthreads ? numthreads : 1);
+  p.bands=gal_pointer_allocate(GAL_TYPE_SIZE_T, numbands+1, 0, __func__,
+                               "p.bands");
+  for(i=0;i<=numbands;++i) p.bands[i]=i*p.nrows/numbands;
+
+  /* Pack the dataset, do the iterations, then unpack it. */
+  p.stage=BINARY_PACKED_PACK;
+  gal_threads_spin_off(binary_packed_on_thread, &p, numbands, numthreads,
+                       input->minmapsize, input->quietmmap);
+  p.stage=BINARY_PACKED_ITERATE;
+  for(i=0;i<num;++i)
+    {
+      gal_threads_spin_off(binary_packed_on_thread, &p, numbands,
+                           numthreads, input->minmapsize, input->quietmmap);
+      p.curr=!p.curr;
+    }
+  p.stage=BINARY_PACKED_UNPACK;
+  gal_threads_spin_off(binary_packed_on_thread, &p, numbands, numthreads,
+                       input->minmapsize, input->quietmmap);
+
+  /* Clean up. */
+  for(i=0;i<2;++i) { free(p.ones[i]); free(p.zeros[i]); }
+  free(p.full);
+  free(p.bands);
+  free(p.rowinc);
+  free(p.offsets);
 }
 
 
@@ -305,11 +381,9 @@ binary_erode_dilate_general(gal_data_t *input, unsigned char dilate0_erode1,
    when the input's type isn't 'uint8_t', 'inplace' is irrelevant. */
 static gal_data_t *
 binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
-                    int inplace, int d0e1)
+                    int inplace, int d0e1, size_t numthreads)
 {
-  size_t counter;
   gal_data_t *binary;
-  size_t *dinc=gal_dimension_increment(input->ndim, input->dsize);
 
   /* Currently this only works on blocks. */
   if(input->block)
@@ -329,30 +403,13 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
       binary_erode_dilate_1d(binary, d0e1);
       break;
 
-    case 2:
-      for(counter=0;counter<num;++counter)
-        switch(connectivity)
-          {
-          case 1: binary_erode_dilate_2d_4con(binary, d0e1); break;
-          case 2: binary_erode_dilate_2d_8con(binary, d0e1); break;
-          default:
-            error(EXIT_FAILURE, 0, "%s: %d not acceptable for connectivity "
-                  "in a 2D dataset", __func__, connectivity);
-          }
-      break;
-
-    case 3:
-      for(counter=0;counter<num;++counter)
-        binary_erode_dilate_general(binary, d0e1, connectivity);
-      break;
-
     default:
-      error(EXIT_FAILURE, 0, "%s: currently doesn't work on %zu "
-            "dimensional datasets", __func__, binary->ndim);
+      if(binary->size && num)
+        binary_erode_dilate_packed(binary, num, d0e1, connectivity,
+                                   numthreads);
     }
 
-  /* Clean up and return. */
-  free(dinc);
+  /* Return the output. */
   return binary;
 }
 
@@ -362,9 +419,10 @@ binary_erode_dilate(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
-                 int inplace)
+                 int inplace, size_t numthreads)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 1);
+  return binary_erode_dilate(input, num, connectivity, inplace, 1,
+                             numthreads);
 }
 
 
@@ -373,9 +431,10 @@ gal_binary_erode(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
-                  int inplace)
+                  int inplace, size_t numthreads)
 {
-  return binary_erode_dilate(input, num, connectivity, inplace, 0);
+  return binary_erode_dilate(input, num, connectivity, inplace, 0,
+                             numthreads);
 }
 
 
@@ -384,17 +443,17 @@ gal_binary_dilate(gal_data_t *input, size_t num, int connectivity,
 
 gal_data_t *
 gal_binary_open(gal_data_t *input, size_t num, int connectivity,
-                int inplace)
+                int inplace, size_t numthreads)
 {
   gal_data_t *out;
 
   /* First do the necessary number of erosions. */
-  out=gal_binary_erode(input, num, connectivity, inplace);
+  out=gal_binary_erode(input, num, connectivity, inplace, numthreads);
 
   /* If 'inplace' was called, then 'out' is the same as 'input', if it
      wasn't, then 'out' is a newly allocated array. In any case, we should
      dilate in the same allocated space. */
-  gal_binary_dilate(input, num, connectivity, 1);
+  gal_binary_dilate(out, num, connectivity, 1, numthreads);
 
   /* Return the output dataset. */
   return out;
@@ -485,17 +544,189 @@ gal_binary_number_neighbors(gal_data_t *input, int connectivity, int inplace)
 /*********************************************************************/
 /*****************      Connected components      ********************/
 /*********************************************************************/
-/* Find connected components in an intput dataset. */
+/* Parameters for labeling the connected components on multiple
+   threads. */
+struct binary_cc_params
+{
+  gal_data_t      *binary;  /* Input binary dataset.                     */
+  gal_data_t         *lab;  /* Output labels.                            */
+  int        connectivity;  /* Connectivity of the neighbors.            */
+  int            hasblank;  /* If the input has blank values.            */
+  size_t            *dinc;  /* Increment of each dimension.              */
+  size_t           *start;  /* First index of each slab (and the end).   */
+  size_t         **parent;  /* Parent of each provisional label in slab. */
+  size_t       *numlocal;  /* Number of provisional labels in slab.      */
+  size_t          *offset;  /* Global ID of first label of each slab.    */
+  int32_t          *final;  /* Final label of each global ID.            */
+};
+
+
+
+
+
+/* Find the root of the given element (with path compression: every
+   element's parent is set to its grand-parent). */
+static size_t
+binary_cc_find(size_t *parent, size_t i)
+{
+  while(parent[i]!=i)
+    {
+      parent[i]=parent[parent[i]];
+      i=parent[i];
+    }
+  return i;
+}
+
+
+
+
+
+/* Merge the sets of two elements: the root with the larger index is put
+   under the root with the smaller index. So the root of each set is
+   always its smallest element. */
+static void
+binary_cc_union(size_t *parent, size_t a, size_t b)
+{
+  size_t ra=binary_cc_find(parent, a), rb=binary_cc_find(parent, b);
+  if(ra<rb)      parent[rb]=ra;
+  else if(rb<ra) parent[ra]=rb;
+}
+
+
+
+
+
+/* First pass over each slab (a contiguous range of the slowest
+   dimension): every foreground pixel gets the provisional label of its
+   first labeled neighbor that is before it (in the same slab) and the
+   provisional labels of all such neighbors are merged. If none of them
+   is labeled, the pixel gets a new provisional label. The provisional
+   labels of each slab start from 1 and are given in the order of their
+   first pixel. */
+static void *
+binary_cc_first_pass(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_cc_params *p=(struct binary_cc_params *)tprm->params;
+
+  int32_t cur;
+  gal_data_t *binary=p->binary;
+  int32_t *l=p->lab->array;
+  uint8_t *b=binary->array;
+  size_t i, j, s, n, *parent, numparent;
+
+  /* Go over all the slabs given to this thread. */
+  for(j=0; tprm->indexs[j] != GAL_BLANK_SIZE_T; ++j)
+    {
+      /* Initialize the table of provisional labels. */
+      s=tprm->indexs[j];
+      n=0;
+      numparent=1024;
+      parent=gal_pointer_allocate(GAL_TYPE_SIZE_T, numparent, 0, __func__,
+                                  "parent");
+
+      /* Go over the pixels of this slab. */
+      for(i=p->start[s]; i<p->start[s+1]; ++i)
+        {
+          /* Blank and background pixels. */
+          if( p->hasblank && b[i]==GAL_BLANK_UINT8 )
+            { l[i]=GAL_BLANK_INT32; continue; }
+          if( b[i]==0 ) { l[i]=0; continue; }
+
+          /* Parse the neighbors that have already been labeled. */
+          cur=0;
+          GAL_DIMENSION_NEIGHBOR_OP(i, binary->ndim, binary->dsize,
+                                    p->connectivity, p->dinc,
+            {
+              if( nind<i && nind>=p->start[s] && l[nind]>0 )
+                {
+                  if(cur) binary_cc_union(parent, cur-1, l[nind]-1);
+                  else    cur=l[nind];
+                }
+            } );
+
+          /* None of the neighbors were labeled: new provisional label. */
+          if(cur==0)
+            {
+              if(n==INT32_MAX)
+                error(EXIT_FAILURE, 0, "%s: too many provisional labels "
+                      "in one thread, please use more threads", __func__);
+              if(n==numparent)
+                {
+                  numparent*=2;
+                  parent=realloc(parent, numparent*sizeof *parent);
+                  if(parent==NULL)
+                    error(EXIT_FAILURE, errno, "%s: couldn't re-allocate "
+                          "%zu bytes for 'parent'", __func__,
+                          numparent*sizeof *parent);
+                }
+              parent[n]=n;
+              cur=++n;
+            }
+          l[i]=cur;
+        }
+
+      /* Keep the table for the merging step. */
+      p->parent[s]=parent;
+      p->numlocal[s]=n;
+    }
+
+  /* Wait for the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Last pass over each slab: replace the provisional labels with the
+   final labels. */
+static void *
+binary_cc_final_pass(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct binary_cc_params *p=(struct binary_cc_params *)tprm->params;
+
+  size_t i, j, s;
+  int32_t *l=p->lab->array;
+
+  /* Go over all the slabs given to this thread. */
+  for(j=0; tprm->indexs[j] != GAL_BLANK_SIZE_T; ++j)
+    {
+      s=tprm->indexs[j];
+      for(i=p->start[s]; i<p->start[s+1]; ++i)
+        if(l[i]>0) l[i]=p->final[ p->offset[s] + l[i] - 1 ];
+    }
+
+  /* Wait for the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find connected components in an intput dataset.
+
+   The dataset is divided into slabs along its slowest dimension (one for
+   each thread) and the connected pieces within each slab are found
+   independently with a union-find structure. The pieces that touch each
+   other over the border of two slabs are then merged. Since the
+   provisional labels of all the slabs are given in the order of their
+   first pixel, the final label of each connected component is the same
+   as a single raster scan with a flood-fill: the labels are in the order
+   of the first pixel of each component. So the output doesn't depend on
+   the number of threads. */
 size_t
 gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
-                                int connectivity)
+                                int connectivity, size_t numthreads)
 {
-  int32_t *l;
-  uint8_t *b, *bf;
   gal_data_t *lab;
-  size_t p, i, curlab=1;
-  gal_list_sizet_t *Q=NULL;
-  size_t *dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  int32_t *l, curlab=0;
+  struct binary_cc_params p;
+  size_t i, s, g, r, numslabs, numglobal, slice, *global;
 
   /* Two small sanity checks. */
   if(binary->type!=GAL_TYPE_UINT8)
@@ -506,7 +737,9 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
           "must not be a tile", __func__);
 
 
-  /* Prepare the dataset for the labels. */
+  /* Prepare the dataset for the labels. Note that all the pixels of the
+     labels will be written in the first pass, so they don't need to be
+     initialized. */
   if(*out)
     {
       /* Use the given dataset.  */
@@ -522,72 +755,101 @@ gal_binary_connected_components(gal_data_t *binary, gal_data_t **out,
         error(EXIT_FAILURE, 0, "%s: the 'out' dataset must have 'int32' type"
               "but the array you have given is '%s' type", __func__,
               gal_type_name(lab->type, 1));
-
-      /* Reset all its values to zero. */
-      memset(lab->array, 0, lab->size * gal_type_sizeof(lab->type));
     }
   else
     lab=*out=gal_data_alloc(NULL, GAL_TYPE_INT32, binary->ndim,
-                            binary->dsize, binary->wcs, 1,
+                            binary->dsize, binary->wcs, 0,
                             binary->minmapsize, binary->quietmmap,
                             NULL, "labels", NULL);
+  if(binary->size==0) return 0;
+
+
+  /* Set the slabs: the slowest dimension is divided between the
+     threads. */
+  numslabs = numthreads==0 ? 1 : numthreads;
+  if(numslabs>binary->dsize[0]) numslabs=binary->dsize[0];
+  slice=binary->size/binary->dsize[0];
+  p.start=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs+1, 0, __func__,
+                               "p.start");
+  for(s=0;s<=numslabs;++s)
+    p.start[s] = slice * ( s * binary->dsize[0] / numslabs );
+
+
+  /* Label the pixels of each slab. Library must have no side effect: the
+     blank flag of the input should not be changed. */
+  p.lab=lab;
+  p.binary=binary;
+  p.connectivity=connectivity;
+  p.hasblank=gal_blank_present(binary, 0);
+  p.dinc=gal_dimension_increment(binary->ndim, binary->dsize);
+  p.parent=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs, 0, __func__,
+                                "p.parent");
+  p.numlocal=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs, 0, __func__,
+                                  "p.numlocal");
+  gal_threads_spin_off(binary_cc_first_pass, &p, numslabs, numthreads,
+                       binary->minmapsize, binary->quietmmap);
+
+
+  /* Put the provisional labels of all the slabs into one table (with a
+     global ID for each provisional label). */
+  numglobal=0;
+  p.offset=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs, 0, __func__,
+                                "p.offset");
+  for(s=0;s<numslabs;++s)
+    { p.offset[s]=numglobal; numglobal+=p.numlocal[s]; }
+  global=gal_pointer_allocate(GAL_TYPE_SIZE_T, numglobal ? numglobal : 1, 0,
+                              __func__, "global");
+  for(s=0;s<numslabs;++s)
+    {
+      for(i=0;i<p.numlocal[s];++i)
+        global[ p.offset[s]+i ] = ( p.offset[s]
+                                    + binary_cc_find(p.parent[s], i) );
+      free(p.parent[s]);
+    }
 
 
-  /* Initialize the labels array. If we have blank pixels in the byt
-     array, then give them the blank labeled array. Note that since
-     their value will not be 0, they will also not be labeled. */
-  l=lab->array;
-  bf=(b=binary->array)+binary->size; /* Library must have no side effect:*/
-  if( gal_blank_present(binary, 0) ) /* blank flag should not be changed.*/
-    do *l++ = *b==GAL_BLANK_UINT8 ? GAL_BLANK_INT32 : 0; while(++b<bf);
-
-
-  /* Go over all the pixels and do a breadth-first: any pixel that is not
-     labeled is used to label the full object by checking neighbors before
-     going onto the next pixels. */
+  /* Merge the provisional labels over the border of the slabs: only the
+     neighbors of the first plane of each slab can be in the previous
+     slab. */
   l=lab->array;
-  b=binary->array;
-  for(i=0;i<binary->size;++i)
-
-    /* Check if this pixel is already labeled. */
-    if( b[i] && l[i]==0 )
-      {
-        /* This is the first pixel of this connected region that we have
-           got to. */
-        l[i]=curlab;
-
-        /* Add this pixel to the queue of pixels to work with. */
-        gal_list_sizet_add(&Q, i);
-
-        /* While a pixel remains in the queue, continue labelling and
-           searching for neighbors. */
-        while(Q!=NULL)
+  for(s=1;s<numslabs;++s)
+    for(i=p.start[s]; i<p.start[s]+slice; ++i)
+      if(l[i]>0)
+        GAL_DIMENSION_NEIGHBOR_OP(i, binary->ndim, binary->dsize,
+                                  connectivity, p.dinc,
           {
-            /* Pop an element from the queue. */
-            p=gal_list_sizet_pop(&Q);
+            if( nind<p.start[s] && l[nind]>0 )
+              binary_cc_union(global, p.offset[s]   + l[i]-1,
+                                      p.offset[s-1] + l[nind]-1);
+          } );
+
+
+  /* Set the final label of each global ID. Global IDs are in the order
+     of their first pixel, so the first ID of each set is the one that
+     sets its final label. */
+  p.final=gal_pointer_allocate(GAL_TYPE_INT32, numglobal ? numglobal : 1, 0,
+                               __func__, "p.final");
+  for(g=0;g<numglobal;++g)
+    {
+      r=binary_cc_find(global, g);
+      p.final[g] = r==g ? ++curlab : p.final[r];
+    }
 
-            /* Go over all its neighbors and add them to the list if they
-               haven't already been labeled. */
-            GAL_DIMENSION_NEIGHBOR_OP(p, binary->ndim, binary->dsize,
-                                      connectivity, dinc,
-              {
-                if( b[ nind ] && l[ nind ]==0 )
-                  {
-                    l[ nind ] = curlab;
-                    gal_list_sizet_add(&Q, nind);
-                  }
-              } );
-          }
 
-        /* This object has been fully labeled, so increment the current
-           label. */
-        ++curlab;
-      }
+  /* Write the final labels. */
+  gal_threads_spin_off(binary_cc_final_pass, &p, numslabs, numthreads,
+                       binary->minmapsize, binary->quietmmap);
 
 
   /* Clean up and return the total number. */
-  free(dinc);
-  return curlab-1;
+  free(global);
+  free(p.dinc);
+  free(p.start);
+  free(p.final);
+  free(p.offset);
+  free(p.parent);
+  free(p.numlocal);
+  return curlab;
 }
 
 
@@ -958,7 +1220,7 @@ gal_binary_holes_label(gal_data_t *input, int connectivity,
 
   /* Label the holes. Recall that the first label is just the undetected
      regions, so we should subtract that from the total number.*/
-  *numholes=gal_binary_connected_components(inv, &holelabs, connectivity);
+  *numholes=gal_binary_connected_components(inv, &holelabs, connectivity, 1);
   *numholes -= 1;
 
 
@@ -1057,7 +1319,7 @@ gal_binary_holes_fill(gal_data_t *input, int connectivity, size_t maxsize)
   inv=binary_make_padded_inverse(input, &tile);
 
   /* Label the holes */
-  numholes=gal_binary_connected_components(inv, &holelabs, connectivity);
+  numholes=gal_binary_connected_components(inv, &holelabs, connectivity, 1);
 
   /* Any pixel with a label that is not touching the edges is a hole in the
      input image and we should invert the respective pixel. To do it, we'll
@@ -22,12 +22,15 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include <gsl/gsl_fft_complex.h>
+
 #include <gnuastro/list.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/threads.h>
@@ -70,6 +73,706 @@ convolve_tile_is_on_edge(size_t *h, size_t *start_end_coord, size_t *k,
 
 
 
+/* Return the (distinct) hosts of the given tiles: the full block when
+   'convoverch' is non-zero (or the input isn't a tessellation), or the
+   channels. The number of hosts is put in 'numhosts'. */
+static gal_data_t **
+convolve_hosts(gal_data_t *tiles, gal_data_t *block, int convoverch,
+               size_t *numhosts)
+{
+  size_t i;
+  gal_data_t *tile, **hosts;
+
+  /* Allocate the array (there can't be more hosts than tiles). */
+  errno=0;
+  hosts=malloc(gal_list_data_number(tiles) * sizeof *hosts);
+  if(hosts==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'hosts'", __func__,
+          gal_list_data_number(tiles) * sizeof *hosts);
+
+  /* Find the hosts. */
+  *numhosts=0;
+  if(convoverch || tiles->block==NULL) hosts[(*numhosts)++]=block;
+  else
+    for(tile=tiles; tile!=NULL; tile=tile->next)
+      {
+        for(i=0;i<*numhosts;++i) if(hosts[i]==tile->block) break;
+        if(i==*numhosts) hosts[(*numhosts)++]=tile->block;
+      }
+  return hosts;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/********************      Separable kernels      ********************/
+/*********************************************************************/
+/* A 2D kernel is separable when it is the product of two 1D kernels (one
+   along each dimension): K[y][x]=v[y]*h[x] (for example a Gaussian that
+   isn't truncated). In this case, convolution can be done as two 1D
+   convolutions (first along the rows, then along the columns) with
+   'kx+ky' multiplications for each pixel, instead of 'kx*ky'. Both passes
+   are simple loops over contiguous arrays, so they are vectorized by the
+   compiler. Like 'convolve_spatial_tile', the sums are kept in double
+   precision.
+
+   The rows of each host (a channel, or the full block) are divided into
+   strips of this many rows and the strips are given to the threads. */
+#define CONVOLVE_SEPARABLE_STRIP 64
+
+/* One strip of rows in a host. */
+struct convolve_separable_task
+{
+  gal_data_t        *host;  /* Host of this strip (channel or block).  */
+  size_t            start;  /* First row (relative to the host).       */
+  size_t              end;  /* Row after the last (relative to host).  */
+};
+
+/* Parameters for all the threads. */
+struct convolve_separable_params
+{
+  gal_data_t       *block;  /* Allocated block of the input.           */
+  gal_data_t         *out;  /* Output dataset.                         */
+  float                *v;  /* 1D kernel along the first dimension.    */
+  float                *h;  /* 1D kernel along the second dimension.   */
+  size_t               ky;  /* Number of elements in 'v'.              */
+  size_t               kx;  /* Number of elements in 'h'.              */
+  size_t             maxw;  /* Maximum width of the hosts.             */
+  int      edgecorrection;  /* Correct convolution's edge effects.     */
+  uint8_t   conv_on_blank;  /* Do convolution over blank pixels also.  */
+  struct convolve_separable_task *tasks; /* Strips of all the hosts.  */
+};
+
+
+
+
+
+/* If the 2D kernel is separable (to within 'GAL_CONVOLVE_SEPARABLE_TOL'
+   of its maximum absolute value), return the two 1D kernels (as a list:
+   the first along the first dimension). Otherwise, return NULL. */
+gal_data_t *
+gal_convolve_kernel_separate(gal_data_t *kernel)
+{
+  gal_data_t *out;
+  float *k=kernel->array, *v, *h;
+  double pivot, max=0.0, tol;
+  size_t x, y, r0=0, c0=0, ky, kx;
+
+  /* Only 2D, 32-bit floating point kernels are checked. */
+  if(kernel->ndim!=2 || kernel->type!=GAL_TYPE_FLOAT32) return NULL;
+  ky=kernel->dsize[0];
+  kx=kernel->dsize[1];
+
+  /* Find the element with the largest absolute value (the pivot). */
+  for(y=0;y<ky;++y)
+    for(x=0;x<kx;++x)
+      {
+        if( isnan(k[y*kx+x]) ) return NULL;
+        if( fabs(k[y*kx+x])>max ) { max=fabs(k[y*kx+x]); r0=y; c0=x; }
+      }
+  if(max==0.0) return NULL;
+
+  /* The vertical kernel is the pivot's column, and the horizontal kernel
+     is the pivot's row (divided by the pivot). */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &ky, NULL, 0, -1, 1,
+                     NULL, NULL, NULL);
+  out->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 1, &kx, NULL, 0, -1, 1,
+                           NULL, NULL, NULL);
+  v=out->array;
+  h=out->next->array;
+  pivot=k[r0*kx+c0];
+  for(y=0;y<ky;++y) v[y]=k[y*kx+c0];
+  for(x=0;x<kx;++x) h[x]=k[r0*kx+x]/pivot;
+
+  /* Make sure that the product of the two reproduces the kernel. */
+  tol=GAL_CONVOLVE_SEPARABLE_TOL*max;
+  for(y=0;y<ky;++y)
+    for(x=0;x<kx;++x)
+      if( fabs( k[y*kx+x] - (double)v[y]*h[x] ) > tol )
+        { gal_list_data_free(out); return NULL; }
+  return out;
+}
+
+
+
+
+
+/* Convolve the strips of rows that were given to this thread. */
+static void *
+convolve_separable_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct convolve_separable_params *sp=
+    (struct convolve_separable_params *)(tprm->params);
+
+  gal_data_t *host;
+  int hasblank, edgecor=sp->edgecorrection;
+  double hj, vi, vsum, ksum, *tr, *mr, *p;
+  float *irow, *orow, *in=sp->block->array, *out=sp->out->array;
+  float *v=sp->v, *h=sp->h;
+  size_t i, j, x, y, r, ind, rs, re, H, W, x0, y0, hstart[2];
+  size_t ky=sp->ky, kx=sp->kx, bw=sp->block->dsize[1], pw=sp->maxw+kx-1;
+  size_t nrows=CONVOLVE_SEPARABLE_STRIP+ky-1;
+
+  /* Allocate this thread's buffers: the (zero-padded) input row and mask
+     ('pad' and 'mpad'), the rows after the first pass ('t' and 'm') and
+     the rows after the second pass ('acc' and 'macc'). */
+  double *pad =gal_pointer_allocate(GAL_TYPE_FLOAT64, pw, 1, __func__,
+                                    "pad");
+  double *mpad=gal_pointer_allocate(GAL_TYPE_FLOAT64, pw, 1, __func__,
+                                    "mpad");
+  double *t   =gal_pointer_allocate(GAL_TYPE_FLOAT64, nrows*sp->maxw, 0,
+                                    __func__, "t");
+  double *m   =gal_pointer_allocate(GAL_TYPE_FLOAT64, nrows*sp->maxw, 0,
+                                    __func__, "m");
+  double *acc =gal_pointer_allocate(GAL_TYPE_FLOAT64, sp->maxw, 0,
+                                    __func__, "acc");
+  double *macc=gal_pointer_allocate(GAL_TYPE_FLOAT64, sp->maxw, 0,
+                                    __func__, "macc");
+  double *hsum=gal_pointer_allocate(GAL_TYPE_FLOAT64, sp->maxw, 0,
+                                    __func__, "hsum");
+
+  /* Go over all the strips given to this thread. */
+  for(ind=0; tprm->indexs[ind] != GAL_BLANK_SIZE_T; ++ind)
+    {
+      /* Basic settings of this strip. */
+      host=sp->tasks[ tprm->indexs[ind] ].host;
+      gal_tile_start_coord(host, hstart);
+      H=host->dsize[0];      y0=hstart[0];
+      W=host->dsize[1];      x0=hstart[1];
+      y=sp->tasks[ tprm->indexs[ind] ].start;
+
+      /* Input rows that are necessary for this strip. */
+      rs = y<ky/2 ? 0 : y-ky/2;
+      re = sp->tasks[ tprm->indexs[ind] ].end + ky-1-ky/2;
+      if(re>H) re=H;
+
+      /* See if there are any blank pixels in the necessary rows (if there
+         aren't any, the sum of the kernel over each pixel only depends on
+         the host's edges). */
+      hasblank=0;
+      for(r=rs; r<re && hasblank==0; ++r)
+        {
+          irow=in+(y0+r)*bw+x0;
+          for(x=0;x<W;++x) if( isnan(irow[x]) ) { hasblank=1; break; }
+        }
+
+      /* First pass (along the rows). Blank pixels and the pixels outside
+         the host have a value of zero in the padded row, and a value of
+         zero in the mask. */
+      for(x=W+kx/2; x<W+kx-1; ++x) pad[x]=mpad[x]=0.0;
+      for(r=rs; r<re; ++r)
+        {
+          irow=in+(y0+r)*bw+x0;
+          tr=t+(r-rs)*W;
+          for(x=0;x<W;++x) pad[kx/2+x] = isnan(irow[x]) ? 0.0 : irow[x];
+          for(x=0;x<W;++x) tr[x]=0.0;
+          for(j=0;j<kx;++j)
+            { hj=h[j]; p=pad+j; for(x=0;x<W;++x) tr[x] += hj*p[x]; }
+
+          /* The same for the mask (only when necessary). */
+          if(hasblank && edgecor)
+            {
+              mr=m+(r-rs)*W;
+              for(x=0;x<W;++x)
+                mpad[kx/2+x] = isnan(irow[x]) ? 0.0 : 1.0;
+              for(x=0;x<W;++x) mr[x]=0.0;
+              for(j=0;j<kx;++j)
+                { hj=h[j]; p=mpad+j; for(x=0;x<W;++x) mr[x] += hj*p[x]; }
+            }
+        }
+
+      /* Without blank pixels, the sum of the horizontal kernel over each
+         column only depends on the host's edge. */
+      if(hasblank==0 && edgecor)
+        for(x=0;x<W;++x)
+          for(hsum[x]=0.0, j=0;j<kx;++j)
+            if( x+j>=kx/2 && x+j-kx/2<W ) hsum[x]+=h[j];
+
+      /* Second pass (along the columns) and writing of the output. */
+      for(; y<sp->tasks[ tprm->indexs[ind] ].end; ++y)
+        {
+          /* Convolve this row along the columns. */
+          vsum=0.0;
+          for(x=0;x<W;++x) acc[x]=macc[x]=0.0;
+          for(i=0;i<ky;++i)
+            if( y+i>=ky/2 && y+i-ky/2<H )
+              {
+                vi=v[i];
+                vsum+=vi;
+                tr=t+(y+i-ky/2-rs)*W;
+                for(x=0;x<W;++x) acc[x] += vi*tr[x];
+                if(hasblank && edgecor)
+                  {
+                    mr=m+(y+i-ky/2-rs)*W;
+                    for(x=0;x<W;++x) macc[x] += vi*mr[x];
+                  }
+              }
+
+          /* Write the output (same as 'convolve_spatial_tile'). */
+          irow=in+(y0+y)*bw+x0;
+          orow=out+(y0+y)*bw+x0;
+          for(x=0;x<W;++x)
+            if( isnan(irow[x]) && sp->conv_on_blank==0 ) orow[x]=NAN;
+            else
+              {
+                ksum = ( edgecor
+                         ? (hasblank ? macc[x] : vsum*hsum[x])
+                         : 1.0 );
+                orow[x] = ksum==0.0 ? NAN : acc[x]/ksum;
+              }
+        }
+    }
+
+  /* Clean up, wait until all other threads finish, then return. */
+  free(t);
+  free(m);
+  free(pad);
+  free(acc);
+  free(mpad);
+  free(macc);
+  free(hsum);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Convolve all the hosts of the given tiles (the channels, or the full
+   block when 'convoverch' is non-zero) with the two 1D kernels. */
+static void
+convolve_separable(gal_data_t *tiles, gal_data_t *kernels, gal_data_t *out,
+                   size_t numthreads, int edgecorrection, int convoverch,
+                   uint8_t conv_on_blank)
+{
+  gal_data_t **hosts;
+  size_t i, y, numhosts, numtasks=0;
+  struct convolve_separable_params sp;
+  gal_data_t *block=gal_tile_block(tiles);
+
+  /* Find the hosts (the full block, or the distinct channels). */
+  hosts=convolve_hosts(tiles, block, convoverch, &numhosts);
+
+  /* Set the parameters and divide the hosts into strips. */
+  sp.out=out;
+  sp.maxw=0;
+  sp.block=block;
+  sp.v=kernels->array;
+  sp.h=kernels->next->array;
+  sp.ky=kernels->size;
+  sp.kx=kernels->next->size;
+  sp.conv_on_blank=conv_on_blank;
+  sp.edgecorrection=edgecorrection;
+  for(i=0;i<numhosts;++i)
+    {
+      numtasks += ( hosts[i]->dsize[0] + CONVOLVE_SEPARABLE_STRIP - 1 )
+                  / CONVOLVE_SEPARABLE_STRIP;
+      if(hosts[i]->dsize[1]>sp.maxw) sp.maxw=hosts[i]->dsize[1];
+    }
+  errno=0;
+  sp.tasks=malloc(numtasks * sizeof *sp.tasks);
+  if(sp.tasks==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'sp.tasks'", __func__,
+          numtasks * sizeof *sp.tasks);
+  numtasks=0;
+  for(i=0;i<numhosts;++i)
+    for(y=0; y<hosts[i]->dsize[0]; y+=CONVOLVE_SEPARABLE_STRIP)
+      {
+        sp.tasks[numtasks].host=hosts[i];
+        sp.tasks[numtasks].start=y;
+        sp.tasks[numtasks].end = ( y+CONVOLVE_SEPARABLE_STRIP
+                                   < hosts[i]->dsize[0]
+                                   ? y+CONVOLVE_SEPARABLE_STRIP
+                                   : hosts[i]->dsize[0] );
+        ++numtasks;
+      }
+
+  /* Do the convolution on the threads. */
+  gal_threads_spin_off(convolve_separable_on_thread, &sp, numtasks,
+                       numthreads, block->minmapsize, block->quietmmap);
+
+  /* Clean up. */
+  free(hosts);
+  free(sp.tasks);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*********************************************************************/
+/********************  Frequency domain convolution  *****************/
+/*********************************************************************/
+/* In the frequency domain, the cost of convolving each pixel doesn't
+   depend on the number of kernel elements. The hosts (channels or the
+   full block) are divided into blocks (of 'B0xB1' pixels). For each
+   block, a window of 'N0xN1' pixels (the block, with half the kernel's
+   width on each side) is transformed, multiplied by the (already
+   transformed) kernel and transformed back. The circular convolution of
+   the window is identical to the linear convolution on the pixels of the
+   block: 'N=B+K-1' (where 'K' is the kernel width). Since every block
+   only writes into its own pixels of the output, the blocks are simply
+   distributed between the threads (to be independently transformed).
+
+   To treat blank pixels (and pixels outside the host) in the same way as
+   spatial convolution, a mask (with a value of 1 for the usable pixels
+   and 0 for the rest) is put in the imaginary part of the window (the
+   input with zero on the blank pixels is in the real part). Since the
+   kernel is real, after the inverse transform, the real part is the
+   convolved input and the imaginary part is the sum of the kernel over
+   the usable pixels (used for the edge correction). So one transform is
+   enough for both. */
+
+/* Largest width of the transforms along each dimension (unless the kernel
+   is larger). */
+#define CONVOLVE_FREQUENCY_MAX_WIDTH 1024
+
+/* Sums of the kernel over the usable pixels that are smaller than this
+   fraction of the sum of its absolute values are considered to be zero
+   (the pixel will be blank with edge correction, like the spatial
+   convolution when no usable pixel overlaps with it). In double
+   precision, the errors of the transforms are well below it. */
+#define CONVOLVE_FREQUENCY_MIN_WEIGHT 1e-10
+
+/* One block of a host. */
+struct convolve_frequency_task
+{
+  gal_data_t        *host;  /* Host of this block (channel or block).  */
+  size_t         start[2];  /* First pixel (relative to the host).     */
+};
+
+/* Parameters for all the threads. */
+struct convolve_frequency_params
+{
+  gal_data_t       *block;  /* Allocated block of the input.           */
+  gal_data_t         *out;  /* Output dataset.                         */
+  size_t             k[2];  /* Size of the kernel.                     */
+  size_t             n[2];  /* Size of the transforms (window).        */
+  size_t             b[2];  /* Size of each block (in the output).     */
+  double          *kernel;  /* Transformed kernel (complex).           */
+  double        minweight;  /* Sums of the kernel smaller than this    */
+                            /* mean that no usable pixel overlaps.     */
+  int      edgecorrection;  /* Correct convolution's edge effects.     */
+  uint8_t   conv_on_blank;  /* Do convolution over blank pixels also.  */
+  gsl_fft_complex_wavetable *wave[2]; /* Wavetables (for each dim).    */
+  struct convolve_frequency_task *tasks; /* Blocks of all the hosts.   */
+};
+
+
+
+
+
+/* Width of the transforms along one dimension: 'k' is the width of the
+   kernel and 'h' is the largest width of the hosts along this
+   dimension. The total number of operations to convolve a host is
+   roughly proportional to 'n*log(n)' for every block, so the width (that
+   only has 2, 3 and 5 as prime factors, for fast transforms) that
+   minimizes the total cost is used. */
+static size_t
+convolve_frequency_width(size_t k, size_t h)
+{
+  double cost, mincost=0.0f;
+  size_t n, r, best=0, need=h+k-1;
+  size_t max = 2*k>CONVOLVE_FREQUENCY_MAX_WIDTH ? 2*k
+                                                : CONVOLVE_FREQUENCY_MAX_WIDTH;
+
+  for(n=k+1; n<=max; ++n)
+    {
+      /* Only widths with small prime factors. */
+      r=n;
+      while(r%2==0) r/=2;
+      while(r%3==0) r/=3;
+      while(r%5==0) r/=5;
+      if(r!=1) continue;
+
+      /* Total cost over this host. */
+      cost = n * log(n) * ( (h + n-k) / (n-k+1) );
+      if(best==0 || cost<mincost) { best=n; mincost=cost; }
+
+      /* A single block covers the host, so larger widths are useless. */
+      if(n>=need) break;
+    }
+  return best;
+}
+
+
+
+
+
+/* Two dimensional transform of a complex array of 'n[0]xn[1]' elements
+   ('sign' is the direction). Along the second dimension, only the 'nrows'
+   rows starting from 'firstrow' are transformed: in the forward
+   transform, the rows after the window are zero (so their transform is
+   also zero) and in the backward transform, only the rows of the block
+   are necessary. So in the forward transform, the rows are transformed
+   first and in the backward transform, the columns are transformed
+   first. */
+static void
+convolve_frequency_fft2d(double *data, size_t *n, size_t firstrow,
+                         size_t nrows, gsl_fft_direction sign,
+                         gsl_fft_complex_wavetable **wave,
+                         gsl_fft_complex_workspace **work)
+{
+  size_t i;
+
+  if(sign==gsl_fft_forward)
+    for(i=firstrow;i<firstrow+nrows;++i)
+      gsl_fft_complex_transform(data+2*i*n[1], 1, n[1], wave[1], work[1],
+                                sign);
+  for(i=0;i<n[1];++i)
+    gsl_fft_complex_transform(data+2*i, n[1], n[0], wave[0], work[0],
+                              sign);
+  if(sign==gsl_fft_backward)
+    for(i=firstrow;i<firstrow+nrows;++i)
+      gsl_fft_complex_transform(data+2*i*n[1], 1, n[1], wave[1], work[1],
+                                sign);
+}
+
+
+
+
+
+/* Convolve the blocks that were given to this thread. */
+static void *
+convolve_frequency_on_thread(void *inparam)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)inparam;
+  struct convolve_frequency_params *fp=
+    (struct convolve_frequency_params *)(tprm->params);
+
+  gal_data_t *host;
+  double re, im, *w, *kf=fp->kernel;
+  size_t *n=fp->n, *k=fp->k, nn=fp->n[0]*fp->n[1];
+  float v, *in=fp->block->array, *out=fp->out->array;
+  size_t i, x, y, hx, hy, ind, by, bx, wy, wx, hstart[2];
+  size_t bw=fp->block->dsize[1];
+  gsl_fft_complex_workspace *work[2];
+  double *win=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*nn, 0, __func__,
+                                   "win");
+
+  /* Each thread needs its own workspaces. */
+  work[0]=gsl_fft_complex_workspace_alloc(n[0]);
+  work[1]=gsl_fft_complex_workspace_alloc(n[1]);
+
+  /* Go over all the blocks given to this thread. */
+  for(ind=0; tprm->indexs[ind] != GAL_BLANK_SIZE_T; ++ind)
+    {
+      /* Basic settings of this block: 'by' and 'bx' are the number of
+         pixels in it, while 'wy' and 'wx' are the number of pixels in
+         the window. */
+      host=fp->tasks[ tprm->indexs[ind] ].host;
+      y=fp->tasks[ tprm->indexs[ind] ].start[0];
+      x=fp->tasks[ tprm->indexs[ind] ].start[1];
+      gal_tile_start_coord(host, hstart);
+      by = host->dsize[0]-y < fp->b[0] ? host->dsize[0]-y : fp->b[0];
+      bx = host->dsize[1]-x < fp->b[1] ? host->dsize[1]-x : fp->b[1];
+      wy = by + k[0] - 1;
+      wx = bx + k[1] - 1;
+
+      /* Fill the window: coordinates in the window are relative to the
+         first pixel of the block minus half the kernel. */
+      memset(win, 0, 2*nn*sizeof *win);
+      for(i=0;i<wy;++i)
+        {
+          /* Only rows that are within the host. */
+          if(y+i<k[0]/2 || y+i-k[0]/2>=host->dsize[0]) continue;
+          hy=y+i-k[0]/2;
+          w=win+2*i*n[1];
+          for(hx = x<k[1]/2 ? 0 : x-k[1]/2;
+              hx<x+wx-k[1]/2 && hx<host->dsize[1]; ++hx)
+            {
+              v=in[ (hstart[0]+hy)*bw + hstart[1]+hx ];
+              if( !isnan(v) )
+                {
+                  w[ 2*(hx+k[1]/2-x)   ] = v;
+                  w[ 2*(hx+k[1]/2-x)+1 ] = 1.0f;
+                }
+            }
+        }
+
+      /* Forward transform, multiplication with the transformed kernel
+         and backward transform. In the backward transform, only the
+         rows of the block are necessary. */
+      convolve_frequency_fft2d(win, n, 0, wy, gsl_fft_forward, fp->wave,
+                               work);
+      for(i=0;i<nn;++i)
+        {
+          re = win[2*i]*kf[2*i]   - win[2*i+1]*kf[2*i+1];
+          im = win[2*i]*kf[2*i+1] + win[2*i+1]*kf[2*i];
+          win[2*i]=re;
+          win[2*i+1]=im;
+        }
+      convolve_frequency_fft2d(win, n, k[0]/2, by, gsl_fft_backward,
+                               fp->wave, work);
+
+      /* Write the output (similar to 'convolve_spatial_tile'). Note that
+         GSL's backward transform isn't normalized. */
+      for(hy=y; hy<y+by; ++hy)
+        {
+          w=win+2*( (hy-y+k[0]/2)*n[1] + k[1]/2 );
+          for(hx=x; hx<x+bx; ++hx, w+=2)
+            {
+              i=(hstart[0]+hy)*bw + hstart[1]+hx;
+              if( isnan(in[i]) && fp->conv_on_blank==0 ) out[i]=NAN;
+              else
+                {
+                  re=w[0]/nn;
+                  im=w[1]/nn;
+                  out[i] = ( fp->edgecorrection
+                             ? ( fabs(im)<fp->minweight ? NAN : re/im )
+                             : re );
+                }
+            }
+        }
+    }
+
+  /* Clean up, wait until all other threads finish, then return. */
+  free(win);
+  gsl_fft_complex_workspace_free(work[0]);
+  gsl_fft_complex_workspace_free(work[1]);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Convolve all the hosts of the given tiles (the channels, or the full
+   block when 'convoverch' is non-zero) in the frequency domain. */
+static void
+convolve_frequency(gal_data_t *tiles, gal_data_t *kernel, gal_data_t *out,
+                   size_t numthreads, int edgecorrection, int convoverch,
+                   uint8_t conv_on_blank)
+{
+  float *k=kernel->array;
+  gal_data_t **hosts;
+  double kabs=0.0;
+  struct convolve_frequency_params fp;
+  gal_data_t *block=gal_tile_block(tiles);
+  size_t i, y, x, numhosts, numtasks=0, maxh[2]={0,0};
+  gsl_fft_complex_workspace *work[2];
+
+  /* Find the hosts (the full block, or the distinct channels) and the
+     size of the transforms. */
+  hosts=convolve_hosts(tiles, block, convoverch, &numhosts);
+  for(i=0;i<numhosts;++i)
+    {
+      if(hosts[i]->dsize[0]>maxh[0]) maxh[0]=hosts[i]->dsize[0];
+      if(hosts[i]->dsize[1]>maxh[1]) maxh[1]=hosts[i]->dsize[1];
+    }
+  for(i=0;i<2;++i)
+    {
+      fp.k[i]=kernel->dsize[i];
+      fp.n[i]=convolve_frequency_width(fp.k[i], maxh[i]);
+      fp.b[i]=fp.n[i]-fp.k[i]+1;
+    }
+
+  /* When no usable pixel overlaps with a pixel, the sum of the kernel
+     over the usable pixels is zero (but not exactly, because of floating
+     point errors). The errors of the transforms are proportional to the
+     sum of the absolute values of the kernel, so the threshold is
+     derived from it (the smallest kernel element can't be used: when the
+     kernel has negative values, the sum over the usable pixels can be
+     much smaller than it). */
+  for(i=0;i<kernel->size;++i) kabs+=fabs(k[i]);
+  fp.minweight = CONVOLVE_FREQUENCY_MIN_WEIGHT * kabs;
+
+  /* Set the basic parameters. */
+  fp.out=out;
+  fp.block=block;
+  fp.conv_on_blank=conv_on_blank;
+  fp.edgecorrection=edgecorrection;
+  fp.wave[0]=gsl_fft_complex_wavetable_alloc(fp.n[0]);
+  fp.wave[1]=gsl_fft_complex_wavetable_alloc(fp.n[1]);
+
+  /* Transform the kernel: to have the same result as the spatial
+     convolution, the kernel is flipped (and its center is put on the
+     first element). */
+  fp.kernel=gal_pointer_allocate(GAL_TYPE_FLOAT64, 2*fp.n[0]*fp.n[1], 1,
+                                 __func__, "fp.kernel");
+  for(y=0;y<fp.k[0];++y)
+    for(x=0;x<fp.k[1];++x)
+      fp.kernel[ 2*( ( (fp.n[0]+fp.k[0]/2-y) % fp.n[0] ) * fp.n[1]
+                     + (fp.n[1]+fp.k[1]/2-x) % fp.n[1] ) ]
+        = k[y*fp.k[1]+x];
+  work[0]=gsl_fft_complex_workspace_alloc(fp.n[0]);
+  work[1]=gsl_fft_complex_workspace_alloc(fp.n[1]);
+  convolve_frequency_fft2d(fp.kernel, fp.n, 0, fp.n[0], gsl_fft_forward,
+                           fp.wave, work);
+  gsl_fft_complex_workspace_free(work[0]);
+  gsl_fft_complex_workspace_free(work[1]);
+
+  /* Divide the hosts into blocks. */
+  for(i=0;i<numhosts;++i)
+    numtasks += ( ( (hosts[i]->dsize[0] + fp.b[0] - 1) / fp.b[0] )
+                  * ( (hosts[i]->dsize[1] + fp.b[1] - 1) / fp.b[1] ) );
+  errno=0;
+  fp.tasks=malloc(numtasks * sizeof *fp.tasks);
+  if(fp.tasks==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'fp.tasks'", __func__,
+          numtasks * sizeof *fp.tasks);
+  numtasks=0;
+  for(i=0;i<numhosts;++i)
+    for(y=0; y<hosts[i]->dsize[0]; y+=fp.b[0])
+      for(x=0; x<hosts[i]->dsize[1]; x+=fp.b[1])
+        {
+          fp.tasks[numtasks].host=hosts[i];
+          fp.tasks[numtasks].start[0]=y;
+          fp.tasks[numtasks].start[1]=x;
+          ++numtasks;
+        }
+
+  /* Do the convolution on the threads. */
+  gal_threads_spin_off(convolve_frequency_on_thread, &fp, numtasks,
+                       numthreads, block->minmapsize, block->quietmmap);
+
+  /* Clean up. */
+  free(hosts);
+  free(fp.tasks);
+  free(fp.kernel);
+  gsl_fft_complex_wavetable_free(fp.wave[0]);
+  gsl_fft_complex_wavetable_free(fp.wave[1]);
+}
+
+
+
+
+
 
 
 
@@ -103,6 +806,11 @@ struct per_thread_spatial_prm
                              /* Later, just the pixel being convolved.    */
   int           on_edge;     /* If the tile is on the edge or not.        */
   gal_data_t      *host;     /* Size of host (channel or block).          */
+  gal_data_t    *kernel;     /* Kernel that is currently used.            */
+  gal_data_t       *out;     /* Output of the current kernel.             */
+  int64_t       *rowoff;     /* Block offset of each kernel row (from the */
+                             /* convolved pixel) for interior tiles.      */
+  int64_t     **rowoffs;     /* 'rowoff' of all the kernels.              */
   struct spatial_params *cprm; /* Link to main structure for all threads. */
 };
 
@@ -113,10 +821,11 @@ struct per_thread_spatial_prm
 struct spatial_params
 {
   /* Main input/output parameters. */
-  gal_data_t       *out;     /* Output data structure.                    */
+  gal_data_t      **out;     /* Output of each kernel.                    */
   gal_data_t     *tiles;     /* Tiles over the input image.               */
   gal_data_t     *block;     /* Pointer to block for this tile.           */
-  gal_data_t    *kernel;     /* Kernel to convolve with input.            */
+  gal_data_t   **kernel;     /* Kernels to convolve with input.           */
+  size_t     numkernels;     /* Number of kernels (and outputs).          */
   gal_data_t *tocorrect;     /* (possible) convolved image to correct.    */
   int        convoverch;     /* Ignore channel edges in convolution.      */
   int    edgecorrection;     /* Correct convolution's edge effects.       */
@@ -135,7 +844,7 @@ static int
 convolve_spatial_overlap(struct per_thread_spatial_prm *pprm, int tocorrect)
 {
   struct spatial_params *cprm=pprm->cprm;
-  gal_data_t *block=cprm->block, *kernel=cprm->kernel;
+  gal_data_t *block=cprm->block, *kernel=pprm->kernel;
   size_t *dsize = tocorrect ? block->dsize : pprm->host->dsize;
   size_t ndim=block->ndim;
 
@@ -292,7 +1001,129 @@ convolve_spatial_overlap(struct per_thread_spatial_prm *pprm, int tocorrect)
 
 
 
-/* Convolve over one tile that is not touching the edge. */
+/* Offset (within the block) of the first element of each kernel row
+   from the pixel that is being convolved. A "row" is a contiguous set of
+   kernel elements along the fastest dimension, so in 2D, there are
+   'kernel->dsize[0]' rows and in 3D 'kernel->dsize[0]*kernel->dsize[1]'
+   rows. For the tiles that are not on the edge, the full kernel always
+   overlaps with the host, so these offsets are the same for all the
+   pixels and are calculated once for each thread. */
+static int64_t *
+convolve_spatial_row_offsets(gal_data_t *block, gal_data_t *kernel)
+{
+  int64_t *rowoff, stride;
+  size_t r, d, c, ind, ndim=block->ndim;
+  size_t *k=kernel->dsize, kw=kernel->dsize[ndim-1];
+  size_t nrows=kernel->size/kw;
+
+  /* Allocate the array of offsets. */
+  rowoff=gal_pointer_allocate(GAL_TYPE_INT64, nrows, 0, __func__,
+                              "rowoff");
+
+  /* Go over the rows. */
+  for(r=0;r<nrows;++r)
+    {
+      /* The offset of the first element of the row along the fastest
+         dimension. */
+      rowoff[r] = -(int64_t)(kw/2);
+
+      /* Add the offset along the slower dimensions. */
+      ind=r;
+      stride=block->dsize[ndim-1];
+      for(d=ndim-1;d-->0;)
+        {
+          c = ind % k[d];
+          ind /= k[d];
+          rowoff[r] += ( (int64_t)c - (int64_t)(k[d]/2) ) * stride;
+          stride *= block->dsize[d];
+        }
+    }
+
+  /* Return the offsets. */
+  return rowoff;
+}
+
+
+
+
+
+/* Convolve a tile that is not on the edge of its host: the full kernel
+   overlaps with the host for all its pixels. So the overlap doesn't need
+   to be found for each pixel (with 'convolve_spatial_overlap'): the
+   offsets of the kernel rows within the block are fixed (and already
+   calculated in 'pprm->rowoff'). The summation is done in the same order
+   as 'convolve_spatial_tile', so the output is identical.
+
+   The loop over each kernel row is defined as a macro so the compiler can
+   unroll (and vectorize) it for the most common kernel widths (which are
+   given as constants). */
+#define CONVOLVE_INTERIOR_TILE(KW) {                                     \
+    size_t r, c;                                                        \
+    float *ip, *kp;                                                     \
+    while( i_st_en[0] + i_inc <= i_st_en[1] )                           \
+      {                                                                 \
+        for(j=0;j<csize;++j)                                            \
+          {                                                             \
+            in_v = i_start + i_inc + j;                                 \
+            if( isnan(*in_v) && conv_on_blank==0 )                      \
+              out[ in_v - in ]=NAN;                                     \
+            else                                                        \
+              {                                                         \
+                sum=ksum=0.0f;                                          \
+                for(r=0;r<nrows;++r)                                    \
+                  {                                                     \
+                    ip = in_v + rowoff[r];                              \
+                    kp = kernel + r*(KW);                               \
+                    for(c=0;c<(KW);++c)                                 \
+                      if( !isnan(ip[c]) )                               \
+                        { sum += ip[c] * kp[c]; ksum += kp[c]; }        \
+                  }                                                     \
+                if(edgecorrection==0) ksum=1.0f;                        \
+                out[ in_v - in ] = ksum==0.0f ? NAN : sum/ksum;         \
+              }                                                         \
+          }                                                             \
+        i_inc += gal_tile_block_increment(block, tile->dsize, i_ninc++, \
+                                          NULL);                        \
+      }                                                                 \
+  }
+
+static void
+convolve_spatial_tile_interior(struct per_thread_spatial_prm *pprm)
+{
+  struct spatial_params *cprm=pprm->cprm;
+  gal_data_t *tile=pprm->tile, *block=cprm->block;
+
+  double sum, ksum;
+  int64_t *rowoff=pprm->rowoff;
+  int edgecorrection=cprm->edgecorrection;
+  uint8_t conv_on_blank=cprm->conv_on_blank;
+  float *kernel=pprm->kernel->array, *i_start, *in_v;
+  float *in=block->array, *out=pprm->out->array;
+  size_t kw=pprm->kernel->dsize[block->ndim-1];
+  size_t nrows=pprm->kernel->size/kw;
+  size_t j, i_inc=0, i_ninc=1, i_st_en[2];
+  size_t csize=tile->dsize[block->ndim-1];
+
+  /* Starting pointer of the tile. */
+  i_start=gal_tile_start_end_ind_inclusive(tile, block, i_st_en);
+
+  /* Do the convolution (with a fixed kernel width when possible). */
+  switch(kw)
+    {
+    case 3:  CONVOLVE_INTERIOR_TILE(3);  break;
+    case 5:  CONVOLVE_INTERIOR_TILE(5);  break;
+    case 7:  CONVOLVE_INTERIOR_TILE(7);  break;
+    case 9:  CONVOLVE_INTERIOR_TILE(9);  break;
+    case 11: CONVOLVE_INTERIOR_TILE(11); break;
+    default: CONVOLVE_INTERIOR_TILE(kw);
+    }
+}
+
+
+
+
+
+/* Convolve over one tile. */
 static void
 convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
 {
@@ -301,7 +1132,7 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
   int full_overlap;
   double sum, ksum;
   struct spatial_params *cprm=pprm->cprm;
-  gal_data_t *block=cprm->block, *kernel=cprm->kernel;
+  gal_data_t *block=cprm->block, *kernel=pprm->kernel;
   size_t j, ndim=block->ndim, csize=tile->dsize[ndim-1];
   gal_data_t *i_overlap=pprm->i_overlap, *k_overlap=pprm->k_overlap;
 
@@ -312,7 +1143,7 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
 
   /* These variables depend on the type of the input. */
   float *i_start;
-  float *in_v, *in=block->array, *out=cprm->out->array;
+  float *in_v, *in=block->array, *out=pprm->out->array;
 
 
   /* Starting pixel for the host of this tile. Note that when we are in
@@ -337,8 +1168,14 @@ convolve_spatial_tile(struct per_thread_spatial_prm *pprm)
 
 
   /* If it isn't on the edge and we are correcting an already convolved
-     image ('tocorrect!=NULL'), then this tile can be ignored. */
-  if(cprm->tocorrect && pprm->on_edge==0) return;
+     image ('tocorrect!=NULL'), then this tile can be ignored. Otherwise,
+     tiles that aren't on the edge don't need the overlap of each pixel
+     to be checked. */
+  if(pprm->on_edge==0)
+    {
+      if(cprm->tocorrect==NULL) convolve_spatial_tile_interior(pprm);
+      return;
+    }
 
 
   /* Parse over all the tile elements. */
@@ -422,7 +1259,7 @@ convolve_spatial_on_thread(void *inparam)
   struct spatial_params *cprm=(struct spatial_params *)(tprm->params);
   gal_data_t *block=cprm->block;
 
-  size_t i;
+  size_t i, j;
   size_t ndim=block->ndim;
   struct per_thread_spatial_prm *pprm=&cprm->pprm[tprm->id];
   size_t *dsize=gal_pointer_allocate(GAL_TYPE_SIZE_T, ndim, 0, __func__,
@@ -446,24 +1283,41 @@ convolve_spatial_on_thread(void *inparam)
                                              __func__, "pprm->overlap_start");
   pprm->i_overlap     = gal_data_alloc(NULL, block->type, ndim, dsize,
                                        NULL, 0, -1, 1, NULL, NULL, NULL);
-  pprm->k_overlap     = gal_data_alloc(NULL, cprm->kernel->type, ndim, dsize,
+  pprm->k_overlap     = gal_data_alloc(NULL, GAL_TYPE_FLOAT32, ndim, dsize,
                                        NULL, 0, -1, 1, NULL, NULL, NULL);
   free(dsize);
   free(pprm->i_overlap->array);
   free(pprm->k_overlap->array);
   pprm->i_overlap->block = cprm->block;
-  pprm->k_overlap->block = cprm->kernel;
-
-
-  /* Go over all the tiles given to this thread. */
+  errno=0;
+  pprm->rowoffs=calloc(cprm->numkernels, sizeof *pprm->rowoffs);
+  if(pprm->rowoffs==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'pprm->rowoffs'",
+          __func__, cprm->numkernels * sizeof *pprm->rowoffs);
+  if(cprm->tocorrect==NULL)
+    for(j=0;j<cprm->numkernels;++j)
+      pprm->rowoffs[j]=convolve_spatial_row_offsets(block, cprm->kernel[j]);
+
+
+  /* Go over all the tiles given to this thread. When there are multiple
+     kernels, each tile is convolved with all of them before going to the
+     next, so the input pixels around the tile are only read from the
+     memory once (they will be in the CPU's cache for the next kernels). */
   for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
     {
       /* Set this tile's pointer into this thread's parameters. */
       pprm->id   = tprm->indexs[i];
       pprm->tile = &cprm->tiles[ pprm->id ];
 
-      /* Do the convolution on this tile. */
-      convolve_spatial_tile(pprm);
+      /* Do the convolution on this tile with each kernel. */
+      for(j=0;j<cprm->numkernels;++j)
+        {
+          pprm->out    = cprm->out[j];
+          pprm->kernel = cprm->kernel[j];
+          pprm->rowoff = pprm->rowoffs[j];
+          pprm->k_overlap->block = cprm->kernel[j];
+          convolve_spatial_tile(pprm);
+        }
     }
 
 
@@ -475,6 +1329,9 @@ convolve_spatial_on_thread(void *inparam)
   free(pprm->overlap_start);
   gal_data_free(pprm->i_overlap);
   gal_data_free(pprm->k_overlap);
+  for(j=0;j<cprm->numkernels;++j)
+    if(pprm->rowoffs[j]) free(pprm->rowoffs[j]);
+  free(pprm->rowoffs);
   if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
@@ -483,17 +1340,50 @@ convolve_spatial_on_thread(void *inparam)
 
 
 
-/* General spatial convolve function. This function is called by both
-   'gal_convolve_spatial' and 'gal_convolve_spatial_correct_ch_edge'. */
+/* Allocate the output of spatial convolution. */
 static gal_data_t *
-gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
-                             size_t numthreads, int edgecorrection,
-                             int convoverch, uint8_t conv_on_blank,
-                             gal_data_t *tocorrect)
+convolve_spatial_out_alloc(gal_data_t *block)
 {
-  struct spatial_params params;
-  gal_data_t *out, *block=gal_tile_block(tiles);
+  gal_data_t *out;
 
+  /* Allocate the space for the convolved image. */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, block->ndim, block->dsize,
+                     block->wcs, 0, block->minmapsize, block->quietmmap,
+                     NULL, block->unit, NULL);
+
+  /* Spatial convolution won't change the blank bit-flag, so use the
+     block structure's blank bit flag. */
+  out->flag = ( block->flag
+                | ( GAL_DATA_FLAG_BLANK_CH | GAL_DATA_FLAG_HASBLANK ) );
+  return out;
+}
+
+
+
+
+
+/* See if the tiles cover the full block (they are a full tessellation, or
+   the input is a single full dataset). */
+static int
+convolve_spatial_tiles_cover_block(gal_data_t *tiles, gal_data_t *block)
+{
+  size_t size=0;
+  gal_data_t *tile;
+
+  if(tiles->block==NULL) return 1;
+  for(tile=tiles; tile!=NULL; tile=tile->next) size+=tile->size;
+  return size==block->size;
+}
+
+
+
+
+
+/* Sanity checks on the input and kernel of spatial convolution. */
+static void
+convolve_spatial_sanity_check(gal_data_t *tiles, gal_data_t *kernel)
+{
+  gal_data_t *block=gal_tile_block(tiles);
 
   /* Small sanity checks. */
   if(tiles->ndim!=kernel->ndim)
@@ -513,31 +1403,31 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
           "work on a list of tiles. Please (temporarily) set the 'next' "
           "element of the input to 'NULL' and call this function again",
           __func__);
+}
+
 
 
-  /* Set the output datastructure. */
-  if(tocorrect) out=tocorrect;
-  else
-    {
-      /* Allocate the space for the convolved image. */
-      out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, block->ndim, block->dsize,
-                         block->wcs, 0, block->minmapsize, block->quietmmap,
-                         NULL, block->unit, NULL);
-
-      /* Spatial convolution won't change the blank bit-flag, so use the
-         block structure's blank bit flag. */
-      out->flag = ( block->flag
-                    | ( GAL_DATA_FLAG_BLANK_CH | GAL_DATA_FLAG_HASBLANK ) );
-    }
 
 
+/* Convolve the tiles with 'numkernels' kernels on multiple threads (the
+   output of each kernel is the respective element of 'out'). */
+static void
+convolve_spatial_tiles(gal_data_t *tiles, gal_data_t **kernel,
+                       gal_data_t **out, size_t numkernels,
+                       size_t numthreads, int edgecorrection,
+                       int convoverch, uint8_t conv_on_blank,
+                       gal_data_t *tocorrect)
+{
+  struct spatial_params params;
+
   /* Set the pointers in the parameters structure. */
   params.out=out;
   params.tiles=tiles;
-  params.block=block;
   params.kernel=kernel;
   params.tocorrect=tocorrect;
+  params.numkernels=numkernels;
   params.convoverch=convoverch;
+  params.block=gal_tile_block(tiles);
   params.conv_on_blank=conv_on_blank;
   params.edgecorrection=edgecorrection;
 
@@ -556,8 +1446,52 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
                        tiles->minmapsize, tiles->quietmmap);
 
 
-  /* Clean up and return the output array. */
+  /* Clean up. */
   free(params.pprm);
+}
+
+
+
+
+
+/* General spatial convolve function. This function is called by both
+   'gal_convolve_spatial' and 'gal_convolve_spatial_correct_ch_edge'. */
+static gal_data_t *
+gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
+                             size_t numthreads, int edgecorrection,
+                             int convoverch, uint8_t conv_on_blank,
+                             gal_data_t *tocorrect)
+{
+  gal_data_t *out, *block=gal_tile_block(tiles);
+
+
+  /* Small sanity checks. */
+  convolve_spatial_sanity_check(tiles, kernel);
+
+
+  /* Set the output datastructure. */
+  out = tocorrect ? tocorrect : convolve_spatial_out_alloc(block);
+
+
+  /* Large 2D kernels are convolved much faster in the frequency domain
+     (the output is the same to within floating point errors). Since it
+     convolves all the pixels of the hosts, it is only used when the tiles
+     cover the full dataset. */
+  if( tocorrect==NULL
+      && block->ndim==2
+      && kernel->size >= GAL_CONVOLVE_FREQUENCY_MIN_KERNEL
+      && convolve_spatial_tiles_cover_block(tiles, block) )
+    {
+      convolve_frequency(tiles, kernel, out, numthreads, edgecorrection,
+                         convoverch, conv_on_blank);
+      return out;
+    }
+
+
+  /* Do the spatial convolution on threads and return the output. */
+  convolve_spatial_tiles(tiles, &kernel, &out, 1, numthreads,
+                         edgecorrection, convoverch, conv_on_blank,
+                         tocorrect);
   return out;
 }
 
@@ -569,7 +1503,10 @@ gal_convolve_spatial_general(gal_data_t *tiles, gal_data_t *kernel,
    convolution can be greatly sped up if it is done on separate tiles over
    the image (on multiple threads). So as input, you can either give tile
    values or one full array. Just note that if you give a single array as
-   input, the 'next' element has to be 'NULL'. */
+   input, the 'next' element has to be 'NULL'. When the tiles cover the
+   full 2D dataset and the kernel has at least
+   'GAL_CONVOLVE_FREQUENCY_MIN_KERNEL' elements, the convolution is done
+   in the frequency domain (see 'gal_convolve_frequency'). */
 gal_data_t *
 gal_convolve_spatial(gal_data_t *tiles, gal_data_t *kernel,
                      size_t numthreads, int edgecorrection, int convoverch,
@@ -589,6 +1526,138 @@ gal_convolve_spatial(gal_data_t *tiles, gal_data_t *kernel,
 
 
 
+/* Convolve a dataset with multiple kernels ('kernels' is a list). The
+   output is a list of convolved datasets (one for each kernel, in the same
+   order) that are the same as calling 'gal_convolve_spatial' with each
+   kernel. The large kernels that 'gal_convolve_spatial' would convolve in
+   the frequency domain are convolved there one by one, all the others are
+   convolved in one pass over the tiles: each tile is convolved with all
+   of them before going to the next. */
+gal_data_t *
+gal_convolve_spatial_multi(gal_data_t *tiles, gal_data_t *kernels,
+                           size_t numthreads, int edgecorrection,
+                           int convoverch, int conv_on_blank)
+{
+  gal_data_t *kernel, *out=NULL, **karr, **oarr;
+  gal_data_t *block=gal_tile_block(tiles);
+  size_t num=0, numkernels=gal_list_data_number(kernels);
+  int cover=convolve_spatial_tiles_cover_block(tiles, block);
+
+  /* When there isn't any tile structure, 'convoverch' must be set to
+     one. Recall that the input can be a single full dataset also. */
+  if(tiles->block==NULL) convoverch=1;
+
+  /* Allocate the arrays of kernels and outputs for one pass. */
+  errno=0;
+  karr=malloc(numkernels * sizeof *karr);
+  oarr=malloc(numkernels * sizeof *oarr);
+  if(karr==NULL || oarr==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'karr' or 'oarr'",
+          __func__, numkernels * sizeof *karr);
+
+  /* Make the outputs (in the inverse order, the list is reversed later)
+     and convolve the large kernels in the frequency domain (like
+     'gal_convolve_spatial_general'). */
+  for(kernel=kernels; kernel!=NULL; kernel=kernel->next)
+    {
+      convolve_spatial_sanity_check(tiles, kernel);
+      gal_list_data_add(&out, convolve_spatial_out_alloc(block));
+      if( cover
+          && block->ndim==2
+          && kernel->size >= GAL_CONVOLVE_FREQUENCY_MIN_KERNEL )
+        convolve_frequency(tiles, kernel, out, numthreads, edgecorrection,
+                           convoverch, conv_on_blank);
+      else
+        { karr[num]=kernel; oarr[num]=out; ++num; }
+    }
+  gal_list_data_reverse(&out);
+
+  /* Convolve all the other kernels in one pass over the tiles. */
+  if(num)
+    convolve_spatial_tiles(tiles, karr, oarr, num, numthreads,
+                           edgecorrection, convoverch, conv_on_blank,
+                           NULL);
+
+  /* Clean up and return. */
+  free(karr);
+  free(oarr);
+  return out;
+}
+
+
+
+
+
+/* Convolve a 2D dataset with a separable kernel that is given as two 1D
+   kernels ('kernels' is a list: the first is along the first dimension
+   and the second is along the second). The hosts of the tiles (the
+   channels, or the full dataset when 'convoverch' is non-zero) are fully
+   convolved. */
+gal_data_t *
+gal_convolve_spatial_separable(gal_data_t *tiles, gal_data_t *kernels,
+                               size_t numthreads, int edgecorrection,
+                               int convoverch, int conv_on_blank)
+{
+  gal_data_t *out, *block=gal_tile_block(tiles);
+
+  /* Sanity checks. */
+  if(block->ndim!=2 || block->type!=GAL_TYPE_FLOAT32)
+    error(EXIT_FAILURE, 0, "%s: only accepts a 2D 'float32' input "
+          "currently", __func__);
+  if( gal_list_data_number(kernels)!=2
+      || kernels->ndim!=1 || kernels->next->ndim!=1
+      || kernels->type!=GAL_TYPE_FLOAT32
+      || kernels->next->type!=GAL_TYPE_FLOAT32 )
+    error(EXIT_FAILURE, 0, "%s: 'kernels' should be a list of two 1D "
+          "'float32' datasets (the kernel along the first and second "
+          "dimensions)", __func__);
+
+  /* Do the convolution and return the output. */
+  out=convolve_spatial_out_alloc(block);
+  convolve_separable(tiles, kernels, out, numthreads, edgecorrection,
+                     convoverch, conv_on_blank);
+  return out;
+}
+
+
+
+
+
+/* Convolve a 2D dataset with the kernel in the frequency domain. The
+   output is the same as 'gal_convolve_spatial' (to within floating point
+   errors), but the hosts of the tiles (the channels, or the full dataset
+   when 'convoverch' is non-zero) are fully convolved. */
+gal_data_t *
+gal_convolve_frequency(gal_data_t *tiles, gal_data_t *kernel,
+                       size_t numthreads, int edgecorrection,
+                       int convoverch, int conv_on_blank)
+{
+  gal_data_t *out, *block=gal_tile_block(tiles);
+
+  /* Sanity checks. */
+  if(block->ndim!=2 || kernel->ndim!=2)
+    error(EXIT_FAILURE, 0, "%s: only accepts 2D input and kernel "
+          "currently", __func__);
+  if( block->type!=GAL_TYPE_FLOAT32 || kernel->type!=GAL_TYPE_FLOAT32 )
+    error(EXIT_FAILURE, 0, "%s: only accepts 'float32' type input and "
+          "kernel currently", __func__);
+  if( tiles->block==NULL && tiles->next && tiles->next->block==NULL )
+    error(EXIT_FAILURE, 0, "%s: the input is a linked list but not a "
+          "tessellation (a list of tiles). Please (temporarily) set the "
+          "'next' element of the input to 'NULL' and call this function "
+          "again", __func__);
+
+  /* Do the convolution and return the output. */
+  out=convolve_spatial_out_alloc(block);
+  convolve_frequency(tiles, kernel, out, numthreads, edgecorrection,
+                     convoverch, conv_on_blank);
+  return out;
+}
+
+
+
+
+
 /* Correct the edges of channels in an already convolved image when it was
    initially convolved with 'gal_convolve_spatial' with 'convoverch==0'. In
    that case, strong boundaries exist on the tile edges. So if you later
@@ -1062,11 +1062,11 @@ dimension_collapse_sortbased_fill(struct dimension_sortbased_p *p,
      elements outside the range can mask a very large portion of the
      input. */
   tmp = ( formask->ndim==1
-          ? gal_binary_erode(tmp, 1, 1, 1)
-          : gal_binary_dilate(tmp, 1, 1, 1) );
+          ? gal_binary_erode(tmp, 1, 1, 1, 1)
+          : gal_binary_dilate(tmp, 1, 1, 1, 1) );
   gal_binary_holes_fill(tmp, formask->ndim, -1);
-  tmp=gal_binary_erode(tmp, 2, formask->ndim, 1);
-  tmp=gal_binary_dilate(tmp, formask->ndim==1?4:2, formask->ndim, 1);
+  tmp=gal_binary_erode(tmp, 2, formask->ndim, 1, 1);
+  tmp=gal_binary_dilate(tmp, formask->ndim==1?4:2, formask->ndim, 1, 1);
 
   /* Apply the flag onto the input (to set the pixels to NaN). */
   gal_blank_flag_apply(work, tmp);
@@ -2745,6 +2745,64 @@ gal_fits_img_read_kernel(char *filename, char *hdu, size_t minmapsize,
 
 
 
+/* Read 'num' rows of the image HDU that is already opened in 'fptr',
+   starting from row 'first' (counting from zero). A "row" is one element
+   along the slowest dimension (the last FITS axis, ignoring any slower
+   axes with a length of one), so the output is a contiguous part of the
+   full image (only the length of the slowest dimension is different). In
+   this way, very large images can be processed in blocks that fit into
+   the available memory. */
+gal_data_t *
+gal_fits_img_read_rows(fitsfile *fptr, size_t first, size_t num,
+                       size_t minmapsize, int quietmmap)
+{
+  void *blank;
+  gal_data_t *out;
+  size_t i, r, ndim, *dsize;
+  int status=0, type, anyblank;
+  long fpixel[GAL_FITS_MAX_NDIM], lpixel[GAL_FITS_MAX_NDIM];
+  long inc[GAL_FITS_MAX_NDIM];
+
+  /* Read the basic image information. */
+  gal_fits_img_info(fptr, &type, &ndim, &dsize, NULL, NULL);
+  if(ndim==0)
+    error(EXIT_FAILURE, 0, "%s: the HDU has 0 dimensions", __func__);
+
+  /* Find the dimension that defines the rows (in Gnuastro's order, the
+     slowest dimension is the first) and check the requested range. */
+  for(r=0; r<ndim-1 && dsize[r]==1; ++r);
+  if(num==0 || first+num > dsize[r])
+    error(EXIT_FAILURE, 0, "%s: rows %zu to %zu requested, but the image "
+          "has %zu rows", __func__, first+1, first+num, dsize[r]);
+
+  /* Set the first and last pixels of the subset (note that the FITS
+     order of dimensions is the opposite of Gnuastro). */
+  for(i=0;i<ndim;++i)
+    {
+      inc[i]=1;
+      fpixel[ndim-1-i] = i==r ? first+1   : 1;
+      lpixel[ndim-1-i] = i==r ? first+num : dsize[i];
+    }
+
+  /* Allocate the output and read the rows into it. */
+  dsize[r]=num;
+  out=gal_data_alloc(NULL, type, ndim, dsize, NULL, 0, minmapsize,
+                     quietmmap, NULL, NULL, NULL);
+  blank=gal_blank_alloc_write(type);
+  fits_read_subset(fptr, gal_fits_type_to_datatype(type), fpixel, lpixel,
+                   inc, blank, out->array, &anyblank, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Clean up and return. */
+  free(blank);
+  free(dsize);
+  return out;
+}
+
+
+
+
+
 /* Write the requested header keywords first (if we add them after writing
    the image, and there is many keywords (more than 2880/80=36), the whole
    image needs to be shifted to accommodate a new 2880 byte block for new
@@ -2982,6 +3040,112 @@ gal_fits_img_write(gal_data_t *data, char *filename,
 
 
 
+/* Create an image HDU in 'filename' that has the type, dimensions and
+   metadata (WCS, name, unit and comments) of 'meta', but don't write any
+   pixels: the 'array' of 'meta' is not used (it can be NULL). The pixels
+   can then be written in blocks of rows with 'gal_fits_img_write_rows'
+   (when all the pixels don't fit into the memory). The file is not
+   closed, so the returned pointer must be closed by the caller after all
+   the rows have been written. */
+fitsfile *
+gal_fits_img_write_rows_init(gal_data_t *meta, char *filename,
+                             gal_fits_list_key_t *keylist, int freekeys)
+{
+  fitsfile *fptr;
+  int bitpix, status=0;
+  size_t i, ndim=meta->ndim;
+  long naxes[GAL_FITS_MAX_NDIM], naxesone[GAL_FITS_MAX_NDIM];
+
+  /* Small sanity checks. */
+  if( gal_fits_name_is_fits(filename)==0 )
+    error(EXIT_FAILURE, 0, "%s: not a FITS suffix", filename);
+  if(meta->type==GAL_TYPE_UINT64)
+    error(EXIT_FAILURE, 0, "%s: unsigned 64-bit integers are not "
+          "supported when writing an image in blocks of rows", __func__);
+
+  /* Fill the 'naxes' array (in opposite order, and 'long' type). */
+  for(i=0;i<ndim;++i)
+    {
+      naxesone[i]=0;
+      naxes[ndim-1-i]=meta->dsize[i];
+    }
+
+  /* Create the HDU with an empty image, write the keywords and then
+     resize it (to avoid having to shift the image if there are many
+     keywords). Since we don't know if there will be blank values, the
+     BLANK keyword is always written for integer types. */
+  fptr=gal_fits_open_to_write(filename);
+  bitpix=gal_fits_type_to_bitpix(meta->type);
+  fits_create_img(fptr, bitpix, ndim, naxesone, &status);
+  gal_fits_io_error(status, NULL);
+  gal_fits_img_write_to_ptr_keys(fptr, meta,
+                                 gal_fits_type_to_datatype(meta->type), 1,
+                                 keylist, freekeys);
+  fits_resize_img(fptr, bitpix, ndim, naxes, &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Return the pointer. */
+  return fptr;
+}
+
+
+
+
+
+/* Write the (contiguous) 'rows' dataset into the image HDU that is opened
+   in 'fptr', starting from row 'first' (counting from zero). Similar to
+   'gal_fits_img_read_rows', a "row" is one element along the slowest
+   dimension of the HDU's image. */
+void
+gal_fits_img_write_rows(fitsfile *fptr, gal_data_t *rows, size_t first)
+{
+  int bitpix, naxis, status=0;
+  size_t i, r, numrows, rowsize=1;
+  long naxes[GAL_FITS_MAX_NDIM];
+  long fpixel[GAL_FITS_MAX_NDIM], lpixel[GAL_FITS_MAX_NDIM];
+
+  /* Small sanity checks. */
+  if( gal_tile_block(rows)!=rows )
+    error(EXIT_FAILURE, 0, "%s: the input must not be a tile", __func__);
+  if(rows->type==GAL_TYPE_UINT64)
+    error(EXIT_FAILURE, 0, "%s: unsigned 64-bit integers are not "
+          "supported when writing an image in blocks of rows", __func__);
+
+  /* Get the dimensions of the HDU's image and find the row dimension (in
+     the FITS order, the slowest dimension is the last). */
+  if( fits_get_img_param(fptr, GAL_FITS_MAX_NDIM, &bitpix, &naxis,
+                         naxes, &status) )
+    gal_fits_io_error(status, NULL);
+  if(naxis==0)
+    error(EXIT_FAILURE, 0, "%s: the HDU has 0 dimensions", __func__);
+  for(r=naxis-1; r>0 && naxes[r]==1; --r);
+  for(i=0;i<r;++i) rowsize*=naxes[i];
+
+  /* Make sure the dataset is composed of complete rows that are within
+     the image. */
+  numrows=rows->size/rowsize;
+  if( rows->size==0 || rows->size%rowsize
+      || first+numrows > (size_t)(naxes[r]) )
+    error(EXIT_FAILURE, 0, "%s: the %zu elements of the input can't be "
+          "written as complete rows (with %zu elements) from row %zu of an "
+          "image with %ld rows", __func__, rows->size, rowsize, first+1,
+          naxes[r]);
+
+  /* Set the first and last pixels and write the rows. */
+  for(i=0;i<(size_t)naxis;++i)
+    {
+      fpixel[i] = i==r ? first+1       : 1;
+      lpixel[i] = i==r ? first+numrows : naxes[i];
+    }
+  fits_write_subset(fptr, gal_fits_type_to_datatype(rows->type), fpixel,
+                    lpixel, rows->array, &status);
+  gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
 void
 gal_fits_img_write_to_type(gal_data_t *data, char *filename,
                            gal_fits_list_key_t *headers, int type,
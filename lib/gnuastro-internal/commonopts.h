@@ -429,6 +429,19 @@ struct argp_option gal_commonopts_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "numa",
+      GAL_OPTIONS_KEY_NUMA,
+      0,
+      0,
+      "Pin threads, first-touch arrays on threads.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &cp->numa,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "log",
       GAL_OPTIONS_KEY_LOG,
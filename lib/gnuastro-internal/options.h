@@ -110,6 +110,7 @@ enum options_common_keys
 
   /* Only long option (integers for keywords). */
   GAL_OPTIONS_KEY_LOG           = 500,
+  GAL_OPTIONS_KEY_NUMA,
   GAL_OPTIONS_KEY_CITE,
   GAL_OPTIONS_KEY_CONFIG,
   GAL_OPTIONS_KEY_SEARCHIN,
@@ -216,6 +217,7 @@ struct gal_options_common_params
   size_t            numthreads; /* Number of threads to use.              */
   size_t            minmapsize; /* Minimum bytes necessary to use mmap.   */
   uint8_t            quietmmap; /* ==0: print mmap'd file name and size.  */
+  uint8_t                 numa; /* Pin threads and first-touch arrays.    */
   uint8_t                  log; /* Make a log file.                       */
   char            *onlyversion; /* Redundant, kept/set for generality.    */
 
@@ -44,11 +44,41 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* Maximum difference (relative to the maximum absolute value of the
+   kernel) between a 2D kernel and the product of its 1D kernels for it to
+   be considered separable. */
+#define GAL_CONVOLVE_SEPARABLE_TOL 1e-6
+
+/* Minimum number of elements in a 2D kernel for 'gal_convolve_spatial'
+   to convolve in the frequency domain (when the tiles cover the full
+   dataset). */
+#define GAL_CONVOLVE_FREQUENCY_MIN_KERNEL 441
+
+
+
+gal_data_t *
+gal_convolve_kernel_separate(gal_data_t *kernel);
+
 gal_data_t *
 gal_convolve_spatial(gal_data_t *tiles, gal_data_t *kernel,
                      size_t numthreads, int edgecorrection,
                      int convoverch, int conv_on_blank);
 
+gal_data_t *
+gal_convolve_spatial_multi(gal_data_t *tiles, gal_data_t *kernels,
+                           size_t numthreads, int edgecorrection,
+                           int convoverch, int conv_on_blank);
+
+gal_data_t *
+gal_convolve_spatial_separable(gal_data_t *tiles, gal_data_t *kernels,
+                               size_t numthreads, int edgecorrection,
+                               int convoverch, int conv_on_blank);
+
+gal_data_t *
+gal_convolve_frequency(gal_data_t *tiles, gal_data_t *kernel,
+                       size_t numthreads, int edgecorrection,
+                       int convoverch, int conv_on_blank);
+
 
 void
 gal_convolve_spatial_correct_ch_edge(gal_data_t *tiles, gal_data_t *kernel,
@@ -314,6 +314,10 @@ gal_data_t *
 gal_fits_img_read_kernel(char *filename, char *hdu, size_t minmapsize,
                          int quietmmap, char *hdu_option_name);
 
+gal_data_t *
+gal_fits_img_read_rows(fitsfile *fptr, size_t first, size_t num,
+                       size_t minmapsize, int quietmmap);
+
 fitsfile *
 gal_fits_img_write_to_ptr(gal_data_t *data, char *filename,
                           gal_fits_list_key_t *keylist, int freekeys);
@@ -322,6 +326,13 @@ void
 gal_fits_img_write(gal_data_t *data, char *filename,
                    gal_fits_list_key_t *keylist, int freekeys);
 
+fitsfile *
+gal_fits_img_write_rows_init(gal_data_t *meta, char *filename,
+                             gal_fits_list_key_t *keylist, int freekeys);
+
+void
+gal_fits_img_write_rows(fitsfile *fptr, gal_data_t *rows, size_t first);
+
 void
 gal_fits_img_write_to_type(gal_data_t *data, char *filename,
                            gal_fits_list_key_t *keylist, int type,
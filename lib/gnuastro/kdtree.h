@@ -48,13 +48,84 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* Layouts of the k-d tree:
+
+     LEFTRIGHT: Two 'uint32' columns ('left' and 'right'): the index of
+                the left and right child of each row (limited to 2^32-1
+                rows).
+
+     IMPLICIT:  One 'int64' column: the input rows in the order of the
+                tree. The tree is balanced and its nodes are implicit
+                (not stored): they are found from the number of rows and
+                the bucket size below. */
+enum gal_kdtree_layouts
+{
+  GAL_KDTREE_LAYOUT_INVALID,    /* ==0 by C standard. */
+
+  GAL_KDTREE_LAYOUT_LEFTRIGHT,
+  GAL_KDTREE_LAYOUT_IMPLICIT,
+};
+
+/* Maximum number of points in the leaves of the implicit layout. */
+#define GAL_KDTREE_IMPLICIT_BUCKET 8
+
+
+
+/* A k-d tree (with its coordinates) that is prepared for queries. Its
+   contents are internal to the library (the 'gal_kdtree_prepare' function
+   should be used to allocate it). */
+typedef struct gal_kdtree_prepared gal_kdtree_prepared_t;
+
+
+
 gal_data_t *
-gal_kdtree_create(gal_data_t *coords_raw, size_t *root);
+gal_kdtree_create(gal_data_t *coords_raw, size_t *root,
+                  size_t numthreads);
+
+gal_data_t *
+gal_kdtree_create_implicit(gal_data_t *coords_raw, size_t numthreads);
+
+int
+gal_kdtree_layout(gal_data_t *kdtree);
 
 size_t
 gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
                              size_t root, double *point, double *least_dist);
 
+gal_kdtree_prepared_t *
+gal_kdtree_prepare(gal_data_t *coords_raw, gal_data_t *kdtree,
+                   size_t root);
+
+void
+gal_kdtree_prepared_free(gal_kdtree_prepared_t *prep);
+
+size_t
+gal_kdtree_nearest_neighbour_prepared(gal_kdtree_prepared_t *prep,
+                                      double *point, double *least_dist);
+
+gal_data_t *
+gal_kdtree_nearest_neighbour_batch(gal_kdtree_prepared_t *prep,
+                                   gal_data_t *points, size_t numthreads,
+                                   size_t minmapsize, int quietmmap);
+
+size_t
+gal_kdtree_knn(gal_kdtree_prepared_t *prep, double *point, size_t k,
+               size_t *indexs, double *dists);
+
+size_t
+gal_kdtree_range(gal_kdtree_prepared_t *prep, double *point, double radius,
+                 size_t **indexs, double **dists, size_t *allocated);
+
+gal_data_t *
+gal_kdtree_knn_batch(gal_kdtree_prepared_t *prep, gal_data_t *points,
+                     size_t k, size_t numthreads, size_t minmapsize,
+                     int quietmmap);
+
+gal_data_t *
+gal_kdtree_range_batch(gal_kdtree_prepared_t *prep, gal_data_t *points,
+                       double radius, size_t numthreads, size_t minmapsize,
+                       int quietmmap);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
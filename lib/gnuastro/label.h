@@ -63,6 +63,11 @@ gal_data_t *
 gal_label_indexs(gal_data_t *labels, size_t numlabs, size_t minmapsize,
                  int quietmmap);
 
+gal_data_t *
+gal_label_indexs_compact(gal_data_t *labels, size_t numlabs,
+                         size_t numthreads, size_t minmapsize,
+                         int quietmmap);
+
 size_t
 gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
                     gal_data_t *label, size_t *topinds, int min0_max1);
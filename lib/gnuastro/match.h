@@ -57,6 +57,18 @@ gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
                  double *aperture, size_t numthreads, size_t minmapsize,
                  int quietmmap, size_t *nummatched);
 
+gal_data_t *
+gal_match_kdtree_neighbours(gal_data_t *coord1, gal_data_t *coord2,
+                            gal_data_t *coord1_kdtree, size_t kdtree_root,
+                            double *aperture, size_t k, size_t numthreads,
+                            size_t minmapsize, int quietmmap,
+                            size_t *nummatched);
+
+gal_data_t *
+gal_match_sky(gal_data_t *coord1, gal_data_t *coord2, double *aperture,
+              size_t numthreads, size_t minmapsize, int quietmmap,
+              size_t *nummatched);
+
 
 
 
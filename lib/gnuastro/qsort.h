@@ -25,6 +25,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Include other headers if necessary here. Note that other header files
    must be included before the C++ preparations below */
+#include <gnuastro/type.h>
 
 
 
@@ -122,7 +123,7 @@ gal_qsort_float64_i(const void *a, const void *b);
 /*****************************************************************/
 /* Pointer used to sort the indexs of an array based on their flux (value
    in this array). Note: when EACH THREAD USES A DIFFERENT ARRAY, this is
-   not thread-safe . */
+   not thread-safe (use 'gal_qsort_index_r' in such cases). */
 extern void *gal_qsort_index_single;
 
 
@@ -201,6 +202,23 @@ gal_qsort_index_multi_d(const void *a, const void *b);
 int
 gal_qsort_index_multi_i(const void *a, const void *b);
 
+void
+gal_qsort_index_r(size_t *indexs, size_t size, void *values, uint8_t type,
+                  int decreasing);
+
+
+
+
+
+/*****************************************************************/
+/**********    Sorting without a comparison function   ***********/
+/*****************************************************************/
+void
+gal_qsort_increasing(void *array, size_t size, uint8_t type);
+
+void
+gal_qsort_select(void *array, size_t size, size_t k, uint8_t type);
+
 
 
 __END_C_DECLS    /* From C++ preparations */
@@ -134,6 +134,14 @@ gal_data_t *
 gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
                                  int inplace);
 
+gal_data_t *
+gal_statistics_quantile_function_nosort(gal_data_t *input,
+                                        gal_data_t *value);
+
+gal_data_t *
+gal_statistics_quantiles_select(gal_data_t *input, double *quantiles,
+                                size_t numquantiles, int inplace);
+
 gal_data_t *
 gal_statistics_unique(gal_data_t *input, int inplace);
 
@@ -114,22 +114,59 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
 
 
+
+/*******************************************************************/
+/************            NUMA-aware operation         **************/
+/*******************************************************************/
+/* Arrays smaller than this (in bytes) are not first-touched on multiple
+   threads. */
+#define GAL_THREADS_NUMA_MIN_BYTES 4194304
+
+void
+gal_threads_numa_set(size_t numthreads);
+
+size_t
+gal_threads_numa();
+
+void
+gal_threads_first_touch(void *array, size_t bytesize);
+
+
+
+
 /*******************************************************************/
 /************     Run a function on multiple threads  **************/
 /*******************************************************************/
+/* With 'gal_threads_next', each thread takes this fraction of the
+   remaining actions in its own range as a chunk. */
+#define GAL_THREADS_CHUNK_FRACTION 8
+
 struct gal_threads_params
 {
   size_t            id; /* Id of this thread.                            */
   void         *params; /* Input structure for higher-level settings.    */
   size_t       *indexs; /* Indexes of actions to be done in this thread. */
   pthread_barrier_t *b; /* Pointer the barrier for all threads.          */
+  void          *queue; /* Queue of actions (for 'gal_threads_next').    */
+  size_t      chunk[2]; /* Current chunk of actions (start and end).     */
 };
 
+void
+gal_threads_pool_free();
+
+size_t
+gal_threads_next(struct gal_threads_params *tprm);
+
 void
 gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
                      size_t numactions, size_t numthreads,
                      size_t minmapsize, int quietmmap);
 
+void
+gal_threads_spin_off_costs(void *(*worker)(void *), void *caller_params,
+                           size_t numactions, size_t numthreads,
+                           size_t minmapsize, int quietmmap, size_t *costs);
+
 
 __END_C_DECLS    /* From C++ preparations */
 
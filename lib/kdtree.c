@@ -23,16 +23,21 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <error.h>
 #include <float.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include <gnuastro/data.h>
 #include <gnuastro/table.h>
 #include <gnuastro/blank.h>
+#include <gnuastro/kdtree.h>
 #include <gnuastro/pointer.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/permutation.h>
 
 
@@ -73,6 +78,27 @@ struct kdtree_params
 
 
 
+/* A k-d tree with the implicit layout. The coordinates of each point are
+   kept together (interleaved) in the order of the tree, so the points of
+   a leaf (bucket) are contiguous in memory. The nodes aren't stored: the
+   node covering the points '[lo, hi)' is split at 'lo+(hi-lo)/2' (along
+   the axis of its depth) and the children of node 'i' are '2i+1' and
+   '2i+2'. Only the split values are kept (in this breadth-first order), so
+   the top of the tree (that is used by all queries) is in a few cache
+   lines. */
+struct kdtree_implicit
+{
+  size_t              ndim;  /* Number of dimensions.                   */
+  size_t              size;  /* Number of points.                       */
+  int64_t            *rows;  /* Input row of each point (tree order).   */
+  double           *points;  /* Interleaved coordinates (tree order).   */
+  double            *split;  /* Split value of each node.               */
+};
+
+
+
+
+
 /* Swap 2 nodes of the tree. Instead of physically swaping all the values
    we swap just the indexes of the node. */
 static void
@@ -142,6 +168,167 @@ kdtree_distance_find(struct kdtree_params *p, size_t node,
 
 
 
+/****************************************************************
+ ********              Parallel construction              *******
+ ****************************************************************/
+/* The sub-trees of a k-d tree are independent: each only moves the points
+   within its own range. So after the first few levels are split (one
+   level at a time, each level on all threads), the remaining sub-trees
+   are built on separate threads. Every range is split in the same way
+   irrespective of the thread that does it, so the tree doesn't depend on
+   the number of threads. */
+
+/* Each level is split in parallel until there are this many sub-trees
+   for each thread (to balance the work between the threads). */
+#define KDTREE_BUILD_TASKS_PER_THREAD 8
+
+/* Sub-trees with fewer points than this are not worth the overhead of
+   spinning off threads. */
+#define KDTREE_BUILD_MIN_POINTS 10000
+
+/* A sub-tree that should be built. The meaning of 'lo' and 'hi' depends on
+   the layout (in the left/right layout, 'hi' is the last point, while in
+   the implicit layout, it is one after the last point). */
+struct kdtree_task
+{
+  size_t             lo;  /* First point of the sub-tree.              */
+  size_t             hi;  /* Last point of sub-tree (depends on layout). */
+  size_t          depth;  /* Depth of the sub-tree's root in the tree.  */
+  uint32_t         *out;  /* Where to write the index of the root.     */
+};
+
+/* Split the root of a sub-tree and write its children (at most two) into
+   the given array ('lo' of non-existent children is 'GAL_BLANK_SIZE_T'). */
+typedef void (*kdtree_split_func)(void *, struct kdtree_task *,
+                                  struct kdtree_task *);
+
+/* Build a full sub-tree. */
+typedef void (*kdtree_fill_func)(void *, struct kdtree_task *);
+
+/* Parameters for the threads. */
+struct kdtree_build_params
+{
+  void                 *params;  /* Parameters of the layout.          */
+  kdtree_split_func      split;  /* Split the root of a sub-tree.      */
+  kdtree_fill_func        fill;  /* Build a full sub-tree.             */
+  struct kdtree_task    *tasks;  /* Sub-trees to split/build.          */
+  struct kdtree_task *children;  /* Children of each split sub-tree.   */
+};
+
+
+
+
+
+static void *
+kdtree_build_split_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_build_params *bp=(struct kdtree_build_params *)tprm->params;
+
+  size_t i, ind;
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      bp->split(bp->params, &bp->tasks[ind], &bp->children[2*ind]);
+    }
+
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void *
+kdtree_build_fill_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_build_params *bp=(struct kdtree_build_params *)tprm->params;
+
+  size_t i;
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    bp->fill(bp->params, &bp->tasks[ tprm->indexs[i] ]);
+
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Build the tree of 'size' points (starting from the 'root' sub-tree) on
+   'numthreads' threads. */
+static void
+kdtree_build(void *params, struct kdtree_task *root, size_t size,
+             kdtree_split_func split, kdtree_fill_func fill,
+             size_t numthreads, size_t minmapsize, int quietmmap)
+{
+  size_t i, n, numtasks=1;
+  struct kdtree_build_params bp;
+  size_t maxtasks=KDTREE_BUILD_TASKS_PER_THREAD*numthreads;
+
+  /* On a single thread (or for small trees), just build it. */
+  if(numthreads<=1 || size<KDTREE_BUILD_MIN_POINTS)
+    { fill(params, root); return; }
+
+  /* Allocate the sub-tree arrays (each level can at most have double the
+     number of sub-trees of the previous level). */
+  bp.fill=fill;
+  bp.split=split;
+  bp.params=params;
+  errno=0;
+  bp.tasks=malloc(2*maxtasks*sizeof *bp.tasks);
+  bp.children=malloc(2*maxtasks*sizeof *bp.children);
+  if(bp.tasks==NULL || bp.children==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate the sub-trees",
+          __func__);
+  bp.tasks[0]=*root;
+
+  /* Split one level at a time until there are enough sub-trees. */
+  while(numtasks && numtasks<maxtasks)
+    {
+      gal_threads_spin_off(kdtree_build_split_worker, &bp, numtasks,
+                           numthreads, minmapsize, quietmmap);
+
+      /* The children are the sub-trees of the next level. */
+      n=numtasks;
+      numtasks=0;
+      for(i=0;i<2*n;++i)
+        if(bp.children[i].lo!=GAL_BLANK_SIZE_T)
+          bp.tasks[numtasks++]=bp.children[i];
+    }
+
+  /* Build the remaining sub-trees on separate threads. */
+  if(numtasks)
+    gal_threads_spin_off(kdtree_build_fill_worker, &bp, numtasks,
+                         numthreads, minmapsize, quietmmap);
+
+  /* Clean up. */
+  free(bp.children);
+  free(bp.tasks);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /****************************************************************
  ********           Preperations and Cleanup              *******
  ****************************************************************/
@@ -439,22 +626,96 @@ kdtree_fill_subtrees(struct kdtree_params *p, size_t node_left,
 
 
 
+/* Split the root of a sub-tree (in the left/right layout): the same as
+   'kdtree_fill_subtrees', but the children are returned to be built
+   later (possibly on other threads). */
+static void
+kdtree_split_subtree(void *params, struct kdtree_task *task,
+                     struct kdtree_task *children)
+{
+  size_t node_median;
+  struct kdtree_params *p=params;
+
+  /* No children by default. */
+  children[0].lo=children[1].lo=GAL_BLANK_SIZE_T;
+
+  /* A single node. */
+  if(task->lo==task->hi) { *task->out=p->input_row[task->lo]; return; }
+
+  /* Find the median node and write it as the root of this sub-tree. */
+  node_median=kdtree_median_find(p, task->lo, task->hi,
+                                 p->coords[task->depth % p->ndim]->array);
+  *task->out=p->input_row[node_median];
+
+  /* The left sub-tree (see 'kdtree_fill_subtrees'). */
+  if(node_median)
+    {
+      if(node_median==task->lo)
+        p->left[node_median]=GAL_BLANK_UINT32;
+      else
+        {
+          children[0].lo=task->lo;
+          children[0].hi=node_median-1;
+          children[0].depth=task->depth+1;
+          children[0].out=&p->left[node_median];
+        }
+    }
+
+  /* The right sub-tree. */
+  children[1].lo=node_median+1;
+  children[1].hi=task->hi;
+  children[1].depth=task->depth+1;
+  children[1].out=&p->right[node_median];
+}
+
+
+
+
+
+static void
+kdtree_fill_subtree(void *params, struct kdtree_task *task)
+{
+  *task->out=kdtree_fill_subtrees(params, task->lo, task->hi, task->depth);
+}
+
+
+
+
+
 /* High level function to construct the kd-tree. This function initilises
-   and creates the tree in top-down manner. Returns a list containing the
-   indexes of left and right subtrees. */
+   and creates the tree in top-down manner (on 'numthreads' threads). The
+   output doesn't depend on the number of threads. Returns a list
+   containing the indexes of left and right subtrees. */
 gal_data_t *
-gal_kdtree_create(gal_data_t *coords_raw, size_t *root)
+gal_kdtree_create(gal_data_t *coords_raw, size_t *root,
+                  size_t numthreads)
 {
+  uint32_t root32;
+  struct kdtree_task task;
   struct kdtree_params p={0};
 
   /* If there are no coordinates, just return NULL. */
   if(coords_raw->size==0) return NULL;
 
+  /* The indexs of this layout are 32-bit. */
+  if(coords_raw->size>=GAL_BLANK_UINT32)
+    error(EXIT_FAILURE, 0, "%s: %zu rows are too many for the left/right "
+          "layout of the k-d tree (that is limited to %u rows), please "
+          "use 'gal_kdtree_create_implicit'", __func__, coords_raw->size,
+          GAL_BLANK_UINT32-1);
+
   /* Initialise the params structure. */
   kdtree_prepare(&p, coords_raw);
 
   /* Fill the kd-tree. */
-  *root=kdtree_fill_subtrees(&p, 0, coords_raw->size-1, 0);
+  task.lo=0;
+  task.depth=0;
+  task.out=&root32;
+  task.hi=coords_raw->size-1;
+  kdtree_build(&p, &task, coords_raw->size, kdtree_split_subtree,
+               kdtree_fill_subtree, numthreads, coords_raw->minmapsize,
+               coords_raw->quietmmap);
+  *root=root32;
 
   /* For a check
   size_t i;
@@ -493,6 +754,361 @@ gal_kdtree_create(gal_data_t *coords_raw, size_t *root)
 
 
 
+/****************************************************************
+ ********            Implicit (bucketed) layout           *******
+ ****************************************************************/
+/* Order of the coordinates in the implicit layout: NaN is larger than any
+   number (and equal to another NaN). So the blank coordinates are always
+   put in the second half of a node and the split value is only NaN when
+   all the coordinates of the second half are NaN. */
+#define KDTREE_IMPLICIT_LT(A,B) ( (A)<(B) || ( isnan(B) && !isnan(A) ) )
+
+
+
+
+
+/* Put the point with the k-th smallest coordinate (within '[lo, hi)' of
+   'index') in position 'k': smaller (or equal) values will be before it
+   and larger (or equal) values after it. A three-way partition is used,
+   so catalogs with many equal coordinates are also partitioned in linear
+   time. */
+static void
+kdtree_implicit_select(size_t *index, double *coord, size_t lo, size_t hi,
+                       size_t k)
+{
+  size_t i, lt, gt, t;
+  double a, b, c, v, pivot;
+
+  while(hi-lo>1)
+    {
+      /* Median of the first, middle and last values as pivot. */
+      a=coord[ index[lo] ];
+      b=coord[ index[lo+(hi-lo)/2] ];
+      c=coord[ index[hi-1] ];
+      pivot = ( KDTREE_IMPLICIT_LT(a,b)
+                ? ( KDTREE_IMPLICIT_LT(b,c)
+                    ? b : (KDTREE_IMPLICIT_LT(a,c) ? c : a) )
+                : ( KDTREE_IMPLICIT_LT(a,c)
+                    ? a : (KDTREE_IMPLICIT_LT(b,c) ? c : b) ) );
+
+      /* Partition into '[lo, lt)' (smaller), '[lt, gt)' (equal) and '[gt,
+         hi)' (larger). */
+      lt=i=lo;
+      gt=hi;
+      while(i<gt)
+        {
+          v=coord[ index[i] ];
+          if( KDTREE_IMPLICIT_LT(v,pivot) )
+            { t=index[lt]; index[lt++]=index[i]; index[i++]=t; }
+          else if( KDTREE_IMPLICIT_LT(pivot,v) )
+            { t=index[--gt]; index[gt]=index[i]; index[i]=t; }
+          else ++i;
+        }
+
+      /* Continue in the part that contains 'k'. */
+      if(k<lt)       hi=lt;
+      else if(k>=gt) lo=gt;
+      else           return;
+    }
+}
+
+
+
+
+
+/* Build the sub-tree over '[lo, hi)': find the point in the middle along
+   this depth's axis, then build the two halves. */
+static void
+kdtree_implicit_fill(size_t *index, double **coords, size_t ndim,
+                     size_t lo, size_t hi, size_t depth)
+{
+  size_t mid=lo+(hi-lo)/2;
+
+  /* Leaves are not split. */
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET) return;
+
+  /* Split the points and build the children. */
+  kdtree_implicit_select(index, coords[depth%ndim], lo, hi, mid);
+  kdtree_implicit_fill(index, coords, ndim, lo, mid, depth+1);
+  kdtree_implicit_fill(index, coords, ndim, mid, hi, depth+1);
+}
+
+
+
+
+
+/* Parameters to build the implicit layout. */
+struct kdtree_implicit_build
+{
+  size_t           *index;  /* Input row of each point (tree order).   */
+  double         **coords;  /* Coordinates of each dimension.          */
+  size_t             ndim;  /* Number of dimensions.                   */
+};
+
+
+
+
+
+/* Split the root of a sub-tree in the implicit layout. */
+static void
+kdtree_implicit_split(void *params, struct kdtree_task *task,
+                      struct kdtree_task *children)
+{
+  struct kdtree_implicit_build *b=params;
+  size_t lo=task->lo, hi=task->hi, mid=lo+(hi-lo)/2;
+
+  /* Leaves are not split. */
+  children[0].lo=children[1].lo=GAL_BLANK_SIZE_T;
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET) return;
+
+  /* Split the points and return the two halves. */
+  kdtree_implicit_select(b->index, b->coords[task->depth % b->ndim], lo,
+                         hi, mid);
+  children[0].lo=lo;   children[0].hi=mid;
+  children[1].lo=mid;  children[1].hi=hi;
+  children[0].depth=children[1].depth=task->depth+1;
+  children[0].out=children[1].out=NULL;
+}
+
+
+
+
+
+static void
+kdtree_implicit_fill_task(void *params, struct kdtree_task *task)
+{
+  struct kdtree_implicit_build *b=params;
+  kdtree_implicit_fill(b->index, b->coords, b->ndim, task->lo, task->hi,
+                       task->depth);
+}
+
+
+
+
+
+/* Construct a k-d tree with the implicit layout. The output is a single
+   'int64' column that has the input row of each point in the order of
+   the tree (the root is always the first node). Since the indexs are
+   64-bit, there is no practical limit on the number of rows. The tree is
+   built on 'numthreads' threads (the output doesn't depend on it). */
+gal_data_t *
+gal_kdtree_create_implicit(gal_data_t *coords_raw, size_t numthreads)
+{
+  int64_t *rows;
+  size_t i, ndim;
+  struct kdtree_task task;
+  gal_data_t *out, *tmp, **conv;
+  size_t *index, size=coords_raw->size;
+  struct kdtree_implicit_build b;
+  double **coords;
+
+  /* If there are no coordinates, just return NULL. */
+  if(size==0) return NULL;
+
+  /* Convert the coordinates to double (if necessary). */
+  ndim=gal_list_data_number(coords_raw);
+  errno=0;
+  conv=malloc(ndim*sizeof *conv);
+  coords=malloc(ndim*sizeof *coords);
+  if(conv==NULL || coords==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'conv' or 'coords'", __func__, ndim*sizeof *conv);
+  for(i=0, tmp=coords_raw; tmp!=NULL; tmp=tmp->next, ++i)
+    {
+      conv[i] = ( tmp->type==GAL_TYPE_FLOAT64
+                  ? tmp
+                  : gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64) );
+      coords[i]=conv[i]->array;
+    }
+
+  /* Build the tree over the row indexs. */
+  index=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__, "index");
+  for(i=0;i<size;++i) index[i]=i;
+  b.ndim=ndim;
+  b.index=index;
+  b.coords=coords;
+  task.lo=0;
+  task.hi=size;
+  task.depth=0;
+  task.out=NULL;
+  kdtree_build(&b, &task, size, kdtree_implicit_split,
+               kdtree_implicit_fill_task, numthreads,
+               coords_raw->minmapsize, coords_raw->quietmmap);
+
+  /* Write the output. */
+  out=gal_data_alloc(NULL, GAL_TYPE_INT64, 1, &size, NULL, 0,
+                     coords_raw->minmapsize, coords_raw->quietmmap,
+                     "row", "index",
+                     "Input row of each point in implicit kd-tree.");
+  rows=out->array;
+  for(i=0;i<size;++i) rows[i]=index[i];
+
+  /* Clean up and return. */
+  for(i=0, tmp=coords_raw; tmp!=NULL; tmp=tmp->next, ++i)
+    if(conv[i]!=tmp) gal_data_free(conv[i]);
+  free(coords);
+  free(index);
+  free(conv);
+  return out;
+}
+
+
+
+
+
+/* Return the layout of the given k-d tree (or 'GAL_KDTREE_LAYOUT_INVALID'
+   if it doesn't have any of the recognized formats). */
+int
+gal_kdtree_layout(gal_data_t *kdtree)
+{
+  if(kdtree==NULL) return GAL_KDTREE_LAYOUT_INVALID;
+
+  /* A single 64-bit signed integer column. */
+  if(kdtree->next==NULL && kdtree->type==GAL_TYPE_INT64)
+    return GAL_KDTREE_LAYOUT_IMPLICIT;
+
+  /* Two 32-bit unsigned integer columns of the same size. */
+  if(kdtree->next && kdtree->next->next==NULL
+     && kdtree->type==GAL_TYPE_UINT32
+     && kdtree->next->type==GAL_TYPE_UINT32
+     && kdtree->size==kdtree->next->size)
+    return GAL_KDTREE_LAYOUT_LEFTRIGHT;
+
+  /* Not recognized. */
+  return GAL_KDTREE_LAYOUT_INVALID;
+}
+
+
+
+
+
+/* Find the number of nodes (in the breadth-first order) that are necessary
+   for the sub-tree of 'node' over '[lo, hi)'. */
+static size_t
+kdtree_implicit_numnodes(size_t node, size_t lo, size_t hi)
+{
+  size_t mid=lo+(hi-lo)/2, l, r;
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET) return 0; /* Leaf: no node. */
+  l=kdtree_implicit_numnodes(2*node+1, lo, mid);
+  r=kdtree_implicit_numnodes(2*node+2, mid, hi);
+  l = l>r ? l : r;
+  return l>node+1 ? l : node+1;
+}
+
+
+
+
+
+/* Write the split value of each node. The point in the middle was moved
+   when the children were built, but all the points in the second half
+   are larger than (or equal to) those in the first half, so the smallest
+   value in the second half is used. NaN coordinates are always in the
+   second half (see 'KDTREE_IMPLICIT_LT'), so they are ignored here (the
+   split is only NaN when the whole second half is NaN). */
+static void
+kdtree_implicit_splits(struct kdtree_implicit *t, size_t node, size_t lo,
+                       size_t hi, size_t depth)
+{
+  double v, min=NAN;
+  size_t i, axis=depth%t->ndim, mid=lo+(hi-lo)/2;
+
+  /* Leaves aren't split. */
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET) return;
+
+  /* Find the split value and go onto the children. */
+  for(i=mid;i<hi;++i)
+    if( KDTREE_IMPLICIT_LT(v=t->points[ i*t->ndim + axis ], min) ) min=v;
+  t->split[node]=min;
+  kdtree_implicit_splits(t, 2*node+1, lo, mid, depth+1);
+  kdtree_implicit_splits(t, 2*node+2, mid, hi, depth+1);
+}
+
+
+
+
+
+/* Prepare the implicit tree for the queries: put the coordinates of each
+   point together (in the order of the tree) and find the split values. */
+static void
+kdtree_implicit_prepare(struct kdtree_implicit *t, gal_data_t *coords_raw,
+                        gal_data_t *kdtree)
+{
+  size_t i, d, numnodes;
+  gal_data_t *tmp, *conv;
+  double *carr;
+
+  /* Basic checks. */
+  t->size=coords_raw->size;
+  t->ndim=gal_list_data_number(coords_raw);
+  if(kdtree->size!=t->size)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree has %zu rows, but the "
+          "coordinates have %zu rows", __func__, kdtree->size, t->size);
+  t->rows=kdtree->array;
+  for(i=0;i<t->size;++i)
+    if(t->rows[i]<0 || (size_t)(t->rows[i])>=t->size)
+      error(EXIT_FAILURE, 0, "%s: row %zu of the k-d tree has a value "
+            "of %"PRId64" which is not a row in the coordinates",
+            __func__, i, t->rows[i]);
+
+  /* Interleave the coordinates in the order of the tree. */
+  t->points=gal_pointer_allocate(GAL_TYPE_FLOAT64, t->size*t->ndim, 0,
+                                 __func__, "t->points");
+  for(d=0, tmp=coords_raw; tmp!=NULL; tmp=tmp->next, ++d)
+    {
+      conv = ( tmp->type==GAL_TYPE_FLOAT64
+               ? tmp
+               : gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64) );
+      carr=conv->array;
+      for(i=0;i<t->size;++i) t->points[i*t->ndim+d]=carr[ t->rows[i] ];
+      if(conv!=tmp) gal_data_free(conv);
+    }
+
+  /* Find the split values of the nodes. */
+  numnodes=kdtree_implicit_numnodes(0, 0, t->size);
+  t->split=gal_pointer_allocate(GAL_TYPE_FLOAT64, numnodes ? numnodes : 1,
+                                0, __func__, "t->split");
+  kdtree_implicit_splits(t, 0, 0, t->size, 0);
+}
+
+
+
+
+
+/* Squared distance of the point 'i' of the implicit tree to 'point'. */
+static double
+kdtree_implicit_distance(struct kdtree_implicit *t, size_t i,
+                         double *point)
+{
+  size_t d;
+  double t_distance, out=0;
+  double *coords=t->points+i*t->ndim;
+  for(d=0;d<t->ndim;++d)
+    {
+      t_distance=coords[d]-point[d];
+      out += t_distance*t_distance;
+    }
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /****************************************************************
  ********          Nearest-Neighbour Search               *******
  ****************************************************************/
@@ -559,39 +1175,990 @@ kdtree_nearest_neighbour(struct kdtree_params *p, uint32_t node_current,
 
 
 
-/* High-level function used to find the nearest neighbour of a given
-   point in a kd-tree. It calculates the least distance of the point
-   from the nearest node and returns the index of that node.
-
-   Return: The index of the nearest neighbour node in the kd-tree.
-*/
-size_t
-gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
-                             size_t root, double *point,
-                             double *least_dist)
+/* Nearest neighbour in the implicit layout: similar to the function
+   above, but the points of the leaves are checked in a single pass. */
+static void
+kdtree_implicit_nearest_neighbour(struct kdtree_implicit *t, size_t node,
+                                  size_t lo, size_t hi, size_t depth,
+                                  double *point, double *least_dist,
+                                  size_t *out_nn)
 {
-  struct kdtree_params p={0};
-  size_t out_nn=GAL_BLANK_SIZE_T;
+  double d, dx;
+  size_t i, mid=lo+(hi-lo)/2;
 
-  /* Initialisation. */
-  p.left_col=kdtree;
-  *least_dist=DBL_MAX;
-  kdtree_prepare(&p, coords_raw);
+  /* In a leaf, check all the points. */
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET)
+    {
+      for(i=lo;i<hi;++i)
+        {
+          d=kdtree_implicit_distance(t, i, point);
+          if(d < *least_dist) { *least_dist=d; *out_nn=i; }
+        }
+      return;
+    }
 
-  /* Use the low-level function to find th nearest neighbour. */
-  kdtree_nearest_neighbour(&p, root, point, least_dist, &out_nn, 0);
+  /* Search the half that contains the point first, then the other half
+     if the splitting plane is nearer than the nearest point so far. When
+     the split is NaN, both halves are searched ('dx*dx' is NaN). */
+  dx=point[depth%t->ndim]-t->split[node];
+  if(dx<0 || isnan(dx))
+    {
+      kdtree_implicit_nearest_neighbour(t, 2*node+1, lo, mid, depth+1,
+                                        point, least_dist, out_nn);
+      if( !(dx*dx >= *least_dist) )
+        kdtree_implicit_nearest_neighbour(t, 2*node+2, mid, hi, depth+1,
+                                          point, least_dist, out_nn);
+    }
+  else
+    {
+      kdtree_implicit_nearest_neighbour(t, 2*node+2, mid, hi, depth+1,
+                                        point, least_dist, out_nn);
+      if( !(dx*dx >= *least_dist) )
+        kdtree_implicit_nearest_neighbour(t, 2*node+1, lo, mid, depth+1,
+                                          point, least_dist, out_nn);
+    }
+}
 
-  /* least_dist is the square of the distance between the nearest
-     neighbour and the point (used to improve processing).
-     Square root of that is the actual distance. */
-  *least_dist = sqrt(*least_dist);
 
-  /* For a check
-  printf("%s: root=%zu, out_nn=%zu, least_dis=%f\n",
-         __func__, root, out_nn, least_dist);
-  */
 
-  /* Clean up and return. */
-  kdtree_cleanup(&p, coords_raw);
+
+
+/* A k-d tree that is prepared for many (possibly multi-threaded)
+   queries: the sanity checks and the conversion of the coordinates to
+   'double' are only done once (in 'gal_kdtree_prepare'). After that, its
+   contents are only read, so it can be shared between threads. */
+struct gal_kdtree_prepared
+{
+  int                layout;  /* Layout of the tree (left/right, ...). */
+  size_t               root;  /* Index of the root node.               */
+  gal_data_t    *coords_raw;  /* Input coordinates (not owned).        */
+  struct kdtree_params    p;  /* Coordinates (double) and left/right.  */
+  struct kdtree_implicit  t;  /* The implicit layout.                  */
+};
+
+
+
+
+
+gal_kdtree_prepared_t *
+gal_kdtree_prepare(gal_data_t *coords_raw, gal_data_t *kdtree,
+                   size_t root)
+{
+  gal_kdtree_prepared_t *out;
+
+  /* If there are no coordinates, just return NULL. */
+  if(coords_raw->size==0 || kdtree==NULL) return NULL;
+
+  /* Allocate the output. */
+  errno=0;
+  out=calloc(1, sizeof *out);
+  if(out==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'out'", __func__, sizeof *out);
+
+  /* Do the checks and conversions. */
+  out->root=root;
+  out->coords_raw=coords_raw;
+  out->layout=gal_kdtree_layout(kdtree);
+  switch(out->layout)
+    {
+    case GAL_KDTREE_LAYOUT_LEFTRIGHT:
+      out->p.left_col=kdtree;
+      kdtree_prepare(&out->p, coords_raw);
+      break;
+
+    case GAL_KDTREE_LAYOUT_IMPLICIT:
+      kdtree_implicit_prepare(&out->t, coords_raw, kdtree);
+      out->p.ndim=out->t.ndim;
+      break;
+
+    default:
+      error(EXIT_FAILURE, 0, "%s: the k-d tree should either have two "
+            "'uint32' columns (left/right layout) or one 'int64' column "
+            "(implicit layout)", __func__);
+    }
+
+  /* Return the prepared tree. */
+  return out;
+}
+
+
+
+
+
+void
+gal_kdtree_prepared_free(gal_kdtree_prepared_t *prep)
+{
+  if(prep==NULL) return;
+  if(prep->layout==GAL_KDTREE_LAYOUT_IMPLICIT)
+    {
+      free(prep->t.points);
+      free(prep->t.split);
+    }
+  else
+    kdtree_cleanup(&prep->p, prep->coords_raw);
+  free(prep);
+}
+
+
+
+
+
+/* Find the nearest neighbour of 'point' in a prepared k-d tree. This
+   function only reads the contents of 'prep', so it can be called on
+   multiple threads at the same time. */
+size_t
+gal_kdtree_nearest_neighbour_prepared(gal_kdtree_prepared_t *prep,
+                                      double *point, double *least_dist)
+{
+  size_t out_nn=GAL_BLANK_SIZE_T;
+
+  /* Use the low-level function to find the nearest neighbour (in the
+     implicit layout, the position in the tree should be converted to the
+     input row). */
+  *least_dist=DBL_MAX;
+  if(prep->layout==GAL_KDTREE_LAYOUT_IMPLICIT)
+    {
+      kdtree_implicit_nearest_neighbour(&prep->t, 0, 0, prep->t.size, 0,
+                                        point, least_dist, &out_nn);
+      if(out_nn!=GAL_BLANK_SIZE_T) out_nn=prep->t.rows[out_nn];
+    }
+  else
+    kdtree_nearest_neighbour(&prep->p, prep->root, point, least_dist,
+                             &out_nn, 0);
+
+  /* 'least_dist' is the square of the distance between the nearest
+     neighbour and the point (used to improve processing). Square root of
+     that is the actual distance. */
+  *least_dist = sqrt(*least_dist);
   return out_nn;
 }
+
+
+
+
+
+/* High-level function used to find the nearest neighbour of a given
+   point in a kd-tree. It calculates the least distance of the point
+   from the nearest node and returns the index of that node. When many
+   points are to be searched, it is much more efficient to prepare the
+   k-d tree once with 'gal_kdtree_prepare' and use the functions below.
+
+   Return: The index of the nearest neighbour node in the kd-tree.
+*/
+size_t
+gal_kdtree_nearest_neighbour(gal_data_t *coords_raw, gal_data_t *kdtree,
+                             size_t root, double *point,
+                             double *least_dist)
+{
+  size_t out_nn;
+  gal_kdtree_prepared_t *prep;
+
+  /* Prepare the tree, do the search and clean up. */
+  prep=gal_kdtree_prepare(coords_raw, kdtree, root);
+  if(prep==NULL) { *least_dist=NAN; return GAL_BLANK_SIZE_T; }
+  out_nn=gal_kdtree_nearest_neighbour_prepared(prep, point, least_dist);
+  gal_kdtree_prepared_free(prep);
+
+  /* For a check
+  printf("%s: root=%zu, out_nn=%zu, least_dis=%f\n",
+         __func__, root, out_nn, *least_dist);
+  */
+
+  /* Return the index. */
+  return out_nn;
+}
+
+
+
+
+
+/* Parameters for the multi-threaded search of many points. */
+struct kdtree_batch_params
+{
+  gal_kdtree_prepared_t *prep;  /* The prepared k-d tree.              */
+  double             **points;  /* Coordinates of query points.        */
+  size_t               *index;  /* Index of nearest neighbour.         */
+  double                *dist;  /* Distance to nearest neighbour.      */
+  size_t                    k;  /* Number of neighbours to find.       */
+  double               radius;  /* Radius to search within.            */
+  size_t               *count;  /* Number of neighbours of each point. */
+  size_t              *offset;  /* Start of each point's neighbours.   */
+};
+
+
+
+
+
+/* Check the query points of the batch functions and convert them to
+   'double' (only if necessary). The returned array has the converted
+   datasets (to be freed with 'kdtree_batch_points_free') and 'parr' will
+   point to an array of their 'array' pointers. */
+static gal_data_t **
+kdtree_batch_points(gal_kdtree_prepared_t *prep, gal_data_t *points,
+                    double ***parr)
+{
+  size_t i;
+  gal_data_t *tmp, **conv;
+
+  /* Sanity checks. */
+  if(prep==NULL)
+    error(EXIT_FAILURE, 0, "%s: the prepared k-d tree is NULL",
+          __func__);
+  if(gal_list_data_number(points)!=prep->p.ndim)
+    error(EXIT_FAILURE, 0, "%s: the k-d tree has %zu dimensions, but the "
+          "query points have %zu", __func__, prep->p.ndim,
+          gal_list_data_number(points));
+  for(tmp=points->next; tmp!=NULL; tmp=tmp->next)
+    if(tmp->size!=points->size)
+      error(EXIT_FAILURE, 0, "%s: all the columns of 'points' must have "
+            "the same number of elements", __func__);
+
+  /* Convert the query coordinates to 'double' (only if necessary). */
+  errno=0;
+  conv=malloc(prep->p.ndim*sizeof *conv);
+  *parr=malloc(prep->p.ndim*sizeof **parr);
+  if(conv==NULL || *parr==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'conv' or 'parr'", __func__, prep->p.ndim*sizeof *conv);
+  for(i=0, tmp=points; tmp!=NULL; tmp=tmp->next, ++i)
+    {
+      conv[i] = ( tmp->type==GAL_TYPE_FLOAT64
+                  ? tmp
+                  : gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64) );
+      (*parr)[i]=conv[i]->array;
+    }
+
+  /* Return the converted datasets. */
+  return conv;
+}
+
+
+
+
+
+static void
+kdtree_batch_points_free(gal_data_t *points, gal_data_t **conv,
+                         double **parr)
+{
+  size_t i;
+  gal_data_t *tmp;
+  for(i=0, tmp=points; tmp!=NULL; tmp=tmp->next, ++i)
+    if(conv[i]!=tmp) gal_data_free(conv[i]);
+  free(parr);
+  free(conv);
+}
+
+
+
+
+
+static void *
+kdtree_nearest_neighbour_batch_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_batch_params *p=(struct kdtree_batch_params *)tprm->params;
+
+  size_t i, j, ind, ndim=p->prep->p.ndim;
+  double *point=gal_pointer_allocate(GAL_TYPE_FLOAT64, ndim, 0, __func__,
+                                     "point");
+
+  /* Go over all the points that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the point's coordinates. */
+      ind=tprm->indexs[i];
+      for(j=0;j<ndim;++j) point[j]=p->points[j][ind];
+
+      /* Find its nearest neighbour (the distance of points that weren't
+         matched, for example because they have a NaN coordinate, is
+         NaN). */
+      p->index[ind]=gal_kdtree_nearest_neighbour_prepared(p->prep, point,
+                                                          &p->dist[ind]);
+      if(p->index[ind]==GAL_BLANK_SIZE_T) p->dist[ind]=NAN;
+    }
+
+  /* Clean up, wait for all threads to finish and return. */
+  free(point);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the nearest neighbour of all the points in 'points' (a list of
+   columns: one column for each dimension, similar to the coordinates of
+   the k-d tree) on 'numthreads' threads. The output is a list of two
+   columns: the index of the nearest neighbour of each point (a 'size_t'
+   column) and the distance to it (a 'double' column). */
+gal_data_t *
+gal_kdtree_nearest_neighbour_batch(gal_kdtree_prepared_t *prep,
+                                   gal_data_t *points, size_t numthreads,
+                                   size_t minmapsize, int quietmmap)
+{
+  gal_data_t **conv;
+  gal_data_t *index, *dist;
+  struct kdtree_batch_params bp;
+
+  /* Check and convert the query points. */
+  conv=kdtree_batch_points(prep, points, &bp.points);
+
+  /* Allocate the outputs. */
+  index=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &points->size, NULL, 0,
+                       minmapsize, quietmmap, "index", "counter",
+                       "Index of nearest neighbour (counting from 0).");
+  dist=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &points->size, NULL, 0,
+                      minmapsize, quietmmap, "distance", NULL,
+                      "Distance to nearest neighbour.");
+  index->next=dist;
+
+  /* Do the search on multiple threads. */
+  bp.prep=prep;
+  bp.dist=dist->array;
+  bp.index=index->array;
+  gal_threads_spin_off(kdtree_nearest_neighbour_batch_worker, &bp,
+                       points->size, numthreads, minmapsize, quietmmap);
+
+  /* Clean up and return. */
+  kdtree_batch_points_free(points, conv, bp.points);
+  return index;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ********     k-nearest and fixed-radius neighbours       *******
+ ****************************************************************/
+/* Is the neighbour at 'i' farther than the one at 'j'? When the distances
+   are equal, the larger index is considered to be farther, so the order
+   of the outputs doesn't depend on the order that nodes are visited. */
+#define KDTREE_FARTHER(DIST, IND, I, J)                                 \
+  ( (DIST)[I]>(DIST)[J] || ( (DIST)[I]==(DIST)[J] && (IND)[I]>(IND)[J] ) )
+
+
+
+
+
+/* Swap two elements of the (index, distance) pairs. */
+static void
+kdtree_heap_swap(size_t *ind, double *dist, size_t i, size_t j)
+{
+  size_t ti=ind[i];
+  double td=dist[i];
+  ind[i]=ind[j];   dist[i]=dist[j];
+  ind[j]=ti;       dist[j]=td;
+}
+
+
+
+
+
+/* Move element 'i' down the max-heap of 'n' elements (the farthest
+   neighbour is at the root) until it is farther than its children. */
+static void
+kdtree_heap_sift_down(size_t *ind, double *dist, size_t i, size_t n)
+{
+  size_t c;
+
+  while( (c=2*i+1) < n )
+    {
+      /* Select the farther child. */
+      if( c+1<n && KDTREE_FARTHER(dist, ind, c+1, c) ) ++c;
+
+      /* If the parent is already farther, the heap is complete. */
+      if( !KDTREE_FARTHER(dist, ind, c, i) ) return;
+      kdtree_heap_swap(ind, dist, i, c);
+      i=c;
+    }
+}
+
+
+
+
+
+/* Move element 'i' up the max-heap until its parent is farther. */
+static void
+kdtree_heap_sift_up(size_t *ind, double *dist, size_t i)
+{
+  size_t parent;
+
+  while(i>0)
+    {
+      parent=(i-1)/2;
+      if( !KDTREE_FARTHER(dist, ind, i, parent) ) return;
+      kdtree_heap_swap(ind, dist, i, parent);
+      i=parent;
+    }
+}
+
+
+
+
+
+/* Sort the 'n' neighbours of a max-heap by increasing distance (heap
+   sort: the farthest is repeatedly moved to the end). The squared
+   distances are also converted to the actual distance here. */
+static void
+kdtree_heap_sort(size_t *ind, double *dist, size_t n)
+{
+  size_t i;
+
+  for(i=n; i>1; --i)
+    {
+      kdtree_heap_swap(ind, dist, 0, i-1);
+      kdtree_heap_sift_down(ind, dist, 0, i-1);
+    }
+  for(i=0;i<n;++i) dist[i]=sqrt(dist[i]);
+}
+
+
+
+
+
+/* Return 1 if any of the point's coordinates are NaN. */
+static int
+kdtree_point_has_nan(size_t ndim, double *point)
+{
+  size_t i;
+  for(i=0;i<ndim;++i) if( isnan(point[i]) ) return 1;
+  return 0;
+}
+
+
+
+
+
+/* Add a neighbour to the bounded max-heap of the 'k' nearest neighbours:
+   if the heap isn't full yet, add it. Otherwise, if it is nearer than the
+   farthest neighbour so far, replace it. */
+static void
+kdtree_heap_add(size_t *ind, double *dist, size_t k, size_t *num,
+                size_t index, double d)
+{
+  /* A point with a NaN coordinate is not a neighbour of any point. */
+  if(isnan(d)) return;
+
+  /* Add it to the heap. */
+  if(*num<k)
+    {
+      ind[*num]=index;
+      dist[*num]=d;
+      kdtree_heap_sift_up(ind, dist, (*num)++);
+    }
+  else if( d<dist[0] || (d==dist[0] && index<ind[0]) )
+    {
+      ind[0]=index;
+      dist[0]=d;
+      kdtree_heap_sift_down(ind, dist, 0, k);
+    }
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbours of 'point' (the same search as
+   'kdtree_nearest_neighbour', but with the farthest of the 'k' nearest
+   neighbours so far as the search limit). The neighbours are kept in a
+   bounded max-heap of 'num' elements (the squared distances are kept). */
+static void
+kdtree_knn(struct kdtree_params *p, uint32_t node_current, double *point,
+           size_t k, size_t *num, size_t *ind, double *dist, size_t depth)
+{
+  double d, dx;
+  size_t axis=depth % p->ndim;
+  double *coordinates=p->coords[axis]->array;
+
+  /* If no subtree present, don't search further. */
+  if(node_current==GAL_BLANK_UINT32) return;
+
+  /* Distance of this node to the point and to its splitting plane. */
+  d  = kdtree_distance_find(p, node_current, point);
+  dx = coordinates[node_current]-point[axis];
+
+  /* Add this node to the nearest neighbours (if it is near enough). */
+  kdtree_heap_add(ind, dist, k, num, node_current, d);
+
+  /* Search the subtree on the side of the point first. */
+  kdtree_knn(p, dx > 0 ? p->left[node_current] : p->right[node_current],
+             point, k, num, ind, dist, depth+1);
+
+  /* The other subtree only needs to be searched if the heap isn't full
+     or the splitting plane is nearer than the farthest neighbour. */
+  if( *num==k && dx*dx > dist[0] ) return;
+  kdtree_knn(p, dx > 0 ? p->right[node_current] : p->left[node_current],
+             point, k, num, ind, dist, depth+1);
+}
+
+
+
+
+
+/* The 'k' nearest neighbours in the implicit layout (the input rows are
+   put in the heap, so ties are broken in the same way as above). */
+static void
+kdtree_implicit_knn(struct kdtree_implicit *t, size_t node, size_t lo,
+                    size_t hi, size_t depth, double *point, size_t k,
+                    size_t *num, size_t *ind, double *dist)
+{
+  double dx;
+  size_t i, mid=lo+(hi-lo)/2;
+
+  /* In a leaf, check all the points. */
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET)
+    {
+      for(i=lo;i<hi;++i)
+        kdtree_heap_add(ind, dist, k, num, t->rows[i],
+                        kdtree_implicit_distance(t, i, point));
+      return;
+    }
+
+  /* Search the half that contains the point first (the first half when
+     the split is NaN). */
+  dx=point[depth%t->ndim]-t->split[node];
+  if(dx<0 || isnan(dx))
+    kdtree_implicit_knn(t, 2*node+1, lo, mid, depth+1, point, k, num,
+                        ind, dist);
+  else
+    kdtree_implicit_knn(t, 2*node+2, mid, hi, depth+1, point, k, num,
+                        ind, dist);
+
+  /* Search the other half if necessary (always when the split is NaN,
+     because 'dx*dx' is then NaN). */
+  if( *num==k && dx*dx > dist[0] ) return;
+  if(dx<0 || isnan(dx))
+    kdtree_implicit_knn(t, 2*node+2, mid, hi, depth+1, point, k, num,
+                        ind, dist);
+  else
+    kdtree_implicit_knn(t, 2*node+1, lo, mid, depth+1, point, k, num,
+                        ind, dist);
+}
+
+
+
+
+
+/* Find the (at most) 'k' nearest neighbours of 'point' in a prepared k-d
+   tree. The index and distance of each neighbour are written in 'indexs'
+   and 'dists' (that should each have space for 'k' elements), sorted by
+   increasing distance. This function only reads the contents of 'prep',
+   so it can be called on multiple threads at the same time.
+
+   Return: The number of neighbours that were found ('k' or the number of
+   nodes in the tree, whichever is smaller; zero if the point has a NaN
+   coordinate). */
+size_t
+gal_kdtree_knn(gal_kdtree_prepared_t *prep, double *point, size_t k,
+               size_t *indexs, double *dists)
+{
+  size_t num=0;
+
+  /* Basic checks. */
+  if(prep==NULL || k==0 || kdtree_point_has_nan(prep->p.ndim, point))
+    return 0;
+
+  /* Do the search and sort the outputs. */
+  if(prep->layout==GAL_KDTREE_LAYOUT_IMPLICIT)
+    kdtree_implicit_knn(&prep->t, 0, 0, prep->t.size, 0, point, k, &num,
+                        indexs, dists);
+  else
+    kdtree_knn(&prep->p, prep->root, point, k, &num, indexs, dists, 0);
+  kdtree_heap_sort(indexs, dists, num);
+  return num;
+}
+
+
+
+
+
+/* Add a neighbour to the outputs of the range search. When 'ind' is
+   NULL, it is only counted. The outputs are (re-)allocated as they become
+   full. */
+static void
+kdtree_range_add(size_t *num, size_t **ind, double **dist,
+                 size_t *allocated, size_t index, double d)
+{
+  if(ind)
+    {
+      if(*num==*allocated)
+        {
+          *allocated = *allocated ? 2 * *allocated : 16;
+          errno=0;
+          *ind=realloc(*ind, *allocated * sizeof **ind);
+          *dist=realloc(*dist, *allocated * sizeof **dist);
+          if(*ind==NULL || *dist==NULL)
+            error(EXIT_FAILURE, errno, "%s: couldn't re-allocate %zu "
+                  "elements for the neighbours", __func__, *allocated);
+        }
+      (*ind)[*num]=index;
+      (*dist)[*num]=d;
+    }
+  ++(*num);
+}
+
+
+
+
+
+/* Add the nodes within the squared radius 'r2' to the outputs (see
+   'kdtree_range_add'). */
+static void
+kdtree_range(struct kdtree_params *p, uint32_t node_current, double *point,
+             double r2, size_t *num, size_t **ind, double **dist,
+             size_t *allocated, size_t depth)
+{
+  double d, dx;
+  size_t axis=depth % p->ndim;
+  double *coordinates=p->coords[axis]->array;
+
+  /* If no subtree present, don't search further. */
+  if(node_current==GAL_BLANK_UINT32) return;
+
+  /* Distance of this node to the point and to its splitting plane. */
+  d  = kdtree_distance_find(p, node_current, point);
+  dx = coordinates[node_current]-point[axis];
+
+  /* If this node is within the radius, add it. */
+  if(d<=r2) kdtree_range_add(num, ind, dist, allocated, node_current, d);
+
+  /* Search the subtree on the side of the point, then the other side if
+     the splitting plane is within the radius (or if this node's coordinate
+     is NaN, so 'dx*dx' is NaN). */
+  kdtree_range(p, dx > 0 ? p->left[node_current] : p->right[node_current],
+               point, r2, num, ind, dist, allocated, depth+1);
+  if( !(dx*dx > r2) )
+    kdtree_range(p, dx > 0 ? p->right[node_current] : p->left[node_current],
+                 point, r2, num, ind, dist, allocated, depth+1);
+}
+
+
+
+
+
+/* Range search in the implicit layout. */
+static void
+kdtree_implicit_range(struct kdtree_implicit *t, size_t node, size_t lo,
+                      size_t hi, size_t depth, double *point, double r2,
+                      size_t *num, size_t **ind, double **dist,
+                      size_t *allocated)
+{
+  double d, dx;
+  size_t i, mid=lo+(hi-lo)/2;
+
+  /* In a leaf, check all the points. */
+  if(hi-lo<=GAL_KDTREE_IMPLICIT_BUCKET)
+    {
+      for(i=lo;i<hi;++i)
+        if( (d=kdtree_implicit_distance(t, i, point)) <= r2 )
+          kdtree_range_add(num, ind, dist, allocated, t->rows[i], d);
+      return;
+    }
+
+  /* Search the half that contains the point, then the other half if the
+     splitting plane is within the radius (both halves when the split is
+     NaN). */
+  dx=point[depth%t->ndim]-t->split[node];
+  if(dx<0 || !(dx*dx>r2))
+    kdtree_implicit_range(t, 2*node+1, lo, mid, depth+1, point, r2, num,
+                          ind, dist, allocated);
+  if(dx>=0 || !(dx*dx>r2))
+    kdtree_implicit_range(t, 2*node+2, mid, hi, depth+1, point, r2, num,
+                          ind, dist, allocated);
+}
+
+
+
+
+
+/* Call the range search of the layout of the prepared tree. */
+static void
+kdtree_range_prepared(gal_kdtree_prepared_t *prep, double *point,
+                      double r2, size_t *num, size_t **ind, double **dist,
+                      size_t *allocated)
+{
+  if(prep->layout==GAL_KDTREE_LAYOUT_IMPLICIT)
+    kdtree_implicit_range(&prep->t, 0, 0, prep->t.size, 0, point, r2, num,
+                          ind, dist, allocated);
+  else
+    kdtree_range(&prep->p, prep->root, point, r2, num, ind, dist,
+                 allocated, 0);
+}
+
+
+
+
+
+/* Find all the nodes of a prepared k-d tree that are within a distance of
+   'radius' from 'point' (inclusive). The neighbours are written in
+   '*indexs' and '*dists' (sorted by increasing distance). These arrays
+   have space for '*allocated' elements: if they are too small, they will
+   be re-allocated (and '*allocated' updated). So they can initially be
+   NULL (with '*allocated' being zero) and be re-used for many points.
+   This function only reads the contents of 'prep', so it can be called
+   on multiple threads at the same time (with different output arrays).
+
+   Return: The number of neighbours that were found. */
+size_t
+gal_kdtree_range(gal_kdtree_prepared_t *prep, double *point, double radius,
+                 size_t **indexs, double **dists, size_t *allocated)
+{
+  size_t i, num=0;
+
+  /* Basic checks. */
+  if(prep==NULL || isnan(radius) || radius<0
+     || kdtree_point_has_nan(prep->p.ndim, point))
+    return 0;
+
+  /* Do the search. */
+  kdtree_range_prepared(prep, point, radius*radius, &num, indexs, dists,
+                        allocated);
+
+  /* Sort the neighbours by distance (build a max-heap, then sort it). */
+  for(i=num/2; i>0; --i) kdtree_heap_sift_down(*indexs, *dists, i-1, num);
+  kdtree_heap_sort(*indexs, *dists, num);
+  return num;
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbours of each point (on one thread). */
+static void *
+kdtree_knn_batch_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_batch_params *p=(struct kdtree_batch_params *)tprm->params;
+
+  size_t i, j, ind, ndim=p->prep->p.ndim;
+  double *point=gal_pointer_allocate(GAL_TYPE_FLOAT64, ndim, 0, __func__,
+                                     "point");
+
+  /* Each point has space for 'k' neighbours. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      for(j=0;j<ndim;++j) point[j]=p->points[j][ind];
+      p->count[ind]=gal_kdtree_knn(p->prep, point, p->k,
+                                   p->index+ind*p->k, p->dist+ind*p->k);
+    }
+
+  /* Clean up, wait for all threads to finish and return. */
+  free(point);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Find the neighbours of each point within the radius (on one thread).
+   When 'p->index' is NULL, only the number of neighbours of each point
+   is found. Otherwise, they are copied into the outputs at the offset of
+   each point. */
+static void *
+kdtree_range_batch_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct kdtree_batch_params *p=(struct kdtree_batch_params *)tprm->params;
+
+  double *dist=NULL;
+  size_t *index=NULL, allocated=0;
+  size_t i, j, ind, num, ndim=p->prep->p.ndim;
+  double *point=gal_pointer_allocate(GAL_TYPE_FLOAT64, ndim, 0, __func__,
+                                     "point");
+
+  /* Go over all the points that were assigned to this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      ind=tprm->indexs[i];
+      for(j=0;j<ndim;++j) point[j]=p->points[j][ind];
+
+      /* Only count the neighbours. */
+      if(p->index==NULL)
+        {
+          num=0;
+          if( !kdtree_point_has_nan(ndim, point) )
+            kdtree_range_prepared(p->prep, point, p->radius*p->radius,
+                                  &num, NULL, NULL, NULL);
+          p->count[ind]=num;
+        }
+
+      /* Find the neighbours and put them in their place in the output. */
+      else
+        {
+          num=gal_kdtree_range(p->prep, point, p->radius, &index, &dist,
+                               &allocated);
+          memcpy(p->index+p->offset[ind], index, num*sizeof *index);
+          memcpy(p->dist+p->offset[ind], dist, num*sizeof *dist);
+        }
+    }
+
+  /* Clean up, wait for all threads to finish and return. */
+  free(dist);
+  free(index);
+  free(point);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Allocate the output of the batch neighbour searches: three columns of
+   'num' elements (the query point, the neighbour and the distance). */
+static gal_data_t *
+kdtree_pairs_alloc(size_t num, size_t minmapsize, int quietmmap)
+{
+  gal_data_t *out;
+
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &num, NULL, 0, minmapsize,
+                     quietmmap, "query", "counter",
+                     "Index of query point (counting from 0).");
+  out->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &num, NULL, 0,
+                           minmapsize, quietmmap, "index", "counter",
+                           "Index of neighbour (counting from 0).");
+  out->next->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &num, NULL, 0,
+                                 minmapsize, quietmmap, "distance", NULL,
+                                 "Distance to neighbour.");
+  return out;
+}
+
+
+
+
+
+/* Find the 'k' nearest neighbours of all the points in 'points' (a list
+   of columns, similar to 'gal_kdtree_nearest_neighbour_batch') on
+   'numthreads' threads. The output is a list of three columns with one
+   row for every neighbour: the index of the query point, the index of
+   the neighbour ('size_t' columns) and the distance between them (a
+   'double' column). The rows are sorted by the query point, then by
+   distance. */
+gal_data_t *
+gal_kdtree_knn_batch(gal_kdtree_prepared_t *prep, gal_data_t *points,
+                     size_t k, size_t numthreads, size_t minmapsize,
+                     int quietmmap)
+{
+  gal_data_t **conv, *out;
+  struct kdtree_batch_params bp;
+  size_t i, j, o, num=0, *qarr, *iarr;
+  double *darr;
+
+  /* Check and convert the query points. */
+  conv=kdtree_batch_points(prep, points, &bp.points);
+
+  /* Allocate space for 'k' neighbours of every point. */
+  bp.k=k;
+  bp.prep=prep;
+  bp.count=gal_pointer_allocate(GAL_TYPE_SIZE_T, points->size, 0,
+                                __func__, "bp.count");
+  bp.index=gal_pointer_allocate(GAL_TYPE_SIZE_T, points->size*k, 0,
+                                __func__, "bp.index");
+  bp.dist=gal_pointer_allocate(GAL_TYPE_FLOAT64, points->size*k, 0,
+                               __func__, "bp.dist");
+
+  /* Do the search on multiple threads. */
+  gal_threads_spin_off(kdtree_knn_batch_worker, &bp, points->size,
+                       numthreads, minmapsize, quietmmap);
+
+  /* Put the neighbours of all points together in the output. */
+  for(i=0;i<points->size;++i) num+=bp.count[i];
+  out=kdtree_pairs_alloc(num, minmapsize, quietmmap);
+  o=0;
+  qarr=out->array;
+  iarr=out->next->array;
+  darr=out->next->next->array;
+  for(i=0;i<points->size;++i)
+    for(j=0;j<bp.count[i];++j)
+      {
+        qarr[o]=i;
+        iarr[o]=bp.index[i*k+j];
+        darr[o++]=bp.dist[i*k+j];
+      }
+
+  /* Clean up and return. */
+  kdtree_batch_points_free(points, conv, bp.points);
+  free(bp.count);
+  free(bp.index);
+  free(bp.dist);
+  return out;
+}
+
+
+
+
+
+/* Find all the neighbours within 'radius' of all the points in 'points'
+   on 'numthreads' threads. The output has the same format as
+   'gal_kdtree_knn_batch'. The neighbours are first counted, so each
+   thread can write its results directly into its place in the output
+   (the output is independent of the number of threads). */
+gal_data_t *
+gal_kdtree_range_batch(gal_kdtree_prepared_t *prep, gal_data_t *points,
+                       double radius, size_t numthreads, size_t minmapsize,
+                       int quietmmap)
+{
+  size_t i, j, num=0;
+  gal_data_t **conv, *out;
+  struct kdtree_batch_params bp;
+  size_t *qarr;
+
+  /* Check and convert the query points. */
+  conv=kdtree_batch_points(prep, points, &bp.points);
+
+  /* Count the number of neighbours of each point. */
+  bp.prep=prep;
+  bp.index=NULL;
+  bp.radius=radius;
+  bp.count=gal_pointer_allocate(GAL_TYPE_SIZE_T, points->size, 0,
+                                __func__, "bp.count");
+  gal_threads_spin_off(kdtree_range_batch_worker, &bp, points->size,
+                       numthreads, minmapsize, quietmmap);
+
+  /* Find the offset of each point's neighbours in the output. */
+  bp.offset=gal_pointer_allocate(GAL_TYPE_SIZE_T, points->size, 0,
+                                 __func__, "bp.offset");
+  for(i=0;i<points->size;++i) { bp.offset[i]=num; num+=bp.count[i]; }
+
+  /* Allocate the output and fill it. */
+  out=kdtree_pairs_alloc(num, minmapsize, quietmmap);
+  if(num)
+    {
+      qarr=out->array;
+      bp.index=out->next->array;
+      bp.dist=out->next->next->array;
+      for(i=0;i<points->size;++i)
+        for(j=0;j<bp.count[i];++j)
+          qarr[bp.offset[i]+j]=i;
+      gal_threads_spin_off(kdtree_range_batch_worker, &bp, points->size,
+                           numthreads, minmapsize, quietmmap);
+    }
+
+  /* Clean up and return. */
+  kdtree_batch_points_free(points, conv, bp.points);
+  free(bp.offset);
+  free(bp.count);
+  return out;
+}
@@ -31,6 +31,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/list.h>
 #include <gnuastro/qsort.h>
 #include <gnuastro/label.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
 #include <gnuastro/dimension.h>
 #include <gnuastro/statistics.h>
@@ -149,6 +150,147 @@ gal_label_indexs(gal_data_t *labels, size_t numlabs, size_t minmapsize,
 
 
 
+/* Parameters for the threads of 'gal_label_indexs_compact'. */
+struct label_compact_params
+{
+  int32_t         *labels;  /* Array of labels.                          */
+  size_t          numlabs;  /* Number of labels.                         */
+  size_t           *start;  /* First index of each slab (and the end).   */
+  size_t          *counts;  /* Count (or next position) of labels/slab.  */
+  size_t          *indexs;  /* Output indexs (NULL in the counting pass). */
+};
+
+
+
+
+
+/* On each slab: in the first pass (when 'p->indexs==NULL'), count the
+   number of pixels of each label, and in the second pass, write each
+   pixel's index in its label's next position. */
+static void *
+label_compact_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct label_compact_params *p=(struct label_compact_params *)tprm->params;
+
+  size_t i, j, s, *c;
+  int32_t *l=p->labels;
+
+  /* Go over all the slabs given to this thread. */
+  for(j=0; tprm->indexs[j] != GAL_BLANK_SIZE_T; ++j)
+    {
+      s=tprm->indexs[j];
+      c=p->counts + s*(p->numlabs+1);
+      if(p->indexs)
+        {
+          for(i=p->start[s]; i<p->start[s+1]; ++i)
+            if(l[i]>0 && (size_t)l[i]<=p->numlabs)
+              p->indexs[ c[ l[i] ]++ ] = i;
+        }
+      else
+        for(i=p->start[s]; i<p->start[s+1]; ++i)
+          if(l[i]>0 && (size_t)l[i]<=p->numlabs) ++c[ l[i] ];
+    }
+
+  /* Wait for the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Put the indexs of all the labeled regions into one array (where the
+   indexs of each label are contiguous) and return it with the offsets
+   of each label (similar to the compressed sparse row format). The
+   dataset is divided into slabs (one for each thread). Each slab's
+   number of pixels of each label are counted in parallel, then every slab
+   is given its starting position within each label and the indexs are
+   written in parallel. Since the slabs are in order, the indexs of each
+   label are sorted (similar to 'gal_label_indexs'). Elements with a
+   label larger than 'numlabs' are ignored. */
+gal_data_t *
+gal_label_indexs_compact(gal_data_t *labels, size_t numlabs,
+                         size_t numthreads, size_t minmapsize,
+                         int quietmmap)
+{
+  gal_data_t *max, *out;
+  size_t i, s, n, sum, numslabs, numind;
+  struct label_compact_params p={NULL, 0, NULL, NULL, NULL};
+
+  /* Sanity check. */
+  label_check_type(labels, GAL_TYPE_INT32, "labels", __func__);
+
+  /* If the user hasn't given the number of labels, find it (maximum
+     label). */
+  if(numlabs==0)
+    {
+      max=gal_statistics_maximum(labels);
+      n=*((int32_t *)(max->array));
+      numlabs = *((int32_t *)(max->array))>0 ? n : 0;
+      gal_data_free(max);
+    }
+
+  /* Every slab keeps a counter for every label, so when there are many
+     labels, the number of slabs is decreased to avoid allocating more
+     counters than the number of elements in the dataset. */
+  numslabs = numthreads ? numthreads : 1;
+  if( numslabs > labels->size/(numlabs+1) )
+    numslabs = labels->size/(numlabs+1) ? labels->size/(numlabs+1) : 1;
+
+  /* Set the starting index of each slab. */
+  p.start=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs+1, 0, __func__,
+                               "p.start");
+  for(s=0;s<=numslabs;++s) p.start[s] = labels->size * s / numslabs;
+
+  /* Count the number of elements of each label in each slab. */
+  p.labels=labels->array;
+  p.numlabs=numlabs;
+  p.counts=gal_pointer_allocate(GAL_TYPE_SIZE_T, numslabs*(numlabs+1), 1,
+                                __func__, "p.counts");
+  gal_threads_spin_off(label_compact_on_thread, &p, numslabs, numthreads,
+                       minmapsize, quietmmap);
+
+  /* The offsets of each label. There is one extra element, so the number
+     of elements of label 'i' is 'offsets[i+1]-offsets[i]'. The counters
+     of each slab are then replaced by the slab's first position in the
+     label (there are no elements with a label of 0). */
+  n=numlabs+2;
+  out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &n, NULL, 0, minmapsize,
+                     quietmmap, "OFFSETS", NULL,
+                     "Offset of each label's indexs.");
+  sum=0;
+  for(i=0;i<=numlabs;++i)
+    {
+      ((size_t *)(out->array))[i]=sum;
+      for(s=0;s<numslabs;++s)
+        {
+          n=p.counts[ s*(numlabs+1) + i ];
+          p.counts[ s*(numlabs+1) + i ] = sum;
+          sum+=n;
+        }
+    }
+  ((size_t *)(out->array))[numlabs+1]=numind=sum;
+
+  /* Allocate the indexs and fill them. */
+  out->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &numind, NULL, 0,
+                           minmapsize, quietmmap, "INDEXS", NULL,
+                           "Index of each labeled element.");
+  p.indexs=out->next->array;
+  gal_threads_spin_off(label_compact_on_thread, &p, numslabs, numthreads,
+                       minmapsize, quietmmap);
+
+  /* Clean up and return. */
+  free(p.start);
+  free(p.counts);
+  return out;
+}
+
+
+
+
+
 
 
 
@@ -239,19 +381,15 @@ gal_label_watershed(gal_data_t *values, gal_data_t *indexs,
 
 
   /* If the indexs aren't already sorted (by the value they correspond to),
-     sort them given indexs based on their flux ('gal_qsort_index_arr' is
-     defined as static in 'gnuastro/qsort.h'). */
+     sort them based on their flux. 'gal_qsort_index_r' doesn't use any
+     global variable, so this function can be called on different
+     threads (with different 'values') at the same time. */
   if( !( (indexs->flag & GAL_DATA_FLAG_SORT_CH)
         && ( indexs->flag
              & (GAL_DATA_FLAG_SORTED_I
                 | GAL_DATA_FLAG_SORTED_D) ) ) )
-    {
-      gal_qsort_index_single=values->array;
-      qsort(indexs->array, indexs->size, sizeof(size_t),
-            ( min0_max1
-              ? gal_qsort_index_single_float32_d
-              : gal_qsort_index_single_float32_i) );
-    }
+    gal_qsort_index_r(indexs->array, indexs->size, values->array,
+                      GAL_TYPE_FLOAT32, min0_max1);
 
 
   /* Initialize the region we want to over-segment. */
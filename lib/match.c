@@ -28,6 +28,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <error.h>
 #include <float.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gsl/gsl_sort.h>
 
@@ -277,108 +278,72 @@ match_distance(double *delta, int iscircle, size_t ndim,
 
 
 
-/* In the 'match_XXXX_second_in_first' functions, we made an array of
-   lists, here we want to reverse that list to fix the second two issues
-   that were discussed there. */
-void
-match_rearrange(gal_data_t *A, gal_data_t *B, struct match_sfll **bina)
+/* Allocate the arrays that keep the nearest row of one catalog for each
+   row of the other ('ind') and its distance ('dist'). Rows with no match
+   have a blank index. */
+static void
+match_nearest_alloc(size_t size, size_t **ind, float **dist)
 {
-  size_t bi;
-  float *fp, *fpf, r, *ainb;
-  size_t ai, ar=A->size, br=B->size;
-
-  /* Allocate the space for 'ainb' and initialize it to NaN (since zero is
-     meaningful in this context; both for indexs and also for floats). This
-     is a two column array that will keep the distance and index of the
-     closest element in catalog 'a' for each element in catalog b. */
-  errno=0; ainb=calloc(2*br, sizeof *ainb);
-  if(ainb==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'ainb'", __func__,
-          br*sizeof *ainb);
-  fpf=(fp=ainb)+2*br; do *fp++=NAN; while(fp<fpf);
-
-  /* Go over each object in catalog 'a' and re-distribute the near objects,
-     to find which ones in catalog 'a' are within the search radius of
-     catalog b in a sorted manner. Note that we only need the 'ai' with the
-     minimum distance to 'bi', the rest are junk. */
-  for( ai=0; ai<ar; ++ai )
-    while( bina[ai] )	/* As long as its not NULL.            */
-      {
-	/* Pop out a 'bi' and its distance to this 'ai' from 'bina' (this
-           is the nearest B item to this A element). */
-	match_pop_from_sfll(&bina[ai], &bi, &r);
-
-	/* If nothing has been put here (the 'isnan' condition below is
-	   true), or something exists (the isnan is false, and so it will
-	   check the second OR test) with a distance that is larger than
-	   this distance then just put this value in. */
-	if( isnan(ainb[bi*2]) || r<ainb[bi*2+1] )
-	  {
-	    ainb[bi*2  ] = ai;
-	    ainb[bi*2+1] = r;
-	  }
-      }
+  size_t i, *in;
 
-  /* For checking the status of affairs uncomment this block
-  {
-    printf("\n\nFilled ainb:\n");
-    for(bi=0;bi<br;++bi)
-      if( !isnan(ainb[bi*2]) )
-	printf("bi: %lu: %.0f, %f\n", bi, ainb[bi*2], ainb[bi*2+1]);
-  }
-  */
+  /* Allocate the arrays. */
+  in=*ind=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__,
+                               "ind");
+  *dist=gal_pointer_allocate(GAL_TYPE_FLOAT32, size, 0, __func__,
+                             "dist");
 
-  /* Re-fill the bina array, but this time only with the 'bi' that is
-     closest to it. Note that bina was fully set to NULL after popping all
-     the elements in the loop above. */
-  for( bi=0; bi<br; ++bi )
-    if( !isnan(ainb[bi*2]) )
+  /* Initialize the indexs to blank (no match). */
+  for(i=0;i<size;++i) in[i]=GAL_BLANK_SIZE_T;
+}
+
+
+
+
+
+/* In the 'match_XXXX_second_in_first' functions, we found the nearest
+   row of the first catalog for each row of the second ('ainb', with its
+   distance in 'rinb'). But one row of the first catalog may be the
+   nearest to many rows of the second. Here, we only keep the nearest of
+   those for each row of the first catalog ('bina' and 'rina'). When the
+   distances are equal, the row of the second catalog with the smaller
+   index is kept, so the result doesn't depend on the order that the
+   matches were found in (for example, the number of threads). */
+static void
+match_rearrange(size_t ar, size_t br, size_t *ainb, float *rinb,
+                size_t **bina, float **rina)
+{
+  float *ra;
+  size_t ai, bi, *ba;
+
+  /* Allocate the output arrays. */
+  match_nearest_alloc(ar, bina, rina);
+
+  /* Go over the rows of the second catalog and keep the nearest to each
+     row of the first. */
+  ba=*bina;
+  ra=*rina;
+  for(bi=0;bi<br;++bi)
+    if( (ai=ainb[bi])!=GAL_BLANK_SIZE_T
+        && ( ba[ai]==GAL_BLANK_SIZE_T || rinb[bi]<ra[ai] ) )
       {
-	/* Just to keep the same terminology as before and easier
-	   reading. */
-	r=ainb[bi*2+1];
-	ai=(size_t)(ainb[bi*2]);
-
-	/* Check if this is the first time we are associating a 'bi' to
-	   this 'ai'. If so, then just allocate a single element
-	   list. Otherwise, see if the distance is closer or not. If so,
-	   replace the values in the single node. */
-	if( bina[ai] )
-	  {
-	    /* If the distance of this record is smaller than the existing
-	       entry, then replace the values. */
-	    if( r < bina[ai]->f )
-	      {
-		bina[ai]->f=r;
-		bina[ai]->v=bi;
-	      }
-	  }
-	else
-          match_add_to_sfll(&bina[ai], bi, r);
+        ba[ai]=bi;
+        ra[ai]=rinb[bi];
       }
 
   /* For checking the status of affairs uncomment this block
   {
-    size_t bi, counter=0;
-    double *a[2]={A->array, A->next->array};
-    double *b[2]={B->array, B->next->array};
+    size_t counter=0;
     printf("\n\nRearranged bina:\n");
     for(ai=0;ai<ar;++ai)
-      if(bina[ai])
+      if(ba[ai]!=GAL_BLANK_SIZE_T)
         {
           ++counter;
-          bi=bina[ai]->v;
-          printf("A_%lu (%.8f, %.8f) <--> B_%lu (%.8f, %.8f):\n\t%f\n",
-                 ai, a[0][ai], a[1][ai], bi, b[0][bi], b[1][bi],
-                 bina[ai]->f);
+          printf("A_%zu <--> B_%zu: %f\n", ai, ba[ai], ra[ai]);
         }
     printf("\n-----------\nMatched: %zu\n", counter);
   }
   exit(0);
   */
-
-  /* Clean up. */
-  free(ainb);
 }
 
 
@@ -388,9 +353,8 @@ match_rearrange(gal_data_t *A, gal_data_t *B, struct match_sfll **bina)
 /* The matching has been done, write the output. */
 static gal_data_t *
 match_output(gal_data_t *A, gal_data_t *B, size_t *A_perm, size_t *B_perm,
-             struct match_sfll **bina, size_t minmapsize, int quietmmap)
+             size_t *bina, float *rina, size_t minmapsize, int quietmmap)
 {
-  float r;
   double *rval;
   gal_data_t *out;
   uint8_t *Bmatched;
@@ -398,7 +362,7 @@ match_output(gal_data_t *A, gal_data_t *B, size_t *A_perm, size_t *B_perm,
   size_t *aind, *bind, match_i, nomatch_i;
 
   /* Find how many matches there were in total. */
-  for(ai=0;ai<A->size;++ai) if(bina[ai]) ++nummatched;
+  for(ai=0;ai<A->size;++ai) if(bina[ai]!=GAL_BLANK_SIZE_T) ++nummatched;
 
 
   /* If there aren't any matches, return NULL. */
@@ -441,11 +405,11 @@ match_output(gal_data_t *A, gal_data_t *B, size_t *A_perm, size_t *B_perm,
   for(ai=0;ai<A->size;++ai)
     {
       /* A match was found. */
-      if(bina[ai])
+      if(bina[ai]!=GAL_BLANK_SIZE_T)
         {
           /* Note that the permutation keeps the original indexs. */
-          match_pop_from_sfll(&bina[ai], &bi, &r);
-          rval[ match_i   ] = r;
+          bi=bina[ai];
+          rval[ match_i   ] = rina[ai];
           aind[ match_i   ] = A_perm ? A_perm[ai] : ai;
           bind[ match_i++ ] = B_perm ? B_perm[bi] : bi;
 
@@ -865,6 +829,36 @@ match_sort_based_second_in_first(gal_data_t *A, gal_data_t *B,
 
 
 
+/* Find the nearest row of the first catalog for each row of the second
+   from the lists of 'match_sort_based_second_in_first' (the lists are
+   freed in the process). */
+static void
+match_sort_based_nearest(size_t ar, struct match_sfll **bina,
+                         size_t *ainb, float *rinb)
+{
+  float r;
+  size_t ai, bi;
+
+  for(ai=0;ai<ar;++ai)
+    while( bina[ai] )	/* As long as its not NULL.            */
+      {
+        /* Pop out a 'bi' and its distance to this 'ai'. */
+        match_pop_from_sfll(&bina[ai], &bi, &r);
+
+        /* If nothing has been put here, or the existing match is farther,
+           then just put this value in. */
+        if( ainb[bi]==GAL_BLANK_SIZE_T || r<rinb[bi] )
+          {
+            ainb[bi]=ai;
+            rinb[bi]=r;
+          }
+      }
+}
+
+
+
+
+
 /* Match two positions: the two inputs ('coord1' and 'coord2') should be
    lists of coordinates (each is a list of datasets). To speed up the
    search, this function will sort the inputs by their first column. If
@@ -891,9 +885,10 @@ gal_match_sort_based(gal_data_t *coord1, gal_data_t *coord2,
                       size_t *nummatched)
 {
   int allf64=1;
+  float *rinb, *rina;
   gal_data_t *A, *B, *out;
-  size_t *A_perm=NULL, *B_perm=NULL;
-  struct match_sfll **bina;
+  struct match_sfll **blists;
+  size_t *ainb, *bina, *A_perm=NULL, *B_perm=NULL;
 
   /* Do a small sanity check and make the preparations. After this point,
      we'll call the two arrays 'a' and 'b'.*/
@@ -904,31 +899,38 @@ gal_match_sort_based(gal_data_t *coord1, gal_data_t *coord2,
                             minmapsize);
 
 
-  /* Allocate the 'bina' array (an array of lists). Let's call the first
-     catalog 'a' and the second 'b'. This array has 'a->size' elements
-     (pointers) and for each, it keeps a list of 'b' elements that are
-     nearest to it. */
+  /* Allocate the 'blists' array (an array of lists). Let's call the
+     first catalog 'a' and the second 'b'. This array has 'a->size'
+     elements (pointers) and for each, it keeps a list of 'b' elements
+     that are nearest to it. */
   errno=0;
-  bina=calloc(A->size, sizeof *bina);
-  if(bina==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'bina'", __func__,
-          A->size*sizeof *bina);
+  blists=calloc(A->size, sizeof *blists);
+  if(blists==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'blists'", __func__,
+          A->size*sizeof *blists);
 
 
   /* All records in 'b' that match each 'a' (possibly duplicate). */
-  match_sort_based_second_in_first(A, B, aperture, bina);
+  match_sort_based_second_in_first(A, B, aperture, blists);
 
 
   /* Two re-arrangings will fix the issue. */
-  match_rearrange(A, B, bina);
+  match_nearest_alloc(B->size, &ainb, &rinb);
+  match_sort_based_nearest(A->size, blists, ainb, rinb);
+  match_rearrange(A->size, B->size, ainb, rinb, &bina, &rina);
 
 
   /* The match is done, write the output. */
-  out=match_output(A, B, A_perm, B_perm, bina, minmapsize, quietmmap);
+  out=match_output(A, B, A_perm, B_perm, bina, rina, minmapsize,
+                   quietmmap);
 
 
   /* Clean up. */
+  free(ainb);
+  free(rinb);
   free(bina);
+  free(rina);
+  free(blists);
   if(A!=coord1)
     {
       gal_list_data_free(A);
@@ -974,6 +976,7 @@ struct match_kdtree_params
   double          *aperture;  /* Acceptable aperture for match.       */
   size_t        kdtree_root;  /* Index (counting from 0) of root.     */
   gal_data_t      *A_kdtree;  /* k-d tree of first coordinate.        */
+  gal_kdtree_prepared_t *A_prep; /* Prepared k-d tree (for queries).  */
 
   /* Internal parameters for easy aperture checking. For example there is
      no need to calculate the fixed 'cos()' and 'sin()' functions every
@@ -986,7 +989,8 @@ struct match_kdtree_params
   /* Internal items. */
   double              *a[3];  /* Direct pointers to column arrays.    */
   double              *b[3];  /* Direct pointers to column arrays.    */
-  struct match_sfll  **bina;  /* Second cat. items in first.          */
+  size_t              *ainb;  /* Nearest 1st cat. row to each 2nd.   */
+  float               *rinb;  /* Distance to the nearest row.         */
   gal_data_t        *Aexist;  /* If any element of A exists in bins.  */
   double         *Abinwidth;  /* Width of bins along each dimension.  */
   double              *Amin;  /* Minimum value of A along each dim.   */
@@ -1080,7 +1084,7 @@ match_kdtree_A_coverage(struct match_kdtree_params *p)
              equal/larger than ther user's given aperture and that these
              bins are only for rejecting points before the k-d tree (they
              aren't used within the k-d tree matching). */
-          gal_binary_dilate(hist, 1, 1, 1);
+          gal_binary_dilate(hist, 1, 1, 1, 1);
 
           /* Set the general bin properties along this dimension. */
           d=bins->array;
@@ -1132,8 +1136,9 @@ match_kdtree_A_coverage(struct match_kdtree_params *p)
 
 
 
+/* Check the inputs of the k-d tree based matching functions. */
 static void
-match_kdtree_sanity_check(struct match_kdtree_params *p)
+match_kdtree_check_inputs(struct match_kdtree_params *p)
 {
   gal_data_t *tmp;
 
@@ -1148,15 +1153,14 @@ match_kdtree_sanity_check(struct match_kdtree_params *p)
           gal_list_data_number(p->B),
           gal_list_data_number(p->A_kdtree));
 
-  /* Make sure that the k-d tree only has two columns. */
-  if( gal_list_data_number(p->A_kdtree)!=2 )
-    error(EXIT_FAILURE, 0, "%s: the 'kdtree' argument should only "
-          "two nodes/columns (elements in a simply linked list), "
-          "but it has %zu nodes/columns", __func__,
-          gal_list_data_number(p->A_kdtree));
+  /* Make sure that the k-d tree has one of the recognized layouts. */
+  if( gal_kdtree_layout(p->A_kdtree)==GAL_KDTREE_LAYOUT_INVALID )
+    error(EXIT_FAILURE, 0, "%s: the 'kdtree' argument should either "
+          "have two 'uint32' columns (left/right layout) or one 'int64' "
+          "column (implicit layout), see 'gal_kdtree_create' and "
+          "'gal_kdtree_create_implicit'", __func__);
 
-  /* Make sure the coordinates have a 'double' type and that the k-d tree
-     has an unsigned 32-bit integer type.*/
+  /* Make sure the coordinates have a 'double' type. */
   for(tmp=p->A; tmp!=NULL; tmp=tmp->next)
     if( tmp->type!=GAL_TYPE_FLOAT64 )
       error(EXIT_FAILURE, 0, "%s: the type of all columns in 'coord1' "
@@ -1167,21 +1171,23 @@ match_kdtree_sanity_check(struct match_kdtree_params *p)
       error(EXIT_FAILURE, 0, "%s: the type of all columns in 'coord2' "
             "should be 'double', but at least one of them is '%s'",
             __func__, gal_type_name(tmp->type, 1));
-  for(tmp=p->A_kdtree; tmp!=NULL; tmp=tmp->next)
-    if( tmp->type!=GAL_TYPE_UINT32 )
-      error(EXIT_FAILURE, 0, "%s: the type of both columns in "
-            "'coord1_kdtree' should be 'uint32', but it is '%s'",
-            __func__, gal_type_name(tmp->type, 1));
+}
+
+
+
 
-  /* Allocate and initialize the 'bina' array (an array of lists). Let's
-     call the first catalog 'a' and the second 'b'. This array has
-     'a->size' elements (pointers) and for each, it keeps a list of 'b'
-     elements that are nearest to it. */
-  errno=0;
-  p->bina=calloc(p->A->size, sizeof *p->bina);
-  if(p->bina==NULL)
-    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'bina'",
-          __func__, p->A->size*sizeof *p->bina);
+
+static void
+match_kdtree_sanity_check(struct match_kdtree_params *p)
+{
+  /* Check the inputs. */
+  match_kdtree_check_inputs(p);
+
+  /* Allocate the arrays that keep the nearest row of the first catalog
+     (and its distance) for each row of the second. Each row of the second
+     catalog is only processed by one thread, so the threads don't need
+     to be synchronized when writing in these arrays. */
+  match_nearest_alloc(p->B->size, &p->ainb, &p->rinb);
 
   /* Pointers to the input column arrays for easy parsing later. */
   p->a[0]=p->A->array;
@@ -1197,6 +1203,10 @@ match_kdtree_sanity_check(struct match_kdtree_params *p)
       if( p->B->next->next ) p->b[2]=p->B->next->next->array;
     }
 
+  /* Prepare the k-d tree for the queries of all the threads (only done
+     once). */
+  p->A_prep=gal_kdtree_prepare(p->A, p->A_kdtree, p->kdtree_root);
+
   /* Find the bins of the first input along all its dimensions and select
      those that contain data. This is very important in optimal k-d tree
      based matching because confirming a non-match in a k-d tree is very
@@ -1273,9 +1283,8 @@ match_kdtree_worker(void *in_prm)
         {
           /* Find the index of the nearest neighbor in the first catalog to
              this point in the second catalog. */
-          ai = gal_kdtree_nearest_neighbour(p->A, p->A_kdtree,
-                                            p->kdtree_root, point,
-                                            &least_dist);
+          ai = gal_kdtree_nearest_neighbour_prepared(p->A_prep, point,
+                                                     &least_dist);
 
           /* If nothing was found within the least distance, then the 'ai'
              will be 'GAL_BLANK_SIZE_T'. */
@@ -1289,9 +1298,12 @@ match_kdtree_worker(void *in_prm)
                                p->c, p->s);
 
               /* If the radial distance is smaller than the radial measure,
-                 then add this item to a match with 'ai'. */
+                 then keep 'ai' as the match of this row. */
               if(r<p->aperture[0])
-                match_add_to_sfll(&p->bina[ai], bi, r);
+                {
+                  p->ainb[bi]=ai;
+                  p->rinb[bi]=r;
+                }
             }
 
           /* For a check:
@@ -1342,6 +1354,8 @@ gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
                  double *aperture, size_t numthreads, size_t minmapsize,
                  int quietmmap, size_t *nummatched)
 {
+  float *rina;
+  size_t *bina;
   gal_data_t *out=NULL;
   struct match_kdtree_params p;
 
@@ -1364,19 +1378,563 @@ gal_match_kdtree(gal_data_t *coord1, gal_data_t *coord2,
   match_kdtree_second_in_first(&p, numthreads, minmapsize, quietmmap);
 
   /* Find the best match for each item (from possibly multiple matches). */
-  match_rearrange(p.A, p.B, p.bina);
+  match_rearrange(p.A->size, p.B->size, p.ainb, p.rinb, &bina, &rina);
 
   /* The match is done, write the output. */
-  out=match_output(p.A, p.B, NULL, NULL, p.bina, minmapsize, quietmmap);
+  out=match_output(p.A, p.B, NULL, NULL, bina, rina, minmapsize,
+                   quietmmap);
 
   /* Set 'nummatched' and return output. */
   *nummatched = out ?  out->next->next->size : 0;
 
   /* Clean up and return. */
-  free(p.bina);
+  free(bina);
+  free(rina);
+  free(p.ainb);
+  free(p.rinb);
   free(p.Amin);
   free(p.Amax);
   free(p.Abinwidth);
   gal_list_data_free(p.Aexist);
+  gal_kdtree_prepared_free(p.A_prep);
+  return out;
+}
+
+
+
+
+
+/* Sort the matches of one row of the second catalog (that are in the
+   '[start, end)' range of the arrays) by their distance (when the
+   distances are equal, by the row in the first catalog). The number of
+   matches of each row is usually small, so insertion sort is used. */
+static void
+match_kdtree_neighbours_sort(size_t *aind, double *rval, size_t start,
+                             size_t end)
+{
+  double r;
+  size_t i, j, ai;
+
+  for(i=start+1;i<end;++i)
+    {
+      r=rval[i];
+      ai=aind[i];
+      for(j=i; j>start && ( rval[j-1]>r
+                            || (rval[j-1]==r && aind[j-1]>ai) ); --j)
+        {
+          rval[j]=rval[j-1];
+          aind[j]=aind[j-1];
+        }
+      rval[j]=r;
+      aind[j]=ai;
+    }
+}
+
+
+
+
+
+/* Find all the rows of the first catalog that are within the aperture of
+   each row in the second (when 'k' is 0), or only the 'k' nearest of
+   them. Unlike 'gal_match_kdtree', a row of either catalog can be present
+   in many matches, so the output only has 'nummatched' rows (one for
+   each match; sorted by the row in the second catalog, then by
+   distance). */
+gal_data_t *
+gal_match_kdtree_neighbours(gal_data_t *coord1, gal_data_t *coord2,
+                            gal_data_t *coord1_kdtree, size_t kdtree_root,
+                            double *aperture, size_t k, size_t numthreads,
+                            size_t minmapsize, int quietmmap,
+                            size_t *nummatched)
+{
+  size_t i, j, bi, start, end, num=0;
+  size_t *qarr, *iarr, *aind, *bind;
+  struct match_kdtree_params p;
+  gal_kdtree_prepared_t *prep;
+  double *darr, *rval, dist[3];
+  gal_data_t *pairs, *out=NULL;
+  double delta[3];
+
+  /* In case the 'k-d' tree is empty, just return a NULL pointer and the
+     number of matches to zero. */
+  *nummatched=0;
+  if(coord1_kdtree==NULL) return NULL;
+
+  /* Write the parameters into the structure and check them. */
+  p.A=coord1;
+  p.B=coord2;
+  p.aperture=aperture;
+  p.A_kdtree=coord1_kdtree;
+  match_kdtree_check_inputs(&p);
+  match_aperture_prepare(p.A, p.B, p.aperture, p.ndim, p.a, p.b, dist,
+                         p.c, p.s, &p.iscircle);
+
+  /* Find all the rows of the first catalog that are within the major
+     axis of the aperture (which also contains elliptical apertures). */
+  prep=gal_kdtree_prepare(coord1, coord1_kdtree, kdtree_root);
+  pairs=gal_kdtree_range_batch(prep, coord2, aperture[0], numthreads,
+                               minmapsize, quietmmap);
+  gal_kdtree_prepared_free(prep);
+
+  /* Keep the neighbours that are within the aperture (the arrays are
+     over-written from their start: 'num' is never larger than 'i'). The
+     range search is inclusive, but similar to the other matching modes
+     (for example 'match_kdtree_worker'), a point is only within the
+     aperture when its distance is smaller than it: points that are
+     exactly on the border are not kept. */
+  qarr=pairs->array;
+  iarr=pairs->next->array;
+  darr=pairs->next->next->array;
+  for(start=0; start<pairs->size; start=end)
+    {
+      /* Find the elliptical distance of the matches of this row. */
+      j=num;
+      bi=qarr[start];
+      for(end=start; end<pairs->size && qarr[end]==bi; ++end)
+        {
+          for(i=0;i<p.ndim;++i)
+            delta[i]=p.b[i][bi] - p.a[i][ iarr[end] ];
+          darr[j]=match_distance(delta, p.iscircle, p.ndim, p.aperture,
+                                 p.c, p.s);
+          if(darr[j]<aperture[0]) { qarr[j]=bi; iarr[j++]=iarr[end]; }
+        }
+
+      /* The elliptical distances may not be in the same order as the
+         (circular) distances of the k-d tree, so sort them. Then, only
+         keep the 'k' nearest when necessary. */
+      if(p.iscircle==0) match_kdtree_neighbours_sort(iarr, darr, num, j);
+      num = ( k && j-num>k ) ? num+k : j;
+    }
+
+  /* Write the output (same columns as 'match_output'). */
+  if(num)
+    {
+      out=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &num, NULL, 0,
+                         minmapsize, quietmmap, "CAT1_ROW", "counter",
+                         "Row index in first catalog (counting from 0).");
+      out->next=gal_data_alloc(NULL, GAL_TYPE_SIZE_T, 1, &num, NULL, 0,
+                               minmapsize, quietmmap, "CAT2_ROW",
+                               "counter", "Row index in second catalog "
+                               "(counting from 0).");
+      out->next->next=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &num,
+                                     NULL, 0, minmapsize, quietmmap,
+                                     "MATCH_DIST", NULL,
+                                     "Distance between the match.");
+      aind=out->array;
+      bind=out->next->array;
+      rval=out->next->next->array;
+      memcpy(aind, iarr, num*sizeof *aind);
+      memcpy(bind, qarr, num*sizeof *bind);
+      memcpy(rval, darr, num*sizeof *rval);
+    }
+
+  /* Clean up and return. */
+  *nummatched=num;
+  gal_list_data_free(pairs);
+  return out;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/********************************************************************/
+/*************      Matching on the celestial sphere     *************/
+/********************************************************************/
+/* The two catalogs are partitioned into declination zones (each with a
+   height equal to the aperture radius) and sorted by their zone, then by
+   RA within each zone. The matches of a point in the second catalog can
+   only be in its own zone and the zones immediately below and above it,
+   and within each zone, the candidates are a contiguous range of RA
+   (found with a binary search). The distances are found from the unit
+   vectors of the points, so the poles and the RA=0/360 border need no
+   special treatment.
+
+   The points of the second catalog (in the same zone/RA order) are
+   processed by the threads in blocks of this many points. Neighboring
+   points in a block therefore need the same part of the first catalog,
+   which greatly improves the usage of the CPU cache. */
+#define MATCH_SKY_BLOCK 4096
+
+/* Zone, RA and row of a point (for sorting). */
+struct match_sky_point
+{
+  int64_t              zone;  /* Declination zone of point.           */
+  double                 ra;  /* Right Ascension (in [0,360)).        */
+  size_t                row;  /* Row in the input.                    */
+};
+
+struct match_sky_params
+{
+  /* First catalog (sorted by zone and RA). */
+  size_t                 na;  /* Number of usable points.             */
+  int64_t            *azone;  /* Zone of each point.                  */
+  double               *ara;  /* RA of each point.                    */
+  double              *axyz;  /* Unit vector of each point.           */
+  size_t              *arow;  /* Row of each point in the input.      */
+
+  /* Second catalog (sorted by zone and RA). */
+  size_t                 nb;  /* Number of usable points.             */
+  struct match_sky_point *b;  /* Zone, RA and row of each point.      */
+  double              *bdec;  /* Declination (in input's row order).  */
+
+  /* Aperture. */
+  double              zoneh;  /* Height of each zone (degrees).       */
+  double             radius;  /* Radius of the aperture (degrees).    */
+  double             chord2;  /* Squared chord length of the radius.  */
+
+  /* Output. */
+  size_t              *ainb;  /* Nearest 1st cat. row to each 2nd.    */
+  float               *rinb;  /* Distance to the nearest row.         */
+};
+
+
+
+
+
+static int
+match_sky_point_cmp(const void *a, const void *b)
+{
+  struct match_sky_point *pa=(struct match_sky_point *)a;
+  struct match_sky_point *pb=(struct match_sky_point *)b;
+
+  if(pa->zone!=pb->zone) return pa->zone<pb->zone ? -1 : 1;
+  if(pa->ra!=pb->ra)     return pa->ra<pb->ra     ? -1 : 1;
+  return pa->row<pb->row ? -1 : (pa->row>pb->row ? 1 : 0);
+}
+
+
+
+
+
+static int64_t
+match_sky_zone(double dec, double zoneh)
+{
+  return (int64_t)floor( (dec+90.0)/zoneh );
+}
+
+
+
+
+
+/* Sort the usable points (with no NaN and a declination within
+   [-90,90]) of a catalog by their zone and RA. */
+static struct match_sky_point *
+match_sky_sort(double *ra, double *dec, size_t size, double zoneh,
+               size_t *num)
+{
+  size_t i, n=0;
+  struct match_sky_point *out;
+
+  /* Allocate the array. */
+  errno=0;
+  out=malloc( (size ? size : 1) * sizeof *out );
+  if(out==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't allocate %zu bytes for "
+          "'out'", __func__, size*sizeof *out);
+
+  /* Fill it with the usable points. */
+  for(i=0;i<size;++i)
+    if( !isnan(ra[i]) && dec[i]>=-90.0 && dec[i]<=90.0 )
+      {
+        out[n].row=i;
+        out[n].zone=match_sky_zone(dec[i], zoneh);
+        out[n].ra=fmod(ra[i], 360.0);
+        if(out[n].ra<0) out[n].ra+=360.0;
+        ++n;
+      }
+
+  /* Sort the points and return. */
+  qsort(out, n, sizeof *out, match_sky_point_cmp);
+  *num=n;
+  return out;
+}
+
+
+
+
+
+static void
+match_sky_unit_vector(double ra, double dec, double *xyz)
+{
+  double r=ra*M_PI/180.0, d=dec*M_PI/180.0;
+  xyz[0]=cos(d)*cos(r);
+  xyz[1]=cos(d)*sin(r);
+  xyz[2]=sin(d);
+}
+
+
+
+
+
+/* Index of the first point in the first catalog that is not before the
+   given zone and RA. */
+static size_t
+match_sky_search(struct match_sky_params *p, int64_t zone, double ra)
+{
+  size_t lo=0, hi=p->na, mid;
+
+  while(lo<hi)
+    {
+      mid=lo+(hi-lo)/2;
+      if( p->azone[mid]<zone || (p->azone[mid]==zone && p->ara[mid]<ra) )
+        lo=mid+1;
+      else
+        hi=mid;
+    }
+  return lo;
+}
+
+
+
+
+
+/* Check the points of the first catalog in the given zone that have an RA
+   in the '[ramin, ramax]' range and keep the nearest. */
+static void
+match_sky_candidates(struct match_sky_params *p, int64_t zone,
+                     double ramin, double ramax, double *bxyz,
+                     double *bestd2, size_t *bestrow)
+{
+  double d2, *a;
+  size_t i, end;
+
+  end=match_sky_search(p, zone, ramax);
+  while(end<p->na && p->azone[end]==zone && p->ara[end]==ramax) ++end;
+  for(i=match_sky_search(p, zone, ramin); i<end; ++i)
+    {
+      a=p->axyz+3*i;
+      d2 = (a[0]-bxyz[0])*(a[0]-bxyz[0])
+         + (a[1]-bxyz[1])*(a[1]-bxyz[1])
+         + (a[2]-bxyz[2])*(a[2]-bxyz[2]);
+      if( d2<=p->chord2
+          && ( d2<*bestd2 || (d2==*bestd2 && p->arow[i]<*bestrow) ) )
+        {
+          *bestd2=d2;
+          *bestrow=p->arow[i];
+        }
+    }
+}
+
+
+
+
+
+static void *
+match_sky_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct match_sky_params *p=(struct match_sky_params *)tprm->params;
+
+  int64_t z, z0, z1;
+  size_t i, j, end, bestrow;
+  double ra, dec, dra, r, bestd2, bxyz[3];
+  double rr=p->radius*M_PI/180.0, maxzone=floor(180.0/p->zoneh);
+
+  /* Go over the blocks of this thread. */
+  for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+    {
+      end=(tprm->indexs[i]+1)*MATCH_SKY_BLOCK;
+      if(end>p->nb) end=p->nb;
+      for(j=tprm->indexs[i]*MATCH_SKY_BLOCK; j<end; ++j)
+        {
+          /* Coordinates of this point. */
+          ra=p->b[j].ra;
+          dec=p->bdec[ p->b[j].row ];
+          match_sky_unit_vector(ra, dec, bxyz);
+
+          /* Half-width of the aperture along RA (in degrees). When the
+             aperture contains a pole, all RAs should be checked. */
+          if( fabs(dec)+p->radius >= 90.0 ) dra=180.0;
+          else
+            dra = atan( sin(rr) / sqrt( cos(dec*M_PI/180.0-rr)
+                                        * cos(dec*M_PI/180.0+rr) ) )
+                  * 180.0/M_PI;
+
+          /* Zones that may contain a match. */
+          z0=match_sky_zone(dec-p->radius, p->zoneh);
+          z1=match_sky_zone(dec+p->radius, p->zoneh);
+          if(z0<0) z0=0;
+          if(z1>maxzone) z1=maxzone;
+
+          /* Check the candidates in each zone (the RA range may pass the
+             RA=0/360 border). */
+          bestd2=INFINITY;
+          bestrow=GAL_BLANK_SIZE_T;
+          for(z=z0; z<=z1; ++z)
+            {
+              if(dra>=180.0)
+                match_sky_candidates(p, z, 0.0, 360.0, bxyz, &bestd2,
+                                     &bestrow);
+              else
+                {
+                  match_sky_candidates(p, z, ra-dra<0 ? 0.0 : ra-dra,
+                                       ra+dra>360.0 ? 360.0 : ra+dra,
+                                       bxyz, &bestd2, &bestrow);
+                  if(ra-dra<0)
+                    match_sky_candidates(p, z, ra-dra+360.0, 360.0,
+                                         bxyz, &bestd2, &bestrow);
+                  if(ra+dra>360.0)
+                    match_sky_candidates(p, z, 0.0, ra+dra-360.0,
+                                         bxyz, &bestd2, &bestrow);
+                }
+            }
+
+          /* Keep the nearest point if it is within the aperture. */
+          if(bestrow!=GAL_BLANK_SIZE_T)
+            {
+              r=2.0*asin( sqrt(bestd2)/2.0 )*180.0/M_PI;
+              if(r<p->radius)
+                {
+                  p->ainb[ p->b[j].row ]=bestrow;
+                  p->rinb[ p->b[j].row ]=r;
+                }
+            }
+        }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+match_sky_sanity_check(gal_data_t *coord1, gal_data_t *coord2,
+                       double *aperture)
+{
+  gal_data_t *tmp;
+
+  /* Both inputs should have two columns (RA and Dec). */
+  if( gal_list_data_number(coord1)!=2 || gal_list_data_number(coord2)!=2 )
+    error(EXIT_FAILURE, 0, "%s: the inputs should each have two columns "
+          "(RA and Dec, in degrees)", __func__);
+
+  /* The columns should be 64-bit floating point and have the same
+     size. */
+  for(tmp=coord1; tmp!=NULL; tmp=tmp->next)
+    if(tmp->type!=GAL_TYPE_FLOAT64 || tmp->size!=coord1->size)
+      error(EXIT_FAILURE, 0, "%s: the columns of the first input should "
+            "have a 64-bit floating point type and the same number of "
+            "rows", __func__);
+  for(tmp=coord2; tmp!=NULL; tmp=tmp->next)
+    if(tmp->type!=GAL_TYPE_FLOAT64 || tmp->size!=coord2->size)
+      error(EXIT_FAILURE, 0, "%s: the columns of the second input should "
+            "have a 64-bit floating point type and the same number of "
+            "rows", __func__);
+
+  /* Only circular apertures are supported. */
+  if( !(aperture[0]>0) || aperture[0]>=180.0 )
+    error(EXIT_FAILURE, 0, "%s: the radius of the aperture (%g) should "
+          "be larger than zero and smaller than 180 degrees", __func__,
+          aperture[0]);
+  if(aperture[1]!=1.0)
+    error(EXIT_FAILURE, 0, "%s: only circular apertures are supported on "
+          "the celestial sphere (the axis ratio is %g)", __func__,
+          aperture[1]);
+}
+
+
+
+
+
+/* Match two catalogs on the celestial sphere: the two inputs should each
+   have two 64-bit floating point columns (RA and Dec in degrees). The
+   aperture should be circular, its radius (and the distances in the
+   output) is in degrees. The output has the same format as
+   'gal_match_kdtree'. */
+gal_data_t *
+gal_match_sky(gal_data_t *coord1, gal_data_t *coord2, double *aperture,
+              size_t numthreads, size_t minmapsize, int quietmmap,
+              size_t *nummatched)
+{
+  size_t i, *bina;
+  gal_data_t *out=NULL;
+  float *rina;
+  struct match_sky_point *a;
+  struct match_sky_params p;
+  double *ra, *dec, chord;
+
+  /* Basic sanity checks. */
+  match_sky_sanity_check(coord1, coord2, aperture);
+
+  /* Set the basic parameters. The zone height is the radius of the
+     aperture, so only three zones need to be checked for every point. */
+  p.radius=aperture[0];
+  p.zoneh=aperture[0];
+  chord=2*sin( p.radius*M_PI/180.0/2 );
+  p.chord2=chord*chord;
+
+  /* Sort the first catalog and keep the sorted values in separate arrays
+     (for a better usage of the CPU cache during the search). */
+  ra=coord1->array;
+  dec=coord1->next->array;
+  a=match_sky_sort(ra, dec, coord1->size, p.zoneh, &p.na);
+  p.azone=gal_pointer_allocate(GAL_TYPE_INT64, p.na, 0, __func__,
+                               "p.azone");
+  p.ara=gal_pointer_allocate(GAL_TYPE_FLOAT64, p.na, 0, __func__,
+                             "p.ara");
+  p.axyz=gal_pointer_allocate(GAL_TYPE_FLOAT64, 3*p.na, 0, __func__,
+                              "p.axyz");
+  p.arow=gal_pointer_allocate(GAL_TYPE_SIZE_T, p.na, 0, __func__,
+                              "p.arow");
+  for(i=0;i<p.na;++i)
+    {
+      p.ara[i]=a[i].ra;
+      p.arow[i]=a[i].row;
+      p.azone[i]=a[i].zone;
+      match_sky_unit_vector(a[i].ra, dec[a[i].row], p.axyz+3*i);
+    }
+  free(a);
+
+  /* Sort the second catalog (for the blocks of the threads to be
+     close-by on the sky). */
+  p.bdec=coord2->next->array;
+  p.b=match_sky_sort(coord2->array, p.bdec, coord2->size, p.zoneh,
+                     &p.nb);
+
+  /* Find the nearest point of the first catalog to each point of the
+     second on multiple threads. */
+  match_nearest_alloc(coord2->size, &p.ainb, &p.rinb);
+  if(p.na && p.nb)
+    gal_threads_spin_off(match_sky_worker, &p,
+                         p.nb/MATCH_SKY_BLOCK + (p.nb%MATCH_SKY_BLOCK?1:0),
+                         numthreads, minmapsize, quietmmap);
+
+  /* Find the best match for each item and write the output. */
+  match_rearrange(coord1->size, coord2->size, p.ainb, p.rinb, &bina,
+                  &rina);
+  out=match_output(coord1, coord2, NULL, NULL, bina, rina, minmapsize,
+                   quietmmap);
+  *nummatched = out ?  out->next->next->size : 0;
+
+  /* Clean up and return. */
+  free(p.b);
+  free(bina);
+  free(rina);
+  free(p.ara);
+  free(p.ainb);
+  free(p.rinb);
+  free(p.arow);
+  free(p.axyz);
+  free(p.azone);
   return out;
 }
@@ -2860,6 +2860,11 @@ gal_options_read_low_level_checks(struct gal_options_common_params *cp)
   if(cp->numthreads==0)
     cp->numthreads=gal_threads_number();
 
+  /* In the NUMA-aware mode, the threads are pinned to CPUs and large
+     arrays are first-touched on the same threads that use them later. */
+  if(cp->numa && cp->numthreads>1)
+    gal_threads_numa_set(cp->numthreads);
+
   /* If 'minmapsize==0' and quiet isn't given, print a warning. */
   if(cp->minmapsize==0 && cp->quiet==0)
     {
@@ -31,6 +31,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <sys/mman.h>
 
 #include <gnuastro/type.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
 
 #include <gnuastro-internal/checkset.h>
@@ -245,11 +246,19 @@ gal_pointer_allocate_ram_or_mmap(uint8_t type, size_t size, int clear,
                                   quietmmap);
   else
     {
-      /* Allocate the necessary space in the RAM. */
+      /* Allocate the necessary space in the RAM. In the NUMA-aware mode,
+         large arrays are first-touched (and thus cleared) on the threads
+         that will later use them (see 'gal_threads_first_touch'). */
       errno=0;
-      out = ( clear
-              ? calloc( size,  gal_type_sizeof(type) )
-              : malloc( size * gal_type_sizeof(type) ) );
+      if( gal_threads_numa() && bytesize>=GAL_THREADS_NUMA_MIN_BYTES )
+        {
+          out=malloc(bytesize);
+          if(out) gal_threads_first_touch(out, bytesize);
+        }
+      else
+        out = ( clear
+                ? calloc( size,  gal_type_sizeof(type) )
+                : malloc( size * gal_type_sizeof(type) ) );
 
       /* If the array is NULL (there was no RAM left: on
          systems other than Linux, 'malloc' will actually
@@ -23,12 +23,16 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <config.h>
 
 #include <math.h>
+#include <error.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <fitsio.h>
 
+#include <gnuastro/type.h>
 #include <gnuastro/qsort.h>
+#include <gnuastro/pointer.h>
 
 
 /*****************************************************************/
@@ -414,3 +418,542 @@ gal_qsort_index_multi_i(const void *a, const void *b)
   int out=(ta > tb) - (ta < tb);
   return out ? out : COMPARE_FLOAT_POSTPROCESS;
 }
+
+
+
+
+
+/*****************************************************************/
+/***************    Reentrant sorting of indexs    ***************/
+/*****************************************************************/
+/* The 'gal_qsort_index_single_*' functions above need the array of values
+   in a global pointer, so two threads can't sort indexs into different
+   arrays at the same time. The function here takes the array as an
+   argument. It doesn't use any comparison function either: the values of
+   the indexs are converted to 64-bit unsigned integer keys that have the
+   same order (the order of floating point numbers is preserved by
+   flipping their bits) and the keys are sorted with a radix sort (one
+   byte in every pass).
+
+   The radix sort is stable (equal values keep their original order) and
+   its passes over bytes that are identical in all the keys are skipped
+   (for example the upper bytes of the keys of 'float32' values). Small
+   arrays are sorted with insertion sort (which is also stable). */
+#define QSORT_INDEX_RADIX_MIN 64
+#define QSORT_INDEX_SIGN      ( (uint64_t)1 << 63 )
+
+#define QSORT_INDEX_KEYS_INT(IT, KEY) {                                 \
+    IT x, *v=values;                                                    \
+    for(i=0;i<size;++i)                                                 \
+      { x=v[ indexs[i] ]; keys[i] = decreasing ? ~(KEY) : (KEY); }      \
+  }
+
+#define QSORT_INDEX_KEYS_FLT(IT, UT, SIGN) {                            \
+    UT u;                                                               \
+    IT x, *v=values;                                                    \
+    for(i=0;i<size;++i)                                                 \
+      {                                                                 \
+        x=v[ indexs[i] ];                                               \
+        if( isnan(x) ) keys[i]=UINT64_MAX;                              \
+        else                                                            \
+          {                                                             \
+            if(x==0) x=0;                  /* Same key for -0 and 0. */ \
+            memcpy(&u, &x, sizeof u);                                   \
+            u = (u & SIGN) ? ~u : (u | SIGN);                           \
+            keys[i] = decreasing ? ~(uint64_t)u : (uint64_t)u;          \
+          }                                                             \
+      }                                                                 \
+  }
+
+static void
+qsort_index_keys(size_t *indexs, size_t size, void *values, uint8_t type,
+                 int decreasing, uint64_t *keys)
+{
+  size_t i;
+  uint32_t s32=(uint32_t)1<<31;
+
+  switch(type)
+    {
+    case GAL_TYPE_UINT8:
+      QSORT_INDEX_KEYS_INT(uint8_t,  (uint64_t)x);                  break;
+    case GAL_TYPE_INT8:
+      QSORT_INDEX_KEYS_INT(int8_t,   (uint64_t)x ^ QSORT_INDEX_SIGN); break;
+    case GAL_TYPE_UINT16:
+      QSORT_INDEX_KEYS_INT(uint16_t, (uint64_t)x);                  break;
+    case GAL_TYPE_INT16:
+      QSORT_INDEX_KEYS_INT(int16_t,  (uint64_t)x ^ QSORT_INDEX_SIGN); break;
+    case GAL_TYPE_UINT32:
+      QSORT_INDEX_KEYS_INT(uint32_t, (uint64_t)x);                  break;
+    case GAL_TYPE_INT32:
+      QSORT_INDEX_KEYS_INT(int32_t,  (uint64_t)x ^ QSORT_INDEX_SIGN); break;
+    case GAL_TYPE_UINT64:
+      QSORT_INDEX_KEYS_INT(uint64_t, x);                            break;
+    case GAL_TYPE_INT64:
+      QSORT_INDEX_KEYS_INT(int64_t,  (uint64_t)x ^ QSORT_INDEX_SIGN); break;
+    case GAL_TYPE_FLOAT32:
+      QSORT_INDEX_KEYS_FLT(float,  uint32_t, s32);                  break;
+    case GAL_TYPE_FLOAT64:
+      QSORT_INDEX_KEYS_FLT(double, uint64_t, QSORT_INDEX_SIGN);     break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, type);
+    }
+}
+
+
+
+
+
+/* Sort the keys (and their indexs) with insertion sort. */
+static void
+qsort_index_insertion(size_t *indexs, uint64_t *keys, size_t size)
+{
+  size_t i, j, ind;
+  uint64_t key;
+
+  for(i=1;i<size;++i)
+    {
+      key=keys[i];
+      ind=indexs[i];
+      for(j=i; j>0 && keys[j-1]>key; --j)
+        {
+          keys[j]=keys[j-1];
+          indexs[j]=indexs[j-1];
+        }
+      keys[j]=key;
+      indexs[j]=ind;
+    }
+}
+
+
+
+
+
+/* Sort the keys (and their indexs) with a least significant digit radix
+   sort. The histograms of all the bytes are found in one pass over the
+   keys. 'tind' and 'tkey' are temporary arrays with the same size. */
+static void
+qsort_index_radix(size_t *indexs, uint64_t *keys, size_t size,
+                  size_t *tind, uint64_t *tkey)
+{
+  uint64_t *k, *kt;
+  size_t b, c, i, sum, *in, *it;
+  size_t hist[sizeof *keys][256]={{0}};
+
+  /* Histogram of every byte. */
+  for(i=0;i<size;++i)
+    for(b=0;b<sizeof *keys;++b)
+      ++hist[b][ (keys[i] >> (8*b)) & 0xff ];
+
+  /* Go over the bytes, from the least significant. */
+  k=keys; in=indexs; kt=tkey; it=tind;
+  for(b=0;b<sizeof *keys;++b)
+    {
+      /* If this byte is the same in all keys, this pass is not needed. */
+      if( hist[b][ (k[0] >> (8*b)) & 0xff ]==size ) continue;
+
+      /* Starting position of each bucket. */
+      sum=0;
+      for(i=0;i<256;++i) { c=hist[b][i]; hist[b][i]=sum; sum+=c; }
+
+      /* Put the keys (and their indexs) in their buckets. */
+      for(i=0;i<size;++i)
+        {
+          c=hist[b][ (k[i] >> (8*b)) & 0xff ]++;
+          kt[c]=k[i];
+          it[c]=in[i];
+        }
+
+      /* Swap the arrays for the next pass. */
+      k=kt;  kt = k==keys   ? tkey : keys;
+      in=it; it = in==indexs ? tind : indexs;
+    }
+
+  /* If the final result is in the temporary arrays, copy it back. */
+  if(in!=indexs) memcpy(indexs, in, size*sizeof *indexs);
+}
+
+
+
+
+
+/* Sort the indexs based on the value they point to in 'values' (which has
+   a type of 'type'). The sort is stable and NaN values are placed at the
+   end (in both increasing and decreasing order), similar to the
+   'gal_qsort_index_single_*' functions. */
+void
+gal_qsort_index_r(size_t *indexs, size_t size, void *values, uint8_t type,
+                  int decreasing)
+{
+  size_t *tind;
+  uint64_t *keys, *tkey;
+
+  /* Nothing to sort. */
+  if(size<2) return;
+
+  /* Build the keys of the indexs. */
+  keys=gal_pointer_allocate(GAL_TYPE_UINT64, size, 0, __func__, "keys");
+  qsort_index_keys(indexs, size, values, type, decreasing, keys);
+
+  /* Sort them. */
+  if(size<QSORT_INDEX_RADIX_MIN)
+    qsort_index_insertion(indexs, keys, size);
+  else
+    {
+      tkey=gal_pointer_allocate(GAL_TYPE_UINT64, size, 0, __func__, "tkey");
+      tind=gal_pointer_allocate(GAL_TYPE_SIZE_T, size, 0, __func__, "tind");
+      qsort_index_radix(indexs, keys, size, tind, tkey);
+      free(tkey);
+      free(tind);
+    }
+
+  /* Clean up. */
+  free(keys);
+}
+
+
+
+
+
+/*****************************************************************/
+/**********     Sorting without a comparison function    *********/
+/*****************************************************************/
+/* When many small arrays need to be sorted (for example the values of
+   each pixel when stacking a few dozen images), 'qsort' is slow because it
+   has to call the comparison function for every comparison. So the
+   functions here are instantiated for every type:
+
+     - Arrays with at most 16 elements are sorted with a sorting network
+       (Batcher's odd-even merge sort). The sequence of compare-exchanges
+       doesn't depend on the values, so they are written explicitly below
+       and the compiler can do each one without any branch.
+
+     - Arrays with at most 'QSORT_SMALL_MAX' elements are sorted with
+       insertion sort.
+
+     - When only one element is needed (for example the median), the
+       larger arrays are partitioned with "introselect": a quick-select
+       (with a median-of-three pivot) that falls back to 'qsort' when the
+       partitions are too unbalanced.
+
+   Similar to the comparison functions above, NaN values are considered to
+   be larger than any number: they are first moved to the end of the array
+   and the rest are sorted (so the comparisons don't need to check for
+   NaN). */
+#define QSORT_SMALL_MAX 24
+
+#define QSORT_CE(i, j) {                                                \
+    x=a[i]; y=a[j]; a[i] = y<x ? y : x; a[j] = y<x ? x : y; }
+
+#define QSORT_NETWORK_2 QSORT_CE(0,1)
+#define QSORT_NETWORK_3 QSORT_CE(0,1) QSORT_CE(0,2) QSORT_CE(1,2)
+#define QSORT_NETWORK_4 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(0,2)       \
+  QSORT_CE(1,3) QSORT_CE(1,2)
+#define QSORT_NETWORK_5 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(0,2)       \
+  QSORT_CE(1,3) QSORT_CE(1,2) QSORT_CE(0,4) QSORT_CE(2,4)               \
+  QSORT_CE(1,2) QSORT_CE(3,4)
+#define QSORT_NETWORK_6 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)       \
+  QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(1,2) QSORT_CE(0,4)               \
+  QSORT_CE(1,5) QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(1,2)               \
+  QSORT_CE(3,4)
+#define QSORT_NETWORK_7 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)       \
+  QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6) QSORT_CE(1,2)               \
+  QSORT_CE(5,6) QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6)               \
+  QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(1,2) QSORT_CE(3,4)               \
+  QSORT_CE(5,6)
+#define QSORT_NETWORK_8 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)       \
+  QSORT_CE(6,7) QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6)               \
+  QSORT_CE(5,7) QSORT_CE(1,2) QSORT_CE(5,6) QSORT_CE(0,4)               \
+  QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7) QSORT_CE(2,4)               \
+  QSORT_CE(3,5) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)
+#define QSORT_NETWORK_9 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)       \
+  QSORT_CE(6,7) QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6)               \
+  QSORT_CE(5,7) QSORT_CE(1,2) QSORT_CE(5,6) QSORT_CE(0,4)               \
+  QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7) QSORT_CE(2,4)               \
+  QSORT_CE(3,5) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)               \
+  QSORT_CE(0,8) QSORT_CE(4,8) QSORT_CE(2,4) QSORT_CE(3,5)               \
+  QSORT_CE(6,8) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)               \
+  QSORT_CE(7,8)
+#define QSORT_NETWORK_10 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(0,2) QSORT_CE(1,3)               \
+  QSORT_CE(4,6) QSORT_CE(5,7) QSORT_CE(1,2) QSORT_CE(5,6)               \
+  QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7)               \
+  QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(1,2) QSORT_CE(3,4)               \
+  QSORT_CE(5,6) QSORT_CE(0,8) QSORT_CE(1,9) QSORT_CE(4,8)               \
+  QSORT_CE(5,9) QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(6,8)               \
+  QSORT_CE(7,9) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)               \
+  QSORT_CE(7,8)
+#define QSORT_NETWORK_11 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(0,2) QSORT_CE(1,3)               \
+  QSORT_CE(4,6) QSORT_CE(5,7) QSORT_CE(8,10) QSORT_CE(1,2)              \
+  QSORT_CE(5,6) QSORT_CE(9,10) QSORT_CE(0,4) QSORT_CE(1,5)              \
+  QSORT_CE(2,6) QSORT_CE(3,7) QSORT_CE(2,4) QSORT_CE(3,5)               \
+  QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6) QSORT_CE(9,10)              \
+  QSORT_CE(0,8) QSORT_CE(1,9) QSORT_CE(2,10) QSORT_CE(4,8)              \
+  QSORT_CE(5,9) QSORT_CE(6,10) QSORT_CE(2,4) QSORT_CE(3,5)              \
+  QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(1,2) QSORT_CE(3,4)               \
+  QSORT_CE(5,6) QSORT_CE(7,8) QSORT_CE(9,10)
+#define QSORT_NETWORK_12 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(10,11) QSORT_CE(0,2)             \
+  QSORT_CE(1,3) QSORT_CE(4,6) QSORT_CE(5,7) QSORT_CE(8,10)              \
+  QSORT_CE(9,11) QSORT_CE(1,2) QSORT_CE(5,6) QSORT_CE(9,10)             \
+  QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7)               \
+  QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(1,2) QSORT_CE(3,4)               \
+  QSORT_CE(5,6) QSORT_CE(9,10) QSORT_CE(0,8) QSORT_CE(1,9)              \
+  QSORT_CE(2,10) QSORT_CE(3,11) QSORT_CE(4,8) QSORT_CE(5,9)             \
+  QSORT_CE(6,10) QSORT_CE(7,11) QSORT_CE(2,4) QSORT_CE(3,5)             \
+  QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(1,2) QSORT_CE(3,4)               \
+  QSORT_CE(5,6) QSORT_CE(7,8) QSORT_CE(9,10)
+#define QSORT_NETWORK_13 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(10,11) QSORT_CE(0,2)             \
+  QSORT_CE(1,3) QSORT_CE(4,6) QSORT_CE(5,7) QSORT_CE(8,10)              \
+  QSORT_CE(9,11) QSORT_CE(1,2) QSORT_CE(5,6) QSORT_CE(9,10)             \
+  QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7)               \
+  QSORT_CE(8,12) QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(10,12)            \
+  QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6) QSORT_CE(9,10)              \
+  QSORT_CE(11,12) QSORT_CE(0,8) QSORT_CE(1,9) QSORT_CE(2,10)            \
+  QSORT_CE(3,11) QSORT_CE(4,12) QSORT_CE(4,8) QSORT_CE(5,9)             \
+  QSORT_CE(6,10) QSORT_CE(7,11) QSORT_CE(2,4) QSORT_CE(3,5)             \
+  QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(10,12) QSORT_CE(1,2)             \
+  QSORT_CE(3,4) QSORT_CE(5,6) QSORT_CE(7,8) QSORT_CE(9,10)              \
+  QSORT_CE(11,12)
+#define QSORT_NETWORK_14 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(10,11) QSORT_CE(12,13)           \
+  QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6) QSORT_CE(5,7)               \
+  QSORT_CE(8,10) QSORT_CE(9,11) QSORT_CE(1,2) QSORT_CE(5,6)             \
+  QSORT_CE(9,10) QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6)              \
+  QSORT_CE(3,7) QSORT_CE(8,12) QSORT_CE(9,13) QSORT_CE(2,4)             \
+  QSORT_CE(3,5) QSORT_CE(10,12) QSORT_CE(11,13) QSORT_CE(1,2)           \
+  QSORT_CE(3,4) QSORT_CE(5,6) QSORT_CE(9,10) QSORT_CE(11,12)            \
+  QSORT_CE(0,8) QSORT_CE(1,9) QSORT_CE(2,10) QSORT_CE(3,11)             \
+  QSORT_CE(4,12) QSORT_CE(5,13) QSORT_CE(4,8) QSORT_CE(5,9)             \
+  QSORT_CE(6,10) QSORT_CE(7,11) QSORT_CE(2,4) QSORT_CE(3,5)             \
+  QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(10,12) QSORT_CE(11,13)           \
+  QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6) QSORT_CE(7,8)               \
+  QSORT_CE(9,10) QSORT_CE(11,12)
+#define QSORT_NETWORK_15 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(10,11) QSORT_CE(12,13)           \
+  QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6) QSORT_CE(5,7)               \
+  QSORT_CE(8,10) QSORT_CE(9,11) QSORT_CE(12,14) QSORT_CE(1,2)           \
+  QSORT_CE(5,6) QSORT_CE(9,10) QSORT_CE(13,14) QSORT_CE(0,4)            \
+  QSORT_CE(1,5) QSORT_CE(2,6) QSORT_CE(3,7) QSORT_CE(8,12)              \
+  QSORT_CE(9,13) QSORT_CE(10,14) QSORT_CE(2,4) QSORT_CE(3,5)            \
+  QSORT_CE(10,12) QSORT_CE(11,13) QSORT_CE(1,2) QSORT_CE(3,4)           \
+  QSORT_CE(5,6) QSORT_CE(9,10) QSORT_CE(11,12) QSORT_CE(13,14)          \
+  QSORT_CE(0,8) QSORT_CE(1,9) QSORT_CE(2,10) QSORT_CE(3,11)             \
+  QSORT_CE(4,12) QSORT_CE(5,13) QSORT_CE(6,14) QSORT_CE(4,8)            \
+  QSORT_CE(5,9) QSORT_CE(6,10) QSORT_CE(7,11) QSORT_CE(2,4)             \
+  QSORT_CE(3,5) QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(10,12)             \
+  QSORT_CE(11,13) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)             \
+  QSORT_CE(7,8) QSORT_CE(9,10) QSORT_CE(11,12) QSORT_CE(13,14)
+#define QSORT_NETWORK_16 QSORT_CE(0,1) QSORT_CE(2,3) QSORT_CE(4,5)      \
+  QSORT_CE(6,7) QSORT_CE(8,9) QSORT_CE(10,11) QSORT_CE(12,13)           \
+  QSORT_CE(14,15) QSORT_CE(0,2) QSORT_CE(1,3) QSORT_CE(4,6)             \
+  QSORT_CE(5,7) QSORT_CE(8,10) QSORT_CE(9,11) QSORT_CE(12,14)           \
+  QSORT_CE(13,15) QSORT_CE(1,2) QSORT_CE(5,6) QSORT_CE(9,10)            \
+  QSORT_CE(13,14) QSORT_CE(0,4) QSORT_CE(1,5) QSORT_CE(2,6)             \
+  QSORT_CE(3,7) QSORT_CE(8,12) QSORT_CE(9,13) QSORT_CE(10,14)           \
+  QSORT_CE(11,15) QSORT_CE(2,4) QSORT_CE(3,5) QSORT_CE(10,12)           \
+  QSORT_CE(11,13) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)             \
+  QSORT_CE(9,10) QSORT_CE(11,12) QSORT_CE(13,14) QSORT_CE(0,8)          \
+  QSORT_CE(1,9) QSORT_CE(2,10) QSORT_CE(3,11) QSORT_CE(4,12)            \
+  QSORT_CE(5,13) QSORT_CE(6,14) QSORT_CE(7,15) QSORT_CE(4,8)            \
+  QSORT_CE(5,9) QSORT_CE(6,10) QSORT_CE(7,11) QSORT_CE(2,4)             \
+  QSORT_CE(3,5) QSORT_CE(6,8) QSORT_CE(7,9) QSORT_CE(10,12)             \
+  QSORT_CE(11,13) QSORT_CE(1,2) QSORT_CE(3,4) QSORT_CE(5,6)             \
+  QSORT_CE(7,8) QSORT_CE(9,10) QSORT_CE(11,12) QSORT_CE(13,14)
+
+#define QSORT_NO_FUNC(NAME, TYPE) \
+  /* Move the NaN elements to the end of the array and return the     */ \
+  /* number of non-NaN elements (for integers, 'a[i]!=a[i]' is always */ \
+  /* false, so the compiler will remove the check). */                  \
+  static size_t                                                         \
+  qsort_no_nan_##NAME(TYPE *a, size_t n)                                \
+  {                                                                     \
+    TYPE t;                                                             \
+    size_t i=0, m=n;                                                    \
+    while(i<m)                                                          \
+      if(a[i]!=a[i]) { t=a[i]; a[i]=a[--m]; a[m]=t; }                   \
+      else ++i;                                                         \
+    return m;                                                           \
+  }                                                                     \
+                                                                        \
+  /* Sort a small array (without any NaN). */                           \
+  static void                                                           \
+  qsort_small_##NAME(TYPE *a, size_t n)                                 \
+  {                                                                     \
+    TYPE x, y;                                                          \
+    size_t i, j;                                                        \
+    switch(n)                                                           \
+      {                                                                 \
+      case 0: case 1:                     return;                       \
+      case 2:  QSORT_NETWORK_2;           return;                       \
+      case 3:  QSORT_NETWORK_3;           return;                       \
+      case 4:  QSORT_NETWORK_4;           return;                       \
+      case 5:  QSORT_NETWORK_5;           return;                       \
+      case 6:  QSORT_NETWORK_6;           return;                       \
+      case 7:  QSORT_NETWORK_7;           return;                       \
+      case 8:  QSORT_NETWORK_8;           return;                       \
+      case 9:  QSORT_NETWORK_9;           return;                       \
+      case 10: QSORT_NETWORK_10;          return;                       \
+      case 11: QSORT_NETWORK_11;          return;                       \
+      case 12: QSORT_NETWORK_12;          return;                       \
+      case 13: QSORT_NETWORK_13;          return;                       \
+      case 14: QSORT_NETWORK_14;          return;                       \
+      case 15: QSORT_NETWORK_15;          return;                       \
+      case 16: QSORT_NETWORK_16;          return;                       \
+      }                                                                 \
+    for(i=1;i<n;++i)                                                    \
+      {                                                                 \
+        x=a[i];                                                         \
+        for(j=i; j>0 && x<a[j-1]; --j) a[j]=a[j-1];                     \
+        a[j]=x;                                                         \
+      }                                                                 \
+    (void)y;                                                            \
+  }                                                                     \
+                                                                        \
+  /* Put the k-th element of an array (without any NaN) in its place. */ \
+  static void                                                           \
+  qsort_select_##NAME(TYPE *a, size_t n, size_t k,                     \
+                      int (*qsort_f)(const void *, const void *))       \
+  {                                                                     \
+    TYPE t, pivot;                                                      \
+    size_t s, depth=0;                                                  \
+    int64_t lo=0, hi=n-1, i, j, m;                                      \
+                                                                        \
+    /* Maximum number of partitions before falling back to 'qsort'. */  \
+    for(s=n; s>0; s/=2) depth+=2;                                       \
+                                                                        \
+    /* Partition the array until the k-th element is in place. */       \
+    while(1)                                                            \
+      {                                                                 \
+        /* Small (or too unbalanced) partitions are sorted. */          \
+        if(hi-lo+1 <= QSORT_SMALL_MAX)                                  \
+          { qsort_small_##NAME(a+lo, hi-lo+1); return; }                \
+        if(depth-- == 0)                                                \
+          { qsort(a+lo, hi-lo+1, sizeof *a, qsort_f); return; }         \
+                                                                        \
+        /* The pivot is the median of the first, middle and last    */  \
+        /* elements; after sorting them, 'a[lo]' and 'a[hi]' will    */ \
+        /* stop the two scans of the partitioning below. */             \
+        m=lo+(hi-lo)/2;                                                 \
+        if(a[m]<a[lo]) { t=a[m]; a[m]=a[lo]; a[lo]=t; }                 \
+        if(a[hi]<a[m])                                                  \
+          {                                                             \
+            t=a[hi]; a[hi]=a[m]; a[m]=t;                                \
+            if(a[m]<a[lo]) { t=a[m]; a[m]=a[lo]; a[lo]=t; }             \
+          }                                                             \
+        pivot=a[m];                                                     \
+                                                                        \
+        /* Hoare's partitioning. */                                     \
+        i=lo;                                                           \
+        j=hi;                                                           \
+        while(i<=j)                                                     \
+          {                                                             \
+            while(a[i]<pivot) ++i;                                      \
+            while(pivot<a[j]) --j;                                      \
+            if(i<=j) { t=a[i]; a[i]=a[j]; a[j]=t; ++i; --j; }           \
+          }                                                             \
+                                                                        \
+        /* Elements between 'j' and 'i' are equal to the pivot. */      \
+        if     ( (int64_t)k <= j ) hi=j;                                \
+        else if( (int64_t)k >= i ) lo=i;                                \
+        else return;                                                    \
+      }                                                                 \
+  }
+
+QSORT_NO_FUNC(uint8,   uint8_t)
+QSORT_NO_FUNC(int8,    int8_t)
+QSORT_NO_FUNC(uint16,  uint16_t)
+QSORT_NO_FUNC(int16,   int16_t)
+QSORT_NO_FUNC(uint32,  uint32_t)
+QSORT_NO_FUNC(int32,   int32_t)
+QSORT_NO_FUNC(uint64,  uint64_t)
+QSORT_NO_FUNC(int64,   int64_t)
+QSORT_NO_FUNC(float32, float)
+QSORT_NO_FUNC(float64, double)
+
+
+
+
+
+/* Sort the array in increasing order (NaN elements will be at the
+   end). */
+#define QSORT_INCREASING(NAME, TYPE, QSORT_F) {                         \
+    if(size<=QSORT_SMALL_MAX)                                           \
+      qsort_small_##NAME(array, qsort_no_nan_##NAME(array, size));      \
+    else                                                                \
+      qsort(array, size, sizeof(TYPE), QSORT_F);                        \
+  }
+void
+gal_qsort_increasing(void *array, size_t size, uint8_t type)
+{
+  switch(type)
+    {
+    case GAL_TYPE_UINT8:
+      QSORT_INCREASING(uint8,   uint8_t,  gal_qsort_uint8_i);   break;
+    case GAL_TYPE_INT8:
+      QSORT_INCREASING(int8,    int8_t,   gal_qsort_int8_i);    break;
+    case GAL_TYPE_UINT16:
+      QSORT_INCREASING(uint16,  uint16_t, gal_qsort_uint16_i);  break;
+    case GAL_TYPE_INT16:
+      QSORT_INCREASING(int16,   int16_t,  gal_qsort_int16_i);   break;
+    case GAL_TYPE_UINT32:
+      QSORT_INCREASING(uint32,  uint32_t, gal_qsort_uint32_i);  break;
+    case GAL_TYPE_INT32:
+      QSORT_INCREASING(int32,   int32_t,  gal_qsort_int32_i);   break;
+    case GAL_TYPE_UINT64:
+      QSORT_INCREASING(uint64,  uint64_t, gal_qsort_uint64_i);  break;
+    case GAL_TYPE_INT64:
+      QSORT_INCREASING(int64,   int64_t,  gal_qsort_int64_i);   break;
+    case GAL_TYPE_FLOAT32:
+      QSORT_INCREASING(float32, float,    gal_qsort_float32_i); break;
+    case GAL_TYPE_FLOAT64:
+      QSORT_INCREASING(float64, double,   gal_qsort_float64_i); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, type);
+    }
+}
+
+
+
+
+
+/* Partially sort the array so the element at index 'k' is the one that
+   would be there if the array was sorted in increasing order (with the
+   NaN elements at the end). All the elements before it will be smaller
+   or equal and all the elements after it will be larger or equal (but
+   they are not necessarily sorted). */
+#define QSORT_SELECT(NAME, QSORT_F) {                                   \
+    n=qsort_no_nan_##NAME(array, size);                                 \
+    if(k<n) qsort_select_##NAME(array, n, k, QSORT_F);                  \
+  }
+void
+gal_qsort_select(void *array, size_t size, size_t k, uint8_t type)
+{
+  size_t n;
+
+  /* Small sanity check. */
+  if(k>=size)
+    error(EXIT_FAILURE, 0, "%s: the requested index (%zu) must be smaller "
+          "than the number of elements (%zu)", __func__, k, size);
+
+  /* Do the selection. */
+  switch(type)
+    {
+    case GAL_TYPE_UINT8:   QSORT_SELECT(uint8,   gal_qsort_uint8_i);   break;
+    case GAL_TYPE_INT8:    QSORT_SELECT(int8,    gal_qsort_int8_i);    break;
+    case GAL_TYPE_UINT16:  QSORT_SELECT(uint16,  gal_qsort_uint16_i);  break;
+    case GAL_TYPE_INT16:   QSORT_SELECT(int16,   gal_qsort_int16_i);   break;
+    case GAL_TYPE_UINT32:  QSORT_SELECT(uint32,  gal_qsort_uint32_i);  break;
+    case GAL_TYPE_INT32:   QSORT_SELECT(int32,   gal_qsort_int32_i);   break;
+    case GAL_TYPE_UINT64:  QSORT_SELECT(uint64,  gal_qsort_uint64_i);  break;
+    case GAL_TYPE_INT64:   QSORT_SELECT(int64,   gal_qsort_int64_i);   break;
+    case GAL_TYPE_FLOAT32: QSORT_SELECT(float32, gal_qsort_float32_i); break;
+    case GAL_TYPE_FLOAT64: QSORT_SELECT(float64, gal_qsort_float64_i); break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+            __func__, type);
+    }
+}
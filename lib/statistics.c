@@ -768,6 +768,200 @@ gal_statistics_quantile_function(gal_data_t *input, gal_data_t *value,
 
 
 
+/* Return the quantile function of the given value (as float64), without
+   sorting the input. The elements of the input are only parsed once: in
+   that single pass, the number of elements that are smaller or equal to
+   the value is counted, while the largest element that is smaller or
+   equal to it and the smallest element that is larger than it are
+   found. These are the two elements that 'STATS_QFUNC_IND' compares with
+   the value (as neighbors in the sorted array), so the result is the
+   same. The four elements of 'range' are (in the input's type): the
+   value, the largest element smaller or equal to it, the smallest
+   element larger than it and the minimum. */
+#define STATS_QFUNC_NOSORT(IT) {                                        \
+    IT *r=range->array;                                                 \
+    if( r[0] < r[3] ) d[0] = -INFINITY;                                 \
+    else if( c==n )   d[0] =  INFINITY;                                 \
+    else              d[0] = ( (double)( r[0]-r[1] < r[2]-r[0]          \
+                                         ? c-1 : c )                    \
+                               / ((double)(n - 1)) );                   \
+  }
+gal_data_t *
+gal_statistics_quantile_function_nosort(gal_data_t *input,
+                                        gal_data_t *value)
+{
+  double *d;
+  gal_data_t *v, *range, *out;
+  size_t c=0, n=0, dsize=1, rsize=4;
+  uint8_t type=gal_tile_block(input)->type;
+  size_t width=gal_type_sizeof(type);
+
+  /* Sanity checks. */
+  if(value->size>1)
+    error(EXIT_FAILURE, 0, "%s: the 'value' argument must only have "
+          "one element", __func__);
+
+  /* Allocate the output and the range. */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &dsize, NULL, 1, -1, 1,
+                     NULL, NULL, NULL);
+  range=gal_data_alloc(NULL, type, 1, &rsize, NULL, 0, -1, 1, NULL,
+                       NULL, NULL);
+
+  /* Put the value in the first element of 'range' (with the same type as
+     the input), then initialize the other three elements. For the
+     floating point types, infinity is used so infinite elements are also
+     accounted for. */
+  v = value->type==type ? value : gal_data_copy_to_new_type(value, type);
+  memcpy(range->array, v->array, width);
+  gal_type_min(type, gal_pointer_increment(range->array, 1, type));
+  gal_type_max(type, gal_pointer_increment(range->array, 2, type));
+  gal_type_max(type, gal_pointer_increment(range->array, 3, type));
+  switch(type)
+    {
+    case GAL_TYPE_FLOAT32:
+      ((float *)(range->array))[1]=-INFINITY;
+      ((float *)(range->array))[2]=((float *)(range->array))[3]=INFINITY;
+      break;
+    case GAL_TYPE_FLOAT64:
+      ((double *)(range->array))[1]=-INFINITY;
+      ((double *)(range->array))[2]=((double *)(range->array))[3]=INFINITY;
+      break;
+    }
+
+  /* Parse the input (blank elements are ignored). */
+  if(input->size && gal_blank_is(range->array, type)==0)
+    GAL_TILE_PARSE_OPERATE(input, range, 0, 1,
+                           {
+                             ++n;
+                             if(*i<=o[0]) { ++c; if(*i>o[1]) o[1]=*i; }
+                             else if(*i<o[2]) o[2]=*i;
+                             if(*i<o[3]) o[3]=*i;
+                           });
+
+  /* Only continue processing if there are non-blank values. */
+  if(n)
+    {
+      d=out->array;
+      switch(type)
+        {
+        case GAL_TYPE_UINT8:     STATS_QFUNC_NOSORT( uint8_t  );  break;
+        case GAL_TYPE_INT8:      STATS_QFUNC_NOSORT( int8_t   );  break;
+        case GAL_TYPE_UINT16:    STATS_QFUNC_NOSORT( uint16_t );  break;
+        case GAL_TYPE_INT16:     STATS_QFUNC_NOSORT( int16_t  );  break;
+        case GAL_TYPE_UINT32:    STATS_QFUNC_NOSORT( uint32_t );  break;
+        case GAL_TYPE_INT32:     STATS_QFUNC_NOSORT( int32_t  );  break;
+        case GAL_TYPE_UINT64:    STATS_QFUNC_NOSORT( uint64_t );  break;
+        case GAL_TYPE_INT64:     STATS_QFUNC_NOSORT( int64_t  );  break;
+        case GAL_TYPE_FLOAT32:   STATS_QFUNC_NOSORT( float    );  break;
+        case GAL_TYPE_FLOAT64:   STATS_QFUNC_NOSORT( double   );  break;
+        default:
+          error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
+                __func__, type);
+        }
+    }
+  else
+    gal_blank_write(out->array, out->type);
+
+  /* Clean up and return. */
+  if(v!=value) gal_data_free(v);
+  gal_data_free(range);
+  return out;
+}
+
+
+
+
+
+/* Return a dataset (with the same type as the input) that keeps the
+   values at each one of the given quantiles. Instead of sorting the full
+   dataset, the elements are only partially sorted (with
+   'gal_qsort_select'): once for each requested quantile, in increasing
+   order of the quantiles, so each selection only has to look at the
+   elements after the previous one. The values are identical to those
+   that 'gal_statistics_quantile' would give. Similar to
+   'gal_statistics_no_blank_sorted', the input will be modified when
+   'inplace' is non-zero (and it is not a tile). */
+gal_data_t *
+gal_statistics_quantiles_select(gal_data_t *input, double *quantiles,
+                                size_t numquantiles, int inplace)
+{
+  gal_data_t *nb, *out;
+  size_t i, start=0, *index, *order;
+  uint8_t type=gal_tile_block(input)->type;
+
+  /* Allocate the output. */
+  out=gal_data_alloc(NULL, type, 1, &numquantiles, NULL, 1, -1, 1,
+                     NULL, NULL, NULL);
+
+  /* Get a contiguous patch of memory without blank values that we can
+     modify. */
+  if(input->size)
+    {
+      nb = ( input->block || inplace==0 ) ? gal_data_copy(input) : input;
+      if( gal_blank_present(nb, 1) ) gal_blank_remove(nb);
+    }
+  else nb=input;
+
+  /* Only continue if there are non-blank elements. */
+  if(nb->size)
+    {
+      /* Find the index of each quantile. If the dataset is already sorted
+         there is no need to do anything further. Note that if it is
+         sorted in decreasing order, we need the inverse quantile. */
+      index=gal_pointer_allocate(GAL_TYPE_SIZE_T, numquantiles, 0,
+                                 __func__, "index");
+      gal_statistics_is_sorted(nb, 1);
+      for(i=0;i<numquantiles;++i)
+        index[i]=gal_statistics_quantile_index(nb->size,
+                                               ( nb->flag
+                                                 & GAL_DATA_FLAG_SORTED_D
+                                                 ? 1.0f - quantiles[i]
+                                                 : quantiles[i] ) );
+
+      /* Not sorted: select the elements in increasing order of their
+         index. */
+      if( (nb->flag & GAL_DATA_FLAG_SORTED_I)==0
+          && (nb->flag & GAL_DATA_FLAG_SORTED_D)==0 )
+        {
+          order=gal_pointer_allocate(GAL_TYPE_SIZE_T, numquantiles, 0,
+                                     __func__, "order");
+          memcpy(order, index, numquantiles*sizeof *index);
+          gal_qsort_increasing(order, numquantiles, GAL_TYPE_SIZE_T);
+          for(i=0;i<numquantiles;++i)
+            if(order[i]>=start)
+              {
+                gal_qsort_select(gal_pointer_increment(nb->array, start,
+                                                       type),
+                                 nb->size-start, order[i]-start, type);
+                start=order[i]+1;
+              }
+          free(order);
+
+          /* The array is now partially sorted (it may even be sorted by
+             chance), so the sort flags can't be trusted any more. */
+          nb->flag &= ~GAL_DATA_FLAG_SORT_CH;
+        }
+
+      /* Write the values into the output. */
+      for(i=0;i<numquantiles;++i)
+        memcpy(gal_pointer_increment(out->array, i, type),
+               gal_pointer_increment(nb->array, index[i], type),
+               gal_type_sizeof(type));
+      free(index);
+    }
+  else
+    for(i=0;i<numquantiles;++i)
+      gal_blank_write(gal_pointer_increment(out->array, i, type), type);
+
+  /* Clean up and return. */
+  if(nb!=input) gal_data_free(nb);
+  return out;
+}
+
+
+
+
+
 /* Pull out unique elements. */
 #define UNIQUE_BYTYPE(TYPE) {                                           \
     size_t i, j;                                                        \
@@ -1628,34 +1822,10 @@ gal_statistics_is_sorted(gal_data_t *input, int updateflags)
 void
 gal_statistics_sort_increasing(gal_data_t *input)
 {
-  /* Do the sorting. */
+  /* Do the sorting (small arrays, like the values of each pixel in a
+     stack, are sorted without a comparison function). */
   if(input->size)
-    switch(input->type)
-      {
-      case GAL_TYPE_UINT8:
-        STATISTICS_SORT(gal_qsort_uint8_i);    break;
-      case GAL_TYPE_INT8:
-        STATISTICS_SORT(gal_qsort_int8_i);     break;
-      case GAL_TYPE_UINT16:
-        STATISTICS_SORT(gal_qsort_uint16_i);   break;
-      case GAL_TYPE_INT16:
-        STATISTICS_SORT(gal_qsort_int16_i);    break;
-      case GAL_TYPE_UINT32:
-        STATISTICS_SORT(gal_qsort_uint32_i);   break;
-      case GAL_TYPE_INT32:
-        STATISTICS_SORT(gal_qsort_int32_i);    break;
-      case GAL_TYPE_UINT64:
-        STATISTICS_SORT(gal_qsort_uint64_i);   break;
-      case GAL_TYPE_INT64:
-        STATISTICS_SORT(gal_qsort_int64_i);    break;
-      case GAL_TYPE_FLOAT32:
-        STATISTICS_SORT(gal_qsort_float32_i);  break;
-      case GAL_TYPE_FLOAT64:
-        STATISTICS_SORT(gal_qsort_float64_i);  break;
-      default:
-        error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
-              __func__, input->type);
-      }
+    gal_qsort_increasing(input->array, input->size, input->type);
 
   /* Set the flags. */
   input->flag |=  GAL_DATA_FLAG_SORT_CH;
@@ -24,9 +24,11 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <time.h>
 #include <stdio.h>
+#include <sched.h>
 #include <errno.h>
 #include <error.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gnuastro/threads.h>
 #include <gnuastro/pointer.h>
@@ -166,6 +168,163 @@ pthread_barrier_destroy(pthread_barrier_t *b)
 
 
 
+/*******************************************************************/
+/************            NUMA-aware operation         **************/
+/*******************************************************************/
+/* On systems with multiple memory nodes (for example multi-socket
+   servers), each page of memory is placed on the node of the CPU that
+   first writes into it ("first touch"). When 'threads_numa' is not zero,
+   the threads of the pool are pinned to fixed CPUs, the actions are
+   given to the threads in contiguous blocks, and large arrays are
+   first-touched in the same contiguous blocks on 'threads_numa' threads
+   of the pool. Therefore, the thread that later processes a tile will
+   usually find its pixels on its own memory node. */
+static size_t threads_numa=0;
+#if HAVE_PTHREAD_SETAFFINITY_NP
+static cpu_set_t threads_numa_cpus;
+#endif
+
+struct threads_first_touch
+{
+  unsigned char  *array;  /* Array to touch.                              */
+  size_t       bytesize;  /* Number of bytes in the array.                */
+  size_t      numblocks;  /* Number of blocks to touch.                   */
+};
+
+
+
+
+
+/* Activate (when 'numthreads' is non-zero) or de-activate the NUMA-aware
+   mode. This should be called before any thread is spun-off (a thread of
+   the pool that is already pinned will stay on its CPU). */
+void
+gal_threads_numa_set(size_t numthreads)
+{
+  threads_numa=numthreads;
+
+  /* Keep the CPUs that this process is allowed to run on (the threads
+     will be pinned to these CPUs in order). */
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  if(numthreads
+     && sched_getaffinity(0, sizeof threads_numa_cpus, &threads_numa_cpus))
+    error(EXIT_FAILURE, errno, "%s: couldn't get the CPUs that this "
+          "process can use", __func__);
+#endif
+}
+
+
+
+
+
+size_t
+gal_threads_numa()
+{
+  return threads_numa;
+}
+
+
+
+
+
+/* Pin the calling thread to the CPU with the given index (counting
+   within the CPUs that are available to this process). */
+static void
+threads_numa_pin(size_t index)
+{
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  int err;
+  cpu_set_t one;
+  size_t i, num=CPU_COUNT(&threads_numa_cpus);
+
+  /* Only CPUs that are available can be used. */
+  if(num==0) return;
+  index%=num;
+
+  /* Find the CPU and pin the thread to it. */
+  for(i=0;i<CPU_SETSIZE;++i)
+    if( CPU_ISSET(i, &threads_numa_cpus) && index-- == 0 )
+      {
+        CPU_ZERO(&one);
+        CPU_SET(i, &one);
+        err=pthread_setaffinity_np(pthread_self(), sizeof one, &one);
+        if(err)
+          error(EXIT_FAILURE, err, "%s: couldn't pin thread to CPU %zu",
+                __func__, i);
+        break;
+      }
+#endif
+}
+
+
+
+
+
+static void *
+threads_first_touch_worker(void *in_prm)
+{
+  size_t i, start, end;
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct threads_first_touch *p=(struct threads_first_touch *)tprm->params;
+
+  /* Set the bytes of each block to zero. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      start = tprm->indexs[i]     * p->bytesize / p->numblocks;
+      end   = (tprm->indexs[i]+1) * p->bytesize / p->numblocks;
+      memset(p->array+start, 0, end-start);
+    }
+
+  /* Wait for all threads to finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Set all the bytes of 'array' to zero. In the NUMA-aware mode (and when
+   the array is large), this is done on multiple threads with the same
+   contiguous distribution of actions to threads that
+   'gal_threads_dist_in_threads' uses. So each part of the array is placed
+   on the memory node of the thread that will later use it. */
+void
+gal_threads_first_touch(void *array, size_t bytesize)
+{
+  struct threads_first_touch p;
+
+  /* Small arrays, or when the NUMA-aware mode isn't active. */
+  if(threads_numa<2 || bytesize<GAL_THREADS_NUMA_MIN_BYTES)
+    { memset(array, 0, bytesize); return; }
+
+  /* Touch the blocks on the threads. */
+  p.array=array;
+  p.bytesize=bytesize;
+  p.numblocks=threads_numa;
+  gal_threads_spin_off(threads_first_touch_worker, &p, threads_numa,
+                       threads_numa, -1, 1);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*******************************************************************/
 /************              Thread utilities           **************/
 /*******************************************************************/
@@ -192,7 +351,7 @@ gal_threads_dist_in_threads(size_t numactions, size_t numthreads,
 {
   size_t *sp, *fp;
   char *mmapname=NULL;
-  size_t i, *thrds, thrdcols;
+  size_t i, j, start, end, *thrds, thrdcols, numblocks;
   *outthrdcols = thrdcols = numactions/numthreads+2;
 
   /* Allocate the space to keep the identifiers. */
@@ -204,9 +363,25 @@ gal_threads_dist_in_threads(size_t numactions, size_t numthreads,
   fp=(sp=thrds)+numthreads*thrdcols;
   do *sp=GAL_BLANK_SIZE_T; while(++sp<fp);
 
-  /* Distribute the labels in the threads.  */
-  for(i=0;i<numactions;++i)
-    thrds[ (i%numthreads)*thrdcols+(i/numthreads) ] = i;
+  /* Distribute the labels in the threads. In the NUMA-aware mode, each
+     thread gets a contiguous block of actions (similar to the blocks of
+     'gal_threads_first_touch'). Otherwise, they are distributed in a
+     round-robin fashion. In both cases, when there are fewer actions
+     than threads, only the first 'numactions' threads get an action (one
+     each): 'gal_threads_spin_off' only runs those threads. */
+  if(threads_numa)
+    {
+      numblocks = numactions<numthreads ? numactions : numthreads;
+      for(i=0;i<numblocks;++i)
+        {
+          start = i     * numactions / numblocks;
+          end   = (i+1) * numactions / numblocks;
+          for(j=start;j<end;++j) thrds[ i*thrdcols + j-start ] = j;
+        }
+    }
+  else
+    for(i=0;i<numactions;++i)
+      thrds[ (i%numthreads)*thrdcols+(i/numthreads) ] = i;
 
   /* In case you want to see the result:
   for(i=0;i<numthreads;++i)
@@ -262,6 +437,413 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
 
 
+/*******************************************************************/
+/************        Persistent pool of threads       **************/
+/*******************************************************************/
+/* Creating and destroying threads is expensive, and many programs (for
+   example NoiseChisel or Segment) call 'gal_threads_spin_off' many times
+   for each input. So the threads that are created by it are kept (waiting
+   for a new job) after the job is finished. The pool grows when more
+   threads are necessary at the same time (for example when a worker
+   function calls 'gal_threads_spin_off' itself). */
+struct threads_job
+{
+  size_t          remaining;  /* Number of threads that haven't finished. */
+  pthread_cond_t       done;  /* Signaled when all threads are finished.  */
+};
+
+struct threads_pool_slot
+{
+  pthread_t          thread;  /* ID of this thread.                       */
+  pthread_cond_t       cond;  /* Signaled when a job is given.            */
+  void *(*worker)(void *);    /* Function to run (NULL: slot is free).    */
+  void                 *arg;  /* Argument to pass to the function.        */
+  struct threads_job   *job;  /* The job that this thread is part of.     */
+  int                  quit;  /* The thread should return.                */
+  size_t              index;  /* Index of this thread in the pool.        */
+  int                pinned;  /* Thread has been pinned to a CPU.         */
+};
+
+/* All the threads in the pool (the slots are allocated separately, so
+   their addresses don't change when the pool grows). */
+static pthread_mutex_t threads_pool_mutex=PTHREAD_MUTEX_INITIALIZER;
+static struct threads_pool_slot **threads_pool=NULL;
+static size_t threads_pool_num=0;
+
+
+
+
+
+/* Function that runs on each thread of the pool: wait for a job, run it,
+   and report that it is done. */
+static void *
+threads_pool_run(void *in)
+{
+  void *arg;
+  struct threads_job *job;
+  void *(*worker)(void *);
+  struct threads_pool_slot *slot=(struct threads_pool_slot *)in;
+
+  pthread_mutex_lock(&threads_pool_mutex);
+  while(1)
+    {
+      /* Wait for a job. */
+      while(slot->worker==NULL && slot->quit==0)
+        pthread_cond_wait(&slot->cond, &threads_pool_mutex);
+      if(slot->quit) break;
+
+      /* Run the job (the mutex isn't locked while the job is running). */
+      arg=slot->arg;
+      job=slot->job;
+      worker=slot->worker;
+      pthread_mutex_unlock(&threads_pool_mutex);
+      if(threads_numa && slot->pinned==0)
+        { threads_numa_pin(slot->index); slot->pinned=1; }
+      worker(arg);
+      pthread_mutex_lock(&threads_pool_mutex);
+
+      /* Free this slot and let the caller know if all the threads of this
+         job are finished. */
+      slot->arg=NULL;
+      slot->job=NULL;
+      slot->worker=NULL;
+      if(--job->remaining==0) pthread_cond_signal(&job->done);
+    }
+  pthread_mutex_unlock(&threads_pool_mutex);
+  return NULL;
+}
+
+
+
+
+
+/* Give the job of thread 'id' to a free thread of the pool (a new thread
+   is created if none is free). The pool's mutex should be locked before
+   calling this function. */
+static void
+threads_pool_give(void *(*worker)(void *), void *arg,
+                  struct threads_job *job, size_t id)
+{
+  int err;
+  size_t i;
+  struct threads_pool_slot *slot=NULL, **tmp;
+
+  /* Find a free thread. The thread with the same index is preferred: so
+     in consecutive calls, the same thread (and thus the same CPU in the
+     NUMA-aware mode) does the same actions. */
+  if(id<threads_pool_num && threads_pool[id]->worker==NULL)
+    slot=threads_pool[id];
+  else
+    for(i=0;i<threads_pool_num;++i)
+      if(threads_pool[i]->worker==NULL)
+        { slot=threads_pool[i]; break; }
+
+  /* If there was no free thread, add a new one to the pool. */
+  if(slot==NULL)
+    {
+      errno=0;
+      tmp=realloc(threads_pool, (threads_pool_num+1) * sizeof *tmp);
+      slot=calloc(1, sizeof *slot);
+      if(tmp==NULL || slot==NULL)
+        error(EXIT_FAILURE, errno, "%s: couldn't allocate a new thread "
+              "in the pool", __func__);
+      threads_pool=tmp;
+      slot->index=threads_pool_num;
+      err=pthread_cond_init(&slot->cond, NULL);
+      if(err) error(EXIT_FAILURE, err, "%s: initializing cond", __func__);
+      err=pthread_create(&slot->thread, NULL, threads_pool_run, slot);
+      if(err)
+        error(EXIT_FAILURE, err, "%s: can't create thread %zu of the pool",
+              __func__, threads_pool_num);
+      threads_pool[threads_pool_num++]=slot;
+    }
+
+  /* Give the job to the thread. */
+  slot->arg=arg;
+  slot->job=job;
+  slot->worker=worker;
+  pthread_cond_signal(&slot->cond);
+}
+
+
+
+
+
+/* Stop and free all the threads in the pool (they will be created again
+   if 'gal_threads_spin_off' is called later). This is only necessary
+   when the library should be unloaded (for example before 'dlclose'),
+   or if a memory checker shouldn't report the pool's threads. It should
+   not be called while any job is running. */
+void
+gal_threads_pool_free()
+{
+  size_t i;
+
+  /* Ask all the threads to return. */
+  pthread_mutex_lock(&threads_pool_mutex);
+  for(i=0;i<threads_pool_num;++i)
+    {
+      threads_pool[i]->quit=1;
+      pthread_cond_signal(&threads_pool[i]->cond);
+    }
+  pthread_mutex_unlock(&threads_pool_mutex);
+
+  /* Wait for them to return and free the slots. */
+  for(i=0;i<threads_pool_num;++i)
+    {
+      pthread_join(threads_pool[i]->thread, NULL);
+      pthread_cond_destroy(&threads_pool[i]->cond);
+      free(threads_pool[i]);
+    }
+  free(threads_pool);
+  threads_pool=NULL;
+  threads_pool_num=0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*******************************************************************/
+/************     Dynamic scheduling of the actions   **************/
+/*******************************************************************/
+/* When the cost of the actions is very different, the threads that got
+   the cheap actions will finish much earlier than the others. So, in
+   addition to the fixed distribution of the actions in 'indexs' (that is
+   used by most of the worker functions), 'gal_threads_spin_off' also
+   gives each thread a contiguous range of the actions. With
+   'gal_threads_next', each thread takes chunks from the start of its own
+   range (each chunk is a fraction of what remains), and when its range is
+   finished, it steals half of the remaining actions of the thread that
+   has the most remaining actions.
+
+   When the (estimated) cost of each action is known in advance (given to
+   'gal_threads_spin_off_costs'), the actions are instead given one by one
+   from a single queue that is sorted by decreasing cost. So the most
+   expensive actions are started first and the cheap ones fill the gaps
+   at the end (the "longest processing time first" rule). */
+struct threads_range
+{
+  pthread_mutex_t     mutex;  /* Mutex to change this range.              */
+  size_t              start;  /* First action that is not yet taken.      */
+  size_t                end;  /* Action after the last in this range.     */
+};
+
+struct threads_queue
+{
+  size_t                num;  /* Number of ranges (threads).              */
+  struct threads_range *ranges; /* The range of each thread.              */
+  size_t             *order;  /* Actions sorted by cost (or NULL).        */
+  size_t          numorder;  /* Number of actions in 'order'.             */
+  size_t               next;  /* Next element of 'order' to give.         */
+  pthread_mutex_t     mutex;  /* Mutex to change 'next'.                  */
+};
+
+/* For sorting the actions by their cost. */
+struct threads_cost
+{
+  size_t               cost;  /* Cost of the action.                      */
+  size_t              index;  /* Index of the action.                     */
+};
+
+
+
+
+
+/* Sort by decreasing cost, actions with the same cost are sorted by their
+   index (so the order doesn't depend on the 'qsort' implementation). */
+static int
+threads_cost_d(const void *a, const void *b)
+{
+  const struct threads_cost *ca=a, *cb=b;
+  if(ca->cost!=cb->cost) return ca->cost > cb->cost ? -1 : 1;
+  return ca->index < cb->index ? -1 : (ca->index > cb->index);
+}
+
+
+
+
+
+/* Allocate the queue for 'numactions' actions on 'numthreads' threads
+   ('costs' may be NULL). */
+static struct threads_queue *
+threads_queue_alloc(size_t numactions, size_t numthreads, size_t *costs)
+{
+  size_t i;
+  struct threads_queue *q;
+  struct threads_cost *sorted;
+
+  /* Allocate the structures. */
+  errno=0;
+  q=malloc(sizeof *q);
+  if(q==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'q'", __func__,
+          sizeof *q);
+  errno=0;
+  q->ranges=malloc(numthreads * sizeof *q->ranges);
+  if(q->ranges==NULL)
+    error(EXIT_FAILURE, errno, "%s: %zu bytes for 'q->ranges'", __func__,
+          numthreads * sizeof *q->ranges);
+
+  /* Set the (contiguous) range of each thread. */
+  q->num=numthreads;
+  for(i=0;i<numthreads;++i)
+    {
+      pthread_mutex_init(&q->ranges[i].mutex, NULL);
+      q->ranges[i].start = i     * numactions / numthreads;
+      q->ranges[i].end   = (i+1) * numactions / numthreads;
+    }
+
+  /* If the costs are given, sort the actions by decreasing cost. */
+  q->next=0;
+  q->order=NULL;
+  q->numorder=0;
+  pthread_mutex_init(&q->mutex, NULL);
+  if(costs)
+    {
+      errno=0;
+      sorted=malloc(numactions * sizeof *sorted);
+      if(sorted==NULL)
+        error(EXIT_FAILURE, errno, "%s: %zu bytes for 'sorted'", __func__,
+              numactions * sizeof *sorted);
+      for(i=0;i<numactions;++i)
+        { sorted[i].cost=costs[i]; sorted[i].index=i; }
+      qsort(sorted, numactions, sizeof *sorted, threads_cost_d);
+      q->order=gal_pointer_allocate(GAL_TYPE_SIZE_T, numactions, 0,
+                                    __func__, "q->order");
+      for(i=0;i<numactions;++i) q->order[i]=sorted[i].index;
+      q->numorder=numactions;
+      free(sorted);
+    }
+  return q;
+}
+
+
+
+
+
+static void
+threads_queue_free(struct threads_queue *q)
+{
+  size_t i;
+  for(i=0;i<q->num;++i) pthread_mutex_destroy(&q->ranges[i].mutex);
+  pthread_mutex_destroy(&q->mutex);
+  free(q->ranges);
+  free(q->order);
+  free(q);
+}
+
+
+
+
+
+/* Return the index of the next action that this thread should do, or
+   'GAL_BLANK_SIZE_T' when all the actions have been taken. */
+size_t
+gal_threads_next(struct gal_threads_params *tprm)
+{
+  struct threads_range *own, *r;
+  struct threads_queue *q=tprm->queue;
+  size_t i, rem, take, maxrem, victim;
+
+  /* When the actions are sorted by cost, give the next one. */
+  if(q->order)
+    {
+      pthread_mutex_lock(&q->mutex);
+      i = q->next<q->numorder ? q->order[q->next++] : GAL_BLANK_SIZE_T;
+      pthread_mutex_unlock(&q->mutex);
+      return i;
+    }
+
+  /* If there are actions in the current chunk, use them. */
+  if(tprm->chunk[0]<tprm->chunk[1]) return tprm->chunk[0]++;
+
+  /* Get a new chunk. */
+  own=&q->ranges[tprm->id];
+  while(1)
+    {
+      /* Take a chunk from the start of this thread's own range. */
+      pthread_mutex_lock(&own->mutex);
+      rem=own->end-own->start;
+      if(rem)
+        {
+          take=(rem+GAL_THREADS_CHUNK_FRACTION-1)/GAL_THREADS_CHUNK_FRACTION;
+          tprm->chunk[0]=own->start;
+          tprm->chunk[1]=own->start+take;
+          own->start+=take;
+          pthread_mutex_unlock(&own->mutex);
+          return tprm->chunk[0]++;
+        }
+      pthread_mutex_unlock(&own->mutex);
+
+      /* Find the thread with the most remaining actions. */
+      maxrem=0;
+      victim=GAL_BLANK_SIZE_T;
+      for(i=0;i<q->num;++i)
+        if(i!=tprm->id)
+          {
+            r=&q->ranges[i];
+            pthread_mutex_lock(&r->mutex);
+            rem=r->end-r->start;
+            pthread_mutex_unlock(&r->mutex);
+            if(rem>maxrem) { maxrem=rem; victim=i; }
+          }
+
+      /* All the actions have been taken. */
+      if(victim==GAL_BLANK_SIZE_T) return GAL_BLANK_SIZE_T;
+
+      /* Steal half of the victim's remaining actions (from the end of its
+         range) and put them in this thread's range (the remaining actions
+         of the victim may have changed since they were counted). The two
+         mutexes are not locked together, to avoid a dead-lock when two
+         threads steal from each other. */
+      r=&q->ranges[victim];
+      pthread_mutex_lock(&r->mutex);
+      take=(r->end-r->start+1)/2;
+      r->end-=take;
+      i=r->end;
+      pthread_mutex_unlock(&r->mutex);
+      pthread_mutex_lock(&own->mutex);
+      own->start=i;
+      own->end=i+take;
+      pthread_mutex_unlock(&own->mutex);
+    }
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*******************************************************************/
 /************     Run a function on multiple threads  **************/
 /*******************************************************************/
@@ -301,6 +883,10 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
        }
 
+       (When the actions have very different costs, instead of the loop
+       above, use 'while( (i=gal_threads_next(tprm))!=GAL_BLANK_SIZE_T )'
+       so the actions are distributed dynamically: 'i' is the index.)
+
        if(tprm->b) pthread_barrier_wait(tprm->b);
        return NULL;
      }
@@ -334,18 +920,18 @@ gal_threads_attr_barrier_init(pthread_attr_t *attr, pthread_barrier_t *b,
 
       $ grep -r gal_threads_spin_off ./
 */
-void
-gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
-                     size_t numactions, size_t numthreads,
-                     size_t minmapsize, int quietmmap)
+static void
+threads_spin_off(void *(*worker)(void *), void *caller_params,
+                 size_t numactions, size_t numthreads, size_t minmapsize,
+                 int quietmmap, size_t *costs)
 {
   int err;
-  pthread_t t;          /* All thread ids saved in this, not used. */
   char *mmapname=NULL;
-  pthread_attr_t attr;
   pthread_barrier_t b;
+  struct threads_job job;
+  struct threads_queue *queue;
   struct gal_threads_params *prm;
-  size_t i, *indexs, thrdcols, numbarriers;
+  size_t i, *indexs, thrdcols, numrun;
 
   /* If there are no actions, then just return. */
   if(numactions==0) return;
@@ -365,51 +951,56 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
       exit(EXIT_FAILURE);
     }
 
-  /* Distribute the actions into the threads: */
+  /* Distribute the actions into the threads: in 'indexs' for the workers
+     that use a fixed distribution, and in the queue for the workers that
+     use 'gal_threads_next'. Only the threads that have at least one
+     action in 'indexs' will be run. */
   mmapname=gal_threads_dist_in_threads(numactions, numthreads, minmapsize,
                                        quietmmap, &indexs, &thrdcols);
+  numrun = numactions<numthreads ? numactions : numthreads;
+  queue=threads_queue_alloc(numactions, numrun, costs);
+  for(i=0;i<numrun;++i)
+    {
+      prm[i].id=i;
+      prm[i].queue=queue;
+      prm[i].params=caller_params;
+      prm[i].indexs=&indexs[i*thrdcols];
+      prm[i].chunk[0]=prm[i].chunk[1]=0;
+    }
 
   /* Do the job: when only one thread is necessary, there is no need to
-     spin-off one thread, just call the workerfunction directly (spinning
-     off threads is expensive). This is for the generic thread spinner
-     function, not this simple function where 'numthreads' is a
-     constant. */
-  if(numthreads==1)
+     use other threads, just call the workerfunction directly. */
+  if(numrun==1)
     {
-      prm[0].id=0;
       prm[0].b=NULL;
-      prm[0].indexs=indexs;
-      prm[0].params=caller_params;
       worker(&prm[0]);
     }
   else
     {
-      /* Initialize the attributes. Note that this running thread
-         (that spins-off the nt threads) is also a thread, so the
-         number the barriers should be one more than the number of
-         threads spinned off. */
-      numbarriers = (numactions<numthreads ? numactions : numthreads) + 1;
-      gal_threads_attr_barrier_init(&attr, &b, numbarriers);
-
-      /* Spin-off the threads: */
-      for(i=0;i<numthreads;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            prm[i].id=i;
-            prm[i].b=&b;
-            prm[i].params=caller_params;
-            prm[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, worker, &prm[i]);
-            if(err)
-              {
-                fprintf(stderr, "can't create thread %zu", i);
-                exit(EXIT_FAILURE);
-              }
-          }
-
-      /* Wait for all threads to finish and free the spaces. */
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
+      /* The barrier is only for the workers (they may need to wait for
+         each other). This thread waits for the job to finish with the
+         pool's condition variable. */
+      err=pthread_barrier_init(&b, NULL, numrun);
+      if(err) error(EXIT_FAILURE, 0, "%s: thread barrier not initialized",
+                    __func__);
+      err=pthread_cond_init(&job.done, NULL);
+      if(err) error(EXIT_FAILURE, err, "%s: initializing cond", __func__);
+
+      /* Give the actions to the threads of the pool and wait for them to
+         finish. */
+      job.remaining=numrun;
+      pthread_mutex_lock(&threads_pool_mutex);
+      for(i=0;i<numrun;++i)
+        {
+          prm[i].b=&b;
+          threads_pool_give(worker, &prm[i], &job, i);
+        }
+      while(job.remaining)
+        pthread_cond_wait(&job.done, &threads_pool_mutex);
+      pthread_mutex_unlock(&threads_pool_mutex);
+
+      /* Clean up. */
+      pthread_cond_destroy(&job.done);
       pthread_barrier_destroy(&b);
     }
 
@@ -421,5 +1012,36 @@ gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
   else         free(indexs);
 
   /* Clean up. */
+  threads_queue_free(queue);
   free(prm);
 }
+
+
+
+
+
+void
+gal_threads_spin_off(void *(*worker)(void *), void *caller_params,
+                     size_t numactions, size_t numthreads,
+                     size_t minmapsize, int quietmmap)
+{
+  threads_spin_off(worker, caller_params, numactions, numthreads,
+                   minmapsize, quietmmap, NULL);
+}
+
+
+
+
+
+/* Similar to 'gal_threads_spin_off', but the (estimated) cost of each
+   action is also given. The worker function should use
+   'gal_threads_next': it will give the actions in decreasing order of
+   their cost. */
+void
+gal_threads_spin_off_costs(void *(*worker)(void *), void *caller_params,
+                           size_t numactions, size_t numthreads,
+                           size_t minmapsize, int quietmmap, size_t *costs)
+{
+  threads_spin_off(worker, caller_params, numactions, numthreads,
+                   minmapsize, quietmmap, costs);
+}
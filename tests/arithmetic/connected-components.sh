@@ -56,3 +56,19 @@ if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
 # debugging when the developer doesn't have access to the user's system.
 $check_with_program $execname $img 2 connected-components -hDETECTIONS   \
                               --output=connected-components.fits
+if [ $? != 0 ]; then exit 1; fi
+
+# The labels should not depend on the number of threads. The configuration
+# (including '--numthreads') and date are not written in the outputs, so
+# they should be byte-for-byte identical.
+for conn in 1 2; do
+    for nt in 1 4; do
+        $check_with_program $execname $img $conn connected-components \
+                                      -hDETECTIONS --numthreads=$nt \
+                                      --outfitsnoconfig --outfitsnodate \
+                                      --output=connected-components-$nt.fits
+        if [ $? != 0 ]; then exit 1; fi
+    done
+    cmp connected-components-1.fits connected-components-4.fits
+    if [ $? != 0 ]; then exit 1; fi
+done
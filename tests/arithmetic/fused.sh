@@ -0,0 +1,109 @@
+# Run the same expression with Arithmetic in one command (where the
+# element-wise operators are fused) and operator by operator.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+imgin=convolve_spatial_noised.fits
+imgnc=convolve_spatial_noised_detected.fits
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $imgin    ]; then echo "$imgin does not exist."; exit 77; fi
+if [ ! -f $imgnc    ]; then echo "$imgnc does not exist."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The expression below is fused into one tree (that is evaluated in one
+# pass) when given to Arithmetic in one command. In the second run, each
+# operator is given to Arithmetic separately and its output is written
+# into a file (in the type that the library gives it), which is the input
+# of the next operator. The 'float64' conversion makes the rest of the
+# expression be done in double precision, and the negative values (after
+# subtracting the Sky) that are given to 'sqrt' produce blank pixels. The
+# two outputs must be identical: the maximum absolute difference must be
+# zero and the blank pixels must be the same.
+$check_with_program $execname $imgin $imgnc - $imgnc float64 / sqrt \
+                               2 pow 3 + $imgin x $imgnc / 1.5 - log10 \
+                               --hdu=1 --hdu=SKY --hdu=SKY_STD --hdu=1 \
+                               --hdu=SKY_STD --output=fused-one.fits
+if [ $? != 0 ]; then exit 1; fi
+
+# The same expression, operator by operator ('fused-step-N.fits' is the
+# output of the N-th step).
+o="--output"
+$execname $imgin $imgnc - -h1 -hSKY           $o=fused-step-1.fits \
+    && $execname $imgnc float64 -hSKY_STD     $o=fused-step-2.fits \
+    && $execname fused-step-1.fits fused-step-2.fits / -h1 -h1 \
+                                              $o=fused-step-3.fits \
+    && $execname fused-step-3.fits sqrt -h1   $o=fused-step-4.fits \
+    && $execname fused-step-4.fits 2 pow -h1  $o=fused-step-5.fits \
+    && $execname fused-step-5.fits 3 + -h1    $o=fused-step-6.fits \
+    && $execname fused-step-6.fits $imgin x -h1 -h1 \
+                                              $o=fused-step-7.fits \
+    && $execname fused-step-7.fits $imgnc / -h1 -hSKY_STD \
+                                              $o=fused-step-8.fits \
+    && $execname fused-step-8.fits 1.5 - -h1  $o=fused-step-9.fits \
+    && $execname fused-step-9.fits log10 -h1  $o=fused-steps.fits
+if [ $? != 0 ]; then exit 1; fi
+rm -f fused-step-?.fits
+
+# Compare the two outputs.
+diff=$($execname fused-one.fits fused-steps.fits - abs maximum \
+                 --hdu=1 --hdu=1 --quiet)
+nblank=$($execname fused-one.fits isblank fused-steps.fits isblank ne \
+                   sum --hdu=1 --hdu=1 --quiet)
+rm -f fused-steps.fits
+if [ "x$diff" = x ] || [ $(echo $diff | awk '{print ($1==0)}') != 1 ]; then
+    echo "Fused and operator-by-operator outputs differ (maximum: $diff)."
+    exit 1
+fi
+if [ "x$nblank" = x ] || [ $(echo $nblank | awk '{print ($1==0)}') != 1 ]
+then
+    echo "Blank pixels of fused and operator-by-operator outputs differ."
+    exit 1
+fi
@@ -0,0 +1,123 @@
+# Stack an image with the 'median' operator and compare it with the
+# (sort-based) 0.5 quantile of the same stack, with the mean of the two
+# middle values (for an even number of layers) and with stacking in
+# blocks of rows.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+imgin=convolve_spatial_noised.fits
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $imgin    ]; then echo "$imgin does not exist."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The layers of the stack are built from the same image, but each pixel
+# has a different value in each layer. For an odd number of layers, the
+# 0.5 quantile (which sorts all the values of each pixel) is the same as
+# the median (which only selects the middle value), so the two must be
+# identical.
+layers5="$imgin $imgin 2 x $imgin 0.5 x 3 + $imgin sqrt $imgin -1 x"
+layers7="$layers5 $imgin 5 - $imgin 0.1 x"
+for n in 5 7; do
+
+    # Select the layers.
+    if [ $n = 5 ]; then layers=$layers5; else layers=$layers7; fi
+
+    # Run the two operators.
+    $check_with_program $execname $layers $n median -g1 \
+                        --output=median-stack-$n.fits
+    $check_with_program $execname $layers $n 0.5 quantile -g1 \
+                        --output=median-stack-quantile-$n.fits
+
+    # Make sure the two are identical.
+    diff=$($execname median-stack-$n.fits median-stack-quantile-$n.fits \
+                     - abs maxvalue -g1 --quiet)
+    if ! awk -v d="$diff" 'BEGIN{exit !(d==0)}'; then
+        echo "$n layers: median and 0.5 quantile differ by '$diff'"
+        exit 1
+    fi
+done
+
+
+
+
+
+# Even number of layers (with NaN values). The last two layers are blank
+# in the pixels that are brighter than 10000 (about half of the image),
+# so half of the pixels have 6 values and the rest have 4. In both cases
+# (after sorting), the two middle values are the 2nd and 3rd layers, so
+# the median must be identical to their mean (which is how the median of
+# an even number of values was found by sorting).
+nanl="10000 gt nan where"
+layers6="$imgin $imgin 1 + $imgin 2 + $imgin 3 + \
+         $imgin 10 + $imgin $nanl $imgin 10 - $imgin $nanl"
+$check_with_program $execname $layers6 6 median -g1 \
+                    --output=median-stack-6.fits
+$execname $imgin 1 + $imgin 2 + + 2 / -g1 --output=median-stack-6-ref.fits
+diff=$($execname median-stack-6.fits median-stack-6-ref.fits - abs \
+                 maxvalue -g1 --quiet)
+nblank=$($execname median-stack-6.fits isblank sum -g1 --quiet)
+if ! awk -v d="$diff" -v b="$nblank" 'BEGIN{exit !(d==0 && b==0)}'; then
+    echo "6 layers: median differs from the mean of the middle values" \
+         "by '$diff' (with '$nblank' blank pixels)"
+    exit 1
+fi
+
+
+
+
+
+# Stack the same layers with '--stackmemory' (the image that is directly
+# given as an operand is read in blocks of rows): the output must be
+# identical.
+$check_with_program $execname $layers7 7 median -g1 --stackmemory=1 \
+                    --output=median-stack-rows.fits
+diff=$($execname median-stack-7.fits median-stack-rows.fits - abs \
+                 maxvalue -g1 --quiet)
+if ! awk -v d="$diff" 'BEGIN{exit !(d==0)}'; then
+    echo "stacking in blocks of rows differs by '$diff'"
+    exit 1
+fi
@@ -0,0 +1,93 @@
+# Make an S/N image with Arithmetic in blocks of rows (streaming).
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=arithmetic
+execname=../bin/$prog/ast$prog
+imgin=convolve_spatial_noised.fits
+imgnc=convolve_spatial_noised_detected.fits
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $imgin    ]; then echo "$imgin does not exist."; exit 77; fi
+if [ ! -f $imgnc    ]; then echo "$imgnc does not exist."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The same image is built without streaming, and the two outputs must be
+# identical: the maximum absolute difference must be zero and the blank
+# pixels must be the same.
+$check_with_program $execname $imgin $imgnc - $imgnc / --hdu=1 --hdu=SKY  \
+                               --hdu=SKY_STD --streamrows=17 \
+                               --output=snimage-stream.fits
+if [ $? != 0 ]; then exit 1; fi
+$execname $imgin $imgnc - $imgnc / --hdu=1 --hdu=SKY --hdu=SKY_STD \
+          --output=snimage-nostream.fits
+if [ $? != 0 ]; then exit 1; fi
+diff=$($execname snimage-stream.fits snimage-nostream.fits - abs maximum \
+                 --hdu=1 --hdu=1 --quiet)
+nblank=$($execname snimage-stream.fits isblank snimage-nostream.fits \
+                   isblank ne sum --hdu=1 --hdu=1 --quiet)
+rm -f snimage-nostream.fits
+if [ "x$diff" = x ] || [ $(echo $diff | awk '{print ($1==0)}') != 1 ]; then
+    echo "Streamed and non-streamed outputs differ (maximum: $diff)."
+    exit 1
+fi
+if [ "x$nblank" = x ] || [ $(echo $nblank | awk '{print ($1==0)}') != 1 ]
+then
+    echo "Blank pixels of streamed and non-streamed outputs differ."
+    exit 1
+fi
+
+# A streamed output that isn't a FITS file must be rejected before
+# anything is written.
+$execname $imgin $imgnc - $imgnc / --hdu=1 --hdu=SKY --hdu=SKY_STD \
+          --streamrows=17 --output=snimage-stream.txt 2> /dev/null
+if [ $? = 0 ] || [ -f snimage-stream.txt ]; then
+    echo "A non-FITS output was accepted with '--streamrows'."
+    rm -f snimage-stream.txt
+    exit 1
+fi
@@ -0,0 +1,150 @@
+# Compare the two paths of spatial domain convolution (tiles on the edge
+# of their channel and interior tiles) with kernels of different widths
+# in 2D and 3D. When 'GNUASTRO_BENCHMARK' is set, the 2D inputs are large
+# and the speed of each path is also printed.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=convolve
+execname=../bin/$prog/ast$prog
+dep1name=$progbdir/astarithmetic
+
+if [ x"$GNUASTRO_BENCHMARK" = x ]; then width=200
+else                                    width=4000
+fi
+img=convolve-benchmark.fits
+cube=convolve-benchmark-cube.fits
+kernel=convolve-benchmark-kernel.fits
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The programs it uses weren't made.
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $dep1name ]; then echo "$dep1name doesn't exist."; exit 77; fi
+
+
+
+
+
+# Inputs
+# ======
+#
+# A noisy image and cube (with a fixed random seed). The kernels (made
+# in the test below) have random values, so they are not separable and
+# all the pixels go through the spatial convolution of each tile.
+export GSL_RNG_TYPE=ranlxs2
+export GSL_RNG_SEED=1
+$dep1name $width $width 2 makenew float32 10 mknoise-sigma \
+          --envseed --quiet --output=$img
+$dep1name 48 48 48 3 makenew float32 10 mknoise-sigma \
+          --envseed --quiet --output=$cube
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The kernel's overlap with the image is found for every pixel of the
+# tiles that are on the edge of their channel, but not for the tiles that
+# are fully within it (interior tiles). With a single tile that covers the
+# whole input, all the pixels go through the edge path. With small tiles,
+# almost all the pixels go through the interior path. The two outputs
+# must be bit-identical. In benchmark mode, the number of pixels convolved
+# per second in each is printed (in the log of this test) for comparison
+# between different builds or systems.
+now () {
+    t=$(date +%s%N)
+    case $t in
+        *N) echo $(date +%s)000000000 ;;
+        *)  echo $t ;;
+    esac
+}
+run () {
+    start=$(now)
+    $check_with_program $execname $1 --kernel=$kernel --domain=spatial \
+                                  --tilesize=$2 --numchannels=$3 \
+                                  --output=convolve-benchmark-$4.fits
+    out=$?
+    end=$(now)
+    if [ x"$GNUASTRO_BENCHMARK" != x ]; then
+        rate=$(echo $start $end $5 \
+                   | awk '{t=($2-$1)/1e9; if(t>0) printf "%.0f", $3/t; \
+                           else printf "unknown"}')
+        echo "$6, $4 path: $rate pixels per second."
+    fi
+    return $out
+}
+compare () {
+    run $1 $2 $4 edge     $5 "$6" || return 1
+    run $1 $3 $4 interior $5 "$6" || return 1
+    diff=$($dep1name convolve-benchmark-edge.fits \
+                     convolve-benchmark-interior.fits - abs maxvalue \
+                     -g1 --quiet)
+    rm -f convolve-benchmark-edge.fits convolve-benchmark-interior.fits
+    if ! awk -v d="$diff" 'BEGIN{exit !(d==0)}'; then
+        echo "$6: edge and interior paths differ by '$diff'"
+        return 1
+    fi
+}
+out=0
+for w in 3 5 7 9 11; do
+    $dep1name $w $w 2 makenew float32 1 + 0.5 mknoise-uniform \
+              --envseed --quiet --output=$kernel
+    compare $img $width,$width 20,20 1,1 $((width*width)) "2D, ${w}x${w}"
+    if [ $? != 0 ]; then out=1; fi
+done
+for w in 3 5; do
+    $dep1name $w $w $w 3 makenew float32 1 + 0.5 mknoise-uniform \
+              --envseed --quiet --output=$kernel
+    compare $cube 48,48,48 12,12,12 1,1,1 110592 "3D, ${w}x${w}x${w}"
+    if [ $? != 0 ]; then out=1; fi
+done
+
+
+
+
+
+# Clean up
+# ========
+#
+# The inputs are not used by any other test (and can be large), so they
+# are deleted.
+rm -f $img $cube $kernel
+exit $out
@@ -0,0 +1,217 @@
+/*********************************************************************
+A test program to check the erosion, dilation and opening of binary
+datasets.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/blank.h"
+#include "gnuastro/binary.h"
+#include "gnuastro/dimension.h"
+
+
+/* Operators to check. */
+enum morph_operators
+{
+  MORPH_ERODE,
+  MORPH_DILATE,
+  MORPH_OPEN,
+};
+
+
+
+
+
+/* Build a binary image with smooth foreground regions (so they survive a
+   few erosions), some noise and blank pixels (with a fixed seed, so the
+   test is reproducible). */
+static gal_data_t *
+make_image(size_t ndim, size_t *dsize)
+{
+  uint8_t *b;
+  double v, c[3];
+  size_t i, d, tmp;
+  gal_data_t *image;
+  unsigned long seed=1;
+
+  image=gal_data_alloc(NULL, GAL_TYPE_UINT8, ndim, dsize, NULL, 0, -1, 1,
+                       NULL, NULL, NULL);
+  b=image->array;
+  for(i=0;i<image->size;++i)
+    {
+      /* Coordinates of this pixel. */
+      tmp=i;
+      c[0]=c[1]=c[2]=0.0;
+      for(d=ndim;d--;) { c[d]=tmp%dsize[d]; tmp/=dsize[d]; }
+
+      /* The value. */
+      seed = seed*6364136223846793005UL + 1442695040888963407UL;
+      v = sin(c[0]/4.0) + cos(c[1]/6.0) + sin(c[2]/3.0)
+        + ( (double)( (seed>>40) % 1000 ) / 1000.0 - 0.5 );
+      b[i] = v>0.3;
+      if( (seed>>20) % 37 == 0 ) b[i]=GAL_BLANK_UINT8;
+    }
+  return image;
+}
+
+
+
+
+
+/* One erosion or dilation on each byte (independent of the library): a
+   background pixel becomes foreground if any of its neighbors (with the
+   given connectivity) is foreground. Other values (blank) are not
+   changed and aren't foreground. */
+static void
+reference_erode_dilate(gal_data_t *image, size_t num, int connectivity,
+                       int dilate0_erode1)
+{
+  size_t i, n, *dinc;
+  uint8_t f, b, *in, *out=image->array;
+
+  /* Foreground and background values. */
+  if(dilate0_erode1) { f=0; b=1; }
+  else               { f=1; b=0; }
+
+  /* Do the iterations (each on a copy of the previous one). */
+  in=malloc(image->size);
+  dinc=gal_dimension_increment(image->ndim, image->dsize);
+  for(n=0;n<num;++n)
+    {
+      memcpy(in, out, image->size);
+      for(i=0;i<image->size;++i)
+        if(in[i]==b)
+          GAL_DIMENSION_NEIGHBOR_OP(i, image->ndim, image->dsize,
+                                    connectivity, dinc,
+                                    { if(in[nind]==f) out[i]=f; });
+    }
+
+  /* Clean up. */
+  free(dinc);
+  free(in);
+}
+
+
+
+
+
+/* Apply the operator on the image with the library, also make a reference
+   and compare them (return 1 if they differ). When 'inplace' is zero, the
+   input must not change. */
+static int
+check(gal_data_t *image, int operator, size_t num, int connectivity,
+      int inplace, size_t numthreads)
+{
+  size_t i;
+  int out=0;
+  uint8_t *r, *l;
+  char *names[]={"erode", "dilate", "open"};
+  gal_data_t *ref=gal_data_copy(image), *in=gal_data_copy(image), *lib;
+
+  /* With the library. */
+  switch(operator)
+    {
+    case MORPH_ERODE:
+      lib=gal_binary_erode(in, num, connectivity, inplace, numthreads);
+      break;
+    case MORPH_DILATE:
+      lib=gal_binary_dilate(in, num, connectivity, inplace, numthreads);
+      break;
+    default:
+      lib=gal_binary_open(in, num, connectivity, inplace, numthreads);
+    }
+
+  /* The input should only be used for the output when it is in place. */
+  if( inplace ? lib!=in : memcmp(in->array, image->array, image->size) )
+    {
+      printf("%s, inplace=%d: the input was not treated properly.\n",
+             names[operator], inplace);
+      out=1;
+    }
+
+  /* The reference. */
+  if(operator!=MORPH_DILATE)
+    reference_erode_dilate(ref, num, connectivity, 1);
+  if(operator!=MORPH_ERODE)
+    reference_erode_dilate(ref, num, connectivity, 0);
+
+  /* Compare them. */
+  r=ref->array;
+  l=lib->array;
+  for(i=0;i<ref->size;++i)
+    if(r[i]!=l[i])
+      {
+        printf("%zuD (%zu x %zu", image->ndim, image->dsize[0],
+               image->dsize[1]);
+        if(image->ndim==3) printf(" x %zu", image->dsize[2]);
+        printf("), %s, num=%zu, connectivity=%d, inplace=%d, %zu "
+               "threads: pixel %zu is %u, but should be %u.\n",
+               names[operator], num, connectivity, inplace, numthreads, i,
+               l[i], r[i]);
+        out=1;
+        break;
+      }
+
+  /* Clean up and return. */
+  if(lib!=in) gal_data_free(lib);
+  gal_data_free(ref);
+  gal_data_free(in);
+  return out;
+}
+
+
+
+
+
+/* Erode, dilate and open 2D and 3D binary images (with blank pixels and
+   widths that are not a multiple of 64) with all connectivities, a few
+   iterations, in place or not and different numbers of threads and
+   compare them with a simple implementation that works on each byte. */
+int
+main(void)
+{
+  gal_data_t *image;
+  int c, op, ip, out=EXIT_SUCCESS;
+  size_t s, t, num, numthreads[]={1, 3, 8};
+  size_t sizes[][4]={ {2, 41, 130}, {2, 23, 64}, {2, 17, 200},
+                      {2, 1, 77}, {3, 9, 13, 70}, {3, 5, 4, 129} };
+
+  /* Go over all the sizes. */
+  for(s=0; s<sizeof sizes/sizeof *sizes; ++s)
+    {
+      image=make_image(sizes[s][0], sizes[s]+1);
+      for(c=1; c<=(int)image->ndim; ++c)
+        for(num=1; num<=3; ++num)
+          for(op=MORPH_ERODE; op<=MORPH_OPEN; ++op)
+            for(ip=0; ip<2; ++ip)
+              for(t=0; t<sizeof numthreads/sizeof *numthreads; ++t)
+                if( check(image, op, num, c, ip, numthreads[t]) )
+                  out=EXIT_FAILURE;
+      gal_data_free(image);
+    }
+
+  /* Report and return. */
+  if(out==EXIT_SUCCESS)
+    printf("All the outputs are identical to the reference.\n");
+  return out;
+}
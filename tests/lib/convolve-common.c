@@ -0,0 +1,187 @@
+/*********************************************************************
+Common functions of the convolution test programs.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnuastro/tile.h"
+#include "gnuastro/pointer.h"
+
+#include "convolve-common.h"
+
+
+
+
+
+/* Build a noisy image (with a fixed seed, so the tests are reproducible)
+   that also has some blank pixels. */
+gal_data_t *
+convolve_common_image(size_t height, size_t width)
+{
+  float *f;
+  size_t i, dsize[2];
+  unsigned long seed=1;
+  gal_data_t *image;
+
+  dsize[0]=height;
+  dsize[1]=width;
+  image=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0, -1, 1,
+                       NULL, NULL, NULL);
+  f=image->array;
+  for(i=0;i<image->size;++i)
+    {
+      seed = seed*6364136223846793005UL + 1442695040888963407UL;
+      f[i] = 100.0f + (float)( (seed>>40) % 1000 ) / 10.0f;
+      if( (seed>>20) % 53 == 0 ) f[i]=NAN;
+    }
+  return image;
+}
+
+
+
+
+
+/* Define square tiles (of 'tilesize' pixels on each side) and
+   'numchannels' channels along each dimension over the image. Like the
+   options of the programs, the tile size and number of channels are
+   terminated by '-1' (they are freed by 'gal_tile_full_free_contents'). */
+void
+convolve_common_tiles(gal_data_t *image, size_t tilesize,
+                      size_t numchannels,
+                      struct gal_tile_two_layer_params *tl)
+{
+  memset(tl, 0, sizeof *tl);
+  tl->tilesize=gal_pointer_allocate(GAL_TYPE_SIZE_T, 3, 0, __func__,
+                                    "tl->tilesize");
+  tl->numchannels=gal_pointer_allocate(GAL_TYPE_SIZE_T, 3, 0, __func__,
+                                       "tl->numchannels");
+  tl->tilesize[0]=tl->tilesize[1]=tilesize;
+  tl->numchannels[0]=tl->numchannels[1]=numchannels;
+  tl->tilesize[2]=tl->numchannels[2]=-1;
+  tl->remainderfrac=0.1;
+  gal_tile_full_sanity_check("synthetic image", "0", image, tl);
+  gal_tile_full_two_layers(image, tl);
+}
+
+
+
+
+
+/* Convolve the image of the tiles with the (odd-sized) kernel directly
+   (independent of the library's convolution functions) to be used as a
+   reference. For every pixel, the usable (not blank) pixels under the
+   kernel within its host (the channel, or the full image with
+   'convoverch') are summed in double precision. */
+gal_data_t *
+convolve_common_direct(struct gal_tile_two_layer_params *tl,
+                       gal_data_t *kernel, int edgecorrection,
+                       int convoverch, int conv_on_blank)
+{
+  gal_data_t *out, *image=gal_tile_block(tl->tiles);
+  double v, sum, ksum;
+  float *in=image->array, *k=kernel->array, *o;
+  size_t y, x, ky, kx, nused, *dsize=image->dsize;
+  size_t hh=kernel->dsize[0]/2, hw=kernel->dsize[1]/2;
+  size_t *hsize = convoverch ? dsize : tl->channelsize;
+  long yy, xx, hmin[2], hmax[2];
+
+  /* Allocate the output. */
+  out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0, -1, 1,
+                     NULL, NULL, NULL);
+  o=out->array;
+
+  /* Go over all the pixels. */
+  for(y=0;y<dsize[0];++y)
+    for(x=0;x<dsize[1];++x)
+      {
+        /* Blank pixels stay blank when not convolving over them. */
+        if( isnan(in[y*dsize[1]+x]) && conv_on_blank==0 )
+          { o[y*dsize[1]+x]=NAN; continue; }
+
+        /* The host of this pixel (range of usable coordinates). */
+        hmin[0]=(y/hsize[0])*hsize[0];    hmax[0]=hmin[0]+hsize[0];
+        hmin[1]=(x/hsize[1])*hsize[1];    hmax[1]=hmin[1]+hsize[1];
+
+        /* Sum the usable pixels under the kernel. */
+        nused=0;
+        sum=ksum=0.0;
+        for(ky=0;ky<kernel->dsize[0];++ky)
+          for(kx=0;kx<kernel->dsize[1];++kx)
+            {
+              yy=(long)y+(long)ky-(long)hh;
+              xx=(long)x+(long)kx-(long)hw;
+              if(yy<hmin[0] || yy>=hmax[0] || xx<hmin[1] || xx>=hmax[1])
+                continue;
+              v=in[yy*dsize[1]+xx];
+              if( isnan(v) ) continue;
+              sum  += v * k[ky*kernel->dsize[1]+kx];
+              ksum += k[ky*kernel->dsize[1]+kx];
+              ++nused;
+            }
+
+        /* Write the output: with edge correction, a pixel without any
+           usable pixel under the kernel is blank. */
+        if(edgecorrection)
+          o[y*dsize[1]+x] = nused ? sum/ksum : NAN;
+        else
+          o[y*dsize[1]+x] = sum;
+      }
+
+  /* Return the output. */
+  return out;
+}
+
+
+
+
+
+/* Compare the output of a convolution with the reference: blank pixels
+   should be on the same positions and the maximum difference (relative to
+   the maximum absolute value of the reference) should be smaller than
+   'tolerance' (return 1 otherwise). The result is reported with 'name'. */
+int
+convolve_common_compare(gal_data_t *ref, gal_data_t *out, char *name,
+                        double tolerance)
+{
+  size_t i;
+  float *r=ref->array, *o=out->array;
+  double d, max=0.0, maxdiff=0.0;
+
+  /* Go over all the pixels. */
+  for(i=0;i<ref->size;++i)
+    {
+      if( isnan(r[i]) || isnan(o[i]) )
+        {
+          if( isnan(r[i]) && isnan(o[i]) ) continue;
+          printf("%s: pixel %zu is only blank in one output.\n", name, i);
+          return 1;
+        }
+      if( fabs(r[i])>max ) max=fabs(r[i]);
+      d=fabs(r[i]-o[i]);
+      if(d>maxdiff) maxdiff=d;
+    }
+
+  /* Report the result. */
+  printf("%s: maximum relative difference: %g\n", name, maxdiff/max);
+  return maxdiff/max > tolerance;
+}
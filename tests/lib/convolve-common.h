@@ -0,0 +1,44 @@
+/*********************************************************************
+Common functions of the convolution test programs.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef CONVOLVE_COMMON_H
+#define CONVOLVE_COMMON_H
+
+#include "gnuastro/tile.h"
+
+gal_data_t *
+convolve_common_image(size_t height, size_t width);
+
+void
+convolve_common_tiles(gal_data_t *image, size_t tilesize,
+                      size_t numchannels,
+                      struct gal_tile_two_layer_params *tl);
+
+gal_data_t *
+convolve_common_direct(struct gal_tile_two_layer_params *tl,
+                       gal_data_t *kernel, int edgecorrection,
+                       int convoverch, int conv_on_blank);
+
+int
+convolve_common_compare(gal_data_t *ref, gal_data_t *out, char *name,
+                        double tolerance);
+
+#endif
@@ -0,0 +1,157 @@
+/*********************************************************************
+A test program to check the frequency domain convolution.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gnuastro/tile.h"
+#include "gnuastro/threads.h"
+#include "gnuastro/convolve.h"
+
+#include "convolve-common.h"
+
+
+/* Maximum difference between the outputs and the direct convolution
+   (relative to the maximum absolute value of the direct convolution). */
+#define TOLERANCE 1e-5
+
+
+
+
+/* Build a 2D kernel that isn't separable: with 'type==0' it has random
+   positive values, otherwise it is a difference of two Gaussians (with
+   negative values on its outer parts). */
+static gal_data_t *
+make_kernel(int type)
+{
+  float *k;
+  gal_data_t *kernel;
+  double r2, sum=0.0;
+  unsigned long seed=7;
+  size_t i, x, y, dsize[2]={25, 23};
+
+  /* Allocate the kernel and fill it. */
+  kernel=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0, -1, 1,
+                        NULL, NULL, NULL);
+  k=kernel->array;
+  for(y=0;y<dsize[0];++y)
+    for(x=0;x<dsize[1];++x)
+      {
+        i=y*dsize[1]+x;
+        if(type)
+          {
+            r2 = pow((double)y-12.0, 2) + pow((double)x-11.0, 2);
+            k[i] = exp(-r2/8.0) - 0.3 * exp(-r2/50.0);
+          }
+        else
+          {
+            seed = seed*6364136223846793005UL + 1442695040888963407UL;
+            k[i] = 0.01f + (float)( (seed>>40) % 1000 ) / 1000.0f;
+          }
+        sum += k[i];
+      }
+
+  /* Normalize the kernel and return it. */
+  for(i=0;i<kernel->size;++i) k[i]/=sum;
+  return kernel;
+}
+
+
+
+
+
+/* Convolve the image with 'gal_convolve_frequency' and
+   'gal_convolve_spatial' (which also uses the frequency domain for these
+   kernels) and compare them with the direct convolution (return 1 if the
+   difference is larger than the tolerance). */
+static int
+compare(struct gal_tile_two_layer_params *tl, gal_data_t *kernel,
+        size_t numthreads, int edgecorrection, int convoverch,
+        int conv_on_blank)
+{
+  int out;
+  char name[100];
+  gal_data_t *ref, *spa, *fre;
+
+  /* Do the three convolutions. */
+  ref=convolve_common_direct(tl, kernel, edgecorrection, convoverch,
+                             conv_on_blank);
+  spa=gal_convolve_spatial(tl->tiles, kernel, numthreads, edgecorrection,
+                           convoverch, conv_on_blank);
+  fre=gal_convolve_frequency(tl->tiles, kernel, numthreads,
+                             edgecorrection, convoverch, conv_on_blank);
+
+  /* Compare them with the reference. */
+  sprintf(name, "frequency (edgecorrection=%d, convoverch=%d, "
+          "conv_on_blank=%d)", edgecorrection, convoverch, conv_on_blank);
+  out=convolve_common_compare(ref, fre, name, TOLERANCE);
+  sprintf(name, "spatial (edgecorrection=%d, convoverch=%d, "
+          "conv_on_blank=%d)", edgecorrection, convoverch, conv_on_blank);
+  out|=convolve_common_compare(ref, spa, name, TOLERANCE);
+
+  /* Clean up and return. */
+  gal_data_free(ref);
+  gal_data_free(spa);
+  gal_data_free(fre);
+  return out;
+}
+
+
+
+
+
+/* Convolve a noisy image (with blank pixels and four channels) with two
+   large kernels using 'gal_convolve_spatial' and 'gal_convolve_frequency'
+   and make sure the outputs are the same as the direct convolution (to
+   within floating point errors). */
+int
+main(void)
+{
+  int type, ec, ob, oc, out=EXIT_SUCCESS;
+  gal_data_t *image, *kernel;
+  size_t numthreads=gal_threads_number();
+  struct gal_tile_two_layer_params tl;
+
+  /* Build the input. */
+  image=convolve_common_image(260, 300);
+
+  /* Define the tiles over the image (with four channels). */
+  convolve_common_tiles(image, 30, 2, &tl);
+
+  /* Compare the two convolutions with both kernels and all the
+     combinations of the options. */
+  for(type=0; type<2; ++type)
+    {
+      kernel=make_kernel(type);
+      for(ec=0; ec<2; ++ec)
+        for(oc=0; oc<2; ++oc)
+          for(ob=0; ob<2; ++ob)
+            if( compare(&tl, kernel, numthreads, ec, oc, ob) )
+              out=EXIT_FAILURE;
+      gal_data_free(kernel);
+    }
+
+  /* Clean up and return. */
+  gal_tile_full_free_contents(&tl);
+  gal_data_free(image);
+  return out;
+}
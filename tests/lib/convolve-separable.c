@@ -0,0 +1,140 @@
+/*********************************************************************
+A test program to compare the separable and generic spatial convolutions.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gnuastro/tile.h"
+#include "gnuastro/list.h"
+#include "gnuastro/threads.h"
+#include "gnuastro/convolve.h"
+
+#include "convolve-common.h"
+
+
+/* Maximum difference between the two outputs (relative to the maximum
+   absolute value of the generic output). */
+#define TOLERANCE 1e-6
+
+
+
+
+/* Build a 2D Gaussian kernel as the product of two 1D Gaussians (with
+   different widths along each dimension), so it is separable. */
+static gal_data_t *
+make_kernel(void)
+{
+  float *k;
+  gal_data_t *kernel;
+  double v, h, sum=0.0;
+  size_t x, y, dsize[2]={9, 11};
+
+  /* Allocate the kernel and fill it. */
+  kernel=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0, -1, 1,
+                        NULL, NULL, NULL);
+  k=kernel->array;
+  for(y=0;y<dsize[0];++y)
+    for(x=0;x<dsize[1];++x)
+      {
+        v=exp( -0.5 * pow( ((double)y-4.0)/1.5, 2) );
+        h=exp( -0.5 * pow( ((double)x-5.0)/2.0, 2) );
+        sum += k[y*dsize[1]+x] = v*h;
+      }
+
+  /* Normalize the kernel and return it. */
+  for(x=0;x<kernel->size;++x) k[x]/=sum;
+  return kernel;
+}
+
+
+
+
+
+/* Convolve the image with both methods and compare them (return 1 if the
+   difference is larger than the tolerance). */
+static int
+compare(struct gal_tile_two_layer_params *tl, gal_data_t *kernel,
+        gal_data_t *kernels, size_t numthreads, int conv_on_blank)
+{
+  int out;
+  char name[50];
+  gal_data_t *gen, *sep;
+
+  /* Do the two convolutions. */
+  gen=gal_convolve_spatial(tl->tiles, kernel, numthreads, 1, 1,
+                           conv_on_blank);
+  sep=gal_convolve_spatial_separable(tl->tiles, kernels, numthreads, 1, 1,
+                                     conv_on_blank);
+
+  /* Compare them. */
+  sprintf(name, "conv_on_blank=%d", conv_on_blank);
+  out=convolve_common_compare(gen, sep, name, TOLERANCE);
+
+  /* Clean up and return. */
+  gal_data_free(gen);
+  gal_data_free(sep);
+  return out;
+}
+
+
+
+
+
+/* Convolve a noisy image (with blank pixels) with a separable kernel
+   using 'gal_convolve_spatial' and 'gal_convolve_spatial_separable' and
+   make sure the outputs are the same (to within floating point errors). */
+int
+main(void)
+{
+  int out=EXIT_SUCCESS;
+  gal_data_t *image, *kernel, *kernels;
+  size_t numthreads=gal_threads_number();
+  struct gal_tile_two_layer_params tl;
+
+  /* Build the inputs. */
+  image=convolve_common_image(230, 310);
+  kernel=make_kernel();
+
+  /* The kernel should be separable. */
+  kernels=gal_convolve_kernel_separate(kernel);
+  if(kernels==NULL)
+    {
+      printf("the 2D Gaussian kernel was not found to be separable.\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Define the tiles over the image. */
+  convolve_common_tiles(image, 40, 1, &tl);
+
+  /* Compare the two convolutions (with and without convolution over the
+     blank pixels). */
+  if( compare(&tl, kernel, kernels, numthreads, 0)
+      || compare(&tl, kernel, kernels, numthreads, 1) )
+    out=EXIT_FAILURE;
+
+  /* Clean up and return. */
+  gal_tile_full_free_contents(&tl);
+  gal_list_data_free(kernels);
+  gal_data_free(kernel);
+  gal_data_free(image);
+  return out;
+}
@@ -0,0 +1,155 @@
+/*********************************************************************
+A test program to check the distribution of actions between threads.
+
+Original author:
+     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+Contributing author(s):
+Copyright (C) 2024 Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gnuastro/pointer.h"
+#include "gnuastro/threads.h"
+
+
+/* Number of times each action was done. */
+struct params
+{
+  size_t      *count;          /* Number of times each action was done. */
+  int          dynamic;        /* Use 'gal_threads_next'.               */
+  pthread_mutex_t mutex;       /* Mutex to change 'count'.              */
+};
+
+
+
+
+
+/* Count the actions that are given to this thread. */
+static void *
+worker_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct params *p=(struct params *)tprm->params;
+  size_t i, index;
+
+  /* Go over the actions of this thread. */
+  if(p->dynamic)
+    while( (index=gal_threads_next(tprm))!=GAL_BLANK_SIZE_T )
+      {
+        pthread_mutex_lock(&p->mutex);
+        ++p->count[index];
+        pthread_mutex_unlock(&p->mutex);
+      }
+  else
+    for(i=0; tprm->indexs[i] != GAL_BLANK_SIZE_T; ++i)
+      {
+        pthread_mutex_lock(&p->mutex);
+        ++p->count[tprm->indexs[i]];
+        pthread_mutex_unlock(&p->mutex);
+      }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Spin-off 'numactions' actions on 'numthreads' threads and make sure
+   that every action was done exactly once (return 1 otherwise). */
+static int
+check(size_t numactions, size_t numthreads, int dynamic, int withcosts)
+{
+  int out=0;
+  size_t i, *costs=NULL;
+  struct params p={NULL, dynamic, PTHREAD_MUTEX_INITIALIZER};
+
+  /* Allocate the counters (and the costs if necessary). */
+  p.count=gal_pointer_allocate(GAL_TYPE_SIZE_T, numactions, 1, __func__,
+                               "p.count");
+  if(withcosts)
+    {
+      costs=gal_pointer_allocate(GAL_TYPE_SIZE_T, numactions, 0, __func__,
+                                 "costs");
+      for(i=0;i<numactions;++i) costs[i]=(i*7)%5+1;
+    }
+
+  /* Do the job. */
+  if(withcosts)
+    gal_threads_spin_off_costs(worker_on_thread, &p, numactions,
+                               numthreads, -1, 1, costs);
+  else
+    gal_threads_spin_off(worker_on_thread, &p, numactions, numthreads,
+                         -1, 1);
+
+  /* Check the counters. */
+  for(i=0;i<numactions;++i)
+    if(p.count[i]!=1)
+      {
+        printf("%zu actions on %zu threads (dynamic: %d, costs: %d): "
+               "action %zu was done %zu times.\n", numactions, numthreads,
+               dynamic, withcosts, i, p.count[i]);
+        out=1;
+        break;
+      }
+
+  /* Clean up and return. */
+  if(costs) free(costs);
+  free(p.count);
+  return out;
+}
+
+
+
+
+
+/* In the NUMA-aware mode (the '--numa' option of the programs), the
+   actions are given to the threads in contiguous blocks. Make sure that
+   every action is done exactly once for any number of actions (in
+   particular when there are fewer actions than threads). */
+int
+main(void)
+{
+  int out=EXIT_SUCCESS;
+  size_t a, t, numthreads=4;
+  size_t numactions[]={1, 2, 3, 4, 5, 7, 8, 9, 100, 1001};
+
+  /* Activate the NUMA-aware mode like '--numa'. */
+  gal_threads_numa_set(numthreads);
+
+  /* Check all the combinations. */
+  for(t=1;t<=numthreads;++t)
+    for(a=0;a<sizeof numactions/sizeof *numactions;++a)
+      if( check(numactions[a], t, 0, 0)
+          || check(numactions[a], t, 1, 0)
+          || check(numactions[a], t, 1, 1) )
+        out=EXIT_FAILURE;
+
+  /* Also check the distribution without the NUMA-aware mode. */
+  gal_threads_numa_set(0);
+  for(a=0;a<sizeof numactions/sizeof *numactions;++a)
+    if( check(numactions[a], numthreads, 0, 0) )
+      out=EXIT_FAILURE;
+
+  /* Clean up and return. */
+  gal_threads_pool_free();
+  if(out==EXIT_SUCCESS)
+    printf("All actions were done exactly once.\n");
+  return out;
+}
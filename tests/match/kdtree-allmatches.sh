@@ -0,0 +1,97 @@
+# Find all the rows of the first catalog within the aperture of each row
+# in the second (with '--allmatches' and '--nearest'), using the internal
+# k-d tree, and check the matches.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+execname=../bin/$prog/ast$prog
+cat1=$topsrc/tests/$prog/positions-1.txt
+cat2=$topsrc/tests/$prog/positions-2.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The output (first column of both inputs: the row IDs) is compared with
+# the expected matches: sorted by the row of the second input, then by
+# distance. The aperture is chosen so no distance is close to it.
+check () {
+    result=$(grep -v '^#' $1 | awk '{printf "%d,%d ", $1, $2}')
+    if [ "$result" != "$2" ]; then
+        echo "$1: expected '$2', but got '$result'"
+        exit 1
+    fi
+}
+$check_with_program $execname $cat1 $cat2 --aperture=1.4 \
+                              --ccol1=2,3 --ccol2=2,3 --allmatches \
+                              --outcols=a1,b1 \
+                              --output=match-kdtree-allmatches.txt
+if [ $? != 0 ]; then exit 1; fi
+check match-kdtree-allmatches.txt "8,1 9,1 5,3 5,4 1,5 6,6 7,6 1,7 2,7 "
+
+# With '--nearest=1', only the nearest of the matches above are kept.
+$check_with_program $execname $cat1 $cat2 --aperture=1.4 \
+                              --ccol1=2,3 --ccol2=2,3 --nearest=1 \
+                              --outcols=a1,b1 \
+                              --output=match-kdtree-nearest.txt
+if [ $? != 0 ]; then exit 1; fi
+check match-kdtree-nearest.txt "8,1 5,3 5,4 1,5 6,6 1,7 "
+
+# Points that are exactly on the aperture's border are not matched (like
+# the other matching modes). The first row of the second catalog is
+# exactly 1.5 from both rows of the first, and its second row is at 1 and
+# 2 from them.
+printf "1 0 0\n2 3 0\n" > match-kdtree-border-1.txt
+printf "1 1.5 0\n2 1 0\n" > match-kdtree-border-2.txt
+$check_with_program $execname match-kdtree-border-1.txt \
+                              match-kdtree-border-2.txt --aperture=1.5 \
+                              --ccol1=2,3 --ccol2=2,3 --allmatches \
+                              --outcols=a1,b1 \
+                              --output=match-kdtree-border.txt
+if [ $? != 0 ]; then exit 1; fi
+check match-kdtree-border.txt "1,2 "
@@ -0,0 +1,125 @@
+# Match two large catalogs with the k-d tree and check all the matches
+# (with 10^7 rows as a benchmark when 'GNUASTRO_BENCHMARK' is set).
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+execname=../bin/$prog/ast$prog
+dep1name=$progbdir/asttable
+
+cat1=match-benchmark-1.fits
+cat2=match-benchmark-2.fits
+if [ x"$GNUASTRO_BENCHMARK" = x ]; then numrows=10000
+else                                    numrows=10000000
+fi
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The programs it uses weren't made.
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $dep1name ]; then echo "$dep1name doesn't exist."; exit 77; fi
+
+
+
+
+
+# Input catalogs
+# ==============
+#
+# The first catalog has one point in every unit square of a square grid
+# (at a random position within the central half of the square, so the
+# points are at least 0.5 apart). The second catalog has the same points
+# (with the same IDs) randomly shifted by at most 0.0005 along each axis,
+# so with an aperture of 0.002 every row has exactly one possible match.
+# The random seeds are fixed, so the inputs are the same on every run.
+width=$(echo $numrows | awk '{printf "%d", sqrt($1)}')
+numrows=$((width*width))
+awk -v w=$width 'BEGIN{ srand(1);
+       print "# Column 1: ID [counter,i32]";
+       print "# Column 2: X  [pix,f64]";
+       print "# Column 3: Y  [pix,f64]";
+       for(i=0;i<w*w;++i)
+         printf "%d %.6f %.6f\n", i+1, i%w + 0.25 + 0.5*rand(),
+                int(i/w) + 0.25 + 0.5*rand() }' \
+    > match-benchmark-1.txt
+awk 'BEGIN{srand(2)} /^#/{print; next}
+     {printf "%d %.6f %.6f\n", $1, $2 + 0.001*(rand()-0.5),
+             $3 + 0.001*(rand()-0.5)}' match-benchmark-1.txt \
+    > match-benchmark-2.txt
+$dep1name match-benchmark-1.txt --output=$cat1
+$dep1name match-benchmark-2.txt --output=$cat2
+rm -f match-benchmark-1.txt match-benchmark-2.txt
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The time of the match is printed (in the log of this test) for
+# comparison between different builds or systems. All the rows must be
+# matched with the row of the same ID.
+start=$(date +%s)
+$check_with_program $execname $cat1 $cat2 --aperture=0.002 \
+                              --ccol1=2,3 --ccol2=2,3 --outcols=a1,b1 \
+                              --output=match-benchmark.fits
+out=$?
+end=$(date +%s)
+echo "Matching $numrows rows took $((end-start)) seconds."
+if [ $out = 0 ]; then
+    result=$($dep1name match-benchmark.fits \
+                 | awk '$1==$2{++good} END{print NR, good+0}')
+    if [ "$result" != "$numrows $numrows" ]; then
+        echo "Expected all $numrows rows to match their own ID, but" \
+             "(number of matches, correct matches) are: $result"
+        out=1
+    fi
+fi
+
+
+
+
+
+# Clean up
+# ========
+#
+# The inputs and output are large (and not used by any other test), so
+# they are deleted.
+rm -f $cat1 $cat2 match-benchmark.fits
+exit $out
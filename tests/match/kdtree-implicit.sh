@@ -0,0 +1,103 @@
+# Match the two input catalogs with an internally constructed k-d tree that
+# has the implicit layout. Then match two larger catalogs (that have some
+# blank coordinates) with both layouts and make sure the outputs are
+# identical.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+execname=../bin/$prog/ast$prog
+cat1=$topsrc/tests/$prog/positions-1.txt
+cat2=$topsrc/tests/$prog/positions-2.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+$check_with_program $execname $cat1 $cat2 --aperture=0.5 \
+                              --ccol1=2,3 --ccol2=2,3 \
+                              --kdtreelayout=implicit \
+                              --output=match-kdtree-implicit.fits
+if [ $? != 0 ]; then exit 1; fi
+
+# Two random catalogs (with fixed seeds) where about 2% of the rows have a
+# blank (NaN) coordinate. They are large enough for the k-d tree to have
+# many levels, so the blank coordinates are used in the splits of the
+# nodes. The nearest matches and all the matches within the aperture
+# should not depend on the layout of the tree.
+awk 'BEGIN{ srand(1);
+       print "# Column 1: ID [counter,i32]";
+       print "# Column 2: X  [pix,f64]";
+       print "# Column 3: Y  [pix,f64]";
+       for(i=1;i<=5000;++i)
+         { x=sprintf("%.6f", 100*rand()); y=sprintf("%.6f", 100*rand());
+           r=rand(); if(r<0.01) x="nan"; else if(r<0.02) y="nan";
+           print i, x, y } }' > match-kdtree-implicit-1.txt
+awk 'BEGIN{ srand(2);
+       print "# Column 1: ID [counter,i32]";
+       print "# Column 2: X  [pix,f64]";
+       print "# Column 3: Y  [pix,f64]";
+       for(i=1;i<=2000;++i)
+         { x=sprintf("%.6f", 100*rand()); y=sprintf("%.6f", 100*rand());
+           r=rand(); if(r<0.01) x="nan"; else if(r<0.02) y="nan";
+           print i, x, y } }' > match-kdtree-implicit-2.txt
+for all in "" --allmatches; do
+    for layout in leftright implicit; do
+        $check_with_program $execname match-kdtree-implicit-1.txt \
+                            match-kdtree-implicit-2.txt --aperture=1 \
+                            --ccol1=2,3 --ccol2=2,3 --outcols=a1,b1 $all \
+                            --kdtreelayout=$layout \
+                            --output=match-kdtree-implicit-$layout.txt
+        if [ $? != 0 ]; then exit 1; fi
+    done
+    if ! cmp match-kdtree-implicit-leftright.txt \
+             match-kdtree-implicit-implicit.txt; then
+        echo "The matches of the two layouts differ (options: '$all')."
+        exit 1
+    fi
+done
+rm -f match-kdtree-implicit-1.txt match-kdtree-implicit-2.txt \
+      match-kdtree-implicit-leftright.txt match-kdtree-implicit-implicit.txt
@@ -0,0 +1,97 @@
+# Match the two input catalogs on the celestial sphere (the coordinates are
+# RA and Dec in degrees).
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=match
+execname=../bin/$prog/ast$prog
+cat1=$topsrc/tests/$prog/positions-1.txt
+cat2=$topsrc/tests/$prog/positions-2.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+$check_with_program $execname $cat1 $cat2 --aperture=0.5 \
+                              --ccol1=2,3 --ccol2=2,3 \
+                              --kdtree=sky \
+                              --output=match-sky.fits
+if [ $? != 0 ]; then exit 1; fi
+
+# Points near the poles and on both sides of RA=0/360. The first five
+# rows of the second catalog must be matched with the same row of the
+# first (their angular distances are between 9e-6 and 8e-4 degrees):
+#
+#   1: near the north pole, with RAs that are 180 degrees apart.
+#   2: near the south pole, with RAs that are 270 degrees apart.
+#   3: at Dec=89.9, 0.005 degrees apart in RA (much larger than the
+#      aperture in RA, but not on the sky).
+#   4: RA=359.9995 and RA=0.0003 at Dec=10.
+#   5: RA=0.0002 and RA=359.9999 at Dec=-30.
+#
+# The 6th row of the second catalog is 0.002 degrees from the 6th row of
+# the first (larger than the aperture), so it must not be matched. The
+# first catalog also has an extra row (7) that shouldn't be matched.
+hdr="# Column 1: ID [counter,i32]
+# Column 2: RA [deg,f64]
+# Column 3: DEC [deg,f64]"
+printf "%s\n" "$hdr" "1 10 89.9997" "2 45 -89.99995" "3 0 89.9" \
+       "4 359.9995 10" "5 0.0002 -30" "6 180.002 0" "7 100 50" \
+       > match-sky-edge-1.txt
+printf "%s\n" "$hdr" "1 190 89.9997" "2 315 -89.99995" "3 0.005 89.9" \
+       "4 0.0003 10" "5 359.9999 -30" "6 180 0" \
+       > match-sky-edge-2.txt
+$check_with_program $execname match-sky-edge-1.txt match-sky-edge-2.txt \
+                              --aperture=0.001 --ccol1=2,3 --ccol2=2,3 \
+                              --kdtree=sky --outcols=a1,b1 \
+                              --output=match-sky-edge.txt
+if [ $? != 0 ]; then exit 1; fi
+result=$(grep -v '^#' match-sky-edge.txt | awk '{print $1","$2}' \
+             | sort -n | tr '\n' ' ')
+if [ "$result" != "1,1 2,2 3,3 4,4 5,5 " ]; then
+    echo "Expected matches '1,1 2,2 3,3 4,4 5,5 ', but got '$result'"
+    exit 1
+fi
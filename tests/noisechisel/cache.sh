@@ -0,0 +1,102 @@
+# Re-run NoiseChisel with the cache of its expensive stages.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     Mohammad Akhlaghi <mohammad@akhlaghi.org>
+# Contributing author(s):
+# Copyright (C) 2024 Free Software Foundation, Inc.
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variables (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=noisechisel
+execname=../bin/$prog/ast$prog
+img=convolve_spatial_noised.fits
+cache=noisechisel-cache.fits
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ]; then echo "$execname not created."; exit 77; fi
+if [ ! -f $img      ]; then echo "$img does not exist.";   exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# 'check_with_program' can be something like Valgrind or an empty
+# string. Such programs will execute the command if present and help in
+# debugging when the developer doesn't have access to the user's system.
+#
+# The first run writes the cache and the second (with the same options)
+# reads the convolved image and the quantile thresholds from it, so its
+# output must be identical to the first. The third run only changes an
+# option of a later stage, so it should also be able to use the cache. The
+# cache is kept between the runs and the reports of each run are checked
+# to see if the cache was actually used.
+#
+# The output's name is also written in its first HDU (as the value of
+# '--output'), so it is the same in all runs.
+out=noisechisel-cache-out.fits
+rm -f $cache
+run () {
+    $check_with_program $execname $img --cache=$cache --outfitsnodate \
+                                  --output=$out $2 > $1.log \
+        && mv $out $1
+}
+used () {
+    grep -q "Convolved image(s) read from cache" $1.log \
+        && grep -q "quantile thresholds read from cache" $1.log
+}
+
+# First run: the cache doesn't exist, so it shouldn't be used.
+run noisechisel-cache-1.fits
+if [ $? != 0 ]; then exit 1; fi
+if used noisechisel-cache-1.fits; then exit 1; fi
+if [ ! -f $cache ]; then echo "$cache not written."; exit 1; fi
+
+# Second run: identical options, so the cache should be used and the
+# output should be identical.
+run noisechisel-cache-2.fits
+if [ $? != 0 ]; then exit 1; fi
+if ! used noisechisel-cache-2.fits; then exit 1; fi
+cmp noisechisel-cache-1.fits noisechisel-cache-2.fits
+if [ $? != 0 ]; then exit 1; fi
+
+# Third run: only an option after the quantile thresholds has changed.
+run noisechisel-cache-3.fits --dthresh=0.2
+if [ $? != 0 ]; then exit 1; fi
+if ! used noisechisel-cache-3.fits; then exit 1; fi
+
+# The cache and the output can't be the same file.
+$execname $img --cache=$cache --output=$cache
+if [ $? = 0 ]; then exit 1; fi
+if [ ! -f $cache ]; then echo "$cache was removed."; exit 1; fi